@@ -0,0 +1,96 @@
+#pragma once
+/*
+ * Copyright (c) 2021 Backtrace I/O, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/types.h>
+
+#include <bun/bun.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Asynchronous remote unwinding, for event loops watching many processes.
+ *
+ * Requests are queued on a bun_async and carried out by its worker threads,
+ * which do all the blocking work, such as stopping the target thread and
+ * waiting for it. The descriptor returned by bun_async_fd() becomes readable
+ * once requests have completed; bun_async_dispatch() then calls their
+ * callbacks on the calling thread.
+ */
+struct bun_async;
+
+/*
+ * Called by bun_async_dispatch() for every completed request, with the
+ * buffer it was given and the size returned by bun_unwind_remote(), which is
+ * 0 if the thread could not be unwound.
+ */
+typedef void (bun_async_fn)(void *arg, pid_t tid, struct bun_buffer *buffer,
+    size_t size);
+
+/*
+ * Creates `jobs` worker threads unwinding with `handle`, or one per CPU if
+ * `jobs` is 0. The handle must outlive the returned object.
+ *
+ * Returns NULL on failure.
+ */
+struct bun_async *bun_async_create(struct bun_handle *handle,
+    unsigned int jobs);
+
+/*
+ * Returns a non-blocking eventfd(2) descriptor, readable while completed
+ * requests wait for bun_async_dispatch(). It is owned by `async`.
+ */
+int bun_async_fd(const struct bun_async *async);
+
+/*
+ * Queues the unwinding of the thread `tid` into `buffer`, which must stay
+ * valid until `callback` is called. Returns immediately.
+ *
+ * Returns true if the request was queued.
+ */
+bool bun_unwind_remote_async(struct bun_async *async,
+    struct bun_buffer *buffer, pid_t tid, bun_async_fn *callback,
+    void *arg);
+
+/*
+ * Calls the callbacks of the requests completed so far, in order of
+ * completion, and clears the readiness of the descriptor.
+ *
+ * Returns the number of callbacks called.
+ */
+size_t bun_async_dispatch(struct bun_async *async);
+
+/*
+ * Waits for the requests being carried out, then calls the callbacks of all
+ * remaining requests, with a size of 0 for those that were never started,
+ * and frees `async`.
+ */
+void bun_async_destroy(struct bun_async *async);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+/*
+ * Copyright (c) 2021 Backtrace I/O, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/types.h>
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Application-provided unwinders, such as walkers of interpreter or virtual
+ * machine frames.
+ *
+ * The library prepares the writer and fills in the stream header, with the
+ * backend set to BUN_BACKEND_CUSTOM and the thread id set to the unwound
+ * thread. The callbacks only append frames with bun_frame_write(), and may
+ * override the header with bun_header_tid_set() and bun_header_backend_set().
+ * They never see struct bun_handle, whose layout may change between releases.
+ *
+ * The callbacks return false on failure, in which case the corresponding
+ * bun_unwind*() call returns 0.
+ */
+struct bun_backend_ops {
+	/* Must be set to sizeof(struct bun_backend_ops). */
+	size_t size;
+
+	/* Unwinds the calling thread, called by bun_unwind(). */
+	bool (*unwind)(void *context, struct bun_writer *writer);
+
+	/*
+	 * Unwinds from the ucontext_t pointed to by `ucontext`, called by
+	 * bun_unwind_context(). May be NULL.
+	 */
+	bool (*unwind_context)(void *context, struct bun_writer *writer,
+	    void *ucontext);
+
+	/* Unwinds the given thread, called by bun_unwind_remote(). May be NULL. */
+	bool (*unwind_remote)(void *context, struct bun_writer *writer,
+	    pid_t tid);
+
+	/* Releases `context` when the handle is deinitialized. May be NULL. */
+	void (*destroy)(void *context);
+};
+
+/*
+ * Initializes the handle with the given callbacks, which receive `context` as
+ * their first argument. The structure pointed to by `ops` is copied.
+ *
+ * Returns false if `ops` is not valid or memory cannot be allocated. The
+ * context is not destroyed in that case.
+ */
+bool bun_handle_init_custom(struct bun_handle *handle,
+    const struct bun_backend_ops *ops, void *context);
+
+#ifdef __cplusplus
+}
+#endif
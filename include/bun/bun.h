@@ -53,6 +53,98 @@ enum bun_unwind_backend {
 #if defined(BUN_LIBUNWINDSTACK_ENABLED)
 	BUN_BACKEND_LIBUNWINDSTACK = 2,
 #endif /* BUN_LIBUNWINDSTACK_ENABLED */
+#if defined(BUN_FRAMEPOINTER_ENABLED)
+	/*
+	 * Walks the frame pointer chain directly. Requires the code to be
+	 * built with -fno-omit-frame-pointer.
+	 */
+	BUN_BACKEND_FRAMEPOINTER = 3,
+#endif /* BUN_FRAMEPOINTER_ENABLED */
+#if defined(BUN_DWARF_ENABLED)
+	/*
+	 * Built-in interpreter of the .eh_frame unwind tables. It does not
+	 * allocate memory or take locks while unwinding.
+	 *
+	 * The loaded objects are listed once, by bun_handle_init(). Frames of
+	 * objects loaded later with dlopen(3) end the callstack, as do frames
+	 * of objects unloaded since, whose tables are no longer mapped.
+	 * Reinitialize the handle to pick up such changes.
+	 */
+	BUN_BACKEND_DWARF = 4,
+#endif /* BUN_DWARF_ENABLED */
+#if defined(BUN_TABLE_ENABLED)
+	/*
+	 * Uses unwind tables precomputed with the bun_unwind_table tool and
+	 * stored in the cache directory, falling back to BUN_BACKEND_DWARF for
+	 * objects without one.
+	 */
+	BUN_BACKEND_TABLE = 5,
+#endif /* BUN_TABLE_ENABLED */
+#if defined(BUN_SFRAME_ENABLED)
+	/*
+	 * Uses the .sframe sections emitted by the assembler with
+	 * -Wa,--gsframe. Objects without one are unwound with the DWARF
+	 * backend, or the frame pointer backend if the former is not built.
+	 */
+	BUN_BACKEND_SFRAME = 6,
+#endif /* BUN_SFRAME_ENABLED */
+#if defined(BUN_SHADOW_ENABLED)
+	/*
+	 * Copies the shadow call stack maintained by instrumented code, see
+	 * bun/shadow.h.
+	 */
+	BUN_BACKEND_SHADOW = 7,
+#endif /* BUN_SHADOW_ENABLED */
+#if defined(BUN_PERF_ENABLED)
+	/*
+	 * Remote unwinding only. Samples the user-space callchain collected by
+	 * the kernel with perf_event_open(2) instead of stopping the target
+	 * with ptrace(2). The callchain is built by walking frame pointers and
+	 * the thread must be running to be sampled.
+	 */
+	BUN_BACKEND_PERF = 8,
+#endif /* BUN_PERF_ENABLED */
+#if defined(BUN_CORE_ENABLED)
+	/*
+	 * Unwinds the threads saved in an ELF core file. Handles are
+	 * initialized with bun_handle_init_core(), see bun/core.h.
+	 */
+	BUN_BACKEND_CORE = 9,
+#endif /* BUN_CORE_ENABLED */
+#if defined(BUN_HYBRID_ENABLED)
+	/*
+	 * Walks the frame pointer chain and checks every step against the
+	 * DWARF call frame information until it has learned which objects
+	 * keep the chain intact. Only the others pay for the CFI afterwards.
+	 */
+	BUN_BACKEND_HYBRID = 10,
+#endif /* BUN_HYBRID_ENABLED */
+#if defined(BUN_HANDSHAKE_ENABLED)
+	/*
+	 * Remote unwinding only, of processes that called
+	 * bun_handshake_install(). The registers are handed over by a signal
+	 * handler of the target thread instead of stopping it with ptrace(2),
+	 * see bun/handshake.h.
+	 */
+	BUN_BACKEND_HANDSHAKE = 11,
+#endif /* BUN_HANDSHAKE_ENABLED */
+#if defined(BUN_CENSUS_ENABLED)
+	/*
+	 * Remote unwinding only. Threads blocked in the kernel are unwound
+	 * without being stopped, from the stack and instruction pointers found
+	 * in /proc/<pid>/task/<tid>/syscall, with the DWARF backend reading
+	 * their memory with process_vm_readv(2). Running threads, and threads
+	 * that wake up while being read, are stopped with ptrace(2) instead.
+	 * As no other register of a blocked thread is known, its walk ends at
+	 * the first frame whose unwind rule needs one, such as code built with
+	 * frame pointers that no inner frame saved.
+	 */
+	BUN_BACKEND_CENSUS = 12,
+#endif /* BUN_CENSUS_ENABLED */
+	/*
+	 * Unwinder provided by the application, see bun/backend.h.
+	 */
+	BUN_BACKEND_CUSTOM = 0x100,
 	BUN_BACKEND_DEFAULT = BUN_DETECTED_SYSTEM_BACKEND
 };
 
@@ -112,6 +204,14 @@ struct bun_handle
 	void *backend_context;
 	uint64_t flags;
 	int write_count;
+
+	/*
+	 * Set by backends that stop remote threads with ptrace(2), so that
+	 * bun_unwind_remote_process() can stop all the threads of a process
+	 * before unwinding them. Kept apart from the flags, which belong to
+	 * the caller.
+	 */
+	bool remote_ptrace;
 };
 
 /*
@@ -119,7 +219,55 @@ struct bun_handle
  * the unwind backend.
  */
 enum bun_handle_flags {
-	BUN_HANDLE_WRITE_ONCE = (1ULL << 0)
+	BUN_HANDLE_WRITE_ONCE = (1ULL << 0),
+	/*
+	 * Only record addresses and registers, leaving symbolization to the
+	 * reader. Backends that always symbolize ignore this flag.
+	 */
+	BUN_HANDLE_SKIP_SYMBOLS = (1ULL << 1),
+	/*
+	 * Stop the threads of other processes with PTRACE_SEIZE and
+	 * PTRACE_INTERRUPT instead of PTRACE_ATTACH, so that no SIGSTOP is
+	 * sent to them. Falls back to PTRACE_ATTACH on kernels without
+	 * PTRACE_SEIZE.
+	 */
+	BUN_HANDLE_PTRACE_SEIZE = (1ULL << 2),
+	/*
+	 * Only save the registers and the top of the stack of threads of
+	 * other processes while they are stopped, and unwind and symbolize
+	 * once they are running again. Frames deeper than the saved stack
+	 * are read from the running thread and may be inconsistent. Backends
+	 * that cannot unwind from a snapshot ignore this flag.
+	 */
+	BUN_HANDLE_DETACH_EARLY = (1ULL << 3),
+	/*
+	 * With BUN_BACKEND_HANDSHAKE, have the target thread fork a frozen
+	 * copy of its process from the signal handler and unwind the copy,
+	 * so that the stack cannot change while it is read. The target only
+	 * waits for the fork. Other backends ignore this flag.
+	 */
+	BUN_HANDLE_FORK_SNAPSHOT = (1ULL << 4),
+	/*
+	 * Write streams in version 2 of the format, which encodes frames with
+	 * LEB128 varints, stores each address as the zigzag-encoded distance
+	 * from the previous frame and omits the fields that are zero or
+	 * empty. Frames typically take less than half the space of version
+	 * 1. bun_frame_read() decodes both versions, but readers built before
+	 * version 2 cannot read it.
+	 */
+	BUN_HANDLE_STREAM_V2 = (1ULL << 5),
+	/*
+	 * Registers are captured for every frame by default. The following
+	 * flags restrict them, so that backends skip fetching the others.
+	 * With BUN_HANDLE_REGISTERS_TOP_FRAME, only the innermost frame
+	 * has registers. With BUN_HANDLE_REGISTERS_CALLEE_SAVED, frames
+	 * only have the registers preserved across calls, along with the
+	 * stack pointer and program counter. Both can be combined.
+	 * BUN_HANDLE_REGISTERS_NONE drops all of them.
+	 */
+	BUN_HANDLE_REGISTERS_TOP_FRAME = (1ULL << 6),
+	BUN_HANDLE_REGISTERS_CALLEE_SAVED = (1ULL << 7),
+	BUN_HANDLE_REGISTERS_NONE = (1ULL << 8)
 };
 
 /*
@@ -159,7 +307,8 @@ size_t bun_unwind(struct bun_handle *handle, struct bun_buffer *buffer);
  * - buffer - pointer to the output buffer
  * - context - pointer to the context
  *
- * Returns the number of bytes written.
+ * Returns the number of bytes written, or 0 if the backend cannot unwind from
+ * a context. The first frame is the one the context was saved in.
  *
  * This function is safe to use from signal handlers (for backends that allow
  * signal-safe unwinding).
@@ -176,7 +325,8 @@ size_t bun_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
  * - buffer - pointer to the output buffer
  * - pid - id of the thread to be unwound
  *
- * Returns the number of bytes written.
+ * Returns the number of bytes written, or 0 if the backend cannot unwind
+ * other threads.
  *
  * This function is safe to use from signal handlers (for backends that allow
  * remote unwinding).
@@ -184,6 +334,35 @@ size_t bun_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
 size_t bun_unwind_remote(struct bun_handle *handle, struct bun_buffer *buffer,
     pid_t pid);
 
+/*
+ * Called by bun_unwind_remote_process() for every thread of the process, with
+ * the buffer holding its stream and the size returned by bun_unwind_remote().
+ * If the thread could not be stopped or unwound, `buffer` is NULL and `size`
+ * is 0. It may be called from several threads at once. The buffer is reused
+ * once the callback returns.
+ */
+typedef void (bun_process_thread_fn)(void *arg, pid_t tid,
+    struct bun_buffer *buffer, size_t size);
+
+/*
+ * This function unwinds every thread of the process `pid`, as listed in
+ * /proc/<pid>/task when it is called, on up to `jobs` threads, or one per CPU
+ * if `jobs` is 0. Every stream is written into a buffer of `buffer_size` bytes
+ * and passed to `callback`.
+ *
+ * With backends that stop threads with ptrace(2), all the threads are stopped
+ * before the first one is unwound, so that the streams describe one moment of
+ * the process, and they are resumed once they have all been unwound. The maps
+ * and objects cached by the handle are shared by all the threads.
+ *
+ * Returns the number of threads successfully unwound.
+ *
+ * This function is not safe to use from signal handlers.
+ */
+size_t bun_unwind_remote_process(struct bun_handle *handle, pid_t pid,
+    size_t buffer_size, unsigned int jobs, bun_process_thread_fn *callback,
+    void *arg);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -0,0 +1,98 @@
+#pragma once
+/*
+ * Copyright (c) 2021 Backtrace I/O, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/types.h>
+
+#include <bun/bun.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * ELF core file unwinding, used by BUN_BACKEND_CORE.
+ *
+ * The handle maps the core file and the objects listed in its NT_FILE note,
+ * read from their original paths below `sysroot`. Each thread saved in the
+ * core is then unwound with bun_unwind_remote(), passing its thread id, using
+ * the registers of its NT_PRSTATUS note and the memory of the PT_LOAD
+ * segments. The handle is read-only once initialized, so the threads of a
+ * core can be unwound concurrently.
+ *
+ * The core must have been produced on the current architecture.
+ */
+
+/*
+ * Initializes the handle for the core file at `path`. `sysroot` is prepended
+ * to the paths of the mapped objects and may be NULL.
+ *
+ * Returns true for success.
+ */
+bool bun_handle_init_core(struct bun_handle *handle, const char *path,
+    const char *sysroot);
+
+/*
+ * A cache of the objects mapped by cores, keyed by their build-id, so that
+ * the cores of many processes running the same build share one copy of every
+ * object and of its symbol table. It can be used by many handles at once.
+ */
+struct bun_object_cache;
+
+/*
+ * Creates a cache keeping up to `limit` bytes of objects that are not in use
+ * by any handle, evicting the least recently used ones first.
+ *
+ * Returns NULL on failure.
+ */
+struct bun_object_cache *bun_object_cache_create(size_t limit);
+
+/*
+ * Destroys the cache. Every handle using it must have been deinitialized.
+ */
+void bun_object_cache_destroy(struct bun_object_cache *cache);
+
+/*
+ * Same as bun_handle_init_core(), looking the objects up in `cache`, which
+ * must outlive the handle. Objects whose build-id is not saved in the core
+ * are loaded for this handle only.
+ *
+ * Returns true for success.
+ */
+bool bun_handle_init_core_cached(struct bun_handle *handle, const char *path,
+    const char *sysroot, struct bun_object_cache *cache);
+
+/*
+ * Copies the ids of the threads saved in the core into `tids`, up to `count`
+ * of them.
+ *
+ * Returns the number of threads in the core, which may exceed `count`.
+ */
+size_t bun_core_threads(const struct bun_handle *handle, pid_t *tids,
+    size_t count);
+
+#ifdef __cplusplus
+}
+#endif
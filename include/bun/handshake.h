@@ -0,0 +1,70 @@
+#pragma once
+/*
+ * Copyright (c) 2021 Backtrace I/O, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdbool.h>
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cooperative remote unwinding, used by BUN_BACKEND_HANDSHAKE.
+ *
+ * A process calling bun_handshake_install() lets monitors unwind its threads
+ * without stopping them with ptrace(2). To unwind a thread, the monitor
+ * queues `signal` to it; the handler publishes the registers the thread was
+ * interrupted with into a region of memory shared with the monitor and
+ * returns. The monitor then walks the stack with process_vm_readv(2), while
+ * the thread keeps running.
+ *
+ * The region is found by the monitor through /proc/<pid>/fd. The handler is
+ * async-signal-safe and the monitor gives up on threads that do not answer in
+ * time, for instance because they block the signal.
+ *
+ * For hang dumps, handles with the BUN_HANDLE_FORK_SNAPSHOT flag ask the
+ * handler to also fork a copy of the process, without running the atfork
+ * handlers. The copy waits, frozen, to be unwound and killed by the monitor,
+ * and exits on its own if that does not happen within a few seconds. The
+ * thread resumes as soon as the copy exists, and the copy-on-write memory
+ * keeps its stack as it was when the signal arrived for the whole walk.
+ */
+
+/*
+ * Installs the handler of `signal`, normally a real-time signal the
+ * application does not use otherwise, and creates the shared region. If
+ * `reader` is not 0, the process `reader`, or any process if it is -1, is
+ * allowed to read the memory of this one even where the Yama LSM restricts
+ * it to ancestors, see PR_SET_PTRACER in prctl(2). Note that this also allows
+ * it to attach to this process. Forked snapshots grant it the same.
+ *
+ * This function may only be called once per process.
+ *
+ * Returns true for success.
+ */
+bool bun_handshake_install(int signal, pid_t reader);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+/*
+ * Copyright (c) 2021 Backtrace I/O, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Shadow call stack, used by BUN_BACKEND_SHADOW.
+ *
+ * Every thread keeps a stack of the functions it is executing along with the
+ * addresses they were called from. It is maintained either by compiling code
+ * with -finstrument-functions, in which case libbun provides the hooks, or by
+ * annotating functions with the macros below. Capturing the stack is then a
+ * copy of that array and never reads the thread's real stack.
+ *
+ * Only the innermost BUN_SHADOW_STACK_DEPTH entries are kept.
+ */
+#define BUN_SHADOW_STACK_DEPTH 256
+
+/*
+ * Pushes an entry for `function`, called from `call_site`. These functions
+ * are async-signal-safe.
+ */
+void bun_shadow_enter(void *function, void *call_site);
+
+/*
+ * Pops the innermost entry.
+ */
+void bun_shadow_exit(void);
+
+/*
+ * Helper used by BUN_SHADOW_SCOPE.
+ */
+void bun_shadow_scope_exit(int *scope);
+
+/*
+ * Records entry into `function`, which must be the function the macro is
+ * used in. It has to be paired with BUN_SHADOW_EXIT on every return path.
+ */
+#define BUN_SHADOW_ENTER(function)                                            \
+	bun_shadow_enter((void *)(function), __builtin_return_address(0))
+
+#define BUN_SHADOW_EXIT() bun_shadow_exit()
+
+/*
+ * Records entry into `function` and pops the entry automatically when the
+ * enclosing scope is left.
+ */
+#define BUN_SHADOW_SCOPE(function)                                            \
+	__attribute__((cleanup(bun_shadow_scope_exit), unused))               \
+	int bun_shadow_scope_ = (BUN_SHADOW_ENTER(function), 0)
+
+#ifdef __cplusplus
+}
+#endif
@@ -68,6 +68,14 @@ struct bun_frame {
 	size_t register_count;
 	size_t register_buffer_size;
 	void *register_data;
+
+	/*
+	 * Version and architecture of the stream the frame was read from,
+	 * which determine the layout of register_data. Frames built by
+	 * writers leave them to 0.
+	 */
+	unsigned int version;
+	enum bun_architecture architecture;
 };
 
 enum bun_register {
@@ -203,12 +211,18 @@ struct bun_writer_reader_base {
 	bool overflow;
 };
 
+/*
+ * Version 2 streams store the address of each frame relative to the one
+ * before it, which the writer and the reader keep track of.
+ */
 struct bun_writer {
 	struct bun_writer_reader_base data;
+	uint64_t previous_addr;
 };
 
 struct bun_reader {
 	struct bun_writer_reader_base data;
+	uint64_t previous_addr;
 };
 
 /*
@@ -278,6 +292,23 @@ bool bun_frame_register_append(struct bun_frame *, enum bun_register reg,
 bool bun_frame_register_get(struct bun_frame *, size_t index,
     enum bun_register *reg, uintmax_t *value);
 
+/*
+ * Gets the value of the register `reg`. Registers of frames read from version
+ * 2 streams are found in constant time.
+ *
+ * Returns false if the frame does not have the register.
+ */
+bool bun_frame_register_find(struct bun_frame *, enum bun_register reg,
+    uintmax_t *value);
+
+/*
+ * Returns true if the register `reg` is to be captured for the next frame
+ * written by the writer, according to the BUN_HANDLE_REGISTERS_* flags of its
+ * handle. Backends check it before fetching the value of a register.
+ */
+bool bun_writer_register_wanted(const bun_writer_t *writer,
+    enum bun_register reg);
+
 /*
  * Write the callstack information in a human-readable format to the specified
  * file buffer.
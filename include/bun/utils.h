@@ -68,7 +68,9 @@ const char *bun_cache_dir_get();
 bool bun_unwind_demangle(char *dest, size_t dest_size, const char *src);
 
 /*
- * This function waits for the pid to become signalled.
+ * This function waits for the pid, a thread traced by the caller, to stop.
+ * The wait gives up after `msec_timeout` milliseconds, measured on the
+ * monotonic clock, or never if it is negative.
  *
  * Returns a negative number on failure and 0 on success.
  */
@@ -0,0 +1,430 @@
+#define _GNU_SOURCE
+#include "bun_census.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+
+#include <bun/core.h>
+#include <bun/stream.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_internal.h"
+#include "../../bun_maps.h"
+#include "../../bun_memory.h"
+#include "../../bun_ptrace.h"
+#include "../dwarf/bun_dwarf_remote.h"
+
+/* How long a running thread may take to stop. */
+#define CENSUS_ATTACH_TIMEOUT_MS 5000
+
+/* Longest line of /proc/<pid>/task/<tid>/syscall: 9 values and separators. */
+#define CENSUS_LINE_SIZE 256
+
+/*
+ * The objects of the process being unwound, valid as long as its maps do not
+ * change.
+ */
+struct census_target {
+	struct bun_dwarf_remote remote;
+	unsigned int references;
+};
+
+/*
+ * The targets are kept for the processes whose maps are cached, so that
+ * alternating between processes does not load their objects again.
+ */
+struct bun_census_context {
+	pthread_mutex_t lock;
+	struct bun_maps_cache maps;
+	struct bun_maps_table table;
+	struct census_target *targets[BUN_MAPS_CACHE_SIZE];
+	size_t stack_limit;
+
+	/* Objects shared by the targets, and kept across their reloads. */
+	struct bun_object_cache *objects;
+};
+
+static size_t census_unwind_remote(struct bun_handle *handle,
+    struct bun_buffer *buffer, pid_t tid);
+static void destroy_handle(struct bun_handle *handle);
+
+bool
+bun_internal_initialize_census(struct bun_handle *handle)
+{
+	struct bun_census_context *context;
+
+	context = calloc(1, sizeof(*context));
+	if (context == NULL)
+		return false;
+
+	context->objects = bun_object_cache_create(
+	    BUN_DWARF_REMOTE_CACHE_LIMIT);
+	if (context->objects == NULL) {
+		free(context);
+		return false;
+	}
+
+	if (pthread_mutex_init(&context->lock, NULL) != 0) {
+		bun_object_cache_destroy(context->objects);
+		free(context);
+		return false;
+	}
+
+	bun_maps_cache_init(&context->maps);
+	bun_maps_table_init(&context->table);
+	context->stack_limit = bun_cursor_stack_limit();
+
+	handle->backend_context = context;
+	handle->unwind_remote = census_unwind_remote;
+	handle->destroy = destroy_handle;
+	return true;
+}
+
+static void
+target_free(struct census_target *target)
+{
+
+	bun_dwarf_remote_deinit(&target->remote);
+	free(target);
+	return;
+}
+
+static void
+target_release(struct bun_census_context *context,
+    struct census_target *target)
+{
+	unsigned int references;
+
+	pthread_mutex_lock(&context->lock);
+	references = --target->references;
+	pthread_mutex_unlock(&context->lock);
+
+	if (references == 0)
+		target_free(target);
+
+	return;
+}
+
+/*
+ * Returns the target the thread `tid` belongs to, which must be released
+ * with target_release(). A target is reused until the maps of its process
+ * change.
+ */
+static struct census_target *
+target_get(struct bun_census_context *context, pid_t tid)
+{
+	struct census_target *target = NULL, *previous;
+	struct bun_maps *maps;
+	size_t slot;
+	int found;
+
+	maps = bun_maps_cache_get(&context->maps, tid, false);
+	if (maps == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&context->lock);
+	found = bun_maps_table_find(&context->table, maps->stamp.pid);
+	if (found != -1)
+		target = context->targets[found];
+	if (target != NULL && target->remote.maps == maps) {
+		target->references++;
+		pthread_mutex_unlock(&context->lock);
+		bun_maps_release(maps);
+		return target;
+	}
+
+	pthread_mutex_unlock(&context->lock);
+
+	/* The objects are loaded without holding the lock. */
+	target = calloc(1, sizeof(*target));
+	if (target == NULL) {
+		bun_maps_release(maps);
+		return NULL;
+	}
+
+	if (bun_dwarf_remote_init(&target->remote, maps,
+	    context->objects) == false) {
+		target_free(target);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&context->lock);
+	slot = bun_maps_table_slot(&context->table,
+	    target->remote.maps->stamp.pid);
+	previous = context->targets[slot];
+	context->targets[slot] = target;
+	target->references = 2;
+	pthread_mutex_unlock(&context->lock);
+
+	if (previous != NULL)
+		target_release(context, previous);
+
+	return target;
+}
+
+/*
+ * Reads /proc/<pid>/task/<tid>/syscall into `line`.
+ */
+static bool
+syscall_read(pid_t pid, pid_t tid, char *line)
+{
+	char path[64];
+	ssize_t length;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/%d/task/%d/syscall", (int)pid,
+	    (int)tid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	length = read(fd, line, CENSUS_LINE_SIZE - 1);
+	close(fd);
+	if (length <= 0)
+		return false;
+
+	line[length] = '\0';
+	return true;
+}
+
+/*
+ * Extracts the stack and instruction pointers of a blocked thread from its
+ * syscall line. The kernel writes "running" for a thread that is not blocked,
+ * "-1 <sp> <pc>" for one blocked outside of a system call, and the number
+ * and six arguments of the system call followed by "<sp> <pc>" otherwise.
+ *
+ * Returns false if the thread is running.
+ */
+static bool
+syscall_parse(const char *line, uintptr_t *sp, uintptr_t *pc)
+{
+	unsigned long long values[9];
+	size_t count = 0;
+	char *end;
+
+	while (count < sizeof(values) / sizeof(*values)) {
+		values[count] = strtoull(line, &end, 0);
+		if (end == line)
+			break;
+
+		count++;
+		line = end;
+	}
+
+	if (count != 3 && count != 9)
+		return false;
+
+	*sp = values[count - 2];
+	*pc = values[count - 1];
+	return *sp != 0 && *pc != 0;
+}
+
+/*
+ * Reads the general purpose registers of the thread `tid`, which must be
+ * stopped, in the cursor's layout.
+ */
+static bool
+regs_load(pid_t tid, uintptr_t *pc, uintptr_t regs_out[], uint64_t *valid)
+{
+#if defined(BUN_PTRACE_SNAPSHOT_SUPPORTED)
+	struct user_regs_struct regs;
+	struct iovec iov = {
+		.iov_base = &regs,
+		.iov_len = sizeof(regs)
+	};
+
+	if (ptrace(PTRACE_GETREGSET, tid, (void *)NT_PRSTATUS, &iov) != 0 ||
+	    iov.iov_len != sizeof(regs))
+		return false;
+
+#if defined(__x86_64__)
+	const uintptr_t values[] = {
+		regs.rax, regs.rdx, regs.rcx, regs.rbx, regs.rsi, regs.rdi,
+		regs.rbp, regs.rsp, regs.r8, regs.r9, regs.r10, regs.r11,
+		regs.r12, regs.r13, regs.r14, regs.r15
+	};
+
+	*pc = regs.rip;
+#elif defined(__i386__)
+	const uintptr_t values[] = {
+		regs.eax, regs.ecx, regs.edx, regs.ebx, regs.esp, regs.ebp,
+		regs.esi, regs.edi
+	};
+
+	*pc = regs.eip;
+#elif defined(__aarch64__)
+	uintptr_t values[32];
+
+	for (size_t i = 0; i < 31; i++)
+		values[i] = regs.regs[i];
+	values[31] = regs.sp;
+	*pc = regs.pc;
+#endif
+
+	*valid = 0;
+	for (size_t i = 0; i < sizeof(values) / sizeof(*values); i++) {
+		regs_out[i] = values[i];
+		*valid |= BUN_CURSOR_REGISTER_BIT(i);
+	}
+
+	return true;
+#else
+	(void)tid;
+	(void)pc;
+	(void)regs_out;
+	(void)valid;
+	return false;
+#endif
+}
+
+static bool
+census_read(void *arg, uintptr_t addr, uintptr_t *value)
+{
+
+	return bun_memory_cache_read(arg, value, addr, sizeof(*value));
+}
+
+static size_t
+census_write(struct bun_handle *handle, struct bun_buffer *buffer, pid_t tid,
+    const struct census_target *target, struct bun_cursor *cursor)
+{
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+	struct bun_writer writer;
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		return 0;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_CENSUS);
+	bun_header_tid_set(&writer, tid);
+
+	do {
+		if (bun_dwarf_remote_write_frame(&target->remote, cursor,
+		    &writer, handle) == false)
+			return 0;
+	} while (bun_dwarf_remote_step(&target->remote, cursor) == true);
+
+	return hdr->size;
+}
+
+/*
+ * Unwinds a thread blocked in the kernel without stopping it. Its stack is
+ * only known to be intact if the thread is still blocked at the same point
+ * once it has been read.
+ */
+static size_t
+census_unwind_blocked(struct bun_handle *handle, struct bun_buffer *buffer,
+    pid_t tid, const struct census_target *target,
+    struct bun_memory_cache *memory)
+{
+	struct bun_census_context *context = handle->backend_context;
+	pid_t pid = target->remote.maps->stamp.pid;
+	char before[CENSUS_LINE_SIZE], after[CENSUS_LINE_SIZE];
+	struct bun_cursor cursor;
+	uintptr_t sp, pc;
+	size_t size;
+
+	if (syscall_read(pid, tid, before) == false ||
+	    syscall_parse(before, &sp, &pc) == false)
+		return 0;
+
+	/* Only the stack pointer is known, the walk must recover the rest. */
+	bun_memory_cache_init(memory, pid);
+	bun_cursor_init_reader(&cursor, pc, sp, 0, context->stack_limit,
+	    census_read, memory);
+	cursor.regs_valid &= ~BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_FP);
+
+	size = census_write(handle, buffer, tid, target, &cursor);
+	if (size == 0 || syscall_read(pid, tid, after) == false ||
+	    strcmp(before, after) != 0)
+		return 0;
+
+	return size;
+}
+
+static size_t
+census_unwind_stopped(struct bun_handle *handle, struct bun_buffer *buffer,
+    pid_t tid, const struct census_target *target,
+    struct bun_memory_cache *memory)
+{
+	struct bun_census_context *context = handle->backend_context;
+	uintptr_t regs[BUN_CURSOR_REGISTER_COUNT];
+	struct bun_cursor cursor;
+	uint64_t regs_valid;
+	uintptr_t pc;
+	size_t size = 0;
+
+	if (bun_ptrace_attach(tid, handle->flags,
+	    CENSUS_ATTACH_TIMEOUT_MS) == false)
+		return 0;
+
+	if (regs_load(tid, &pc, regs, &regs_valid) == true) {
+		bun_memory_cache_init(memory, target->remote.maps->stamp.pid);
+		bun_cursor_init_reader(&cursor, pc,
+		    regs[BUN_CURSOR_REGISTER_SP], regs[BUN_CURSOR_REGISTER_FP],
+		    context->stack_limit, census_read, memory);
+		memcpy(cursor.regs, regs, sizeof(cursor.regs));
+		cursor.regs_valid = regs_valid;
+		size = census_write(handle, buffer, tid, target, &cursor);
+	}
+
+	bun_ptrace_detach(tid);
+	return size;
+}
+
+static size_t
+census_unwind_remote(struct bun_handle *handle, struct bun_buffer *buffer,
+    pid_t tid)
+{
+	struct bun_census_context *context = handle->backend_context;
+	struct bun_memory_cache *memory;
+	struct census_target *target;
+	size_t size = 0;
+
+	target = target_get(context, tid);
+	if (target == NULL)
+		return 0;
+
+	memory = malloc(sizeof(*memory));
+	if (memory == NULL)
+		goto out;
+
+	/* Threads that are running, or ran while being read, are stopped. */
+	size = census_unwind_blocked(handle, buffer, tid, target, memory);
+	if (size == 0)
+		size = census_unwind_stopped(handle, buffer, tid, target,
+		    memory);
+
+out:
+	free(memory);
+	target_release(context, target);
+	return size;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+	struct bun_census_context *context = handle->backend_context;
+
+	if (context == NULL)
+		return;
+
+	for (size_t i = 0; i < BUN_MAPS_CACHE_SIZE; i++) {
+		if (context->targets[i] != NULL)
+			target_release(context, context->targets[i]);
+	}
+
+	bun_maps_cache_deinit(&context->maps);
+	bun_object_cache_destroy(context->objects);
+	pthread_mutex_destroy(&context->lock);
+	free(context);
+	return;
+}
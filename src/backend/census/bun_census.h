@@ -0,0 +1,9 @@
+#pragma once
+
+#include <bun/bun.h>
+
+/*
+ * Initialize the /proc/<pid>/task/<tid>/syscall census backend. This function
+ * is only meant for internal use.
+ */
+bool bun_internal_initialize_census(struct bun_handle *handle);
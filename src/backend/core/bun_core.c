@@ -0,0 +1,734 @@
+#define _GNU_SOURCE
+#include "bun_core.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/procfs.h>
+#include <sys/stat.h>
+#include <sys/user.h>
+
+#include <bun/core.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_internal.h"
+#include "../../bun_modules.h"
+#include "../../bun_object_cache.h"
+#include "../dwarf/bun_dwarf.h"
+#if defined(BUN_FRAMEPOINTER_ENABLED)
+#include "../framepointer/bun_framepointer.h"
+#endif /* BUN_FRAMEPOINTER_ENABLED */
+
+#if defined(__x86_64__)
+#define CORE_MACHINE EM_X86_64
+#elif defined(__i386__)
+#define CORE_MACHINE EM_386
+#elif defined(__aarch64__)
+#define CORE_MACHINE EM_AARCH64
+#endif
+
+/* Notes of core files are aligned to 4 bytes on all architectures. */
+#define NOTE_ALIGN 4
+
+/*
+ * Memory of the process saved in a PT_LOAD segment. Only the bytes present
+ * in the file are covered, pages that were not dumped cannot be read.
+ */
+struct core_segment {
+	uintptr_t start;
+	uintptr_t end;
+	const uint8_t *data;
+};
+
+/*
+ * Registers of a thread, in cursor numbering.
+ */
+struct core_thread {
+	pid_t tid;
+	uintptr_t pc;
+	uintptr_t regs[BUN_CURSOR_REGISTER_COUNT];
+	uint64_t regs_valid;
+};
+
+/*
+ * objects[i] backs modules.modules[i]. The module paths point into the
+ * NT_FILE note of the core. Everything is read-only once initialized.
+ */
+struct bun_core_context {
+	const uint8_t *core;
+	size_t core_size;
+	struct core_segment *segments;
+	size_t segment_count;
+	struct core_thread *threads;
+	size_t thread_count;
+	struct bun_module_table modules;
+	struct bun_object **objects;
+	struct bun_object_cache *cache;
+	size_t stack_limit;
+};
+
+/* A module and its object, kept together while sorting. */
+struct core_entry {
+	struct bun_module module;
+	struct bun_object *object;
+};
+
+struct note {
+	uint32_t type;
+	const char *name;
+	size_t name_size;
+	const uint8_t *desc;
+	size_t desc_size;
+};
+
+static size_t core_unwind_remote(struct bun_handle *handle,
+    struct bun_buffer *buffer, pid_t tid);
+static void destroy_handle(struct bun_handle *handle);
+
+/*
+ * Maps the whole file read-only.
+ */
+static bool
+file_map(const char *path, const uint8_t **data, size_t *size)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	*data = map;
+	*size = st.st_size;
+	return true;
+}
+
+/*
+ * Returns the ELF header of the image if it is of the given type, targets
+ * the current architecture and its program headers are in bounds.
+ */
+static const ElfW(Ehdr) *
+elf_header(const uint8_t *data, size_t size, int type)
+{
+	const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)data;
+
+	if (size < sizeof(*ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0)
+		return NULL;
+
+	if (ehdr->e_ident[EI_CLASS] != (sizeof(uintptr_t) == 8 ?
+	    ELFCLASS64 : ELFCLASS32) || ehdr->e_type != type ||
+	    ehdr->e_machine != CORE_MACHINE ||
+	    ehdr->e_phentsize != sizeof(ElfW(Phdr)))
+		return NULL;
+
+	if (ehdr->e_phoff > size ||
+	    (size - ehdr->e_phoff) / sizeof(ElfW(Phdr)) < ehdr->e_phnum)
+		return NULL;
+
+	return ehdr;
+}
+
+/*
+ * Decodes the note at `*cursor` and moves the cursor past it.
+ *
+ * Returns false at the end of the notes or if they are malformed.
+ */
+static bool
+note_next(const uint8_t **cursor, const uint8_t *end, struct note *note)
+{
+	ElfW(Nhdr) nhdr;
+	size_t name_size, desc_size;
+
+	if ((size_t)(end - *cursor) < sizeof(nhdr))
+		return false;
+
+	memcpy(&nhdr, *cursor, sizeof(nhdr));
+	*cursor += sizeof(nhdr);
+
+	name_size = ((size_t)nhdr.n_namesz + NOTE_ALIGN - 1) &
+	    ~(size_t)(NOTE_ALIGN - 1);
+	desc_size = ((size_t)nhdr.n_descsz + NOTE_ALIGN - 1) &
+	    ~(size_t)(NOTE_ALIGN - 1);
+	if ((size_t)(end - *cursor) < name_size ||
+	    (size_t)(end - *cursor) - name_size < desc_size)
+		return false;
+
+	note->type = nhdr.n_type;
+	note->name = (const char *)*cursor;
+	note->name_size = nhdr.n_namesz;
+	note->desc = *cursor + name_size;
+	note->desc_size = nhdr.n_descsz;
+	*cursor += name_size + desc_size;
+	return true;
+}
+
+/*
+ * Returns the core memory backing [addr, addr + size), or NULL if it is not
+ * entirely saved in a single segment.
+ */
+static const uint8_t *
+core_memory(const struct bun_core_context *context, uintptr_t addr,
+    size_t size)
+{
+	size_t low = 0;
+	size_t high = context->segment_count;
+
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		const struct core_segment *segment = &context->segments[mid];
+
+		if (addr < segment->start) {
+			high = mid;
+		} else if (addr >= segment->end) {
+			low = mid + 1;
+		} else {
+			if (segment->end - addr < size)
+				return NULL;
+
+			return segment->data + (addr - segment->start);
+		}
+	}
+
+	return NULL;
+}
+
+static bool
+core_read(void *arg, uintptr_t addr, uintptr_t *value)
+{
+	const uint8_t *data = core_memory(arg, addr, sizeof(*value));
+
+	if (data == NULL)
+		return false;
+
+	memcpy(value, data, sizeof(*value));
+	return true;
+}
+
+static int
+compare_segments(const void *a, const void *b)
+{
+	const struct core_segment *lhs = a;
+	const struct core_segment *rhs = b;
+
+	if (lhs->start < rhs->start)
+		return -1;
+
+	return lhs->start > rhs->start;
+}
+
+static int
+compare_entries(const void *a, const void *b)
+{
+	const struct core_entry *lhs = a;
+	const struct core_entry *rhs = b;
+
+	if (lhs->module.start < rhs->module.start)
+		return -1;
+
+	return lhs->module.start > rhs->module.start;
+}
+
+/*
+ * Loads the registers of the NT_PRSTATUS note into the thread.
+ */
+static void
+thread_load(struct core_thread *thread, const uint8_t *desc)
+{
+	struct elf_prstatus status;
+	struct user_regs_struct regs;
+
+	static_assert(sizeof(regs) <= sizeof(status.pr_reg),
+	    "Expected the registers to fit into pr_reg");
+
+	memcpy(&status, desc, sizeof(status));
+	memcpy(&regs, &status.pr_reg, sizeof(regs));
+
+#if defined(__x86_64__)
+	const uintptr_t values[] = {
+		regs.rax, regs.rdx, regs.rcx, regs.rbx, regs.rsi, regs.rdi,
+		regs.rbp, regs.rsp, regs.r8, regs.r9, regs.r10, regs.r11,
+		regs.r12, regs.r13, regs.r14, regs.r15
+	};
+
+	thread->pc = regs.rip;
+#elif defined(__i386__)
+	const uintptr_t values[] = {
+		regs.eax, regs.ecx, regs.edx, regs.ebx, regs.esp, regs.ebp,
+		regs.esi, regs.edi
+	};
+
+	thread->pc = regs.eip;
+#elif defined(__aarch64__)
+	uintptr_t values[32];
+
+	for (size_t i = 0; i < 31; i++)
+		values[i] = regs.regs[i];
+	values[31] = regs.sp;
+	thread->pc = regs.pc;
+#endif
+
+	thread->tid = status.pr_pid;
+	thread->regs_valid = 0;
+	for (size_t i = 0; i < sizeof(values) / sizeof(*values); i++) {
+		thread->regs[i] = values[i];
+		thread->regs_valid |= BUN_CURSOR_REGISTER_BIT(i);
+	}
+
+	return;
+}
+
+/*
+ * Looks for the build-id of the object mapped at `base` in the memory saved
+ * in the core.
+ *
+ * Returns false if the core does not hold it.
+ */
+static bool
+core_build_id(const struct bun_core_context *context, uintptr_t base,
+    const uint8_t **build_id, size_t *build_id_size)
+{
+	const ElfW(Ehdr) *ehdr;
+	const ElfW(Phdr) *phdrs;
+	uintptr_t bias = 0;
+	bool biased = false;
+
+	/* The first page of ELF mappings is dumped by default. */
+	ehdr = (const ElfW(Ehdr) *)core_memory(context, base, sizeof(*ehdr));
+	if (ehdr == NULL || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0)
+		return false;
+
+	phdrs = (const ElfW(Phdr) *)core_memory(context, base + ehdr->e_phoff,
+	    ehdr->e_phnum * sizeof(ElfW(Phdr)));
+	if (phdrs == NULL)
+		return false;
+
+	for (size_t i = 0; i < ehdr->e_phnum && biased == false; i++) {
+		if (phdrs[i].p_type != PT_LOAD)
+			continue;
+
+		/* The first segment is the one mapped at `base`. */
+		bias = base - (phdrs[i].p_vaddr - phdrs[i].p_offset);
+		biased = true;
+	}
+
+	for (size_t i = 0; i < ehdr->e_phnum && biased == true; i++) {
+		const uint8_t *notes;
+
+		if (phdrs[i].p_type != PT_NOTE)
+			continue;
+
+		notes = core_memory(context, bias + phdrs[i].p_vaddr,
+		    phdrs[i].p_filesz);
+		if (notes != NULL && bun_build_id_find(notes,
+		    phdrs[i].p_filesz, build_id, build_id_size) == true)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Maps the object `path`, loaded at `base` in the process, from below
+ * `sysroot`. If the core holds the build-id of the object, the file must
+ * have the same one, and it is looked up in the object cache first.
+ *
+ * Returns false if it cannot be used to unwind the core.
+ */
+static bool
+object_load(const struct bun_core_context *context, const char *sysroot,
+    const char *path, uintptr_t base, struct core_entry *entry)
+{
+	struct bun_module *module = &entry->module;
+	const struct bun_object *object;
+	const uint8_t *build_id = NULL;
+	size_t build_id_size = 0;
+	const ElfW(Ehdr) *ehdr;
+	char full_path[PATH_MAX];
+	int written;
+
+	memset(entry, 0, sizeof(*entry));
+
+	written = snprintf(full_path, sizeof(full_path), "%s%s",
+	    sysroot != NULL ? sysroot : "", path);
+	if (written < 0 || (size_t)written >= sizeof(full_path))
+		return false;
+
+	core_build_id(context, base, &build_id, &build_id_size);
+	entry->object = bun_object_get(context->cache, full_path, build_id,
+	    build_id_size);
+	if (entry->object == NULL)
+		return false;
+
+	object = entry->object;
+
+	ehdr = elf_header(object->data, object->size, ET_DYN);
+	if (ehdr == NULL)
+		ehdr = elf_header(object->data, object->size, ET_EXEC);
+	if (ehdr == NULL)
+		goto error;
+
+	if (bun_object_module(object, path, base, module) == false)
+		goto error;
+
+	return true;
+error:
+	bun_object_release(entry->object);
+	return false;
+}
+
+/*
+ * Loads the objects listed in the NT_FILE note. Its layout is a count and a
+ * page size, followed by the {start, end, file offset in pages} triplets of
+ * every mapping, followed by their NUL-terminated paths.
+ */
+static bool
+objects_load(struct bun_core_context *context, const char *sysroot,
+    const uint8_t *desc, size_t size)
+{
+	const size_t word = sizeof(unsigned long);
+	const char *path, *end = (const char *)desc + size;
+	struct core_entry *entries;
+	unsigned long count;
+	size_t loaded = 0;
+
+	if (desc == NULL || size < 2 * word)
+		return true;
+
+	memcpy(&count, desc, word);
+	if (count > (size - 2 * word) / (3 * word))
+		return false;
+
+	entries = calloc(count + 1, sizeof(*entries));
+	if (entries == NULL)
+		return false;
+
+	path = (const char *)desc + (2 + 3 * count) * word;
+	for (unsigned long i = 0; i < count; i++) {
+		const char *next = memchr(path, '\0', end - path);
+		unsigned long start, offset;
+		bool duplicate = false;
+
+		if (next == NULL)
+			break;
+
+		memcpy(&start, desc + (2 + 3 * i) * word, word);
+		memcpy(&offset, desc + (2 + 3 * i + 2) * word, word);
+
+		/* Objects are located through their first mapping. */
+		for (size_t j = 0; j < loaded && offset == 0; j++)
+			duplicate |= strcmp(entries[j].module.path, path) == 0;
+
+		if (offset == 0 && duplicate == false &&
+		    object_load(context, sysroot, path, start,
+		    &entries[loaded]) == true)
+			loaded++;
+
+		path = next + 1;
+	}
+
+	qsort(entries, loaded, sizeof(*entries), compare_entries);
+
+	context->modules.modules = calloc(loaded + 1,
+	    sizeof(*context->modules.modules));
+	context->objects = calloc(loaded + 1, sizeof(*context->objects));
+	if (context->modules.modules == NULL || context->objects == NULL) {
+		for (size_t i = 0; i < loaded; i++)
+			bun_object_release(entries[i].object);
+		free(entries);
+		return false;
+	}
+
+	for (size_t i = 0; i < loaded; i++) {
+		context->modules.modules[i] = entries[i].module;
+		context->objects[i] = entries[i].object;
+	}
+
+	context->modules.count = loaded;
+	free(entries);
+	return true;
+}
+
+/*
+ * Collects the segments, threads and the NT_FILE note of the core.
+ */
+static bool
+core_parse(struct bun_core_context *context, const char *sysroot)
+{
+	const ElfW(Ehdr) *ehdr;
+	const ElfW(Phdr) *phdrs;
+	const uint8_t *file_note = NULL;
+	size_t file_note_size = 0;
+
+	ehdr = elf_header(context->core, context->core_size, ET_CORE);
+	if (ehdr == NULL)
+		return false;
+
+	phdrs = (const ElfW(Phdr) *)(context->core + ehdr->e_phoff);
+
+	/* Both arrays are sized for the worst case. */
+	context->segments = calloc(ehdr->e_phnum + 1,
+	    sizeof(*context->segments));
+	if (context->segments == NULL)
+		return false;
+
+	for (size_t i = 0; i < ehdr->e_phnum; i++) {
+		const ElfW(Phdr) *phdr = &phdrs[i];
+		struct core_segment *segment;
+
+		if (phdr->p_type != PT_LOAD || phdr->p_filesz == 0 ||
+		    phdr->p_offset > context->core_size ||
+		    context->core_size - phdr->p_offset < phdr->p_filesz)
+			continue;
+
+		segment = &context->segments[context->segment_count++];
+		segment->start = phdr->p_vaddr;
+		segment->end = phdr->p_vaddr + phdr->p_filesz;
+		segment->data = context->core + phdr->p_offset;
+	}
+
+	qsort(context->segments, context->segment_count,
+	    sizeof(*context->segments), compare_segments);
+
+	for (int pass = 0; pass < 2; pass++) {
+		size_t count = 0;
+
+		for (size_t i = 0; i < ehdr->e_phnum; i++) {
+			const uint8_t *cursor, *end;
+			struct note note;
+
+			if (phdrs[i].p_type != PT_NOTE ||
+			    phdrs[i].p_offset > context->core_size ||
+			    context->core_size - phdrs[i].p_offset <
+			    phdrs[i].p_filesz)
+				continue;
+
+			cursor = context->core + phdrs[i].p_offset;
+			end = cursor + phdrs[i].p_filesz;
+			while (note_next(&cursor, end, &note) == true) {
+				if (note.type == NT_FILE) {
+					file_note = note.desc;
+					file_note_size = note.desc_size;
+				}
+
+				if (note.type != NT_PRSTATUS ||
+				    note.desc_size < sizeof(struct elf_prstatus))
+					continue;
+
+				if (pass == 1)
+					thread_load(&context->threads[count],
+					    note.desc);
+				count++;
+			}
+		}
+
+		if (pass == 0) {
+			context->threads = calloc(count + 1,
+			    sizeof(*context->threads));
+			if (context->threads == NULL)
+				return false;
+		}
+
+		context->thread_count = count;
+	}
+
+	return objects_load(context, sysroot, file_note, file_note_size);
+}
+
+bool
+bun_internal_initialize_core(struct bun_handle *handle, const char *path,
+    const char *sysroot, struct bun_object_cache *cache)
+{
+#if defined(CORE_MACHINE)
+	struct bun_core_context *context;
+
+	context = calloc(1, sizeof(struct bun_core_context));
+	if (context == NULL)
+		return false;
+
+	if (file_map(path, &context->core, &context->core_size) == false) {
+		free(context);
+		return false;
+	}
+
+	context->cache = cache;
+	context->stack_limit = bun_cursor_stack_limit();
+
+	handle->backend_context = context;
+	handle->unwind_remote = core_unwind_remote;
+	handle->destroy = destroy_handle;
+
+	if (core_parse(context, sysroot) == false) {
+		destroy_handle(handle);
+		handle->backend_context = NULL;
+		return false;
+	}
+
+	return true;
+#else
+	(void) handle;
+	(void) path;
+	(void) sysroot;
+	(void) cache;
+	return false;
+#endif
+}
+
+size_t
+bun_core_threads(const struct bun_handle *handle, pid_t *tids, size_t count)
+{
+	const struct bun_core_context *context = handle->backend_context;
+
+	if (handle->destroy != destroy_handle || context == NULL)
+		return 0;
+
+	for (size_t i = 0; i < context->thread_count && i < count; i++)
+		tids[i] = context->threads[i].tid;
+
+	return context->thread_count;
+}
+
+/*
+ * Returns the name of the function containing `pc`, along with its start
+ * address, or NULL.
+ */
+static const char *
+object_symbol(const struct bun_object *object, uintptr_t bias, uintptr_t pc,
+    uintptr_t *start)
+{
+	const struct bun_object_symbol *symbol;
+
+	symbol = bun_object_symbol_find(object, pc - bias);
+	if (symbol == NULL)
+		return NULL;
+
+	*start = bias + symbol->start;
+	return symbol->name;
+}
+
+static bool
+core_write_frame(const struct bun_core_context *context,
+    const struct bun_cursor *cursor, struct bun_writer *writer,
+    const struct bun_handle *handle)
+{
+	const struct bun_module *module;
+	const char *symbol = NULL;
+	uintptr_t pc = cursor->pc;
+	uintptr_t start = 0;
+
+	if (cursor->return_address == true)
+		pc--;
+
+	if ((handle->flags & BUN_HANDLE_SKIP_SYMBOLS) != 0)
+		return bun_cursor_write_frame_symbol(cursor, writer, NULL, NULL,
+		    0);
+
+	module = bun_module_table_find(&context->modules, pc);
+	if (module == NULL)
+		return bun_cursor_write_frame_symbol(cursor, writer, NULL, NULL,
+		    0);
+
+	symbol = object_symbol(context->objects[module -
+	    context->modules.modules], module->bias, pc, &start);
+	return bun_cursor_write_frame_symbol(cursor, writer, symbol,
+	    module->path, symbol != NULL ? cursor->pc - start : 0);
+}
+
+static bool
+core_step(const struct bun_core_context *context, struct bun_cursor *cursor)
+{
+	uintptr_t pc = cursor->pc;
+
+	if (cursor->return_address == true)
+		pc--;
+
+	if (bun_module_table_find(&context->modules, pc) != NULL)
+		return bun_internal_dwarf_step(&context->modules, cursor);
+
+#if defined(BUN_FRAMEPOINTER_ENABLED)
+	/* The object could not be loaded, its frame may have a record. */
+	return bun_internal_framepointer_step(cursor);
+#else
+	return false;
+#endif
+}
+
+static size_t
+core_unwind_remote(struct bun_handle *handle, struct bun_buffer *buffer,
+    pid_t tid)
+{
+	struct bun_core_context *context = handle->backend_context;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+	const struct core_thread *thread = NULL;
+	struct bun_cursor cursor;
+	struct bun_writer writer;
+
+	for (size_t i = 0; i < context->thread_count; i++) {
+		if (context->threads[i].tid == tid) {
+			thread = &context->threads[i];
+			break;
+		}
+	}
+
+	if (thread == NULL)
+		return 0;
+
+	bun_cursor_init_reader(&cursor, thread->pc,
+	    thread->regs[BUN_CURSOR_REGISTER_SP],
+	    thread->regs[BUN_CURSOR_REGISTER_FP], context->stack_limit,
+	    core_read, context);
+	memcpy(cursor.regs, thread->regs, sizeof(cursor.regs));
+	cursor.regs_valid = thread->regs_valid;
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		return 0;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_CORE);
+	bun_header_tid_set(&writer, tid);
+
+	do {
+		if (core_write_frame(context, &cursor, &writer, handle) == false)
+			return 0;
+	} while (core_step(context, &cursor) == true);
+
+	return hdr->size;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+	struct bun_core_context *context = handle->backend_context;
+
+	if (context == NULL)
+		return;
+
+	for (size_t i = 0; i < context->modules.count; i++)
+		bun_object_release(context->objects[i]);
+
+	munmap((void *)context->core, context->core_size);
+	free(context->objects);
+	bun_module_table_deinit(&context->modules);
+	free(context->threads);
+	free(context->segments);
+	free(context);
+	return;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <bun/bun.h>
+#include <bun/core.h>
+
+/*
+ * Initialize the core file backend for the core at `path`, with an optional
+ * object cache. This function is only meant for internal use, see
+ * bun_handle_init_core().
+ */
+bool bun_internal_initialize_core(struct bun_handle *handle, const char *path,
+    const char *sysroot, struct bun_object_cache *cache);
@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include "bun_dwarf.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <ucontext.h>
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_internal.h"
+#include "../../bun_modules.h"
+#include "bun_dwarf_cfi.h"
+
+/*
+ * The module table is built once, when the handle is initialized, and is
+ * read-only afterwards. Unwinding only touches the stack of the calling
+ * thread, so the handle can be used by any number of threads at once.
+ */
+struct bun_dwarf_context {
+	struct bun_module_table modules;
+	size_t stack_limit;
+};
+
+static size_t dwarf_unwind(struct bun_handle *handle,
+    struct bun_buffer *buffer);
+static size_t dwarf_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context);
+static size_t dwarf_unwind_impl(struct bun_cursor *cursor,
+    struct bun_handle *handle, struct bun_buffer *buffer);
+static void destroy_handle(struct bun_handle *handle);
+
+bool
+bun_internal_initialize_dwarf(struct bun_handle *handle)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+	struct bun_dwarf_context *context;
+
+	context = malloc(sizeof(struct bun_dwarf_context));
+	if (context == NULL)
+		return false;
+
+	if (bun_module_table_init(&context->modules) == false) {
+		free(context);
+		return false;
+	}
+
+	context->stack_limit = bun_cursor_stack_limit();
+
+	handle->backend_context = context;
+	handle->unwind = dwarf_unwind;
+	handle->unwind_context = dwarf_unwind_context;
+	handle->destroy = destroy_handle;
+	return true;
+#else
+	/* ARM uses .ARM.exidx instead of .eh_frame. */
+	(void) handle;
+	return false;
+#endif
+}
+
+bool
+bun_internal_dwarf_step(const struct bun_module_table *modules,
+    struct bun_cursor *cursor)
+{
+	const struct bun_module *module;
+	struct bun_dwarf_fde fde;
+	struct bun_dwarf_rules rules;
+	uintptr_t pc = cursor->pc;
+
+	/*
+	 * A return address may be the first instruction of the next function
+	 * if the call was the last instruction of the caller, so look up the
+	 * call instruction instead.
+	 */
+	if (cursor->return_address == true)
+		pc--;
+
+	module = bun_module_table_find(modules, pc);
+	if (module == NULL ||
+	    bun_module_probe(module, &cursor->probed_module) == false)
+		return false;
+
+	if (bun_dwarf_fde_find(module->eh_frame_hdr, module->eh_frame_hdr_size,
+	    module->delta, pc, &fde) == false)
+		return false;
+
+	if (bun_dwarf_rules_find(&fde, pc, &rules) == false)
+		return false;
+
+	return bun_dwarf_step(&rules, cursor);
+}
+
+static size_t __attribute__((noinline))
+dwarf_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
+{
+	struct bun_dwarf_context *context = handle->backend_context;
+	struct bun_cursor cursor;
+	ucontext_t uc;
+
+	if (getcontext(&uc) != 0)
+		return 0;
+
+	if (bun_cursor_init_context(&cursor, &uc, context->stack_limit) == false)
+		return 0;
+
+	/* The saved pc is the return address of getcontext(). */
+	cursor.return_address = true;
+
+	/* Skip the frame of this function. */
+	if (bun_internal_dwarf_step(&context->modules, &cursor) == false)
+		return 0;
+
+	return dwarf_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+dwarf_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
+    void *context)
+{
+	struct bun_dwarf_context *dwarf_context = handle->backend_context;
+	struct bun_cursor cursor;
+
+	if (bun_cursor_init_context(&cursor, context,
+	    dwarf_context->stack_limit) == false)
+		return 0;
+
+	return dwarf_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+dwarf_unwind_impl(struct bun_cursor *cursor, struct bun_handle *handle,
+    struct bun_buffer *buffer)
+{
+	struct bun_dwarf_context *context = handle->backend_context;
+	struct bun_writer writer;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		return 0;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_DWARF);
+	bun_header_tid_set(&writer, bun_gettid());
+
+	do {
+		if (bun_cursor_write_frame(cursor, &writer, handle) == false)
+			return 0;
+	} while (bun_internal_dwarf_step(&context->modules, cursor) == true);
+
+	return hdr->size;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+	struct bun_dwarf_context *context = handle->backend_context;
+
+	bun_module_table_deinit(&context->modules);
+	free(context);
+	return;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <bun/bun.h>
+
+struct bun_cursor;
+struct bun_module_table;
+
+/*
+ * Initialize the DWARF call frame information backend. This function is only
+ * meant for internal use.
+ */
+bool bun_internal_initialize_dwarf(struct bun_handle *handle);
+
+/*
+ * Moves the cursor to the caller's frame using the .eh_frame_hdr and .eh_frame
+ * sections of the module containing the cursor's pc. This function is only
+ * meant for internal use.
+ *
+ * Returns false if there is no unwind information for the frame or it cannot
+ * be applied.
+ */
+bool bun_internal_dwarf_step(const struct bun_module_table *modules,
+    struct bun_cursor *cursor);
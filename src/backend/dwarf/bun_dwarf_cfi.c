@@ -0,0 +1,1256 @@
+#define _GNU_SOURCE
+#include "bun_dwarf_cfi.h"
+
+#include <string.h>
+
+/* Pointer encodings, see the LSB Core specification. */
+#define DW_EH_PE_absptr 0x00
+#define DW_EH_PE_uleb128 0x01
+#define DW_EH_PE_udata2 0x02
+#define DW_EH_PE_udata4 0x03
+#define DW_EH_PE_udata8 0x04
+#define DW_EH_PE_sleb128 0x09
+#define DW_EH_PE_sdata2 0x0a
+#define DW_EH_PE_sdata4 0x0b
+#define DW_EH_PE_sdata8 0x0c
+#define DW_EH_PE_pcrel 0x10
+#define DW_EH_PE_datarel 0x30
+#define DW_EH_PE_funcrel 0x40
+#define DW_EH_PE_indirect 0x80
+#define DW_EH_PE_omit 0xff
+
+/* Call frame instructions. */
+#define DW_CFA_advance_loc 0x40
+#define DW_CFA_offset 0x80
+#define DW_CFA_restore 0xc0
+#define DW_CFA_nop 0x00
+#define DW_CFA_set_loc 0x01
+#define DW_CFA_advance_loc1 0x02
+#define DW_CFA_advance_loc2 0x03
+#define DW_CFA_advance_loc4 0x04
+#define DW_CFA_offset_extended 0x05
+#define DW_CFA_restore_extended 0x06
+#define DW_CFA_undefined 0x07
+#define DW_CFA_same_value 0x08
+#define DW_CFA_register 0x09
+#define DW_CFA_remember_state 0x0a
+#define DW_CFA_restore_state 0x0b
+#define DW_CFA_def_cfa 0x0c
+#define DW_CFA_def_cfa_register 0x0d
+#define DW_CFA_def_cfa_offset 0x0e
+#define DW_CFA_def_cfa_expression 0x0f
+#define DW_CFA_expression 0x10
+#define DW_CFA_offset_extended_sf 0x11
+#define DW_CFA_def_cfa_sf 0x12
+#define DW_CFA_def_cfa_offset_sf 0x13
+#define DW_CFA_val_offset 0x14
+#define DW_CFA_val_offset_sf 0x15
+#define DW_CFA_val_expression 0x16
+#define DW_CFA_AARCH64_negate_ra_state 0x2d
+#define DW_CFA_GNU_args_size 0x2e
+#define DW_CFA_GNU_negative_offset_extended 0x2f
+
+/* DWARF expression operations used by call frame information. */
+#define DW_OP_addr 0x03
+#define DW_OP_deref 0x06
+#define DW_OP_const1u 0x08
+#define DW_OP_const1s 0x09
+#define DW_OP_const2u 0x0a
+#define DW_OP_const2s 0x0b
+#define DW_OP_const4u 0x0c
+#define DW_OP_const4s 0x0d
+#define DW_OP_const8u 0x0e
+#define DW_OP_const8s 0x0f
+#define DW_OP_constu 0x10
+#define DW_OP_consts 0x11
+#define DW_OP_dup 0x12
+#define DW_OP_drop 0x13
+#define DW_OP_over 0x14
+#define DW_OP_pick 0x15
+#define DW_OP_swap 0x16
+#define DW_OP_rot 0x17
+#define DW_OP_abs 0x19
+#define DW_OP_and 0x1a
+#define DW_OP_div 0x1b
+#define DW_OP_minus 0x1c
+#define DW_OP_mod 0x1d
+#define DW_OP_mul 0x1e
+#define DW_OP_neg 0x1f
+#define DW_OP_not 0x20
+#define DW_OP_or 0x21
+#define DW_OP_plus 0x22
+#define DW_OP_plus_uconst 0x23
+#define DW_OP_shl 0x24
+#define DW_OP_shr 0x25
+#define DW_OP_shra 0x26
+#define DW_OP_xor 0x27
+#define DW_OP_bra 0x28
+#define DW_OP_eq 0x29
+#define DW_OP_ge 0x2a
+#define DW_OP_gt 0x2b
+#define DW_OP_le 0x2c
+#define DW_OP_lt 0x2d
+#define DW_OP_ne 0x2e
+#define DW_OP_skip 0x2f
+#define DW_OP_lit0 0x30
+#define DW_OP_lit31 0x4f
+#define DW_OP_breg0 0x70
+#define DW_OP_breg31 0x8f
+#define DW_OP_bregx 0x92
+#define DW_OP_deref_size 0x94
+#define DW_OP_nop 0x96
+
+/* Depth of the DW_CFA_remember_state stack. */
+#define REMEMBER_STACK_DEPTH 4
+
+/* Limits for DWARF expressions. */
+#define EXPRESSION_STACK_DEPTH 16
+#define EXPRESSION_MAX_OPERATIONS 256
+
+#if defined(__aarch64__)
+#define RETURN_ADDRESS_MASK 0x0000ffffffffffffULL
+#else
+#define RETURN_ADDRESS_MASK UINTPTR_MAX
+#endif
+
+/*
+ * Bounds-checked reader of unwind sections. Reading past `end` sets the error
+ * flag and returns zeros.
+ */
+struct reader {
+	const uint8_t *cursor;
+	const uint8_t *end;
+	intptr_t delta;
+	uintptr_t datarel_base;
+	uintptr_t funcrel_base;
+	bool error;
+};
+
+static void
+reader_init(struct reader *reader, const uint8_t *start, const uint8_t *end,
+    intptr_t delta)
+{
+
+	memset(reader, 0, sizeof(*reader));
+	reader->cursor = start;
+	reader->end = end;
+	reader->delta = delta;
+	return;
+}
+
+static bool
+reader_fetch(struct reader *reader, void *dest, size_t size)
+{
+
+	if (reader->error == true ||
+	    (size_t)(reader->end - reader->cursor) < size) {
+		reader->error = true;
+		memset(dest, 0, size);
+		return false;
+	}
+
+	memcpy(dest, reader->cursor, size);
+	reader->cursor += size;
+	return true;
+}
+
+#define READER_FUNCTION(name, type)                                           \
+static type                                                                   \
+name(struct reader *reader)                                                   \
+{                                                                             \
+	type value;                                                           \
+                                                                              \
+	reader_fetch(reader, &value, sizeof(value));                          \
+	return value;                                                         \
+}
+
+READER_FUNCTION(read_u8, uint8_t)
+READER_FUNCTION(read_u16, uint16_t)
+READER_FUNCTION(read_u32, uint32_t)
+READER_FUNCTION(read_u64, uint64_t)
+READER_FUNCTION(read_s16, int16_t)
+READER_FUNCTION(read_s32, int32_t)
+READER_FUNCTION(read_s64, int64_t)
+READER_FUNCTION(read_address, uintptr_t)
+
+static uint64_t
+read_uleb128(struct reader *reader)
+{
+	uint64_t value = 0;
+	unsigned int shift = 0;
+	uint8_t byte;
+
+	do {
+		byte = read_u8(reader);
+		if (shift < 64)
+			value |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	} while ((byte & 0x80) != 0 && reader->error == false);
+
+	return value;
+}
+
+static int64_t
+read_sleb128(struct reader *reader)
+{
+	uint64_t value = 0;
+	unsigned int shift = 0;
+	uint8_t byte;
+
+	do {
+		byte = read_u8(reader);
+		if (shift < 64)
+			value |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	} while ((byte & 0x80) != 0 && reader->error == false);
+
+	if (shift < 64 && (byte & 0x40) != 0)
+		value |= ~(uint64_t)0 << shift;
+
+	return (int64_t)value;
+}
+
+/*
+ * Reads a pointer with the given DW_EH_PE encoding. Indirect pointers are
+ * returned without dereferencing; unwinding never needs their targets.
+ */
+static uintptr_t
+read_encoded(struct reader *reader, uint8_t encoding)
+{
+	const uintptr_t field = (uintptr_t)reader->cursor + reader->delta;
+	uintptr_t value;
+
+	if (encoding == DW_EH_PE_omit)
+		return 0;
+
+	switch (encoding & 0x0f) {
+	case DW_EH_PE_absptr:
+		value = read_address(reader);
+		break;
+	case DW_EH_PE_uleb128:
+		value = read_uleb128(reader);
+		break;
+	case DW_EH_PE_udata2:
+		value = read_u16(reader);
+		break;
+	case DW_EH_PE_udata4:
+		value = read_u32(reader);
+		break;
+	case DW_EH_PE_udata8:
+		value = read_u64(reader);
+		break;
+	case DW_EH_PE_sleb128:
+		value = read_sleb128(reader);
+		break;
+	case DW_EH_PE_sdata2:
+		value = read_s16(reader);
+		break;
+	case DW_EH_PE_sdata4:
+		value = read_s32(reader);
+		break;
+	case DW_EH_PE_sdata8:
+		value = read_s64(reader);
+		break;
+	default:
+		reader->error = true;
+		return 0;
+	}
+
+	switch (encoding & 0x70) {
+	case DW_EH_PE_absptr:
+		break;
+	case DW_EH_PE_pcrel:
+		value += field;
+		break;
+	case DW_EH_PE_datarel:
+		value += reader->datarel_base;
+		break;
+	case DW_EH_PE_funcrel:
+		value += reader->funcrel_base;
+		break;
+	default:
+		reader->error = true;
+		return 0;
+	}
+
+	return value;
+}
+
+/*
+ * Reads the length of a CIE or FDE and returns the end of the entry, or NULL
+ * for the terminator and malformed entries.
+ */
+static const uint8_t *
+read_entry_length(struct reader *reader)
+{
+	uint64_t length = read_u32(reader);
+
+	if (length == 0xffffffff)
+		length = read_u64(reader);
+
+	if (reader->error == true || length == 0 ||
+	    length > (uint64_t)(reader->end - reader->cursor))
+		return NULL;
+
+	return reader->cursor + length;
+}
+
+const uint8_t *
+bun_dwarf_entry_next(const uint8_t *entry, const uint8_t *end)
+{
+	struct reader reader;
+
+	reader_init(&reader, entry, end, 0);
+	return read_entry_length(&reader);
+}
+
+/*
+ * Parses the CIE into `fde`. `augmented` is set if FDEs using this CIE carry
+ * augmentation data.
+ */
+static bool
+parse_cie(const uint8_t *cie, const uint8_t *end, struct bun_dwarf_fde *fde,
+    bool *augmented)
+{
+	struct reader reader;
+	const uint8_t *cie_end;
+	const char *augmentation;
+	size_t augmentation_length;
+	uint8_t version;
+
+	reader_init(&reader, cie, end, fde->delta);
+	cie_end = read_entry_length(&reader);
+	if (cie_end == NULL)
+		return false;
+
+	reader.end = cie_end;
+	if (read_u32(&reader) != 0)
+		return false;
+
+	version = read_u8(&reader);
+	if (version != 1 && version != 3 && version != 4)
+		return false;
+
+	augmentation = (const char *)reader.cursor;
+	augmentation_length = strnlen(augmentation, reader.end - reader.cursor);
+	if (augmentation_length == (size_t)(reader.end - reader.cursor))
+		return false;
+	reader.cursor += augmentation_length + 1;
+
+	/* Old GCC "eh" augmentation carries a pointer we don't need. */
+	if (strncmp(augmentation, "eh", 2) == 0) {
+		read_address(&reader);
+		augmentation += 2;
+	}
+
+	if (version == 4) {
+		/* address_size and segment_selector_size */
+		read_u8(&reader);
+		if (read_u8(&reader) != 0)
+			return false;
+	}
+
+	fde->code_alignment = read_uleb128(&reader);
+	fde->data_alignment = read_sleb128(&reader);
+	fde->ra_register = (version == 1) ? read_u8(&reader) :
+	    read_uleb128(&reader);
+	fde->pointer_encoding = DW_EH_PE_absptr;
+	fde->signal_frame = false;
+	*augmented = augmentation[0] == 'z';
+
+	if (augmentation[0] == 'z') {
+		uint64_t length = read_uleb128(&reader);
+		const uint8_t *data_end;
+
+		if (reader.error == true ||
+		    length > (uint64_t)(reader.end - reader.cursor))
+			return false;
+		data_end = reader.cursor + length;
+
+		for (const char *c = augmentation + 1; *c != '\0'; c++) {
+			uint8_t encoding;
+
+			switch (*c) {
+			case 'L':
+				read_u8(&reader);
+				break;
+			case 'P':
+				encoding = read_u8(&reader);
+				read_encoded(&reader,
+				    encoding & ~DW_EH_PE_indirect);
+				break;
+			case 'R':
+				fde->pointer_encoding = read_u8(&reader);
+				break;
+			case 'S':
+				fde->signal_frame = true;
+				break;
+			default:
+				/* 'B', 'G' and unknown ones carry no data. */
+				break;
+			}
+		}
+
+		reader.cursor = data_end;
+	} else if (augmentation[0] != '\0') {
+		/* Without 'z' we cannot skip unknown augmentations. */
+		return false;
+	}
+
+	if (reader.error == true)
+		return false;
+
+	fde->cie_instructions = reader.cursor;
+	fde->cie_instructions_end = cie_end;
+	return true;
+}
+
+bool
+bun_dwarf_fde_parse(const uint8_t *entry, const uint8_t *end, intptr_t delta,
+    struct bun_dwarf_fde *fde)
+{
+	struct reader reader;
+	const uint8_t *fde_end;
+	const uint8_t *cie;
+	uint32_t cie_offset;
+	uintptr_t range;
+	bool augmented;
+
+	memset(fde, 0, sizeof(*fde));
+	fde->delta = delta;
+
+	reader_init(&reader, entry, end, delta);
+	fde_end = read_entry_length(&reader);
+	if (fde_end == NULL)
+		return false;
+
+	reader.end = fde_end;
+	cie = reader.cursor;
+	cie_offset = read_u32(&reader);
+	if (cie_offset == 0 || reader.error == true)
+		return false;
+
+	/* The CIE pointer is relative to the field itself and points back. */
+	if ((uintptr_t)cie < cie_offset)
+		return false;
+	cie -= cie_offset;
+
+	if (parse_cie(cie, end, fde, &augmented) == false)
+		return false;
+
+	fde->pc_begin = read_encoded(&reader, fde->pointer_encoding);
+	range = read_encoded(&reader, fde->pointer_encoding & 0x0f);
+	fde->pc_end = fde->pc_begin + range;
+
+	if (augmented == true) {
+		uint64_t length = read_uleb128(&reader);
+
+		if (length > (uint64_t)(reader.end - reader.cursor))
+			return false;
+		reader.cursor += length;
+	}
+
+	if (reader.error == true)
+		return false;
+
+	fde->instructions = reader.cursor;
+	fde->instructions_end = fde_end;
+	return true;
+}
+
+bool
+bun_dwarf_fde_find(const uint8_t *eh_frame_hdr, size_t size, intptr_t delta,
+    uintptr_t pc, struct bun_dwarf_fde *fde)
+{
+	struct reader reader;
+	const int32_t *table;
+	uintptr_t base = (uintptr_t)eh_frame_hdr + delta;
+	uintptr_t count;
+	size_t low, high;
+	uint8_t eh_frame_ptr_encoding, count_encoding, table_encoding;
+
+	if (eh_frame_hdr == NULL)
+		return false;
+
+	reader_init(&reader, eh_frame_hdr, eh_frame_hdr + size, delta);
+	reader.datarel_base = base;
+
+	if (read_u8(&reader) != 1)
+		return false;
+
+	eh_frame_ptr_encoding = read_u8(&reader);
+	count_encoding = read_u8(&reader);
+	table_encoding = read_u8(&reader);
+	read_encoded(&reader, eh_frame_ptr_encoding);
+	count = read_encoded(&reader, count_encoding);
+
+	/*
+	 * Only the encoding emitted by all common linkers is supported, it
+	 * allows indexing the table directly.
+	 */
+	if (reader.error == true || count == 0 ||
+	    table_encoding != (DW_EH_PE_datarel | DW_EH_PE_sdata4))
+		return false;
+
+	if ((size_t)(reader.end - reader.cursor) / (2 * sizeof(int32_t)) < count)
+		return false;
+
+	table = (const int32_t *)reader.cursor;
+
+	/* Find the last entry whose initial location is not above pc. */
+	low = 0;
+	high = count;
+	while (high - low > 1) {
+		size_t mid = low + (high - low) / 2;
+		int32_t location;
+
+		memcpy(&location, &table[2 * mid], sizeof(location));
+		if (base + location <= pc)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	{
+		int32_t location, offset;
+
+		memcpy(&location, &table[2 * low], sizeof(location));
+		memcpy(&offset, &table[2 * low + 1], sizeof(offset));
+		if (base + location > pc)
+			return false;
+
+		/*
+		 * The table does not record the size of .eh_frame, entries are
+		 * bounded by their own length fields.
+		 */
+		if (bun_dwarf_fde_parse(eh_frame_hdr + offset,
+		    (const uint8_t *)UINTPTR_MAX, delta, fde) == false)
+			return false;
+	}
+
+	return pc >= fde->pc_begin && pc < fde->pc_end;
+}
+
+/*
+ * State of the call frame instruction interpreter.
+ */
+struct interpreter {
+	const struct bun_dwarf_fde *fde;
+	struct bun_dwarf_rules *rules;
+
+	/* Rules established by the CIE, for DW_CFA_restore. */
+	struct bun_dwarf_rules initial;
+	bool has_initial;
+
+	struct bun_dwarf_rules remembered[REMEMBER_STACK_DEPTH];
+	size_t remembered_count;
+
+	/* Stop once the location moves past target, unless fn is set. */
+	uintptr_t target;
+	bun_dwarf_row_fn *fn;
+	void *arg;
+	bool done;
+};
+
+static bool
+set_rule(struct interpreter *interpreter, uint64_t reg, uint8_t type,
+    intptr_t offset)
+{
+
+	/* Rules for registers we don't track (e.g. vector ones) are ignored. */
+	if (reg >= BUN_CURSOR_REGISTER_COUNT)
+		return true;
+
+	interpreter->rules->regs[reg].type = type;
+	interpreter->rules->regs[reg].offset = offset;
+	return true;
+}
+
+static bool
+restore_rule(struct interpreter *interpreter, uint64_t reg)
+{
+
+	if (interpreter->has_initial == false)
+		return false;
+
+	if (reg < BUN_CURSOR_REGISTER_COUNT)
+		interpreter->rules->regs[reg] = interpreter->initial.regs[reg];
+
+	return true;
+}
+
+/*
+ * Skips the length-prefixed expression at the reader's cursor and returns its
+ * start.
+ */
+static const uint8_t *
+skip_expression(struct reader *reader)
+{
+	const uint8_t *expression = reader->cursor;
+	uint64_t length = read_uleb128(reader);
+
+	if (reader->error == true ||
+	    length > (uint64_t)(reader->end - reader->cursor)) {
+		reader->error = true;
+		return NULL;
+	}
+
+	reader->cursor += length;
+	return expression;
+}
+
+static bool
+advance(struct interpreter *interpreter, uintptr_t location)
+{
+	struct bun_dwarf_rules *rules = interpreter->rules;
+
+	if (location <= rules->start)
+		return location == rules->start;
+
+	if (interpreter->fn != NULL) {
+		rules->end = location;
+		if (interpreter->fn(interpreter->arg, rules) == false)
+			return false;
+	} else if (location > interpreter->target) {
+		interpreter->done = true;
+		rules->end = location;
+		return true;
+	}
+
+	rules->start = location;
+	return true;
+}
+
+static bool
+execute(struct interpreter *interpreter, const uint8_t *start,
+    const uint8_t *end)
+{
+	const struct bun_dwarf_fde *fde = interpreter->fde;
+	struct bun_dwarf_rules *rules = interpreter->rules;
+	struct reader reader;
+
+	reader_init(&reader, start, end, fde->delta);
+	reader.funcrel_base = fde->pc_begin;
+
+	while (reader.cursor < reader.end && interpreter->done == false) {
+		const uint8_t opcode = read_u8(&reader);
+		const uint8_t operand = opcode & 0x3f;
+		uint64_t reg, value;
+		bool ok = true;
+
+		switch (opcode & 0xc0) {
+		case DW_CFA_advance_loc:
+			ok = advance(interpreter,
+			    rules->start + operand * fde->code_alignment);
+			break;
+		case DW_CFA_offset:
+			value = read_uleb128(&reader);
+			ok = set_rule(interpreter, operand,
+			    BUN_DWARF_RULE_OFFSET, value * fde->data_alignment);
+			break;
+		case DW_CFA_restore:
+			ok = restore_rule(interpreter, operand);
+			break;
+		default:
+			switch (opcode) {
+			case DW_CFA_nop:
+				break;
+			case DW_CFA_set_loc:
+				ok = advance(interpreter, read_encoded(&reader,
+				    fde->pointer_encoding));
+				break;
+			case DW_CFA_advance_loc1:
+				ok = advance(interpreter, rules->start +
+				    read_u8(&reader) * fde->code_alignment);
+				break;
+			case DW_CFA_advance_loc2:
+				ok = advance(interpreter, rules->start +
+				    read_u16(&reader) * fde->code_alignment);
+				break;
+			case DW_CFA_advance_loc4:
+				ok = advance(interpreter, rules->start +
+				    read_u32(&reader) * fde->code_alignment);
+				break;
+			case DW_CFA_offset_extended:
+				reg = read_uleb128(&reader);
+				value = read_uleb128(&reader);
+				ok = set_rule(interpreter, reg,
+				    BUN_DWARF_RULE_OFFSET,
+				    value * fde->data_alignment);
+				break;
+			case DW_CFA_offset_extended_sf:
+				reg = read_uleb128(&reader);
+				ok = set_rule(interpreter, reg,
+				    BUN_DWARF_RULE_OFFSET,
+				    read_sleb128(&reader) * fde->data_alignment);
+				break;
+			case DW_CFA_GNU_negative_offset_extended:
+				reg = read_uleb128(&reader);
+				value = read_uleb128(&reader);
+				ok = set_rule(interpreter, reg,
+				    BUN_DWARF_RULE_OFFSET,
+				    -(intptr_t)value * fde->data_alignment);
+				break;
+			case DW_CFA_val_offset:
+				reg = read_uleb128(&reader);
+				value = read_uleb128(&reader);
+				ok = set_rule(interpreter, reg,
+				    BUN_DWARF_RULE_VAL_OFFSET,
+				    value * fde->data_alignment);
+				break;
+			case DW_CFA_val_offset_sf:
+				reg = read_uleb128(&reader);
+				ok = set_rule(interpreter, reg,
+				    BUN_DWARF_RULE_VAL_OFFSET,
+				    read_sleb128(&reader) * fde->data_alignment);
+				break;
+			case DW_CFA_restore_extended:
+				ok = restore_rule(interpreter,
+				    read_uleb128(&reader));
+				break;
+			case DW_CFA_undefined:
+				ok = set_rule(interpreter, read_uleb128(&reader),
+				    BUN_DWARF_RULE_UNDEFINED, 0);
+				break;
+			case DW_CFA_same_value:
+				ok = set_rule(interpreter, read_uleb128(&reader),
+				    BUN_DWARF_RULE_SAME_VALUE, 0);
+				break;
+			case DW_CFA_register:
+				reg = read_uleb128(&reader);
+				value = read_uleb128(&reader);
+				ok = set_rule(interpreter, reg,
+				    BUN_DWARF_RULE_REGISTER, value);
+				break;
+			case DW_CFA_remember_state:
+				if (interpreter->remembered_count ==
+				    REMEMBER_STACK_DEPTH)
+					return false;
+				interpreter->remembered[
+				    interpreter->remembered_count++] = *rules;
+				break;
+			case DW_CFA_restore_state: {
+				uintptr_t location = rules->start;
+
+				if (interpreter->remembered_count == 0)
+					return false;
+				*rules = interpreter->remembered[
+				    --interpreter->remembered_count];
+				rules->start = location;
+				break;
+			}
+			case DW_CFA_def_cfa:
+				rules->cfa_register = read_uleb128(&reader);
+				rules->cfa_offset = read_uleb128(&reader);
+				rules->cfa_expression = NULL;
+				break;
+			case DW_CFA_def_cfa_sf:
+				rules->cfa_register = read_uleb128(&reader);
+				rules->cfa_offset = read_sleb128(&reader) *
+				    fde->data_alignment;
+				rules->cfa_expression = NULL;
+				break;
+			case DW_CFA_def_cfa_register:
+				rules->cfa_register = read_uleb128(&reader);
+				rules->cfa_expression = NULL;
+				break;
+			case DW_CFA_def_cfa_offset:
+				rules->cfa_offset = read_uleb128(&reader);
+				break;
+			case DW_CFA_def_cfa_offset_sf:
+				rules->cfa_offset = read_sleb128(&reader) *
+				    fde->data_alignment;
+				break;
+			case DW_CFA_def_cfa_expression:
+				rules->cfa_expression = skip_expression(&reader);
+				break;
+			case DW_CFA_expression:
+			case DW_CFA_val_expression:
+				reg = read_uleb128(&reader);
+				if (reg < BUN_CURSOR_REGISTER_COUNT) {
+					rules->regs[reg].type =
+					    opcode == DW_CFA_expression ?
+					    BUN_DWARF_RULE_EXPRESSION :
+					    BUN_DWARF_RULE_VAL_EXPRESSION;
+					rules->regs[reg].expression =
+					    skip_expression(&reader);
+				} else {
+					skip_expression(&reader);
+				}
+				break;
+			case DW_CFA_GNU_args_size:
+				read_uleb128(&reader);
+				break;
+			case DW_CFA_AARCH64_negate_ra_state:
+				/* Signed return addresses are masked instead. */
+				break;
+			default:
+				return false;
+			}
+		}
+
+		if (ok == false || reader.error == true)
+			return false;
+	}
+
+	return true;
+}
+
+static bool
+interpret(struct interpreter *interpreter, struct bun_dwarf_rules *rules)
+{
+	const struct bun_dwarf_fde *fde = interpreter->fde;
+
+	memset(rules, 0, sizeof(*rules));
+	rules->start = fde->pc_begin;
+	rules->end = fde->pc_end;
+	rules->ra_register = fde->ra_register;
+	rules->signal_frame = fde->signal_frame;
+	interpreter->rules = rules;
+
+	if (execute(interpreter, fde->cie_instructions,
+	    fde->cie_instructions_end) == false)
+		return false;
+
+	interpreter->initial = *rules;
+	interpreter->has_initial = true;
+
+	if (execute(interpreter, fde->instructions,
+	    fde->instructions_end) == false)
+		return false;
+
+	/* The last row extends to the end of the function. */
+	if (interpreter->done == false) {
+		rules->end = fde->pc_end;
+		if (interpreter->fn != NULL)
+			return interpreter->fn(interpreter->arg, rules);
+	}
+
+	return true;
+}
+
+bool
+bun_dwarf_rules_find(const struct bun_dwarf_fde *fde, uintptr_t pc,
+    struct bun_dwarf_rules *rules)
+{
+	struct interpreter interpreter;
+
+	if (pc < fde->pc_begin || pc >= fde->pc_end)
+		return false;
+
+	memset(&interpreter, 0, sizeof(interpreter));
+	interpreter.fde = fde;
+	interpreter.target = pc;
+	return interpret(&interpreter, rules);
+}
+
+bool
+bun_dwarf_rows(const struct bun_dwarf_fde *fde, bun_dwarf_row_fn *fn,
+    void *arg)
+{
+	struct interpreter interpreter;
+	struct bun_dwarf_rules rules;
+
+	memset(&interpreter, 0, sizeof(interpreter));
+	interpreter.fde = fde;
+	interpreter.fn = fn;
+	interpreter.arg = arg;
+	return interpret(&interpreter, &rules);
+}
+
+static bool
+read_register(const struct bun_cursor *cursor, uint64_t reg, uintptr_t *value)
+{
+
+	if (reg >= BUN_CURSOR_REGISTER_COUNT ||
+	    (cursor->regs_valid & BUN_CURSOR_REGISTER_BIT(reg)) == 0)
+		return false;
+
+	*value = cursor->regs[reg];
+	return true;
+}
+
+/*
+ * Reads `size` bytes from the stack, as a zero-extended value.
+ */
+static bool
+read_memory(struct bun_cursor *cursor, uintptr_t addr, size_t size,
+    uintptr_t *value)
+{
+	const size_t shift = addr % sizeof(uintptr_t);
+	uintptr_t word;
+
+	if (size == 0 || size > sizeof(uintptr_t) ||
+	    shift + size > sizeof(uintptr_t))
+		return false;
+
+	if (bun_cursor_read(cursor, addr - shift, &word) == false)
+		return false;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	word >>= shift * 8;
+#else
+	word >>= (sizeof(uintptr_t) - shift - size) * 8;
+#endif
+	if (size < sizeof(uintptr_t))
+		word &= ((uintptr_t)1 << (size * 8)) - 1;
+
+	*value = word;
+	return true;
+}
+
+/*
+ * Evaluates a length-prefixed DWARF expression in the context of the cursor's
+ * frame, with `initial` pushed on the stack.
+ */
+static bool
+evaluate(struct bun_cursor *cursor, const uint8_t *expression,
+    uintptr_t initial, bool push_initial, uintptr_t *result)
+{
+	uintptr_t stack[EXPRESSION_STACK_DEPTH];
+	size_t depth = 0;
+	struct reader reader;
+	uint64_t length;
+	size_t operations = 0;
+
+	reader_init(&reader, expression, (const uint8_t *)UINTPTR_MAX, 0);
+	length = read_uleb128(&reader);
+	reader.end = reader.cursor + length;
+
+	if (push_initial == true)
+		stack[depth++] = initial;
+
+#define PUSH(v) do {                                                          \
+	const uintptr_t value_ = (v);                                         \
+                                                                              \
+	if (depth == EXPRESSION_STACK_DEPTH)                                  \
+		return false;                                                 \
+	stack[depth++] = value_;                                              \
+} while (0)
+#define NEED(n) do { if (depth < (n)) return false; } while (0)
+#define BINARY(op) do {                                                       \
+	NEED(2);                                                              \
+	stack[depth - 2] = stack[depth - 2] op stack[depth - 1];              \
+	depth--;                                                              \
+} while (0)
+#define COMPARE(op) do {                                                      \
+	NEED(2);                                                              \
+	stack[depth - 2] = (intptr_t)stack[depth - 2] op                      \
+	    (intptr_t)stack[depth - 1];                                       \
+	depth--;                                                              \
+} while (0)
+
+	while (reader.cursor < reader.end) {
+		const uint8_t opcode = read_u8(&reader);
+		uintptr_t a, b;
+		uint64_t reg;
+
+		if (++operations > EXPRESSION_MAX_OPERATIONS)
+			return false;
+
+		if (opcode >= DW_OP_lit0 && opcode <= DW_OP_lit31) {
+			PUSH(opcode - DW_OP_lit0);
+			continue;
+		}
+
+		if (opcode >= DW_OP_breg0 && opcode <= DW_OP_breg31) {
+			intptr_t offset = read_sleb128(&reader);
+
+			if (read_register(cursor, opcode - DW_OP_breg0,
+			    &a) == false)
+				return false;
+			PUSH(a + offset);
+			continue;
+		}
+
+		switch (opcode) {
+		case DW_OP_addr:
+			PUSH(read_address(&reader));
+			break;
+		case DW_OP_deref:
+			NEED(1);
+			if (read_memory(cursor, stack[depth - 1],
+			    sizeof(uintptr_t), &stack[depth - 1]) == false)
+				return false;
+			break;
+		case DW_OP_deref_size:
+			NEED(1);
+			if (read_memory(cursor, stack[depth - 1],
+			    read_u8(&reader), &stack[depth - 1]) == false)
+				return false;
+			break;
+		case DW_OP_const1u:
+			PUSH(read_u8(&reader));
+			break;
+		case DW_OP_const1s:
+			PUSH((int8_t)read_u8(&reader));
+			break;
+		case DW_OP_const2u:
+			PUSH(read_u16(&reader));
+			break;
+		case DW_OP_const2s:
+			PUSH(read_s16(&reader));
+			break;
+		case DW_OP_const4u:
+			PUSH(read_u32(&reader));
+			break;
+		case DW_OP_const4s:
+			PUSH(read_s32(&reader));
+			break;
+		case DW_OP_const8u:
+			PUSH(read_u64(&reader));
+			break;
+		case DW_OP_const8s:
+			PUSH(read_s64(&reader));
+			break;
+		case DW_OP_constu:
+			PUSH(read_uleb128(&reader));
+			break;
+		case DW_OP_consts:
+			PUSH(read_sleb128(&reader));
+			break;
+		case DW_OP_dup:
+			NEED(1);
+			PUSH(stack[depth - 1]);
+			break;
+		case DW_OP_drop:
+			NEED(1);
+			depth--;
+			break;
+		case DW_OP_over:
+			NEED(2);
+			PUSH(stack[depth - 2]);
+			break;
+		case DW_OP_pick:
+			a = read_u8(&reader);
+			NEED(a + 1);
+			PUSH(stack[depth - 1 - a]);
+			break;
+		case DW_OP_swap:
+			NEED(2);
+			a = stack[depth - 1];
+			stack[depth - 1] = stack[depth - 2];
+			stack[depth - 2] = a;
+			break;
+		case DW_OP_rot:
+			NEED(3);
+			a = stack[depth - 1];
+			stack[depth - 1] = stack[depth - 2];
+			stack[depth - 2] = stack[depth - 3];
+			stack[depth - 3] = a;
+			break;
+		case DW_OP_abs:
+			NEED(1);
+			if ((intptr_t)stack[depth - 1] < 0)
+				stack[depth - 1] = -stack[depth - 1];
+			break;
+		case DW_OP_neg:
+			NEED(1);
+			stack[depth - 1] = -stack[depth - 1];
+			break;
+		case DW_OP_not:
+			NEED(1);
+			stack[depth - 1] = ~stack[depth - 1];
+			break;
+		case DW_OP_and:
+			BINARY(&);
+			break;
+		case DW_OP_or:
+			BINARY(|);
+			break;
+		case DW_OP_xor:
+			BINARY(^);
+			break;
+		case DW_OP_plus:
+			BINARY(+);
+			break;
+		case DW_OP_minus:
+			BINARY(-);
+			break;
+		case DW_OP_mul:
+			BINARY(*);
+			break;
+		case DW_OP_div:
+			NEED(2);
+			if (stack[depth - 1] == 0)
+				return false;
+			stack[depth - 2] = (intptr_t)stack[depth - 2] /
+			    (intptr_t)stack[depth - 1];
+			depth--;
+			break;
+		case DW_OP_mod:
+			NEED(2);
+			if (stack[depth - 1] == 0)
+				return false;
+			BINARY(%);
+			break;
+		case DW_OP_shl:
+			BINARY(<<);
+			break;
+		case DW_OP_shr:
+			BINARY(>>);
+			break;
+		case DW_OP_shra:
+			NEED(2);
+			stack[depth - 2] = (intptr_t)stack[depth - 2] >>
+			    stack[depth - 1];
+			depth--;
+			break;
+		case DW_OP_plus_uconst:
+			NEED(1);
+			stack[depth - 1] += read_uleb128(&reader);
+			break;
+		case DW_OP_eq:
+			COMPARE(==);
+			break;
+		case DW_OP_ne:
+			COMPARE(!=);
+			break;
+		case DW_OP_ge:
+			COMPARE(>=);
+			break;
+		case DW_OP_gt:
+			COMPARE(>);
+			break;
+		case DW_OP_le:
+			COMPARE(<=);
+			break;
+		case DW_OP_lt:
+			COMPARE(<);
+			break;
+		case DW_OP_skip:
+		case DW_OP_bra: {
+			int16_t offset = read_s16(&reader);
+
+			if (opcode == DW_OP_bra) {
+				NEED(1);
+				b = stack[--depth];
+				if (b == 0)
+					break;
+			}
+
+			if (offset < 0 && -offset > reader.cursor - expression)
+				return false;
+			reader.cursor += offset;
+			break;
+		}
+		case DW_OP_bregx:
+			reg = read_uleb128(&reader);
+			if (read_register(cursor, reg, &a) == false)
+				return false;
+			PUSH(a + read_sleb128(&reader));
+			break;
+		case DW_OP_nop:
+			break;
+		default:
+			return false;
+		}
+
+		if (reader.error == true)
+			return false;
+	}
+
+#undef COMPARE
+#undef BINARY
+#undef NEED
+#undef PUSH
+
+	if (depth == 0 || reader.cursor != reader.end)
+		return false;
+
+	*result = stack[depth - 1];
+	return true;
+}
+
+bool
+bun_dwarf_step(const struct bun_dwarf_rules *rules, struct bun_cursor *cursor)
+{
+	uintptr_t regs[BUN_CURSOR_REGISTER_COUNT];
+	uint64_t valid = 0;
+	uintptr_t cfa, ra;
+
+	if (rules->cfa_expression != NULL) {
+		if (evaluate(cursor, rules->cfa_expression, 0, false,
+		    &cfa) == false)
+			return false;
+	} else {
+		if (read_register(cursor, rules->cfa_register, &cfa) == false)
+			return false;
+		cfa += rules->cfa_offset;
+	}
+
+	for (size_t i = 0; i < BUN_CURSOR_REGISTER_COUNT; i++) {
+		const struct bun_dwarf_rule *rule = &rules->regs[i];
+		const uint64_t bit = BUN_CURSOR_REGISTER_BIT(i);
+		uintptr_t addr;
+		bool ok = true;
+
+		switch (rule->type) {
+		case BUN_DWARF_RULE_UNSPECIFIED:
+			if (i == BUN_CURSOR_REGISTER_SP) {
+				regs[i] = cfa;
+				valid |= bit;
+				continue;
+			}
+			/* FALLTHROUGH */
+		case BUN_DWARF_RULE_SAME_VALUE:
+			regs[i] = cursor->regs[i];
+			valid |= cursor->regs_valid & bit;
+			continue;
+		case BUN_DWARF_RULE_UNDEFINED:
+			continue;
+		case BUN_DWARF_RULE_OFFSET:
+			ok = bun_cursor_read(cursor, cfa + rule->offset,
+			    &regs[i]);
+			break;
+		case BUN_DWARF_RULE_VAL_OFFSET:
+			regs[i] = cfa + rule->offset;
+			break;
+		case BUN_DWARF_RULE_REGISTER:
+			ok = read_register(cursor, rule->reg, &regs[i]);
+			break;
+		case BUN_DWARF_RULE_EXPRESSION:
+			ok = evaluate(cursor, rule->expression, cfa, true,
+			    &addr) && bun_cursor_read(cursor, addr, &regs[i]);
+			break;
+		case BUN_DWARF_RULE_VAL_EXPRESSION:
+			ok = evaluate(cursor, rule->expression, cfa, true,
+			    &regs[i]);
+			break;
+		default:
+			ok = false;
+			break;
+		}
+
+		/* Registers we fail to recover are unknown in the caller. */
+		if (ok == true)
+			valid |= bit;
+	}
+
+	/* An undefined return address marks the outermost frame. */
+	if (rules->ra_register >= BUN_CURSOR_REGISTER_COUNT ||
+	    (valid & BUN_CURSOR_REGISTER_BIT(rules->ra_register)) == 0)
+		return false;
+
+	ra = regs[rules->ra_register] & RETURN_ADDRESS_MASK;
+	if (ra == 0)
+		return false;
+
+	if (ra == cursor->pc && regs[BUN_CURSOR_REGISTER_SP] ==
+	    bun_cursor_sp(cursor))
+		return false;
+
+	if (bun_cursor_advance(cursor, regs[BUN_CURSOR_REGISTER_SP]) == false)
+		return false;
+
+	cursor->pc = ra;
+	memcpy(cursor->regs, regs, sizeof(regs));
+	cursor->regs_valid = valid;
+
+	/*
+	 * Signal trampolines resume the interrupted instruction, so the
+	 * caller's pc is exact rather than a return address.
+	 */
+	cursor->return_address = rules->signal_frame == false;
+	return true;
+}
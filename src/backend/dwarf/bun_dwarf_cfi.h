@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../../bun_cursor.h"
+
+/*
+ * DWARF call frame information interpreter.
+ *
+ * The interpreter never allocates and keeps no global state: every function
+ * works on caller-provided structures, so any number of threads can use it
+ * concurrently, including from signal handlers.
+ *
+ * Unwind sections are read through local pointers. `delta` is the value to
+ * add to a local pointer to obtain the address the section is loaded at in
+ * the unwound process, which is needed to decode PC-relative pointers. It is
+ * zero for objects loaded into the current process.
+ */
+
+enum bun_dwarf_rule_type {
+	/* No rule given: same value, except for the stack pointer (CFA). */
+	BUN_DWARF_RULE_UNSPECIFIED = 0,
+	BUN_DWARF_RULE_UNDEFINED,
+	BUN_DWARF_RULE_SAME_VALUE,
+	BUN_DWARF_RULE_OFFSET,
+	BUN_DWARF_RULE_VAL_OFFSET,
+	BUN_DWARF_RULE_REGISTER,
+	BUN_DWARF_RULE_EXPRESSION,
+	BUN_DWARF_RULE_VAL_EXPRESSION
+};
+
+struct bun_dwarf_rule {
+	uint8_t type;
+	union {
+		intptr_t offset;
+		uintptr_t reg;
+		/* ULEB128 length followed by the expression bytes. */
+		const uint8_t *expression;
+	};
+};
+
+/*
+ * A row of the call frame table: how to compute the CFA and the caller's
+ * registers for the pc range [start, end).
+ */
+struct bun_dwarf_rules {
+	uintptr_t start;
+	uintptr_t end;
+
+	/* The CFA is either register + offset, or an expression if not NULL. */
+	uintptr_t cfa_register;
+	intptr_t cfa_offset;
+	const uint8_t *cfa_expression;
+
+	struct bun_dwarf_rule regs[BUN_CURSOR_REGISTER_COUNT];
+	uintptr_t ra_register;
+	bool signal_frame;
+};
+
+/*
+ * A frame description entry along with the relevant fields of its CIE.
+ */
+struct bun_dwarf_fde {
+	uintptr_t pc_begin;
+	uintptr_t pc_end;
+	const uint8_t *instructions;
+	const uint8_t *instructions_end;
+	const uint8_t *cie_instructions;
+	const uint8_t *cie_instructions_end;
+	uintptr_t code_alignment;
+	intptr_t data_alignment;
+	uintptr_t ra_register;
+	uint8_t pointer_encoding;
+	bool signal_frame;
+	intptr_t delta;
+};
+
+/*
+ * Looks up the FDE covering `pc` with a binary search of the sorted table in
+ * the .eh_frame_hdr section.
+ *
+ * Returns false if there is no such FDE or the section cannot be searched.
+ */
+bool bun_dwarf_fde_find(const uint8_t *eh_frame_hdr, size_t size,
+    intptr_t delta, uintptr_t pc, struct bun_dwarf_fde *fde);
+
+/*
+ * Parses the .eh_frame entry at `entry`, which must end before `end`.
+ *
+ * Returns false if the entry is a CIE, the terminator or malformed.
+ */
+bool bun_dwarf_fde_parse(const uint8_t *entry, const uint8_t *end,
+    intptr_t delta, struct bun_dwarf_fde *fde);
+
+/*
+ * Returns the .eh_frame entry following `entry`, or NULL if `entry` is the
+ * terminator or does not end before `end`.
+ */
+const uint8_t *bun_dwarf_entry_next(const uint8_t *entry, const uint8_t *end);
+
+/*
+ * Computes the row of the call frame table that applies to `pc`.
+ *
+ * Returns false if the instructions are malformed or unsupported.
+ */
+bool bun_dwarf_rules_find(const struct bun_dwarf_fde *fde, uintptr_t pc,
+    struct bun_dwarf_rules *rules);
+
+/*
+ * Callback used by bun_dwarf_rows(). Returning false stops the iteration.
+ */
+typedef bool (bun_dwarf_row_fn)(void *, const struct bun_dwarf_rules *);
+
+/*
+ * Calls `fn` for every row of the call frame table described by the FDE.
+ *
+ * Returns false if the instructions are malformed, unsupported or if the
+ * callback stopped the iteration.
+ */
+bool bun_dwarf_rows(const struct bun_dwarf_fde *fde, bun_dwarf_row_fn *fn,
+    void *arg);
+
+/*
+ * Applies the rules to the cursor, moving it to the caller's frame.
+ *
+ * Returns false if this is the outermost frame or the rules cannot be
+ * applied to the cursor's registers and stack.
+ */
+bool bun_dwarf_step(const struct bun_dwarf_rules *rules,
+    struct bun_cursor *cursor);
@@ -0,0 +1,274 @@
+#include "bun_dwarf_remote.h"
+
+#include <elf.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bun/bun.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_maps.h"
+#include "../../bun_memory.h"
+#include "../../bun_object_cache.h"
+#include "bun_dwarf.h"
+#if defined(BUN_FRAMEPOINTER_ENABLED)
+#include "../framepointer/bun_framepointer.h"
+#endif /* BUN_FRAMEPOINTER_ENABLED */
+
+/* Upper bounds of what is read from the target to find a build-id. */
+#define REMOTE_PHDRS_MAX 64
+#define REMOTE_NOTES_MAX 1024
+#define REMOTE_BUILD_ID_MAX 64
+
+/* A module and its object, kept together while sorting. */
+struct remote_entry {
+	struct bun_module module;
+	struct bun_object *object;
+};
+
+static int
+compare_entries(const void *a, const void *b)
+{
+	const struct remote_entry *lhs = a;
+	const struct remote_entry *rhs = b;
+
+	if (lhs->module.start < rhs->module.start)
+		return -1;
+
+	return lhs->module.start > rhs->module.start;
+}
+
+/*
+ * Copies the build-id of the object mapped at `base` in the process `pid`
+ * from its memory.
+ *
+ * Returns false if the object has none or it cannot be read.
+ */
+static bool
+remote_build_id(pid_t pid, uintptr_t base, uint8_t *build_id,
+    size_t *build_id_size)
+{
+	ElfW(Phdr) phdrs[REMOTE_PHDRS_MAX];
+	uint8_t notes[REMOTE_NOTES_MAX];
+	ElfW(Ehdr) ehdr;
+	uintptr_t bias = 0;
+	bool biased = false;
+
+	if (bun_memory_read(pid, &ehdr, base, sizeof(ehdr)) == false ||
+	    memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 ||
+	    ehdr.e_phnum > REMOTE_PHDRS_MAX)
+		return false;
+
+	if (bun_memory_read(pid, phdrs, base + ehdr.e_phoff,
+	    ehdr.e_phnum * sizeof(*phdrs)) == false)
+		return false;
+
+	for (size_t i = 0; i < ehdr.e_phnum && biased == false; i++) {
+		if (phdrs[i].p_type != PT_LOAD)
+			continue;
+
+		/* The first segment is the one mapped at `base`. */
+		bias = base - (phdrs[i].p_vaddr - phdrs[i].p_offset);
+		biased = true;
+	}
+
+	for (size_t i = 0; i < ehdr.e_phnum && biased == true; i++) {
+		size_t size = phdrs[i].p_filesz;
+		const uint8_t *found;
+		size_t found_size;
+
+		if (phdrs[i].p_type != PT_NOTE)
+			continue;
+
+		/* The build-id note comes first in practice. */
+		if (size > sizeof(notes))
+			size = sizeof(notes);
+
+		if (bun_memory_read(pid, notes, bias + phdrs[i].p_vaddr,
+		    size) == false ||
+		    bun_build_id_find(notes, size, &found,
+		    &found_size) == false || found_size > REMOTE_BUILD_ID_MAX)
+			continue;
+
+		memcpy(build_id, found, found_size);
+		*build_id_size = found_size;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Loads the object of the file mapped by `map` in the process `pid`. The file
+ * is opened through the mapping itself, which also works for deleted files,
+ * else below the root directory of the process, so that paths are resolved
+ * in its mount namespace rather than ours. The former needs privileges, the
+ * latter only the ptrace access the maps were read with. The path as seen by
+ * this process is the last resort.
+ */
+static struct bun_object *
+remote_object_get(pid_t pid, const struct bun_maps_entry *map,
+    struct bun_object_cache *cache)
+{
+	uint8_t build_id[REMOTE_BUILD_ID_MAX];
+	const uint8_t *id = NULL;
+	size_t build_id_size = 0;
+	struct bun_object *object;
+	char path[PATH_MAX];
+	int written;
+
+	/* Objects without a build-id are not shared. */
+	if (remote_build_id(pid, map->start, build_id, &build_id_size) == true)
+		id = build_id;
+
+	written = snprintf(path, sizeof(path),
+	    "/proc/%d/map_files/%" PRIxPTR "-%" PRIxPTR, (int)pid,
+	    map->start, map->end);
+	if (written > 0 && (size_t)written < sizeof(path)) {
+		object = bun_object_get(cache, path, id, build_id_size);
+		if (object != NULL)
+			return object;
+	}
+
+	written = snprintf(path, sizeof(path), "/proc/%d/root%s", (int)pid,
+	    map->path);
+	if (written > 0 && (size_t)written < sizeof(path)) {
+		object = bun_object_get(cache, path, id, build_id_size);
+		if (object != NULL)
+			return object;
+	}
+
+	return bun_object_get(cache, map->path, id, build_id_size);
+}
+
+bool
+bun_dwarf_remote_init(struct bun_dwarf_remote *remote, struct bun_maps *maps,
+    struct bun_object_cache *cache)
+{
+	struct remote_entry *entries;
+	size_t loaded = 0;
+
+	memset(remote, 0, sizeof(*remote));
+	remote->maps = maps;
+
+	entries = calloc(maps->count + 1, sizeof(*entries));
+	if (entries == NULL)
+		return false;
+
+	for (size_t i = 0; i < maps->count; i++) {
+		const struct bun_maps_entry *map = &maps->entries[i];
+		struct remote_entry *entry = &entries[loaded];
+		bool duplicate = false;
+
+		if (map->offset != 0 || map->path == NULL)
+			continue;
+
+		for (size_t j = 0; j < loaded; j++)
+			duplicate |= strcmp(entries[j].module.path,
+			    map->path) == 0;
+
+		if (duplicate == true)
+			continue;
+
+		entry->object = remote_object_get(maps->stamp.pid, map, cache);
+		if (entry->object == NULL)
+			continue;
+
+		if (bun_object_module(entry->object, map->path, map->start,
+		    &entry->module) == false) {
+			bun_object_release(entry->object);
+			continue;
+		}
+
+		loaded++;
+	}
+
+	qsort(entries, loaded, sizeof(*entries), compare_entries);
+
+	remote->modules.modules = calloc(loaded + 1,
+	    sizeof(*remote->modules.modules));
+	remote->objects = calloc(loaded + 1, sizeof(*remote->objects));
+	if (remote->modules.modules == NULL || remote->objects == NULL) {
+		for (size_t i = 0; i < loaded; i++)
+			bun_object_release(entries[i].object);
+		free(entries);
+		return false;
+	}
+
+	for (size_t i = 0; i < loaded; i++) {
+		remote->modules.modules[i] = entries[i].module;
+		remote->objects[i] = entries[i].object;
+	}
+
+	remote->modules.count = loaded;
+	free(entries);
+	return true;
+}
+
+void
+bun_dwarf_remote_deinit(struct bun_dwarf_remote *remote)
+{
+
+	for (size_t i = 0; i < remote->modules.count; i++)
+		bun_object_release(remote->objects[i]);
+
+	free(remote->objects);
+	bun_module_table_deinit(&remote->modules);
+	if (remote->maps != NULL)
+		bun_maps_release(remote->maps);
+
+	memset(remote, 0, sizeof(*remote));
+	return;
+}
+
+bool
+bun_dwarf_remote_write_frame(const struct bun_dwarf_remote *remote,
+    const struct bun_cursor *cursor, struct bun_writer *writer,
+    const struct bun_handle *handle)
+{
+	const struct bun_object_symbol *symbol = NULL;
+	const struct bun_module *module;
+	uintptr_t pc = cursor->pc;
+
+	if (cursor->return_address == true)
+		pc--;
+
+	if ((handle->flags & BUN_HANDLE_SKIP_SYMBOLS) != 0)
+		return bun_cursor_write_frame_symbol(cursor, writer, NULL, NULL,
+		    0);
+
+	module = bun_module_table_find(&remote->modules, pc);
+	if (module == NULL)
+		return bun_cursor_write_frame_symbol(cursor, writer, NULL, NULL,
+		    0);
+
+	symbol = bun_object_symbol_find(remote->objects[module -
+	    remote->modules.modules], pc - module->bias);
+	return bun_cursor_write_frame_symbol(cursor, writer,
+	    symbol != NULL ? symbol->name : NULL, module->path,
+	    symbol != NULL ? cursor->pc - module->bias - symbol->start : 0);
+}
+
+bool
+bun_dwarf_remote_step(const struct bun_dwarf_remote *remote,
+    struct bun_cursor *cursor)
+{
+	uintptr_t pc = cursor->pc;
+
+	if (cursor->return_address == true)
+		pc--;
+
+	if (bun_module_table_find(&remote->modules, pc) != NULL)
+		return bun_internal_dwarf_step(&remote->modules, cursor);
+
+#if defined(BUN_FRAMEPOINTER_ENABLED)
+	/* The object could not be loaded, its frame may have a record. */
+	return bun_internal_framepointer_step(cursor);
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "../../bun_modules.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+struct bun_cursor;
+struct bun_handle;
+struct bun_maps;
+struct bun_object;
+struct bun_object_cache;
+struct bun_writer;
+
+/*
+ * The objects mapped by another process, loaded from their files to unwind
+ * its threads with the DWARF backend. It is valid as long as the maps of the
+ * process do not change. objects[i] backs modules.modules[i], whose paths
+ * point into the maps.
+ */
+struct bun_dwarf_remote {
+	struct bun_maps *maps;
+	struct bun_module_table modules;
+	struct bun_object **objects;
+};
+
+/*
+ * Bytes of unused objects kept by the object cache of the handles unwinding
+ * other processes with the DWARF backend.
+ */
+#define BUN_DWARF_REMOTE_CACHE_LIMIT (128UL << 20)
+
+/*
+ * Loads the objects mapped in `maps`, each through the mapping of its first
+ * page, from the files as seen by the process. Objects whose build-id can be
+ * read from the memory of the process must have the same one on disk, and are
+ * looked up in `cache` first. Takes ownership of `maps`, which is released by
+ * bun_dwarf_remote_deinit() even if this function fails.
+ *
+ * Returns false if the memory for the module table cannot be allocated.
+ */
+bool bun_dwarf_remote_init(struct bun_dwarf_remote *remote,
+    struct bun_maps *maps, struct bun_object_cache *cache);
+
+void bun_dwarf_remote_deinit(struct bun_dwarf_remote *remote);
+
+/*
+ * Writes the frame of the cursor, symbolized with the loaded objects unless
+ * the handle has BUN_HANDLE_SKIP_SYMBOLS set.
+ */
+bool bun_dwarf_remote_write_frame(const struct bun_dwarf_remote *remote,
+    const struct bun_cursor *cursor, struct bun_writer *writer,
+    const struct bun_handle *handle);
+
+/*
+ * Moves the cursor to the caller's frame with the unwind information of the
+ * loaded objects, falling back to the frame pointer chain for code outside of
+ * them if the frame pointer backend is built.
+ */
+bool bun_dwarf_remote_step(const struct bun_dwarf_remote *remote,
+    struct bun_cursor *cursor);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,156 @@
+#include "bun_framepointer.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_internal.h"
+
+#if defined(__aarch64__)
+/*
+ * Return addresses may carry a pointer authentication code in the bits above
+ * the virtual address.
+ */
+#define RETURN_ADDRESS_MASK 0x0000ffffffffffffULL
+#else
+#define RETURN_ADDRESS_MASK UINTPTR_MAX
+#endif
+
+struct bun_framepointer_context {
+	size_t stack_limit;
+};
+
+static size_t framepointer_unwind(struct bun_handle *handle,
+    struct bun_buffer *buffer);
+static size_t framepointer_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context);
+static size_t framepointer_unwind_impl(struct bun_cursor *cursor,
+    struct bun_handle *handle, struct bun_buffer *buffer);
+static void destroy_handle(struct bun_handle *handle);
+
+bool
+bun_internal_initialize_framepointer(struct bun_handle *handle)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+	struct bun_framepointer_context *context;
+
+	context = malloc(sizeof(struct bun_framepointer_context));
+	if (context == NULL)
+		return false;
+
+	context->stack_limit = bun_cursor_stack_limit();
+
+	handle->backend_context = context;
+	handle->unwind = framepointer_unwind;
+	handle->unwind_context = framepointer_unwind_context;
+	handle->destroy = destroy_handle;
+	return true;
+#else
+	/* The frame record layout is not fixed by the ABI on other targets. */
+	(void) handle;
+	return false;
+#endif
+}
+
+bool
+bun_internal_framepointer_step(struct bun_cursor *cursor)
+{
+	const uintptr_t fp = bun_cursor_fp(cursor);
+	uintptr_t next_fp, ra;
+
+	/*
+	 * The frame record is {saved frame pointer, return address} on all
+	 * supported architectures. Moving the lower stack bound past it on
+	 * every step makes the walk strictly monotonic, so a cyclic chain
+	 * cannot keep us looping.
+	 */
+	if (bun_cursor_advance(cursor, fp) == false)
+		return false;
+
+	if (bun_cursor_read(cursor, fp, &next_fp) == false)
+		return false;
+
+	if (bun_cursor_read(cursor, fp + sizeof(uintptr_t), &ra) == false)
+		return false;
+
+	ra &= RETURN_ADDRESS_MASK;
+	if (ra == 0)
+		return false;
+
+	if (bun_cursor_advance(cursor, fp + 2 * sizeof(uintptr_t)) == false)
+		return false;
+
+	/* Only the frame and stack pointers are recovered by this walk. */
+	cursor->pc = ra;
+	cursor->regs[BUN_CURSOR_REGISTER_SP] = fp + 2 * sizeof(uintptr_t);
+	cursor->regs[BUN_CURSOR_REGISTER_FP] = next_fp;
+	cursor->regs_valid = BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_SP) |
+	    BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_FP);
+	cursor->return_address = true;
+	return true;
+}
+
+static size_t __attribute__((noinline))
+framepointer_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
+{
+	struct bun_framepointer_context *context = handle->backend_context;
+	struct bun_cursor cursor;
+	uintptr_t fp = (uintptr_t)__builtin_frame_address(0);
+
+	bun_cursor_init(&cursor, 0, fp, fp, context->stack_limit);
+
+	/* Skip the frame of this function. */
+	if (bun_internal_framepointer_step(&cursor) == false)
+		return 0;
+
+	return framepointer_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+framepointer_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context)
+{
+	struct bun_framepointer_context *fp_context = handle->backend_context;
+	struct bun_cursor cursor;
+
+	if (bun_cursor_init_context(&cursor, context,
+	    fp_context->stack_limit) == false)
+		return 0;
+
+	return framepointer_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+framepointer_unwind_impl(struct bun_cursor *cursor, struct bun_handle *handle,
+    struct bun_buffer *buffer)
+{
+	struct bun_writer writer;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		return 0;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_FRAMEPOINTER);
+	bun_header_tid_set(&writer, bun_gettid());
+
+	do {
+		if (bun_cursor_write_frame(cursor, &writer, handle) == false)
+			return 0;
+	} while (bun_internal_framepointer_step(cursor) == true);
+
+	return hdr->size;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+
+	free(handle->backend_context);
+	return;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <bun/bun.h>
+
+struct bun_cursor;
+
+/*
+ * Initialize the frame pointer handler backend. This function is only meant
+ * for internal use.
+ */
+bool bun_internal_initialize_framepointer(struct bun_handle *handle);
+
+/*
+ * Moves the cursor to the caller's frame by following the saved frame pointer.
+ * This function is only meant for internal use.
+ *
+ * Returns false if the chain ends or fails validation.
+ */
+bool bun_internal_framepointer_step(struct bun_cursor *cursor);
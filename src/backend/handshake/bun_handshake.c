@@ -0,0 +1,910 @@
+#define _GNU_SOURCE
+#include "bun_handshake.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/futex.h>
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <bun/core.h>
+#include <bun/handshake.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_internal.h"
+#include "../../bun_maps.h"
+#include "../../bun_memory.h"
+#include "../dwarf/bun_dwarf_remote.h"
+
+#ifndef PR_SET_PTRACER
+#define PR_SET_PTRACER 0x59616d61
+#endif
+
+#ifndef PR_SET_PTRACER_ANY
+#define PR_SET_PTRACER_ANY ((unsigned long)-1)
+#endif
+
+/* Name of the memfd holding the region, as seen in /proc/<pid>/fd. */
+#define HANDSHAKE_NAME "bun-handshake"
+
+#define HANDSHAKE_MAGIC 0x6b73686e7562ULL
+#define HANDSHAKE_VERSION 2
+
+/* Number of requests that can be in flight at once, for all monitors. */
+#define HANDSHAKE_SLOTS 64
+
+/* How long a thread has to answer. */
+#define HANDSHAKE_TIMEOUT_MS 1000
+
+/*
+ * A monitor holds a slot for at most two timeouts, slots held for longer
+ * were abandoned, e.g. by a monitor that crashed, and can be reclaimed.
+ */
+#define HANDSHAKE_STALE_MS (4 * HANDSHAKE_TIMEOUT_MS)
+
+/* How long a snapshot waits for the monitor before exiting on its own. */
+#define HANDSHAKE_SNAPSHOT_LIFETIME_S 10
+
+/* How long the handler waits for the snapshot to publish its pid. */
+#define HANDSHAKE_SNAPSHOT_WAIT_MS (HANDSHAKE_TIMEOUT_MS / 2)
+
+/* The monitor asks for a snapshot of the process, see snapshot_fork(). */
+#define SLOT_FLAG_FORK (1U << 0)
+
+/*
+ * A slot goes from FREE to CLAIMED and REQUESTED on the monitor side, then
+ * to WRITING and DONE in the signal handler of the thread, and back to FREE
+ * once the monitor has copied the registers. A monitor giving up moves it
+ * from REQUESTED back to FREE, so that a late handler leaves it alone.
+ *
+ * The state word also holds the generation of the request, which is bumped
+ * by every claim. A slot left in another state than FREE for longer than
+ * HANDSHAKE_STALE_MS can be claimed again, and the handler of the abandoned
+ * request then fails to move it to DONE.
+ */
+#define SLOT_STATE_MASK 0xffU
+#define SLOT_GENERATION 0x100U
+
+enum handshake_state {
+	SLOT_FREE = 0,
+	SLOT_CLAIMED,
+	SLOT_REQUESTED,
+	SLOT_WRITING,
+	SLOT_DONE
+};
+
+struct handshake_slot {
+	/* The futex the monitor waits on. */
+	uint32_t state;
+	uint32_t flags;
+	pid_t tid;
+
+	/*
+	 * Written by the snapshot itself once it may be traced, the futex
+	 * the handler waits on. -1 if there is none, see snapshot_fork().
+	 */
+	pid_t snapshot;
+
+	/* Generation of the request and when it was claimed, see now_ms(). */
+	uint64_t claimed;
+	uintptr_t pc;
+	uintptr_t regs[BUN_CURSOR_REGISTER_COUNT];
+	uint64_t regs_valid;
+	uintptr_t stack_low;
+	uintptr_t stack_high;
+};
+
+/*
+ * Layout of the shared region. The magic is written last.
+ */
+struct handshake_region {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t word_size;
+	int32_t signal;
+	uint32_t slot_count;
+	struct handshake_slot slots[HANDSHAKE_SLOTS];
+};
+
+/*
+ * What is known of the process being unwound, valid as long as its maps do
+ * not change.
+ */
+struct handshake_target {
+	struct bun_dwarf_remote remote;
+	struct handshake_region *region;
+	unsigned int references;
+};
+
+/*
+ * The targets are kept for the processes whose maps are cached, so that
+ * alternating between processes does not load their objects again.
+ */
+struct bun_handshake_context {
+	pthread_mutex_t lock;
+	struct bun_maps_cache maps;
+	struct bun_maps_table table;
+	struct handshake_target *targets[BUN_MAPS_CACHE_SIZE];
+
+	/* Objects shared by the targets, and kept across their reloads. */
+	struct bun_object_cache *objects;
+};
+
+/*
+ * Waits for up to `ms` milliseconds unless `word` has changed from `value`.
+ * The region is a shared mapping, so the futex is not private.
+ */
+static void
+futex_wait(void *word, uint32_t value, unsigned long ms)
+{
+	struct timespec timeout = { ms / 1000, ms % 1000 * 1000000L };
+
+	syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0);
+	return;
+}
+
+static void
+futex_wake(void *word)
+{
+
+	syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+	return;
+}
+
+/* Target side. */
+static struct handshake_region *handshake_region;
+static size_t handshake_stack_limit;
+static pid_t handshake_reader;
+
+static size_t handshake_unwind_remote(struct bun_handle *handle,
+    struct bun_buffer *buffer, pid_t tid);
+static void destroy_handle(struct bun_handle *handle);
+
+/*
+ * Runs in the snapshot until the monitor kills it. The pid is published only
+ * once the monitor is allowed to read the snapshot, and the snapshot exits
+ * if the handler or the monitor gave up on it already.
+ */
+static void
+snapshot_wait(struct handshake_slot *slot)
+{
+	struct timespec lifetime = { HANDSHAKE_SNAPSHOT_LIFETIME_S, 0 };
+	pid_t expected = 0;
+	sigset_t set;
+
+	sigfillset(&set);
+	sigprocmask(SIG_SETMASK, &set, NULL);
+
+	/* Yama exceptions are not inherited. */
+	if (handshake_reader != 0)
+		prctl(PR_SET_PTRACER, handshake_reader == -1 ?
+		    PR_SET_PTRACER_ANY : (unsigned long)handshake_reader, 0, 0,
+		    0);
+
+	if (__atomic_compare_exchange_n(&slot->snapshot, &expected,
+	    (pid_t)syscall(SYS_getpid), false, __ATOMIC_RELEASE,
+	    __ATOMIC_RELAXED) == false)
+		_exit(0);
+
+	futex_wake(&slot->snapshot);
+	while (nanosleep(&lifetime, &lifetime) == -1 && errno == EINTR)
+		;
+
+	_exit(0);
+}
+
+/*
+ * Forks a frozen copy of the process, which stores its pid into the slot.
+ * Called from the signal handler, so the atfork handlers are skipped by
+ * calling clone(2) directly. The copy is forked by an intermediate process
+ * that exits right away, so that it is reparented and reaped without the
+ * application noticing; the intermediate has no exit signal either.
+ */
+static void
+snapshot_fork(struct handshake_slot *slot)
+{
+	struct timespec start, now;
+	pid_t child, expected = 0;
+	unsigned long elapsed;
+
+	child = syscall(SYS_clone, 0, 0, 0, 0, 0);
+	if (child == -1) {
+		__atomic_store_n(&slot->snapshot, -1, __ATOMIC_RELEASE);
+		return;
+	}
+
+	if (child == 0) {
+		pid_t snapshot = syscall(SYS_clone, SIGCHLD, 0, 0, 0, 0);
+
+		if (snapshot == 0)
+			snapshot_wait(slot);
+
+		if (snapshot == -1)
+			__atomic_store_n(&slot->snapshot, -1, __ATOMIC_RELEASE);
+
+		_exit(0);
+	}
+
+	while (waitpid(child, NULL, __WALL) == -1 && errno == EINTR)
+		;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		if (__atomic_load_n(&slot->snapshot, __ATOMIC_ACQUIRE) != 0)
+			return;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (now.tv_sec - start.tv_sec) * 1000 +
+		    (now.tv_nsec - start.tv_nsec) / 1000000;
+		if (elapsed >= HANDSHAKE_SNAPSHOT_WAIT_MS)
+			break;
+
+		futex_wait(&slot->snapshot, 0,
+		    HANDSHAKE_SNAPSHOT_WAIT_MS - elapsed);
+	}
+
+	/* A snapshot publishing its pid after this exits right away. */
+	__atomic_compare_exchange_n(&slot->snapshot, &expected, -1, false,
+	    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+	return;
+}
+
+static void
+handshake_handler(int signo, siginfo_t *info, void *context)
+{
+	struct handshake_region *region = handshake_region;
+	struct handshake_slot *slot;
+	struct bun_cursor cursor;
+	uint32_t generation, expected;
+	int saved_errno = errno;
+
+	(void) signo;
+
+	if (region == NULL || info->si_code != SI_QUEUE ||
+	    (unsigned int)info->si_value.sival_int >= region->slot_count)
+		goto out;
+
+	slot = &region->slots[info->si_value.sival_int];
+	expected = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+	if ((expected & SLOT_STATE_MASK) != SLOT_REQUESTED ||
+	    slot->tid != bun_gettid())
+		goto out;
+
+	generation = expected & ~SLOT_STATE_MASK;
+	if (__atomic_compare_exchange_n(&slot->state, &expected,
+	    generation | SLOT_WRITING, false, __ATOMIC_ACQUIRE,
+	    __ATOMIC_RELAXED) == false)
+		goto out;
+
+	slot->regs_valid = 0;
+	if (bun_cursor_init_context(&cursor, context,
+	    handshake_stack_limit) == true) {
+		slot->pc = cursor.pc;
+		memcpy(slot->regs, cursor.regs, sizeof(slot->regs));
+		slot->regs_valid = cursor.regs_valid;
+		slot->stack_low = cursor.stack_low;
+		slot->stack_high = cursor.stack_high;
+	}
+
+	if ((slot->flags & SLOT_FLAG_FORK) != 0)
+		snapshot_fork(slot);
+
+	/* The slot may have been reclaimed while this handler was stopped. */
+	expected = generation | SLOT_WRITING;
+	if (__atomic_compare_exchange_n(&slot->state, &expected,
+	    generation | SLOT_DONE, false, __ATOMIC_RELEASE,
+	    __ATOMIC_RELAXED) == true)
+		futex_wake(&slot->state);
+	else if ((slot->flags & SLOT_FLAG_FORK) != 0 && slot->snapshot > 0)
+		kill(slot->snapshot, SIGKILL);
+out:
+	errno = saved_errno;
+	return;
+}
+
+bool
+bun_handshake_install(int signal, pid_t reader)
+{
+	struct handshake_region *region;
+	struct sigaction sa;
+	int fd;
+
+	if (handshake_region != NULL)
+		return false;
+
+	if (reader != 0 && prctl(PR_SET_PTRACER, reader == -1 ?
+	    PR_SET_PTRACER_ANY : (unsigned long)reader, 0, 0, 0) != 0 &&
+	    errno != EINVAL)
+		return false;
+
+	/* The descriptor stays open for monitors to find the region. */
+	fd = bun_memfd_create(HANDSHAKE_NAME);
+	if (fd == -1)
+		return false;
+
+	if (ftruncate(fd, sizeof(*region)) != 0)
+		goto error;
+
+	region = mmap(NULL, sizeof(*region), PROT_READ | PROT_WRITE,
+	    MAP_SHARED, fd, 0);
+	if (region == MAP_FAILED)
+		goto error;
+
+	region->version = HANDSHAKE_VERSION;
+	region->word_size = sizeof(uintptr_t);
+	region->signal = signal;
+	region->slot_count = HANDSHAKE_SLOTS;
+	__atomic_store_n(&region->magic, HANDSHAKE_MAGIC, __ATOMIC_RELEASE);
+
+	handshake_stack_limit = bun_cursor_stack_limit();
+	handshake_reader = reader;
+	handshake_region = region;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = handshake_handler;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(signal, &sa, NULL) != 0) {
+		handshake_region = NULL;
+		munmap(region, sizeof(*region));
+		goto error;
+	}
+
+	return true;
+error:
+	close(fd);
+	return false;
+}
+
+/* Monitor side. */
+
+bool
+bun_internal_initialize_handshake(struct bun_handle *handle)
+{
+	struct bun_handshake_context *context;
+
+	context = calloc(1, sizeof(*context));
+	if (context == NULL)
+		return false;
+
+	context->objects = bun_object_cache_create(
+	    BUN_DWARF_REMOTE_CACHE_LIMIT);
+	if (context->objects == NULL) {
+		free(context);
+		return false;
+	}
+
+	if (pthread_mutex_init(&context->lock, NULL) != 0) {
+		bun_object_cache_destroy(context->objects);
+		free(context);
+		return false;
+	}
+
+	bun_maps_cache_init(&context->maps);
+	bun_maps_table_init(&context->table);
+
+	handle->backend_context = context;
+	handle->unwind_remote = handshake_unwind_remote;
+	handle->destroy = destroy_handle;
+	return true;
+}
+
+/*
+ * Maps the region created by bun_handshake_install() in the process `pid`.
+ *
+ * Returns NULL if the process did not install the handler.
+ */
+static struct handshake_region *
+region_open(pid_t pid)
+{
+	struct handshake_region *region = NULL;
+	struct dirent *entry;
+	char path[64];
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+	dir = opendir(path);
+	if (dir == NULL)
+		return NULL;
+
+	while (region == NULL && (entry = readdir(dir)) != NULL) {
+		char target[PATH_MAX];
+		struct stat st;
+		ssize_t length;
+		int fd;
+
+		length = readlinkat(dirfd(dir), entry->d_name, target,
+		    sizeof(target) - 1);
+		if (length <= 0)
+			continue;
+
+		target[length] = '\0';
+		if (strstr(target, HANDSHAKE_NAME) == NULL)
+			continue;
+
+		fd = openat(dirfd(dir), entry->d_name, O_RDWR | O_CLOEXEC);
+		if (fd == -1)
+			continue;
+
+		if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(*region))
+			region = mmap(NULL, sizeof(*region),
+			    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+
+		if (region == MAP_FAILED) {
+			region = NULL;
+			continue;
+		}
+
+		if (region != NULL && (__atomic_load_n(&region->magic,
+		    __ATOMIC_ACQUIRE) != HANDSHAKE_MAGIC ||
+		    region->version != HANDSHAKE_VERSION ||
+		    region->word_size != sizeof(uintptr_t) ||
+		    region->slot_count != HANDSHAKE_SLOTS)) {
+			munmap(region, sizeof(*region));
+			region = NULL;
+		}
+	}
+
+	closedir(dir);
+	return region;
+}
+
+static void
+target_free(struct handshake_target *target)
+{
+
+	if (target->region != NULL)
+		munmap(target->region, sizeof(*target->region));
+
+	bun_dwarf_remote_deinit(&target->remote);
+	free(target);
+	return;
+}
+
+/*
+ * Takes ownership of `maps`.
+ */
+static struct handshake_target *
+target_load(struct bun_handshake_context *context, struct bun_maps *maps)
+{
+	struct handshake_target *target;
+
+	target = calloc(1, sizeof(*target));
+	if (target == NULL) {
+		bun_maps_release(maps);
+		return NULL;
+	}
+
+	/* Processes without the handler are not worth loading the objects. */
+	target->region = region_open(maps->stamp.pid);
+	if (target->region == NULL) {
+		bun_maps_release(maps);
+		free(target);
+		return NULL;
+	}
+
+	if (bun_dwarf_remote_init(&target->remote, maps,
+	    context->objects) == false) {
+		target_free(target);
+		return NULL;
+	}
+
+	return target;
+}
+
+static void
+target_release(struct bun_handshake_context *context,
+    struct handshake_target *target)
+{
+	unsigned int references;
+
+	pthread_mutex_lock(&context->lock);
+	references = --target->references;
+	pthread_mutex_unlock(&context->lock);
+
+	if (references == 0)
+		target_free(target);
+
+	return;
+}
+
+/*
+ * Returns the target the thread `tid` belongs to, which must be released
+ * with target_release(). A target is reused until the maps of its process
+ * change.
+ */
+static struct handshake_target *
+target_get(struct bun_handshake_context *context, pid_t tid)
+{
+	struct handshake_target *target = NULL, *previous;
+	struct bun_maps *maps;
+	size_t slot;
+	int found;
+
+	maps = bun_maps_cache_get(&context->maps, tid, false);
+	if (maps == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&context->lock);
+	found = bun_maps_table_find(&context->table, maps->stamp.pid);
+	if (found != -1)
+		target = context->targets[found];
+	if (target != NULL && target->remote.maps == maps) {
+		target->references++;
+		pthread_mutex_unlock(&context->lock);
+		bun_maps_release(maps);
+		return target;
+	}
+
+	pthread_mutex_unlock(&context->lock);
+
+	/* The objects are loaded without holding the lock. */
+	target = target_load(context, maps);
+	if (target == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&context->lock);
+	slot = bun_maps_table_slot(&context->table,
+	    target->remote.maps->stamp.pid);
+	previous = context->targets[slot];
+	context->targets[slot] = target;
+	target->references = 2;
+	pthread_mutex_unlock(&context->lock);
+
+	if (previous != NULL)
+		target_release(context, previous);
+
+	return target;
+}
+
+/*
+ * Opens a pidfd for the snapshot. It is not a child of the monitor, but only
+ * exits on its own HANDSHAKE_SNAPSHOT_LIFETIME_S after the handshake, so its
+ * pid cannot have been reused yet.
+ *
+ * Returns -1 if the kernel does not support pidfds, in which case the snapshot
+ * is left to exit on its own.
+ */
+static int
+snapshot_open(pid_t snapshot)
+{
+
+#if defined(SYS_pidfd_open)
+	return syscall(SYS_pidfd_open, snapshot, 0);
+#else
+	(void) snapshot;
+	return -1;
+#endif
+}
+
+static void
+snapshot_kill(int pidfd)
+{
+
+	if (pidfd == -1)
+		return;
+
+#if defined(SYS_pidfd_send_signal)
+	syscall(SYS_pidfd_send_signal, pidfd, SIGKILL, NULL, 0);
+#endif
+	close(pidfd);
+	return;
+}
+
+/*
+ * Returns the CLOCK_MONOTONIC time in milliseconds, truncated to 32 bits.
+ * Differences of such times are valid for 49 days.
+ */
+static uint32_t
+now_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+static unsigned long
+elapsed_ms(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000 +
+	    (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/*
+ * Waits for the slot to leave `state`, for up to HANDSHAKE_TIMEOUT_MS. The
+ * handler wakes the monitor up once it is done.
+ *
+ * Returns the state of the slot.
+ */
+static uint32_t
+slot_wait(struct handshake_slot *slot, uint32_t state)
+{
+	struct timespec start;
+	unsigned long elapsed;
+	uint32_t current;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		current = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+		elapsed = elapsed_ms(&start);
+		if (current != state || elapsed >= HANDSHAKE_TIMEOUT_MS)
+			return current;
+
+		futex_wait(&slot->state, state, HANDSHAKE_TIMEOUT_MS - elapsed);
+	}
+}
+
+/*
+ * Returns true if the request in the slot, whose state word is `state`, was
+ * abandoned by its monitor. A claim whose time is not published yet is
+ * recent.
+ */
+static bool
+slot_stale(const struct handshake_slot *slot, uint32_t state)
+{
+	uint64_t claimed = __atomic_load_n(&slot->claimed, __ATOMIC_ACQUIRE);
+
+	if ((state & SLOT_STATE_MASK) == SLOT_FREE ||
+	    (claimed >> 32) != state / SLOT_GENERATION)
+		return false;
+
+	return now_ms() - (uint32_t)claimed >= HANDSHAKE_STALE_MS;
+}
+
+/*
+ * Claims a free or stale slot of the region, killing the snapshot left by
+ * an abandoned request.
+ *
+ * Returns the slot and stores the generation of the request into
+ * `generation`, or returns NULL if all the slots are in use.
+ */
+static struct handshake_slot *
+slot_claim(struct handshake_region *region, uint32_t *generation)
+{
+
+	for (size_t i = 0; i < HANDSHAKE_SLOTS; i++) {
+		struct handshake_slot *slot = &region->slots[i];
+		uint32_t state, next;
+		bool stale;
+
+		state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+		next = (state & ~SLOT_STATE_MASK) + SLOT_GENERATION;
+		stale = slot_stale(slot, state);
+
+		if ((state & SLOT_STATE_MASK) != SLOT_FREE && stale == false)
+			continue;
+
+		if (__atomic_compare_exchange_n(&slot->state, &state,
+		    next | SLOT_CLAIMED, false, __ATOMIC_ACQUIRE,
+		    __ATOMIC_RELAXED) == false)
+			continue;
+
+		/* Older snapshots have exited on their own. */
+		if (stale == true && (state & SLOT_STATE_MASK) == SLOT_DONE &&
+		    slot->snapshot > 0 && now_ms() - (uint32_t)slot->claimed <
+		    HANDSHAKE_SNAPSHOT_LIFETIME_S * 1000)
+			snapshot_kill(snapshot_open(slot->snapshot));
+
+		__atomic_store_n(&slot->claimed,
+		    (uint64_t)(next / SLOT_GENERATION) << 32 | now_ms(),
+		    __ATOMIC_RELEASE);
+		*generation = next;
+		return slot;
+	}
+
+	return NULL;
+}
+
+/*
+ * Gives up on the snapshot of a request the handler has not finished: kills
+ * it if its pid is published already, else makes it exit as soon as it tries
+ * to publish it.
+ */
+static void
+snapshot_abandon(struct handshake_slot *slot)
+{
+	pid_t snapshot = 0;
+
+	if (__atomic_compare_exchange_n(&slot->snapshot, &snapshot, -1, false,
+	    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE) == false && snapshot > 0)
+		snapshot_kill(snapshot_open(snapshot));
+
+	return;
+}
+
+/*
+ * Asks the thread `tid` for its registers, and a snapshot of the process if
+ * `flags` has SLOT_FLAG_FORK, and copies them into `out`.
+ *
+ * Returns false if the thread did not answer in time or had no registers to
+ * hand over, in which case its snapshot is killed.
+ */
+static bool
+handshake_request(struct handshake_target *target, pid_t tid, uint32_t flags,
+    struct handshake_slot *out)
+{
+	struct handshake_region *region = target->region;
+	uint32_t generation, expected, state;
+	struct handshake_slot *slot;
+	siginfo_t info;
+
+	slot = slot_claim(region, &generation);
+	if (slot == NULL)
+		return false;
+
+	slot->tid = tid;
+	slot->flags = flags;
+	slot->snapshot = 0;
+	__atomic_store_n(&slot->state, generation | SLOT_REQUESTED,
+	    __ATOMIC_RELEASE);
+
+	memset(&info, 0, sizeof(info));
+	info.si_signo = region->signal;
+	info.si_code = SI_QUEUE;
+	info.si_pid = getpid();
+	info.si_uid = getuid();
+	info.si_value.sival_int = slot - region->slots;
+
+	state = generation | SLOT_REQUESTED;
+	if (syscall(SYS_rt_tgsigqueueinfo, target->remote.maps->stamp.pid,
+	    tid, region->signal, &info) == 0)
+		state = slot_wait(slot, generation | SLOT_REQUESTED);
+
+	if (state == (generation | SLOT_REQUESTED)) {
+		/* Unless the handler has just started, it will not write. */
+		expected = generation | SLOT_REQUESTED;
+		if (__atomic_compare_exchange_n(&slot->state, &expected,
+		    generation | SLOT_FREE, false, __ATOMIC_ACQUIRE,
+		    __ATOMIC_ACQUIRE) == true)
+			return false;
+
+		state = expected;
+	}
+
+	/*
+	 * The handler only blocks for a bounded time, it can only fail to
+	 * finish if the process dies or is stopped, in which case the slot is
+	 * left for a later monitor to reclaim.
+	 */
+	if (state == (generation | SLOT_WRITING))
+		state = slot_wait(slot, generation | SLOT_WRITING);
+	if (state == (generation | SLOT_WRITING)) {
+		snapshot_abandon(slot);
+		return false;
+	}
+
+	if (state != (generation | SLOT_DONE))
+		return false;
+
+	memcpy(out, slot, sizeof(*out));
+
+	/* Unless this monitor was so slow that the slot was reclaimed. */
+	expected = generation | SLOT_DONE;
+	if (__atomic_compare_exchange_n(&slot->state, &expected,
+	    generation | SLOT_FREE, false, __ATOMIC_RELEASE,
+	    __ATOMIC_RELAXED) == true && out->regs_valid != 0)
+		return true;
+
+	if (out->snapshot > 0)
+		snapshot_kill(snapshot_open(out->snapshot));
+
+	return false;
+}
+
+static bool
+handshake_read(void *arg, uintptr_t addr, uintptr_t *value)
+{
+
+	return bun_memory_cache_read(arg, value, addr, sizeof(*value));
+}
+
+static size_t
+handshake_unwind_remote(struct bun_handle *handle, struct bun_buffer *buffer,
+    pid_t tid)
+{
+	struct bun_handshake_context *context = handle->backend_context;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+	struct bun_memory_cache *memory = NULL;
+	struct handshake_target *target;
+	struct handshake_slot slot;
+	struct bun_cursor cursor;
+	struct bun_writer writer;
+	uint32_t flags = 0;
+	size_t size = 0;
+	int pidfd = -1;
+	pid_t pid;
+
+	target = target_get(context, tid);
+	if (target == NULL)
+		return 0;
+
+	if ((handle->flags & BUN_HANDLE_FORK_SNAPSHOT) != 0)
+		flags |= SLOT_FLAG_FORK;
+
+	if (handshake_request(target, tid, flags, &slot) == false)
+		goto out;
+
+	if (slot.snapshot > 0)
+		pidfd = snapshot_open(slot.snapshot);
+
+	/* If the fork failed, the live process is read instead. */
+	pid = slot.snapshot > 0 ? slot.snapshot :
+	    target->remote.maps->stamp.pid;
+
+	memory = malloc(sizeof(*memory));
+	if (memory == NULL)
+		goto out;
+
+	/*
+	 * Unless a snapshot is read, the thread runs on while its stack is
+	 * read, and the frames it has returned from since it answered may
+	 * have been overwritten.
+	 */
+	bun_memory_cache_init(memory, pid);
+	bun_cursor_init_reader(&cursor, slot.pc,
+	    slot.regs[BUN_CURSOR_REGISTER_SP], slot.regs[BUN_CURSOR_REGISTER_FP],
+	    slot.stack_high - slot.stack_low, handshake_read, memory);
+	memcpy(cursor.regs, slot.regs, sizeof(cursor.regs));
+	cursor.regs_valid = slot.regs_valid;
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		goto out;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_HANDSHAKE);
+	bun_header_tid_set(&writer, tid);
+
+	do {
+		if (bun_dwarf_remote_write_frame(&target->remote, &cursor,
+		    &writer, handle) == false)
+			goto out;
+	} while (bun_dwarf_remote_step(&target->remote, &cursor) == true);
+
+	size = hdr->size;
+out:
+	snapshot_kill(pidfd);
+
+	free(memory);
+	target_release(context, target);
+	return size;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+	struct bun_handshake_context *context = handle->backend_context;
+
+	if (context == NULL)
+		return;
+
+	for (size_t i = 0; i < BUN_MAPS_CACHE_SIZE; i++) {
+		if (context->targets[i] != NULL)
+			target_release(context, context->targets[i]);
+	}
+
+	bun_maps_cache_deinit(&context->maps);
+	bun_object_cache_destroy(context->objects);
+	pthread_mutex_destroy(&context->lock);
+	free(context);
+	return;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <bun/bun.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*
+ * Initialize the monitor side of the cooperative unwinding backend. This
+ * function is only meant for internal use, see bun/handshake.h.
+ */
+bool bun_internal_initialize_handshake(struct bun_handle *handle);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,323 @@
+#define _GNU_SOURCE
+#include "bun_hybrid.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <ucontext.h>
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_internal.h"
+#include "../../bun_modules.h"
+#include "../dwarf/bun_dwarf.h"
+#include "../framepointer/bun_framepointer.h"
+
+/*
+ * Number of steps on which the frame pointer chain of a module has to agree
+ * with its CFI before the latter stops being consulted.
+ */
+#define HYBRID_AGREEMENTS_MIN 32
+
+/*
+ * What has been learned about a module so far. It is updated with relaxed
+ * atomics, as unwinding may happen on many threads at once and from signal
+ * handlers. A lost update only costs a few more verified steps.
+ */
+struct hybrid_module {
+	int strategy;
+	unsigned int agreements;
+};
+
+/*
+ * states[i] describes modules.modules[i]. The module table is read-only once
+ * initialized, only the learned strategies change.
+ */
+struct bun_hybrid_context {
+	struct bun_module_table modules;
+	struct hybrid_module *states;
+	size_t stack_limit;
+};
+
+static size_t hybrid_unwind(struct bun_handle *handle,
+    struct bun_buffer *buffer);
+static size_t hybrid_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context);
+static size_t hybrid_unwind_impl(struct bun_cursor *cursor,
+    struct bun_handle *handle, struct bun_buffer *buffer);
+static void destroy_handle(struct bun_handle *handle);
+
+bool
+bun_internal_initialize_hybrid(struct bun_handle *handle)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+	struct bun_hybrid_context *context;
+
+	context = malloc(sizeof(struct bun_hybrid_context));
+	if (context == NULL)
+		return false;
+
+	if (bun_module_table_init(&context->modules) == false) {
+		free(context);
+		return false;
+	}
+
+	context->states = calloc(context->modules.count + 1,
+	    sizeof(*context->states));
+	if (context->states == NULL) {
+		bun_module_table_deinit(&context->modules);
+		free(context);
+		return false;
+	}
+
+	context->stack_limit = bun_cursor_stack_limit();
+
+	handle->backend_context = context;
+	handle->unwind = hybrid_unwind;
+	handle->unwind_context = hybrid_unwind_context;
+	handle->destroy = destroy_handle;
+	return true;
+#else
+	(void) handle;
+	return false;
+#endif
+}
+
+enum bun_hybrid_strategy
+bun_internal_hybrid_strategy(const struct bun_handle *handle, uintptr_t pc)
+{
+	const struct bun_hybrid_context *context = handle->backend_context;
+	const struct bun_module *module;
+
+	module = bun_module_table_find(&context->modules, pc);
+	if (module == NULL)
+		return BUN_HYBRID_UNKNOWN;
+
+	return __atomic_load_n(
+	    &context->states[module - context->modules.modules].strategy,
+	    __ATOMIC_RELAXED);
+}
+
+/*
+ * Follows the frame pointer, and checks that the caller's frame is plausible:
+ * its pc is in an executable segment of a loaded object and its stack
+ * pointer is above ours.
+ */
+static bool
+fast_step(const struct bun_hybrid_context *context, struct bun_cursor *cursor)
+{
+	const uintptr_t sp = bun_cursor_sp(cursor);
+
+	if (bun_internal_framepointer_step(cursor) == false)
+		return false;
+
+	if (bun_cursor_sp(cursor) <= sp)
+		return false;
+
+	return bun_module_table_find(&context->modules, cursor->pc - 1) != NULL;
+}
+
+/*
+ * The try_*_step() functions leave the cursor untouched if the step fails.
+ */
+static bool
+try_fast_step(const struct bun_hybrid_context *context,
+    struct bun_cursor *cursor)
+{
+	struct bun_cursor next = *cursor;
+
+	if (fast_step(context, &next) == false)
+		return false;
+
+	*cursor = next;
+	return true;
+}
+
+static bool
+try_slow_step(const struct bun_hybrid_context *context,
+    struct bun_cursor *cursor)
+{
+	struct bun_cursor next = *cursor;
+
+	if (bun_internal_dwarf_step(&context->modules, &next) == false)
+		return false;
+
+	*cursor = next;
+	return true;
+}
+
+/*
+ * Returns true if both unwinders found the same caller. The frame pointer
+ * walk derives the stack pointer from the frame record, which is not the
+ * caller's stack pointer on every architecture, so it is not compared.
+ */
+static bool
+same_frame(const struct bun_cursor *fast, const struct bun_cursor *slow)
+{
+	const uint64_t fp = BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_FP);
+
+	if (fast->pc != slow->pc)
+		return false;
+
+	return (slow->regs_valid & fp) == 0 ||
+	    bun_cursor_fp(fast) == bun_cursor_fp(slow);
+}
+
+static void
+learn(struct hybrid_module *state, bool agreed)
+{
+	int expected = BUN_HYBRID_UNKNOWN;
+
+	/* A single mismatch is enough, the CFI is always right. */
+	if (agreed == false) {
+		__atomic_store_n(&state->strategy, BUN_HYBRID_CFI,
+		    __ATOMIC_RELAXED);
+		return;
+	}
+
+	if (__atomic_add_fetch(&state->agreements, 1, __ATOMIC_RELAXED) <
+	    HYBRID_AGREEMENTS_MIN)
+		return;
+
+	__atomic_compare_exchange_n(&state->strategy, &expected,
+	    BUN_HYBRID_FRAMEPOINTER, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	return;
+}
+
+/*
+ * Moves the cursor to the caller's frame, following the frame pointer unless
+ * the module containing pc is known to need its CFI. While the strategy of a
+ * module is not known, both are run and compared.
+ */
+static bool
+hybrid_step(struct bun_hybrid_context *context, struct bun_cursor *cursor)
+{
+	const struct bun_module *module;
+	struct hybrid_module *state;
+	struct bun_cursor fast, slow;
+	uintptr_t pc = cursor->pc;
+	bool fast_valid;
+	int strategy;
+
+	if (cursor->return_address == true)
+		pc--;
+
+	module = bun_module_table_find(&context->modules, pc);
+	if (module == NULL || module->eh_frame_hdr == NULL)
+		return try_fast_step(context, cursor);
+
+	state = &context->states[module - context->modules.modules];
+	strategy = __atomic_load_n(&state->strategy, __ATOMIC_RELAXED);
+
+	/*
+	 * A frame interrupted by a signal may be anywhere in its function,
+	 * including a prologue that has not set up the frame pointer yet, so
+	 * it tells nothing about the module.
+	 */
+	if (strategy == BUN_HYBRID_CFI || cursor->return_address == false)
+		return try_slow_step(context, cursor) ||
+		    try_fast_step(context, cursor);
+
+	if (strategy == BUN_HYBRID_FRAMEPOINTER) {
+		if (try_fast_step(context, cursor) == true)
+			return true;
+
+		if (try_slow_step(context, cursor) == false)
+			return false;
+
+		/* The chain is broken where the CFI is not. */
+		learn(state, false);
+		return true;
+	}
+
+	fast = *cursor;
+	slow = *cursor;
+	fast_valid = fast_step(context, &fast);
+	if (bun_internal_dwarf_step(&context->modules, &slow) == false) {
+		/* Hand-written code may lack CFI but keep the chain intact. */
+		if (fast_valid == true)
+			*cursor = fast;
+		return fast_valid;
+	}
+
+	learn(state, fast_valid == true && same_frame(&fast, &slow) == true);
+
+	/* The CFI also recovers the callee-saved registers. */
+	*cursor = slow;
+	return true;
+}
+
+static size_t __attribute__((noinline))
+hybrid_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
+{
+	struct bun_hybrid_context *context = handle->backend_context;
+	struct bun_cursor cursor;
+	ucontext_t uc;
+
+	if (getcontext(&uc) != 0)
+		return 0;
+
+	if (bun_cursor_init_context(&cursor, &uc, context->stack_limit) == false)
+		return 0;
+
+	/* The saved pc is the return address of getcontext(). */
+	cursor.return_address = true;
+
+	/* Skip the frame of this function. */
+	if (hybrid_step(context, &cursor) == false)
+		return 0;
+
+	return hybrid_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+hybrid_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
+    void *context)
+{
+	struct bun_hybrid_context *hybrid_context = handle->backend_context;
+	struct bun_cursor cursor;
+
+	if (bun_cursor_init_context(&cursor, context,
+	    hybrid_context->stack_limit) == false)
+		return 0;
+
+	return hybrid_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+hybrid_unwind_impl(struct bun_cursor *cursor, struct bun_handle *handle,
+    struct bun_buffer *buffer)
+{
+	struct bun_hybrid_context *context = handle->backend_context;
+	struct bun_writer writer;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		return 0;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_HYBRID);
+	bun_header_tid_set(&writer, bun_gettid());
+
+	do {
+		if (bun_cursor_write_frame(cursor, &writer, handle) == false)
+			return 0;
+	} while (hybrid_step(context, cursor) == true);
+
+	return hdr->size;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+	struct bun_hybrid_context *context = handle->backend_context;
+
+	free(context->states);
+	bun_module_table_deinit(&context->modules);
+	free(context);
+	return;
+}
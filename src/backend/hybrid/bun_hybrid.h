@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <bun/bun.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*
+ * How the frames of a module are unwound by the hybrid backend.
+ */
+enum bun_hybrid_strategy {
+	/* Not decided yet, frames are unwound both ways and compared. */
+	BUN_HYBRID_UNKNOWN,
+	/* The frame pointer chain has matched the CFI so far. */
+	BUN_HYBRID_FRAMEPOINTER,
+	/* The frame pointer chain is not reliable, always use the CFI. */
+	BUN_HYBRID_CFI
+};
+
+/*
+ * Initialize the hybrid backend, which follows frame pointers and only
+ * interprets the DWARF call frame information of the modules that need it.
+ * This function is only meant for internal use.
+ */
+bool bun_internal_initialize_hybrid(struct bun_handle *handle);
+
+/*
+ * Returns the strategy currently used for the module containing `pc`. This
+ * function is only meant for internal use.
+ */
+enum bun_hybrid_strategy bun_internal_hybrid_strategy(
+    const struct bun_handle *handle, uintptr_t pc);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -7,6 +7,7 @@
 
 #include "bun_libbacktrace.h"
 
+#include "../../bun_cursor.h"
 #include "../../bun_internal.h"
 
 #include <libbacktrace/backtrace.h>
@@ -20,7 +21,18 @@ struct backtrace_context {
 	bun_writer_t writer;
 };
 
+/*
+ * Used to count the frames above the one interrupted by a signal.
+ */
+struct backtrace_skip {
+	uintptr_t pc;
+	int count;
+};
+
 static size_t libbacktrace_unwind(struct bun_handle *, struct bun_buffer *);
+static size_t libbacktrace_unwind_context(struct bun_handle *,
+    struct bun_buffer *, void *);
+static int skip_callback(void *data, uintptr_t pc);
 static void error_callback(void *data, const char *msg, int errnum);
 static void syminfo_callback(void *data, uintptr_t pc, const char *symname,
     uintptr_t symval, uintptr_t symsize);
@@ -52,6 +64,7 @@ bun_internal_initialize_libbacktrace(struct bun_handle *handle)
 	/* Ensure we precompute the state for further operations. */
 	(void) get_backtrace_state();
 	handle->unwind = libbacktrace_unwind;
+	handle->unwind_context = libbacktrace_unwind_context;
 	handle->destroy = libbacktrace_destroy;
 	return true;
 }
@@ -73,6 +86,60 @@ libbacktrace_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
 	return hdr->size;
 }
 
+/*
+ * libbacktrace can only walk the stack of the calling thread, so the frames
+ * of the signal handler and the trampoline are walked over with
+ * backtrace_simple(), which does not symbolize them, until the pc of the
+ * context is found. backtrace_full() then skips as many frames.
+ */
+static size_t __attribute__((noinline))
+libbacktrace_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context)
+{
+	struct backtrace_context bt_ctx;
+	struct backtrace_skip skip;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+	struct bun_cursor cursor;
+
+	if (bun_cursor_init_context(&cursor, context, 0) == false)
+		return 0;
+
+	skip.pc = cursor.pc;
+	skip.count = 0;
+
+	/* The callback returns 1 once the interrupted frame is found. */
+	if (backtrace_simple(get_backtrace_state(), 0, skip_callback,
+	    error_callback, &skip) != 1)
+		return 0;
+
+	bun_writer_init(&bt_ctx.writer, buffer, BUN_ARCH_DETECTED, handle);
+
+	bun_header_backend_set(&bt_ctx.writer, BUN_BACKEND_LIBBACKTRACE);
+
+	if (backtrace_full(get_backtrace_state(), skip.count, full_callback,
+	    error_callback, &bt_ctx) != 0)
+		return 0;
+
+	return hdr->size;
+}
+
+/*
+ * The pc of the interrupted frame is reported as is, while the ones of the
+ * other frames are return addresses adjusted to point into the call
+ * instruction.
+ */
+int
+skip_callback(void *data, uintptr_t pc)
+{
+	struct backtrace_skip *skip = data;
+
+	if (pc == skip->pc)
+		return 1;
+
+	skip->count++;
+	return 0;
+}
+
 void
 error_callback(void *data, const char *msg, int errnum)
 {
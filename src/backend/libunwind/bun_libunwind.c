@@ -13,6 +13,7 @@
 #include <sys/ptrace.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <ucontext.h>
 #include <unistd.h>
 
 #include <libunwind.h>
@@ -23,6 +24,8 @@
 #include <bun/utils.h>
 
 #include "../../bun_internal.h"
+#include "../../bun_memory.h"
+#include "../../bun_ptrace.h"
 #include "unwind.h"
 
 #define REGISTER_GET(cursor, frame, bun_reg, unw_reg, var)                    \
@@ -38,11 +41,30 @@ struct bun_libunwind_context {
 	unw_addr_space_t addr_space;
 };
 
+/*
+ * The thread being unwound remotely by this thread. Its memory is read a page
+ * at a time through process_vm_readv(2) instead of a word at a time with
+ * PTRACE_PEEKDATA.
+ *
+ * If `detached` is set, the thread has been released after its registers and
+ * stack were saved into `snapshot`, which then serves them.
+ */
+struct libunwind_remote {
+	void *upt;
+	bool detached;
+	struct bun_memory_cache cache;
+	struct bun_ptrace_snapshot snapshot;
+};
+
+static __thread struct libunwind_remote *libunwind_remote;
+
 /*
  * Performs the actual unwinding using libunwind.
  */
 static size_t libunwind_unwind(struct bun_handle *handle,
     struct bun_buffer *buffer);
+static size_t libunwind_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context);
 static size_t libunwind_unwind_remote(struct bun_handle *handle,
     struct bun_buffer *buffer, pid_t pid);
 static size_t libunwind_unwind_impl(unw_cursor_t *cursor,
@@ -55,9 +77,120 @@ static size_t libunwind_unwind_impl(unw_cursor_t *cursor,
  */
 static void destroy_handle(struct bun_handle * handle);
 
+/*
+ * The accessors of _UPT_accessors are kept, so that `arg` is always the
+ * context returned by _UPT_create(), and the cache of the current remote
+ * unwind is looked up instead. Writes and reads the cache cannot serve, e.g.
+ * because process_vm_readv(2) is not allowed, go through ptrace(2).
+ */
+static int
+remote_access_mem(unw_addr_space_t as, unw_word_t addr, unw_word_t *value,
+    int write, void *arg)
+{
+	struct libunwind_remote *remote = libunwind_remote;
+
+	if (remote == NULL || remote->upt != arg)
+		return _UPT_access_mem(as, addr, value, write, arg);
+
+	if (write == 0 && remote->detached == true &&
+	    bun_ptrace_snapshot_read(&remote->snapshot, value, addr,
+	    sizeof(*value)) == true)
+		return 0;
+
+	if (write == 0 && bun_memory_cache_read(&remote->cache, value, addr,
+	    sizeof(*value)) == true)
+		return 0;
+
+	if (remote->detached == true)
+		return -UNW_EINVAL;
+
+	return _UPT_access_mem(as, addr, value, write, arg);
+}
+
+#if defined(BUN_PTRACE_SNAPSHOT_SUPPORTED)
+/*
+ * Loads the saved value of the libunwind register `reg`.
+ *
+ * Returns false if the register is not saved.
+ */
+static bool
+snapshot_reg(const struct user_regs_struct *regs, unw_regnum_t reg,
+    unw_word_t *value)
+{
+
+	switch (reg) {
+#if defined(__x86_64__)
+	case UNW_X86_64_RAX: *value = regs->rax; break;
+	case UNW_X86_64_RDX: *value = regs->rdx; break;
+	case UNW_X86_64_RCX: *value = regs->rcx; break;
+	case UNW_X86_64_RBX: *value = regs->rbx; break;
+	case UNW_X86_64_RSI: *value = regs->rsi; break;
+	case UNW_X86_64_RDI: *value = regs->rdi; break;
+	case UNW_X86_64_RBP: *value = regs->rbp; break;
+	case UNW_X86_64_RSP: *value = regs->rsp; break;
+	case UNW_X86_64_R8: *value = regs->r8; break;
+	case UNW_X86_64_R9: *value = regs->r9; break;
+	case UNW_X86_64_R10: *value = regs->r10; break;
+	case UNW_X86_64_R11: *value = regs->r11; break;
+	case UNW_X86_64_R12: *value = regs->r12; break;
+	case UNW_X86_64_R13: *value = regs->r13; break;
+	case UNW_X86_64_R14: *value = regs->r14; break;
+	case UNW_X86_64_R15: *value = regs->r15; break;
+	case UNW_X86_64_RIP: *value = regs->rip; break;
+#elif defined(__i386__)
+	case UNW_X86_EAX: *value = regs->eax; break;
+	case UNW_X86_EDX: *value = regs->edx; break;
+	case UNW_X86_ECX: *value = regs->ecx; break;
+	case UNW_X86_EBX: *value = regs->ebx; break;
+	case UNW_X86_ESI: *value = regs->esi; break;
+	case UNW_X86_EDI: *value = regs->edi; break;
+	case UNW_X86_EBP: *value = regs->ebp; break;
+	case UNW_X86_ESP: *value = regs->esp; break;
+	case UNW_X86_EIP: *value = regs->eip; break;
+#elif defined(__aarch64__)
+	case UNW_AARCH64_SP: *value = regs->sp; break;
+	case UNW_AARCH64_PC: *value = regs->pc; break;
+#endif
+	default:
+#if defined(__aarch64__)
+		if (reg >= UNW_AARCH64_X0 && reg <= UNW_AARCH64_X30) {
+			*value = regs->regs[reg - UNW_AARCH64_X0];
+			break;
+		}
+#endif
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+/*
+ * Registers of a released thread come from its snapshot, they cannot be
+ * changed.
+ */
+static int
+remote_access_reg(unw_addr_space_t as, unw_regnum_t reg, unw_word_t *value,
+    int write, void *arg)
+{
+	struct libunwind_remote *remote = libunwind_remote;
+
+	if (remote == NULL || remote->upt != arg || remote->detached == false)
+		return _UPT_access_reg(as, reg, value, write, arg);
+
+#if defined(BUN_PTRACE_SNAPSHOT_SUPPORTED)
+	if (write == 0 && snapshot_reg(&remote->snapshot.regs, reg,
+	    value) == true)
+		return 0;
+#endif
+
+	return -UNW_EBADREG;
+}
+
 bool
 bun_internal_initialize_libunwind(struct bun_handle *handle)
 {
+	unw_accessors_t accessors = _UPT_accessors;
 	unw_addr_space_t as;
 	struct bun_libunwind_context *context;
 
@@ -65,13 +198,17 @@ bun_internal_initialize_libunwind(struct bun_handle *handle)
 	if (context == NULL)
 		return false;
 
-	as = unw_create_addr_space(&_UPT_accessors, 0);
+	accessors.access_mem = remote_access_mem;
+	accessors.access_reg = remote_access_reg;
+	as = unw_create_addr_space(&accessors, 0);
 	context->addr_space = as;
 
 	handle->backend_context = context;
 	handle->unwind = libunwind_unwind;
+	handle->unwind_context = libunwind_unwind_context;
 	handle->unwind_remote = libunwind_unwind_remote;
 	handle->destroy = destroy_handle;
+	handle->remote_ptrace = true;
 	return true;
 }
 
@@ -83,6 +220,49 @@ libunwind_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
 	unw_getcontext(&context);
 	unw_init_local(&cursor, &context);
 
+	/* Skip the frame of this function. */
+	if (unw_step(&cursor) <= 0)
+		return 0;
+
+	return libunwind_unwind_impl(&cursor, handle, buffer, bun_gettid(),
+	    BUN_UNWIND_SIGNAL_SAFETY_REQUIRED);
+}
+
+/*
+ * Unwinds from the ucontext_t passed to a signal handler. The first frame is
+ * the interrupted one, the handler and the signal trampoline are never seen.
+ */
+static size_t
+libunwind_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
+    void *context)
+{
+	unw_cursor_t cursor;
+#if defined(__arm__)
+	const ucontext_t *uc = context;
+	unw_context_t arm_context;
+	unw_context_t *unw_context = &arm_context;
+
+	/* The ARM context only holds the core registers, r0 to pc. */
+	memcpy(arm_context.regs, &uc->uc_mcontext.arm_r0,
+	    sizeof(arm_context.regs));
+#else
+	/* Elsewhere, unw_context_t is laid out like ucontext_t. */
+	unw_context_t *unw_context = context;
+#endif
+
+#if defined(BUN_UNW_INIT_LOCAL2_AVAILABLE)
+	/*
+	 * The pc of the interrupted frame is not a return address, it must
+	 * not be adjusted when looking up its unwind information.
+	 */
+	if (unw_init_local2(&cursor, unw_context,
+	    UNW_INIT_SIGNAL_FRAME) != 0)
+		return 0;
+#else
+	if (unw_init_local(&cursor, unw_context) != 0)
+		return 0;
+#endif
+
 	return libunwind_unwind_impl(&cursor, handle, buffer, bun_gettid(),
 	    BUN_UNWIND_SIGNAL_SAFETY_REQUIRED);
 }
@@ -91,40 +271,57 @@ static size_t
 libunwind_unwind_remote(struct bun_handle *handle, struct bun_buffer *buffer,
     pid_t tid)
 {
-	void *pid_context = _UPT_create(tid);
+	struct libunwind_remote *remote;
 	unw_cursor_t cursor;
 	struct bun_libunwind_context *libunwind_context = handle->backend_context;
-	int err = 0;
 	size_t bytes_written = 0;
 
-	int ptrace_ret = ptrace(PTRACE_ATTACH, tid, 0, 0);
-	if (ptrace_ret != 0) {
-		goto error;
+	remote = malloc(sizeof(*remote));
+	if (remote == NULL)
 		return 0;
-	}
 
-	if (bun_waitpid(tid, 5000) < 0) {
-		goto error;
-		return 0;
+	if (bun_ptrace_attach(tid, handle->flags, 5000) == false)
+		goto out;
+
+	remote->upt = _UPT_create(tid);
+	if (remote->upt == NULL)
+		goto detach;
+
+	bun_memory_cache_init(&remote->cache, tid);
+	remote->detached = false;
+	libunwind_remote = remote;
+
+	/*
+	 * Without a snapshot, the thread stays stopped while it is unwound.
+	 * Everything that is not on the stack or in registers, such as code
+	 * and unwind tables, is not expected to change once it runs again.
+	 */
+	if ((handle->flags & BUN_HANDLE_DETACH_EARLY) != 0 &&
+	    bun_ptrace_snapshot_save(tid, &remote->snapshot) == true) {
+		bun_ptrace_detach(tid);
+		remote->detached = true;
 	}
 
-	err = unw_init_remote(&cursor, libunwind_context->addr_space, pid_context);
+	if (unw_init_remote(&cursor, libunwind_context->addr_space,
+	    remote->upt) != 0)
+		goto destroy;
 
-	if (err != 0) {
-		goto error;
-		return 0;
-	}
+	if (unw_step(&cursor) <= 0)
+		goto destroy;
 
 	bytes_written = libunwind_unwind_impl(&cursor, handle, buffer, tid,
 	    BUN_UNWIND_SIGNAL_SAFETY_NOT_REQUIRED);
 
-	_UPT_destroy(pid_context);
-
-	ptrace(PTRACE_DETACH, tid, 0, 0);
+destroy:
+	libunwind_remote = NULL;
+	_UPT_destroy(remote->upt);
+	if (remote->detached == true)
+		goto out;
+detach:
+	bun_ptrace_detach(tid);
+out:
+	free(remote);
 	return bytes_written;
-error:
-	ptrace(PTRACE_DETACH, tid, 0, 0);
-	return 0;
 }
 
 static void
@@ -164,7 +361,7 @@ libunwind_unwind_impl(unw_cursor_t *cursor, struct bun_handle *handle,
 	bun_header_backend_set(&writer, BUN_BACKEND_LIBUNWIND);
 	bun_header_tid_set(&writer, tid);
 
-	while (unw_step(cursor) > 0) {
+	do {
 		unw_word_t ip, sp, off, current_register;
 		struct bun_frame frame;
 		char registers[512] = {0};
@@ -302,12 +499,17 @@ libunwind_unwind_impl(unw_cursor_t *cursor, struct bun_handle *handle,
 #endif
 
 		for (size_t i = 0; i < sizeof(register_map)/sizeof(*register_map); i++) {
+			/* Each register costs a lookup in the unwind state. */
+			if (bun_writer_register_wanted(&writer,
+			    register_map[i].bun_reg) == false)
+				continue;
+
 			REGISTER_GET(cursor, &frame, register_map[i].bun_reg,
 			    register_map[i].unw_reg, current_register);
 		}
 		if (bun_frame_write(&writer, &frame) == 0)
 			return 0;
-	}
+	} while (unw_step(cursor) > 0);
 
 	return hdr->size;
 }
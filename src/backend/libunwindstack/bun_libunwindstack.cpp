@@ -8,6 +8,9 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <memory>
+#include <mutex>
+
 #include <unwindstack/Elf.h>
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
@@ -19,6 +22,8 @@
 #include "bun/utils.h"
 
 #include "../../bun_internal.h"
+#include "../../bun_maps.h"
+#include "../../bun_ptrace.h"
 
 #include "bun_libunwindstack.h"
 
@@ -32,10 +37,29 @@ static size_t libunwindstack_unwind_context(struct bun_handle *, struct bun_buff
 static size_t libunwindstack_unwind_remote(struct bun_handle *,
     struct bun_buffer *, pid_t);
 
+/*
+ * The parsed maps of the processes last unwound remotely, shared by the
+ * unwinds of their threads until the stamp of a process changes. Their
+ * objects keep the ELF files they loaded, which are reused as well.
+ */
+struct libunwindstack_context {
+	libunwindstack_context()
+	{
+
+		bun_maps_table_init(&table);
+	}
+
+	std::mutex lock;
+	struct bun_maps_table table;
+	struct bun_maps_stamp stamps[BUN_MAPS_CACHE_SIZE];
+	std::shared_ptr<unwindstack::RemoteMaps> maps[BUN_MAPS_CACHE_SIZE];
+};
+
 static void
-destroy_handle(struct bun_handle *)
+destroy_handle(struct bun_handle *handle)
 {
 
+	delete static_cast<libunwindstack_context *>(handle->backend_context);
 	return;
 }
 
@@ -43,10 +67,21 @@ extern "C"
 bool bun_internal_initialize_libunwindstack(struct bun_handle *handle)
 {
 #ifndef BUN_DISABLE_LIBUNWINDSTACK_INTEGRATION
+	/*
+	 * The library then shares the Elf objects of the files mapped by
+	 * several processes, or by one process across reloads of its maps.
+	 */
+	unwindstack::Elf::SetCachingEnabled(true);
+
+	handle->backend_context = new (std::nothrow) libunwindstack_context;
+	if (handle->backend_context == nullptr)
+		return false;
+
 	handle->unwind = libunwindstack_unwind;
 	handle->unwind_context = libunwindstack_unwind_context;
 	handle->unwind_remote = libunwindstack_unwind_remote;
 	handle->destroy = destroy_handle;
+	handle->remote_ptrace = true;
 	return true;
 #else
 	return false;
@@ -196,6 +231,10 @@ libunwindstack_write_frame(const unwindstack::FrameData& frame,
 	bun_frame.register_buffer_size = sizeof(register_buf);
 	bun_frame.register_data = register_buf;
 
+	/*
+	 * The values are already in memory, bun_frame_write() drops the ones
+	 * the handle does not want.
+	 */
 	libunwindstack_populate_regs(&bun_frame, registers);
 
 	return bun_frame_write(writer, &bun_frame) > 0;
@@ -240,83 +279,115 @@ struct bun_buffer *buffer)
 	return hdr->size;
 }
 
+/*
+ * Returns the maps of the process of `pid`, parsing them only if the cached
+ * ones are stale or `reload` is true.
+ */
+static std::shared_ptr<unwindstack::RemoteMaps>
+remote_maps_get(libunwindstack_context *context, pid_t pid, bool reload)
+{
+	struct bun_maps_stamp stamp;
+
+	if (bun_maps_stamp_get(pid, &stamp) == false)
+		return nullptr;
+
+	{
+		std::lock_guard<std::mutex> guard(context->lock);
+		int slot = bun_maps_table_find(&context->table, pid);
+
+		if (reload == false && slot >= 0 &&
+		    context->maps[slot] != nullptr &&
+		    bun_maps_stamp_equal(&context->stamps[slot], &stamp) == true)
+			return context->maps[slot];
+	}
+
+	auto maps = std::make_shared<unwindstack::RemoteMaps>(pid);
+	if (maps->Parse() == false)
+		return nullptr;
+
+	std::lock_guard<std::mutex> guard(context->lock);
+	size_t slot = bun_maps_table_slot(&context->table, pid);
+
+	context->stamps[slot] = stamp;
+	context->maps[slot] = maps;
+	return maps;
+}
+
+/*
+ * The target is stopped for as short as possible: the maps are looked up
+ * before attaching, since they are read from /proc and do not need the target
+ * to be stopped, and every other step starts as soon as the stop has been
+ * observed. If the unwind ran into an address missing from cached maps, the
+ * maps are parsed again and the unwind is retried once.
+ */
 size_t libunwindstack_unwind_remote(struct bun_handle *handle,
 	struct bun_buffer *buffer, pid_t pid)
 {
+	auto *context = static_cast<libunwindstack_context *>(
+	    handle->backend_context);
 	auto *hdr = static_cast<struct bun_payload_header *>(
 	    bun_buffer_payload(buffer));
 	bun_writer_t writer;
-	int ptrace_result;
+	size_t result = 0;
+	bool reload = false;
 
 	bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle);
 
 	bun_header_backend_set(&writer, BUN_BACKEND_LIBUNWINDSTACK);
 	bun_header_tid_set(&writer, pid);
 
-	ptrace_result = ptrace(PTRACE_ATTACH, pid, 0, 0);
-	if (ptrace_result != 0) {
-		return 0;
-	}
-
-	int waitpid_status;
-	waitpid(pid, &waitpid_status, 0);
-	if (!WIFSTOPPED(waitpid_status)) {
-		return 0;
-	}
-
-	/* Wait to ensure that we observe ptrace stop state. */
-	usleep(50000);
-
-	sched_yield();
-
 	std::unique_ptr<unwindstack::Regs> registers;
-	    unwindstack::RemoteMaps remote_maps(pid);
-
-	/* Wait to ensure that we observe ptrace stop state. */
-	usleep(50000);
-
+	auto remote_maps = remote_maps_get(context, pid, false);
 
-	if (remote_maps.Parse() == false) {
-		ptrace(PTRACE_DETACH, pid, 0, 0);
+	if (remote_maps == nullptr)
 		return 0;
-	}
 
-	/* Wait to ensure that we observe ptrace stop state. */
-	usleep(50000);
+	if (bun_ptrace_attach(pid, handle->flags, 5000) == false)
+		return 0;
 
-	registers = std::unique_ptr<unwindstack::Regs>(
-	    unwindstack::Regs::RemoteGet(pid));
+	{
+		auto process_memory =
+		    unwindstack::Memory::CreateProcessMemory(pid);
 
-	/* Wait to ensure that we observe ptrace stop state. */
-	usleep(50000);
+		constexpr static size_t max_frames = 512;
 
-	auto process_memory = unwindstack::Memory::CreateProcessMemory(pid);
+		for (;;) {
+			/* The unwinder updates the registers as it goes. */
+			registers.reset(unwindstack::Regs::RemoteGet(pid));
+			if (registers == nullptr)
+				goto detach;
 
-	/* Wait to ensure that we observe ptrace stop state. */
-	usleep(50000);
+			unwindstack::Unwinder unwinder{
+			    max_frames, remote_maps.get(), registers.get(),
+			    process_memory
+			};
 
-	constexpr static size_t max_frames = 512;
-	unwindstack::Unwinder unwinder{
-	    max_frames, &remote_maps, registers.get(), process_memory
-	};
+			unwinder.Unwind();
 
-	/* Wait to ensure that we observe ptrace stop state. */
-	usleep(50000);
+			if (unwinder.LastErrorCode() ==
+			    unwindstack::ERROR_INVALID_MAP && reload == false) {
+				reload = true;
+				remote_maps = remote_maps_get(context, pid, true);
+				if (remote_maps == nullptr)
+					goto detach;
 
-	unwinder.Unwind();
+				continue;
+			}
 
-	/* Wait to ensure that we observe ptrace stop state. */
-	usleep(50000);
+			for (const auto &frame : unwinder.frames()) {
+				if (libunwindstack_write_frame(frame,
+				    *registers, &writer) == false)
+					goto detach;
+			}
 
-	for (const auto &frame : unwinder.frames()) {
-		if (libunwindstack_write_frame(frame, *registers, &writer) == 0) {
-			ptrace(PTRACE_DETACH, pid, 0, 0);
-			return 0;
+			break;
 		}
 	}
 
-	ptrace(PTRACE_DETACH, pid, 0, 0);
-	return hdr->size;
+	result = hdr->size;
+detach:
+	bun_ptrace_detach(pid);
+	return result;
 }
 
 size_t libunwindstack_unwind_context(struct bun_handle *handle,
@@ -0,0 +1,507 @@
+#define _GNU_SOURCE
+#include "bun_perf.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <asm/perf_regs.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "../../bun_internal.h"
+#include "../../bun_maps.h"
+
+/* Time to wait for the target thread to run and be sampled, in ms. */
+#define PERF_SAMPLE_TIMEOUT 1000
+
+/* Number of data pages of the ring buffer, must be a power of two. */
+#define PERF_RING_PAGES 2
+
+/* Upper bound of the size of a sample record, in 64-bit words. */
+#define PERF_RECORD_WORDS 1024
+
+/*
+ * Registers requested with PERF_SAMPLE_REGS_USER, in the order of the
+ * kernel's numbering. Samples store them in that same order.
+ */
+static const struct {
+	int perf_reg;
+	enum bun_register bun_reg;
+} register_map[] = {
+#if defined(__x86_64__)
+	{PERF_REG_X86_AX, BUN_REGISTER_X86_64_RAX},
+	{PERF_REG_X86_BX, BUN_REGISTER_X86_64_RBX},
+	{PERF_REG_X86_CX, BUN_REGISTER_X86_64_RCX},
+	{PERF_REG_X86_DX, BUN_REGISTER_X86_64_RDX},
+	{PERF_REG_X86_SI, BUN_REGISTER_X86_64_RSI},
+	{PERF_REG_X86_DI, BUN_REGISTER_X86_64_RDI},
+	{PERF_REG_X86_BP, BUN_REGISTER_X86_64_RBP},
+	{PERF_REG_X86_SP, BUN_REGISTER_X86_64_RSP},
+	{PERF_REG_X86_IP, BUN_REGISTER_X86_64_RIP},
+	{PERF_REG_X86_R8, BUN_REGISTER_X86_64_R8},
+	{PERF_REG_X86_R9, BUN_REGISTER_X86_64_R9},
+	{PERF_REG_X86_R10, BUN_REGISTER_X86_64_R10},
+	{PERF_REG_X86_R11, BUN_REGISTER_X86_64_R11},
+	{PERF_REG_X86_R12, BUN_REGISTER_X86_64_R12},
+	{PERF_REG_X86_R13, BUN_REGISTER_X86_64_R13},
+	{PERF_REG_X86_R14, BUN_REGISTER_X86_64_R14},
+	{PERF_REG_X86_R15, BUN_REGISTER_X86_64_R15},
+#elif defined(__i386__)
+	{PERF_REG_X86_AX, BUN_REGISTER_X86_EAX},
+	{PERF_REG_X86_BX, BUN_REGISTER_X86_EBX},
+	{PERF_REG_X86_CX, BUN_REGISTER_X86_ECX},
+	{PERF_REG_X86_DX, BUN_REGISTER_X86_EDX},
+	{PERF_REG_X86_SI, BUN_REGISTER_X86_ESI},
+	{PERF_REG_X86_DI, BUN_REGISTER_X86_EDI},
+	{PERF_REG_X86_BP, BUN_REGISTER_X86_EBP},
+	{PERF_REG_X86_SP, BUN_REGISTER_X86_ESP},
+	{PERF_REG_X86_IP, BUN_REGISTER_X86_EIP},
+#elif defined(__aarch64__)
+	{PERF_REG_ARM64_X0, BUN_REGISTER_AARCH64_X0},
+	{PERF_REG_ARM64_X1, BUN_REGISTER_AARCH64_X1},
+	{PERF_REG_ARM64_X2, BUN_REGISTER_AARCH64_X2},
+	{PERF_REG_ARM64_X3, BUN_REGISTER_AARCH64_X3},
+	{PERF_REG_ARM64_X4, BUN_REGISTER_AARCH64_X4},
+	{PERF_REG_ARM64_X5, BUN_REGISTER_AARCH64_X5},
+	{PERF_REG_ARM64_X6, BUN_REGISTER_AARCH64_X6},
+	{PERF_REG_ARM64_X7, BUN_REGISTER_AARCH64_X7},
+	{PERF_REG_ARM64_X8, BUN_REGISTER_AARCH64_X8},
+	{PERF_REG_ARM64_X9, BUN_REGISTER_AARCH64_X9},
+	{PERF_REG_ARM64_X10, BUN_REGISTER_AARCH64_X10},
+	{PERF_REG_ARM64_X11, BUN_REGISTER_AARCH64_X11},
+	{PERF_REG_ARM64_X12, BUN_REGISTER_AARCH64_X12},
+	{PERF_REG_ARM64_X13, BUN_REGISTER_AARCH64_X13},
+	{PERF_REG_ARM64_X14, BUN_REGISTER_AARCH64_X14},
+	{PERF_REG_ARM64_X15, BUN_REGISTER_AARCH64_X15},
+	{PERF_REG_ARM64_X16, BUN_REGISTER_AARCH64_X16},
+	{PERF_REG_ARM64_X17, BUN_REGISTER_AARCH64_X17},
+	{PERF_REG_ARM64_X18, BUN_REGISTER_AARCH64_X18},
+	{PERF_REG_ARM64_X19, BUN_REGISTER_AARCH64_X19},
+	{PERF_REG_ARM64_X20, BUN_REGISTER_AARCH64_X20},
+	{PERF_REG_ARM64_X21, BUN_REGISTER_AARCH64_X21},
+	{PERF_REG_ARM64_X22, BUN_REGISTER_AARCH64_X22},
+	{PERF_REG_ARM64_X23, BUN_REGISTER_AARCH64_X23},
+	{PERF_REG_ARM64_X24, BUN_REGISTER_AARCH64_X24},
+	{PERF_REG_ARM64_X25, BUN_REGISTER_AARCH64_X25},
+	{PERF_REG_ARM64_X26, BUN_REGISTER_AARCH64_X26},
+	{PERF_REG_ARM64_X27, BUN_REGISTER_AARCH64_X27},
+	{PERF_REG_ARM64_X28, BUN_REGISTER_AARCH64_X28},
+	{PERF_REG_ARM64_X29, BUN_REGISTER_AARCH64_X29},
+	{PERF_REG_ARM64_LR, BUN_REGISTER_AARCH64_X30},
+	{PERF_REG_ARM64_SP, BUN_REGISTER_AARCH64_X31},
+	{PERF_REG_ARM64_PC, BUN_REGISTER_AARCH64_PC},
+#elif defined(__arm__)
+	{PERF_REG_ARM_R0, BUN_REGISTER_ARM_R0},
+	{PERF_REG_ARM_R1, BUN_REGISTER_ARM_R1},
+	{PERF_REG_ARM_R2, BUN_REGISTER_ARM_R2},
+	{PERF_REG_ARM_R3, BUN_REGISTER_ARM_R3},
+	{PERF_REG_ARM_R4, BUN_REGISTER_ARM_R4},
+	{PERF_REG_ARM_R5, BUN_REGISTER_ARM_R5},
+	{PERF_REG_ARM_R6, BUN_REGISTER_ARM_R6},
+	{PERF_REG_ARM_R7, BUN_REGISTER_ARM_R7},
+	{PERF_REG_ARM_R8, BUN_REGISTER_ARM_R8},
+	{PERF_REG_ARM_R9, BUN_REGISTER_ARM_R9},
+	{PERF_REG_ARM_R10, BUN_REGISTER_ARM_R10},
+	{PERF_REG_ARM_FP, BUN_REGISTER_ARM_R11},
+	{PERF_REG_ARM_IP, BUN_REGISTER_ARM_R12},
+	{PERF_REG_ARM_SP, BUN_REGISTER_ARM_R13},
+	{PERF_REG_ARM_LR, BUN_REGISTER_ARM_R14},
+	{PERF_REG_ARM_PC, BUN_REGISTER_ARM_R15},
+#endif
+};
+
+#define REGISTER_MAP_COUNT (sizeof(register_map) / sizeof(*register_map))
+
+struct bun_perf_context {
+	size_t page_size;
+	uint64_t regs_mask;
+	struct bun_maps_cache maps;
+};
+
+/*
+ * The fields of a PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN |
+ * PERF_SAMPLE_REGS_USER record. `regs` is NULL if the kernel did not
+ * capture the user registers.
+ */
+struct perf_sample {
+	const uint64_t *ips;
+	uint64_t nr;
+	const uint64_t *regs;
+};
+
+static size_t perf_unwind_remote(struct bun_handle *handle,
+    struct bun_buffer *buffer, pid_t tid);
+static void destroy_handle(struct bun_handle *handle);
+
+bool
+bun_internal_initialize_perf(struct bun_handle *handle)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || \
+    defined(__arm__)
+	struct bun_perf_context *context;
+	long page_size;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0)
+		return false;
+
+	context = malloc(sizeof(struct bun_perf_context));
+	if (context == NULL)
+		return false;
+
+	context->page_size = page_size;
+	context->regs_mask = 0;
+	for (size_t i = 0; i < REGISTER_MAP_COUNT; i++)
+		context->regs_mask |= 1ULL << register_map[i].perf_reg;
+
+	bun_maps_cache_init(&context->maps);
+	handle->backend_context = context;
+	handle->unwind_remote = perf_unwind_remote;
+	handle->destroy = destroy_handle;
+	return true;
+#else
+	(void) handle;
+	return false;
+#endif
+}
+
+/*
+ * Opens a task clock event on the thread, sampling its user-space callchain
+ * and registers. The event is created disabled.
+ */
+static int
+perf_event_create(const struct bun_perf_context *context, pid_t tid)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = PERF_COUNT_SW_TASK_CLOCK;
+
+	/* The kernel raises this to its minimum hrtimer period. */
+	attr.sample_period = 1;
+	attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN |
+	    PERF_SAMPLE_REGS_USER;
+	attr.sample_regs_user = context->regs_mask;
+	attr.wakeup_events = 1;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.exclude_callchain_kernel = 1;
+
+	return syscall(SYS_perf_event_open, &attr, tid, -1, -1,
+	    PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * Copies `size` bytes at position `offset` of the ring, which may wrap.
+ */
+static void
+ring_copy(void *dest, const char *ring, size_t ring_size, uint64_t offset,
+    size_t size)
+{
+	size_t start = offset & (ring_size - 1);
+	size_t first = size;
+
+	if (first > ring_size - start)
+		first = ring_size - start;
+
+	memcpy(dest, ring + start, first);
+	memcpy((char *)dest + first, ring, size - first);
+	return;
+}
+
+/*
+ * Copies the first sample record of the ring into `record`.
+ *
+ * Returns false if the ring does not hold a complete sample yet.
+ */
+static bool
+ring_sample_read(const struct bun_perf_context *context,
+    const struct perf_event_mmap_page *page, uint64_t *record,
+    size_t record_size)
+{
+	const size_t ring_size = PERF_RING_PAGES * context->page_size;
+	const char *ring = (const char *)page + context->page_size;
+	uint64_t head, tail;
+
+	head = __atomic_load_n(&page->data_head, __ATOMIC_ACQUIRE);
+
+	/* Nothing is ever consumed, records start at the beginning. */
+	for (tail = 0; tail + sizeof(struct perf_event_header) <= head;) {
+		struct perf_event_header header;
+
+		ring_copy(&header, ring, ring_size, tail, sizeof(header));
+		if (header.size < sizeof(header) || tail + header.size > head)
+			return false;
+
+		if (header.type == PERF_RECORD_SAMPLE) {
+			if (header.size > record_size)
+				return false;
+
+			ring_copy(record, ring, ring_size, tail, header.size);
+			return true;
+		}
+
+		tail += header.size;
+	}
+
+	return false;
+}
+
+/*
+ * Decodes the sample record, checking the counts against its size.
+ */
+static bool
+sample_parse(const struct bun_perf_context *context, const uint64_t *record,
+    struct perf_sample *sample)
+{
+	const struct perf_event_header *header = (const void *)record;
+	const size_t words = header->size / sizeof(uint64_t);
+	/* Skip the header and the pid/tid pair. */
+	size_t i = 2;
+	uint64_t abi;
+
+	if (i >= words)
+		return false;
+
+	sample->nr = record[i++];
+	if (sample->nr > words - i)
+		return false;
+
+	sample->ips = &record[i];
+	i += sample->nr;
+
+	if (i >= words)
+		return false;
+
+	abi = record[i++];
+	sample->regs = NULL;
+	if (abi == PERF_SAMPLE_REGS_ABI_NONE)
+		return true;
+
+	if (words - i < (size_t)__builtin_popcountll(context->regs_mask))
+		return false;
+
+	sample->regs = &record[i];
+	return true;
+}
+
+/*
+ * Waits for the first sample of the event.
+ *
+ * Returns false on timeout or if the thread exited.
+ */
+static bool
+sample_wait(const struct bun_perf_context *context, int fd,
+    const struct perf_event_mmap_page *page, uint64_t *record,
+    size_t record_size)
+{
+	struct timespec now, deadline;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &deadline) != 0)
+		return false;
+
+	deadline.tv_sec += PERF_SAMPLE_TIMEOUT / 1000;
+	deadline.tv_nsec += (PERF_SAMPLE_TIMEOUT % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	for (;;) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		long remaining;
+		int r;
+
+		if (ring_sample_read(context, page, record, record_size) == true)
+			return true;
+
+		if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+			return false;
+
+		remaining = (deadline.tv_sec - now.tv_sec) * 1000L +
+		    (deadline.tv_nsec - now.tv_nsec) / 1000000L;
+		if (remaining <= 0)
+			return false;
+
+		r = poll(&pfd, 1, (int)remaining);
+		if (r == -1 && errno != EINTR)
+			return false;
+
+		if (r > 0 && (pfd.revents & (POLLHUP | POLLERR)) != 0)
+			return ring_sample_read(context, page, record,
+			    record_size);
+	}
+}
+
+/*
+ * Points paths[i] to the path of the mapping containing addrs[i], or NULL.
+ * The cached maps are read again once if an address is not mapped at all in
+ * them, since the mapping may be new.
+ *
+ * Returns the maps the paths point into, to be released by the caller, or
+ * NULL if they cannot be read.
+ */
+static struct bun_maps *
+mapping_paths_resolve(struct bun_maps_cache *cache, pid_t tid,
+    const uint64_t *addrs, size_t count, const char **paths)
+{
+	bool reload = false;
+
+	for (;;) {
+		struct bun_maps *maps;
+		bool missing = false;
+
+		maps = bun_maps_cache_get(cache, tid, reload);
+		if (maps == NULL) {
+			for (size_t i = 0; i < count; i++)
+				paths[i] = NULL;
+
+			return NULL;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			const struct bun_maps_entry *entry;
+
+			entry = bun_maps_find(maps, addrs[i]);
+			paths[i] = entry != NULL ? entry->path : NULL;
+			missing |= entry == NULL;
+		}
+
+		if (missing == false || reload == true)
+			return maps;
+
+		bun_maps_release(maps);
+		reload = true;
+	}
+}
+
+static bool
+frame_write(struct bun_writer *writer, uint64_t addr, const char *path,
+    const struct perf_sample *sample, bool innermost)
+{
+	struct bun_frame frame;
+	char registers[(REGISTER_MAP_COUNT + 1) *
+	    (sizeof(uint16_t) + sizeof(uint64_t))];
+
+	memset(&frame, 0, sizeof(frame));
+	frame.addr = addr;
+	frame.filename = path;
+	frame.register_buffer_size = sizeof(registers);
+	frame.register_data = registers;
+
+	/* Registers are only known for the sampled instruction. */
+	if (innermost == true && sample->regs != NULL) {
+		for (size_t i = 0; i < REGISTER_MAP_COUNT; i++) {
+			if (bun_writer_register_wanted(writer,
+			    register_map[i].bun_reg) == false)
+				continue;
+
+			bun_frame_register_append(&frame,
+			    register_map[i].bun_reg, sample->regs[i]);
+		}
+	}
+
+	return bun_frame_write(writer, &frame) != 0;
+}
+
+static size_t
+perf_unwind_remote(struct bun_handle *handle, struct bun_buffer *buffer,
+    pid_t tid)
+{
+	struct bun_perf_context *context = handle->backend_context;
+	const size_t map_size = (PERF_RING_PAGES + 1) * context->page_size;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+	const char *paths[PERF_MAX_STACK_DEPTH];
+	uint64_t addrs[PERF_MAX_STACK_DEPTH];
+	uint64_t record[PERF_RECORD_WORDS];
+	struct perf_event_mmap_page *page;
+	struct perf_sample sample;
+	struct bun_maps *maps = NULL;
+	struct bun_writer writer;
+	size_t count = 0;
+	size_t result = 0;
+	bool sampled;
+	int fd;
+
+	fd = perf_event_create(context, tid);
+	if (fd == -1)
+		return 0;
+
+	page = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED) {
+		close(fd);
+		return 0;
+	}
+
+	sampled = ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) == 0 &&
+	    sample_wait(context, fd, page, record, sizeof(record)) == true;
+
+	/* The sample was copied out of the ring, the event is not needed. */
+	munmap(page, map_size);
+	close(fd);
+
+	if (sampled == false || sample_parse(context, record, &sample) == false)
+		return 0;
+
+	/* Drop the context markers, only user-space entries are left. */
+	for (uint64_t i = 0; i < sample.nr && count < PERF_MAX_STACK_DEPTH;
+	    i++) {
+		if (sample.ips[i] >= PERF_CONTEXT_MAX)
+			continue;
+
+		addrs[count++] = sample.ips[i];
+	}
+
+	if (count == 0)
+		return 0;
+
+	if ((handle->flags & BUN_HANDLE_SKIP_SYMBOLS) == 0) {
+		maps = mapping_paths_resolve(&context->maps, tid, addrs, count,
+		    paths);
+	} else {
+		memset(paths, 0, sizeof(paths));
+	}
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		goto out;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_PERF);
+	bun_header_tid_set(&writer, tid);
+
+	for (size_t i = 0; i < count; i++) {
+		if (frame_write(&writer, addrs[i], paths[i], &sample,
+		    i == 0) == false)
+			goto out;
+	}
+
+	result = hdr->size;
+out:
+	if (maps != NULL)
+		bun_maps_release(maps);
+
+	return result;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+	struct bun_perf_context *context = handle->backend_context;
+
+	bun_maps_cache_deinit(&context->maps);
+	free(context);
+	return;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <bun/bun.h>
+
+/*
+ * Initialize the perf_event_open(2) backend. This function is only meant for
+ * internal use.
+ */
+bool bun_internal_initialize_perf(struct bun_handle *handle);
@@ -0,0 +1,535 @@
+#define _GNU_SOURCE
+#include "bun_sframe.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ucontext.h>
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_internal.h"
+#include "../../bun_modules.h"
+
+#if defined(BUN_DWARF_ENABLED)
+#include "../dwarf/bun_dwarf.h"
+#elif defined(BUN_FRAMEPOINTER_ENABLED)
+#include "../framepointer/bun_framepointer.h"
+#endif
+
+/* See the SFrame format specification, versions 1 and 2. */
+#define SFRAME_MAGIC 0xdee2
+#define SFRAME_VERSION_1 1
+#define SFRAME_VERSION_2 2
+
+#define SFRAME_F_FDE_SORTED 0x1
+#define SFRAME_F_FDE_FUNC_START_PCREL 0x4
+
+#define SFRAME_ABI_AARCH64_ENDIAN_LITTLE 2
+#define SFRAME_ABI_AMD64_ENDIAN_LITTLE 3
+
+#define SFRAME_HEADER_SIZE 28
+#define SFRAME_FDE_SIZE_V1 17
+#define SFRAME_FDE_SIZE_V2 20
+
+#define SFRAME_FRE_TYPE_ADDR1 0
+#define SFRAME_FRE_TYPE_ADDR2 1
+#define SFRAME_FRE_TYPE_ADDR4 2
+
+#define SFRAME_FDE_TYPE_PCMASK 1
+
+#define SFRAME_BASE_REG_FP 0
+
+#if defined(__x86_64__)
+#define SFRAME_ABI SFRAME_ABI_AMD64_ENDIAN_LITTLE
+#define RETURN_ADDRESS_MASK UINTPTR_MAX
+#elif defined(__aarch64__)
+#define SFRAME_ABI SFRAME_ABI_AARCH64_ENDIAN_LITTLE
+#define RETURN_ADDRESS_MASK 0x0000ffffffffffffULL
+#endif
+
+/*
+ * The parts of the section header needed for lookups.
+ */
+struct sframe_section {
+	const uint8_t *start;
+	const uint8_t *fdes;
+	const uint8_t *fres;
+	const uint8_t *end;
+	uint32_t fde_count;
+	size_t fde_size;
+	uint8_t version;
+	uint8_t flags;
+	int8_t fixed_ra_offset;
+};
+
+struct sframe_fde {
+	uintptr_t start;
+	uint32_t size;
+	uint32_t fre_offset;
+	uint32_t fre_count;
+	uint8_t info;
+	uint8_t rep_size;
+};
+
+/*
+ * Recovery rules of a frame row entry. Offsets are relative to the CFA, and
+ * only meaningful if the matching flag is set.
+ */
+struct sframe_rules {
+	int base_register;
+	intptr_t cfa_offset;
+	intptr_t ra_offset;
+	intptr_t fp_offset;
+	bool ra_saved;
+	bool fp_saved;
+};
+
+struct bun_sframe_context {
+	struct bun_module_table modules;
+	size_t stack_limit;
+};
+
+static size_t sframe_unwind(struct bun_handle *handle,
+    struct bun_buffer *buffer);
+static size_t sframe_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context);
+static size_t sframe_unwind_impl(struct bun_cursor *cursor,
+    struct bun_handle *handle, struct bun_buffer *buffer);
+static void destroy_handle(struct bun_handle *handle);
+
+bool
+bun_internal_initialize_sframe(struct bun_handle *handle)
+{
+#if defined(SFRAME_ABI)
+	struct bun_sframe_context *context;
+
+	context = malloc(sizeof(struct bun_sframe_context));
+	if (context == NULL)
+		return false;
+
+	if (bun_module_table_init(&context->modules) == false) {
+		free(context);
+		return false;
+	}
+
+	context->stack_limit = bun_cursor_stack_limit();
+
+	handle->backend_context = context;
+	handle->unwind = sframe_unwind;
+	handle->unwind_context = sframe_unwind_context;
+	handle->destroy = destroy_handle;
+	return true;
+#else
+	/* SFrame is only defined for x86-64 and AArch64. */
+	(void) handle;
+	return false;
+#endif
+}
+
+#if defined(SFRAME_ABI)
+static uint32_t
+load_u32(const uint8_t *p)
+{
+	uint32_t value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static bool
+section_init(struct sframe_section *section, const uint8_t *start,
+    size_t size)
+{
+	const uint8_t *header_end;
+	uint16_t magic;
+	uint32_t fre_length, fde_offset, fre_offset;
+
+	if (start == NULL || size < SFRAME_HEADER_SIZE)
+		return false;
+
+	memcpy(&magic, start, sizeof(magic));
+	if (magic != SFRAME_MAGIC || start[4] != SFRAME_ABI)
+		return false;
+
+	section->version = start[2];
+	section->flags = start[3];
+	if (section->version == SFRAME_VERSION_1) {
+		section->fde_size = SFRAME_FDE_SIZE_V1;
+	} else if (section->version == SFRAME_VERSION_2) {
+		section->fde_size = SFRAME_FDE_SIZE_V2;
+	} else {
+		return false;
+	}
+
+	/* The FDEs must be sorted for the binary search. */
+	if ((section->flags & SFRAME_F_FDE_SORTED) == 0)
+		return false;
+
+	section->fixed_ra_offset = (int8_t)start[6];
+	section->fde_count = load_u32(start + 8);
+	fre_length = load_u32(start + 16);
+	fde_offset = load_u32(start + 20);
+	fre_offset = load_u32(start + 24);
+
+	header_end = start + SFRAME_HEADER_SIZE + start[7];
+	section->start = start;
+	section->end = start + size;
+	if (header_end > section->end ||
+	    fde_offset > (size_t)(section->end - header_end) ||
+	    fre_offset > (size_t)(section->end - header_end))
+		return false;
+
+	section->fdes = header_end + fde_offset;
+	section->fres = header_end + fre_offset;
+	if ((size_t)(section->end - section->fdes) / section->fde_size <
+	    section->fde_count ||
+	    fre_length > (size_t)(section->end - section->fres))
+		return false;
+
+	section->end = section->fres + fre_length;
+	return true;
+}
+
+static void
+fde_load(const struct sframe_section *section, uint32_t index,
+    struct sframe_fde *fde)
+{
+	const uint8_t *p = section->fdes + (size_t)index * section->fde_size;
+	int32_t start;
+
+	memcpy(&start, p, sizeof(start));
+	if ((section->flags & SFRAME_F_FDE_FUNC_START_PCREL) != 0) {
+		fde->start = (uintptr_t)p + start;
+	} else {
+		fde->start = (uintptr_t)section->start + start;
+	}
+
+	fde->size = load_u32(p + 4);
+	fde->fre_offset = load_u32(p + 8);
+	fde->fre_count = load_u32(p + 12);
+	fde->info = p[16];
+	fde->rep_size = section->version == SFRAME_VERSION_1 ? 0 : p[17];
+	return;
+}
+
+/*
+ * Finds the FDE of the function containing pc with a binary search.
+ */
+static bool
+fde_find(const struct sframe_section *section, uintptr_t pc,
+    struct sframe_fde *fde)
+{
+	uint32_t low = 0;
+	uint32_t high = section->fde_count;
+
+	if (high == 0)
+		return false;
+
+	while (high - low > 1) {
+		uint32_t mid = low + (high - low) / 2;
+
+		fde_load(section, mid, fde);
+		if (fde->start <= pc)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	fde_load(section, low, fde);
+	return pc >= fde->start && pc - fde->start < fde->size;
+}
+
+static bool
+read_offset(const uint8_t **p, const uint8_t *end, size_t size,
+    intptr_t *value)
+{
+	int8_t s8;
+	int16_t s16;
+	int32_t s32;
+
+	if ((size_t)(end - *p) < size)
+		return false;
+
+	switch (size) {
+	case 1:
+		memcpy(&s8, *p, size);
+		*value = s8;
+		break;
+	case 2:
+		memcpy(&s16, *p, size);
+		*value = s16;
+		break;
+	case 4:
+		memcpy(&s32, *p, size);
+		*value = s32;
+		break;
+	default:
+		return false;
+	}
+
+	*p += size;
+	return true;
+}
+
+/*
+ * Decodes the frame row entry of the FDE applying to `pc`. The entries of a
+ * function are few and variable-sized, so they are scanned linearly.
+ *
+ * Returns false if the entries are malformed or the return address is
+ * undefined, which marks the outermost frame.
+ */
+static bool
+fre_find(const struct sframe_section *section, const struct sframe_fde *fde,
+    uintptr_t pc, struct sframe_rules *rules)
+{
+	static const size_t address_sizes[] = { 1, 2, 4 };
+	const uint8_t *p = section->fres + fde->fre_offset;
+	const uint8_t fre_type = fde->info & 0xf;
+	uintptr_t offset = pc - fde->start;
+	bool found = false;
+
+	if (fre_type > SFRAME_FRE_TYPE_ADDR4 || fde->fre_offset >
+	    (size_t)(section->end - section->fres))
+		return false;
+
+	if (((fde->info >> 4) & 1) == SFRAME_FDE_TYPE_PCMASK) {
+		/* Repeated blocks of code, such as PLT entries. */
+		if (fde->rep_size == 0)
+			return false;
+		offset %= fde->rep_size;
+	}
+
+	for (uint32_t i = 0; i < fde->fre_count; i++) {
+		const size_t address_size = address_sizes[fre_type];
+		intptr_t offsets[3] = { 0 };
+		uint32_t start = 0;
+		size_t offset_size, count;
+		uint8_t info;
+
+		if ((size_t)(section->end - p) < address_size + 1)
+			return false;
+
+		memcpy(&start, p, address_size);
+		p += address_size;
+		info = *p++;
+
+		/* Entries are sorted by start address. */
+		if (start > offset)
+			break;
+
+		count = (info >> 1) & 0xf;
+		offset_size = (size_t)1 << ((info >> 5) & 0x3);
+		for (size_t j = 0; j < count; j++) {
+			intptr_t value;
+
+			if (read_offset(&p, section->end, offset_size,
+			    &value) == false)
+				return false;
+			if (j < 3)
+				offsets[j] = value;
+		}
+
+		if (count == 0 || count > 3) {
+			found = false;
+			continue;
+		}
+
+		memset(rules, 0, sizeof(*rules));
+		rules->base_register = (info & 1) == SFRAME_BASE_REG_FP ?
+		    BUN_CURSOR_REGISTER_FP : BUN_CURSOR_REGISTER_SP;
+		rules->cfa_offset = offsets[0];
+#if defined(__x86_64__)
+		/* The return address is always at a fixed offset. */
+		rules->ra_saved = true;
+		rules->ra_offset = section->fixed_ra_offset;
+		rules->fp_saved = count > 1;
+		rules->fp_offset = offsets[1];
+#else
+		rules->ra_saved = count > 1;
+		rules->ra_offset = offsets[1];
+		rules->fp_saved = count > 2;
+		rules->fp_offset = offsets[2];
+#endif
+		found = true;
+	}
+
+	return found;
+}
+
+/*
+ * Hands the frame over to the configured fallback unwinder.
+ */
+static bool
+fallback_step(const struct bun_module_table *modules,
+    struct bun_cursor *cursor)
+{
+
+#if defined(BUN_DWARF_ENABLED)
+	return bun_internal_dwarf_step(modules, cursor);
+#elif defined(BUN_FRAMEPOINTER_ENABLED)
+	(void) modules;
+	return bun_internal_framepointer_step(cursor);
+#else
+	(void) modules;
+	(void) cursor;
+	return false;
+#endif
+}
+#endif /* SFRAME_ABI */
+
+bool
+bun_internal_sframe_step(const struct bun_module_table *modules,
+    struct bun_cursor *cursor)
+{
+#if defined(SFRAME_ABI)
+	const struct bun_module *module;
+	struct sframe_section section;
+	struct sframe_rules rules;
+	struct sframe_fde fde;
+	uintptr_t pc = cursor->pc;
+	uintptr_t cfa, ra, fp;
+	uint64_t valid;
+
+	if (cursor->return_address == true)
+		pc--;
+
+	module = bun_module_table_find(modules, pc);
+	if (module == NULL ||
+	    bun_module_probe(module, &cursor->probed_module) == false)
+		return false;
+
+	if (section_init(&section, module->sframe,
+	    module->sframe_size) == false ||
+	    fde_find(&section, pc, &fde) == false)
+		return fallback_step(modules, cursor);
+
+	if (fre_find(&section, &fde, pc, &rules) == false)
+		return false;
+
+	if ((cursor->regs_valid &
+	    BUN_CURSOR_REGISTER_BIT(rules.base_register)) == 0)
+		return false;
+
+	cfa = cursor->regs[rules.base_register] + rules.cfa_offset;
+
+	if (rules.ra_saved == true) {
+		if (bun_cursor_read(cursor, cfa + rules.ra_offset, &ra) == false)
+			return false;
+	} else {
+		/* Still in the link register. */
+		if ((cursor->regs_valid &
+		    BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_RA)) == 0)
+			return false;
+		ra = cursor->regs[BUN_CURSOR_REGISTER_RA];
+	}
+
+	valid = BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_SP);
+	if (rules.fp_saved == true) {
+		if (bun_cursor_read(cursor, cfa + rules.fp_offset, &fp) == false)
+			return false;
+		valid |= BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_FP);
+	} else {
+		fp = bun_cursor_fp(cursor);
+		valid |= cursor->regs_valid &
+		    BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_FP);
+	}
+
+	ra &= RETURN_ADDRESS_MASK;
+	if (ra == 0)
+		return false;
+
+	if (ra == cursor->pc && cfa == bun_cursor_sp(cursor))
+		return false;
+
+	if (bun_cursor_advance(cursor, cfa) == false)
+		return false;
+
+	/* SFrame only describes the stack and frame pointers. */
+	cursor->pc = ra;
+	cursor->regs[BUN_CURSOR_REGISTER_SP] = cfa;
+	cursor->regs[BUN_CURSOR_REGISTER_FP] = fp;
+	cursor->regs_valid = valid;
+	cursor->return_address = true;
+	return true;
+#else
+	(void) modules;
+	(void) cursor;
+	return false;
+#endif
+}
+
+static size_t __attribute__((noinline))
+sframe_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
+{
+	struct bun_sframe_context *context = handle->backend_context;
+	struct bun_cursor cursor;
+	ucontext_t uc;
+
+	if (getcontext(&uc) != 0)
+		return 0;
+
+	if (bun_cursor_init_context(&cursor, &uc, context->stack_limit) == false)
+		return 0;
+
+	/* The saved pc is the return address of getcontext(). */
+	cursor.return_address = true;
+
+	/* Skip the frame of this function. */
+	if (bun_internal_sframe_step(&context->modules, &cursor) == false)
+		return 0;
+
+	return sframe_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+sframe_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
+    void *context)
+{
+	struct bun_sframe_context *sframe_context = handle->backend_context;
+	struct bun_cursor cursor;
+
+	if (bun_cursor_init_context(&cursor, context,
+	    sframe_context->stack_limit) == false)
+		return 0;
+
+	return sframe_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+sframe_unwind_impl(struct bun_cursor *cursor, struct bun_handle *handle,
+    struct bun_buffer *buffer)
+{
+	struct bun_sframe_context *context = handle->backend_context;
+	struct bun_writer writer;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		return 0;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_SFRAME);
+	bun_header_tid_set(&writer, bun_gettid());
+
+	do {
+		if (bun_cursor_write_frame(cursor, &writer, handle) == false)
+			return 0;
+	} while (bun_internal_sframe_step(&context->modules, cursor) == true);
+
+	return hdr->size;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+	struct bun_sframe_context *context = handle->backend_context;
+
+	bun_module_table_deinit(&context->modules);
+	free(context);
+	return;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <bun/bun.h>
+
+struct bun_cursor;
+struct bun_module_table;
+
+/*
+ * Initialize the SFrame backend. This function is only meant for internal
+ * use.
+ */
+bool bun_internal_initialize_sframe(struct bun_handle *handle);
+
+/*
+ * Moves the cursor to the caller's frame using the .sframe section of the
+ * module containing the cursor's pc. Frames not covered by SFrame data are
+ * handed to the DWARF backend, or to the frame pointer backend if the former
+ * is not built. This function is only meant for internal use.
+ *
+ * Returns false if the frame cannot be unwound.
+ */
+bool bun_internal_sframe_step(const struct bun_module_table *modules,
+    struct bun_cursor *cursor);
@@ -0,0 +1,223 @@
+#define _GNU_SOURCE
+#include "bun_shadow.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <bun/bun.h>
+#include <bun/shadow.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_internal.h"
+
+static_assert((BUN_SHADOW_STACK_DEPTH & (BUN_SHADOW_STACK_DEPTH - 1)) == 0,
+    "The shadow stack depth must be a power of two");
+
+struct shadow_entry {
+	uintptr_t function;
+	uintptr_t call_site;
+	uintptr_t cfa;
+};
+
+/*
+ * A ring of the innermost entries. `depth` is the real call depth, which
+ * may exceed the capacity; entry i lives at index i % BUN_SHADOW_STACK_DEPTH.
+ */
+struct shadow_stack {
+	struct shadow_entry entries[BUN_SHADOW_STACK_DEPTH];
+	size_t depth;
+};
+
+static __thread struct shadow_stack shadow_stack;
+
+static size_t shadow_unwind(struct bun_handle *handle,
+    struct bun_buffer *buffer);
+static size_t shadow_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context);
+static void destroy_handle(struct bun_handle *handle);
+
+bool
+bun_internal_initialize_shadow(struct bun_handle *handle)
+{
+
+	/* The stacks are per thread, the handle has no state. */
+	handle->backend_context = NULL;
+	handle->unwind = shadow_unwind;
+	handle->unwind_context = shadow_unwind_context;
+	handle->destroy = destroy_handle;
+	return true;
+}
+
+void
+bun_internal_shadow_push(void *function, void *call_site, uintptr_t cfa)
+{
+	struct shadow_stack *stack = &shadow_stack;
+	const size_t depth = stack->depth;
+	struct shadow_entry *entry;
+
+	/*
+	 * Reserve the slot before filling it, so that a signal handler
+	 * running in between cannot have its own entries overwritten. It may
+	 * see a stale entry at the top, which is harmless.
+	 */
+	stack->depth = depth + 1;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+	entry = &stack->entries[depth % BUN_SHADOW_STACK_DEPTH];
+	entry->function = (uintptr_t)function;
+	entry->call_site = (uintptr_t)call_site;
+	entry->cfa = cfa;
+	return;
+}
+
+void
+bun_shadow_enter(void *function, void *call_site)
+{
+
+	bun_internal_shadow_push(function, call_site,
+	    (uintptr_t)__builtin_dwarf_cfa());
+	return;
+}
+
+void
+bun_shadow_exit(void)
+{
+	struct shadow_stack *stack = &shadow_stack;
+
+	/* Tolerate unbalanced exits, e.g. from longjmp(3) or exceptions. */
+	if (stack->depth > 0)
+		stack->depth--;
+
+	return;
+}
+
+void
+bun_shadow_scope_exit(int *scope)
+{
+
+	(void) scope;
+	bun_shadow_exit();
+	return;
+}
+
+static bool
+write_frame(struct bun_writer *writer, struct bun_handle *handle,
+    uintptr_t pc)
+{
+	struct bun_cursor cursor;
+
+	memset(&cursor, 0, sizeof(cursor));
+	cursor.pc = pc;
+	return bun_cursor_write_frame(&cursor, writer, handle);
+}
+
+/*
+ * Writes the frames of the `count` innermost entries, innermost first. The
+ * innermost frame is `pc`, every entry then contributes the call site in its
+ * caller.
+ */
+static size_t
+shadow_write(struct bun_handle *handle, struct bun_buffer *buffer,
+    const struct shadow_stack *stack, size_t count, uintptr_t pc)
+{
+	struct bun_writer writer;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+	const size_t top = count;
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		return 0;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_SHADOW);
+	bun_header_tid_set(&writer, bun_gettid());
+
+	if (write_frame(&writer, handle, pc) == false)
+		return 0;
+
+	/* Older entries have been overwritten. */
+	if (count > BUN_SHADOW_STACK_DEPTH)
+		count = BUN_SHADOW_STACK_DEPTH;
+
+	for (size_t i = 1; i <= count; i++) {
+		const struct shadow_entry *entry =
+		    &stack->entries[(top - i) % BUN_SHADOW_STACK_DEPTH];
+
+		if (write_frame(&writer, handle, entry->call_site) == false)
+			return 0;
+	}
+
+	return hdr->size;
+}
+
+static size_t
+shadow_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
+{
+	const struct shadow_stack *stack = &shadow_stack;
+	const size_t depth = stack->depth;
+
+	if (depth == 0)
+		return 0;
+
+	return shadow_write(handle, buffer, stack, depth,
+	    stack->entries[(depth - 1) % BUN_SHADOW_STACK_DEPTH].function);
+}
+
+static bool
+on_stack(uintptr_t addr, uintptr_t low, uintptr_t high)
+{
+
+	return addr >= low && addr < high;
+}
+
+static size_t
+shadow_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
+    void *context)
+{
+	const struct shadow_stack *stack = &shadow_stack;
+	struct bun_cursor cursor;
+	uintptr_t sp, altstack_low = 0, altstack_high = 0;
+	size_t count = stack->depth;
+	stack_t altstack;
+
+	if (bun_cursor_init_context(&cursor, context, 0) == false)
+		return 0;
+
+	sp = bun_cursor_sp(&cursor);
+	if (sigaltstack(NULL, &altstack) == 0 &&
+	    (altstack.ss_flags & SS_ONSTACK) != 0) {
+		altstack_low = (uintptr_t)altstack.ss_sp;
+		altstack_high = altstack_low + altstack.ss_size;
+	}
+
+	/*
+	 * Skip the entries pushed by the signal handler. They were pushed
+	 * below the interrupted stack pointer, or on the alternate signal
+	 * stack if the interrupted code was not running on it.
+	 */
+	while (count > 0) {
+		const struct shadow_entry *entry =
+		    &stack->entries[(count - 1) % BUN_SHADOW_STACK_DEPTH];
+		const bool entry_alt = on_stack(entry->cfa, altstack_low,
+		    altstack_high);
+		const bool sp_alt = on_stack(sp, altstack_low, altstack_high);
+
+		if (entry_alt == sp_alt ? entry->cfa >= sp : sp_alt == true)
+			break;
+
+		count--;
+	}
+
+	return shadow_write(handle, buffer, stack, count, cursor.pc);
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+
+	(void) handle;
+	return;
+}
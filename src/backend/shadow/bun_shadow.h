@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <bun/bun.h>
+
+/*
+ * Initialize the shadow call stack backend. This function is only meant for
+ * internal use.
+ */
+bool bun_internal_initialize_shadow(struct bun_handle *handle);
+
+/*
+ * Pushes an entry onto the calling thread's shadow stack. `cfa` is the stack
+ * pointer of the caller at the call site, used to tell apart the entries
+ * pushed by a signal handler. This function is only meant for internal use.
+ */
+void bun_internal_shadow_push(void *function, void *call_site, uintptr_t cfa);
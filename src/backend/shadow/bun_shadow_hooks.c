@@ -0,0 +1,34 @@
+#include <stdint.h>
+
+#include <bun/shadow.h>
+
+#include "bun_shadow.h"
+
+/*
+ * Hooks called by code compiled with -finstrument-functions. They live in
+ * their own object file, so that the linker only pulls them out of the static
+ * library if the application does not define its own.
+ */
+void __cyg_profile_func_enter(void *function, void *call_site)
+    __attribute__((no_instrument_function));
+void __cyg_profile_func_exit(void *function, void *call_site)
+    __attribute__((no_instrument_function));
+
+void
+__cyg_profile_func_enter(void *function, void *call_site)
+{
+
+	bun_internal_shadow_push(function, call_site,
+	    (uintptr_t)__builtin_dwarf_cfa());
+	return;
+}
+
+void
+__cyg_profile_func_exit(void *function, void *call_site)
+{
+
+	(void) function;
+	(void) call_site;
+	bun_shadow_exit();
+	return;
+}
@@ -0,0 +1,375 @@
+#define _GNU_SOURCE
+#include "bun_table.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ucontext.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_internal.h"
+#include "../../bun_modules.h"
+#include "../dwarf/bun_dwarf.h"
+#include "bun_table_format.h"
+
+#if defined(__aarch64__)
+#define RETURN_ADDRESS_MASK 0x0000ffffffffffffULL
+#else
+#define RETURN_ADDRESS_MASK UINTPTR_MAX
+#endif
+
+struct table {
+	const struct bun_table_header *header;
+	const uint32_t *pcs;
+	const struct bun_table_entry *entries;
+	size_t size;
+};
+
+/*
+ * tables[i] is the table of modules.modules[i], or has a NULL header if the
+ * module has none. Like the module table, it is read-only once initialized.
+ */
+struct bun_table_context {
+	struct bun_module_table modules;
+	struct table *tables;
+	size_t stack_limit;
+};
+
+static size_t table_unwind(struct bun_handle *handle,
+    struct bun_buffer *buffer);
+static size_t table_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context);
+static size_t table_unwind_impl(struct bun_cursor *cursor,
+    struct bun_handle *handle, struct bun_buffer *buffer);
+static void destroy_handle(struct bun_handle *handle);
+
+bool
+bun_internal_table_path(char *dest, size_t size, const char *directory,
+    const uint8_t *build_id, size_t build_id_size)
+{
+	size_t length;
+	int written;
+
+	written = snprintf(dest, size, "%s/", directory);
+	if (written < 0 || (size_t)written >= size)
+		return false;
+
+	length = written;
+	for (size_t i = 0; i < build_id_size; i++) {
+		written = snprintf(dest + length, size - length, "%02x",
+		    build_id[i]);
+		if (written < 0 || (size_t)written >= size - length)
+			return false;
+		length += written;
+	}
+
+	written = snprintf(dest + length, size - length, "%s",
+	    BUN_TABLE_SUFFIX);
+	return written >= 0 && (size_t)written < size - length;
+}
+
+/*
+ * Maps the table of the module, if there is a valid one.
+ */
+static void
+table_load(struct table *table, const char *directory,
+    const struct bun_module *module)
+{
+	const struct bun_table_header *header;
+	char path[PATH_MAX];
+	struct stat st;
+	void *data;
+	int fd;
+
+	if (module->build_id == NULL ||
+	    module->build_id_size > BUN_TABLE_BUILD_ID_MAX)
+		return;
+
+	if (bun_internal_table_path(path, sizeof(path), directory,
+	    module->build_id, module->build_id_size) == false)
+		return;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return;
+
+	if (fstat(fd, &st) != 0 ||
+	    (size_t)st.st_size < sizeof(struct bun_table_header)) {
+		close(fd);
+		return;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return;
+
+	header = data;
+	if (header->magic != BUN_TABLE_MAGIC ||
+	    header->version != BUN_TABLE_VERSION ||
+	    header->architecture != BUN_ARCH_DETECTED ||
+	    header->count == 0 ||
+	    bun_table_size(header->count) != (size_t)st.st_size ||
+	    header->build_id_size != module->build_id_size ||
+	    memcmp(header->build_id, module->build_id,
+	    module->build_id_size) != 0) {
+		munmap(data, st.st_size);
+		return;
+	}
+
+	table->header = header;
+	table->pcs = (const uint32_t *)(header + 1);
+	table->entries = (const struct bun_table_entry *)(table->pcs +
+	    header->count);
+	table->size = st.st_size;
+	return;
+}
+
+bool
+bun_internal_initialize_table(struct bun_handle *handle)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+	struct bun_table_context *context;
+	const char *directory;
+
+	context = malloc(sizeof(struct bun_table_context));
+	if (context == NULL)
+		return false;
+
+	if (bun_module_table_init(&context->modules) == false) {
+		free(context);
+		return false;
+	}
+
+	context->tables = calloc(context->modules.count,
+	    sizeof(*context->tables));
+	if (context->tables == NULL) {
+		bun_module_table_deinit(&context->modules);
+		free(context);
+		return false;
+	}
+
+	directory = bun_cache_dir_get();
+	if (directory == NULL)
+		directory = "/tmp";
+
+	for (size_t i = 0; i < context->modules.count; i++)
+		table_load(&context->tables[i], directory,
+		    &context->modules.modules[i]);
+
+	context->stack_limit = bun_cursor_stack_limit();
+
+	handle->backend_context = context;
+	handle->unwind = table_unwind;
+	handle->unwind_context = table_unwind_context;
+	handle->destroy = destroy_handle;
+	return true;
+#else
+	(void) handle;
+	return false;
+#endif
+}
+
+/*
+ * Returns the entry covering the link-time address `pc`, or NULL.
+ */
+static const struct bun_table_entry *
+table_find(const struct table *table, uintptr_t pc)
+{
+	const struct bun_table_header *header = table->header;
+	uintptr_t offset;
+	size_t low, high;
+
+	if (pc < header->base || pc - header->base > UINT32_MAX)
+		return NULL;
+
+	offset = pc - header->base;
+
+	/* Find the last entry whose pc is not above offset. */
+	low = 0;
+	high = header->count;
+	while (high - low > 1) {
+		size_t mid = low + (high - low) / 2;
+
+		if (table->pcs[mid] <= offset)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	if (table->pcs[low] > offset)
+		return NULL;
+
+	return &table->entries[low];
+}
+
+static bool
+table_step(const struct bun_table_context *context, struct bun_cursor *cursor)
+{
+	const struct bun_table_entry *entry;
+	const struct bun_module *module;
+	const struct table *table;
+	uintptr_t pc = cursor->pc;
+	uintptr_t base, cfa, ra, fp;
+	uint64_t valid;
+	int base_register;
+
+	if (cursor->return_address == true)
+		pc--;
+
+	module = bun_module_table_find(&context->modules, pc);
+	if (module == NULL)
+		return false;
+
+	table = &context->tables[module - context->modules.modules];
+	if (table->header == NULL)
+		return bun_internal_dwarf_step(&context->modules, cursor);
+
+	entry = table_find(table, pc - module->bias);
+	if (entry == NULL)
+		return bun_internal_dwarf_step(&context->modules, cursor);
+
+	switch (entry->type) {
+	case BUN_TABLE_TYPE_CFA_SP:
+		base_register = BUN_CURSOR_REGISTER_SP;
+		break;
+	case BUN_TABLE_TYPE_CFA_FP:
+		base_register = BUN_CURSOR_REGISTER_FP;
+		break;
+	case BUN_TABLE_TYPE_FALLBACK:
+		return bun_internal_dwarf_step(&context->modules, cursor);
+	default:
+		return false;
+	}
+
+	if ((cursor->regs_valid & BUN_CURSOR_REGISTER_BIT(base_register)) == 0)
+		return false;
+
+	base = cursor->regs[base_register];
+	cfa = base + entry->cfa_offset;
+
+	if ((entry->flags & BUN_TABLE_RA_SAVED) != 0) {
+		if (bun_cursor_read(cursor, cfa + entry->ra_offset, &ra) == false)
+			return false;
+	} else {
+		if ((cursor->regs_valid &
+		    BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_RA)) == 0)
+			return false;
+		ra = cursor->regs[BUN_CURSOR_REGISTER_RA];
+	}
+
+	valid = BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_SP);
+	if ((entry->flags & BUN_TABLE_FP_SAVED) != 0) {
+		if (bun_cursor_read(cursor, cfa + entry->fp_offset, &fp) == false)
+			return false;
+		valid |= BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_FP);
+	} else {
+		fp = bun_cursor_fp(cursor);
+		valid |= cursor->regs_valid &
+		    BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_FP);
+	}
+
+	ra &= RETURN_ADDRESS_MASK;
+	if (ra == 0)
+		return false;
+
+	if (ra == cursor->pc && cfa == bun_cursor_sp(cursor))
+		return false;
+
+	if (bun_cursor_advance(cursor, cfa) == false)
+		return false;
+
+	/* Only the stack and frame pointers are recovered by the table. */
+	cursor->pc = ra;
+	cursor->regs[BUN_CURSOR_REGISTER_SP] = cfa;
+	cursor->regs[BUN_CURSOR_REGISTER_FP] = fp;
+	cursor->regs_valid = valid;
+	cursor->return_address =
+	    (entry->flags & BUN_TABLE_SIGNAL_FRAME) == 0;
+	return true;
+}
+
+static size_t __attribute__((noinline))
+table_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
+{
+	struct bun_table_context *context = handle->backend_context;
+	struct bun_cursor cursor;
+	ucontext_t uc;
+
+	if (getcontext(&uc) != 0)
+		return 0;
+
+	if (bun_cursor_init_context(&cursor, &uc, context->stack_limit) == false)
+		return 0;
+
+	/* The saved pc is the return address of getcontext(). */
+	cursor.return_address = true;
+
+	/* Skip the frame of this function. */
+	if (table_step(context, &cursor) == false)
+		return 0;
+
+	return table_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+table_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
+    void *context)
+{
+	struct bun_table_context *table_context = handle->backend_context;
+	struct bun_cursor cursor;
+
+	if (bun_cursor_init_context(&cursor, context,
+	    table_context->stack_limit) == false)
+		return 0;
+
+	return table_unwind_impl(&cursor, handle, buffer);
+}
+
+static size_t
+table_unwind_impl(struct bun_cursor *cursor, struct bun_handle *handle,
+    struct bun_buffer *buffer)
+{
+	struct bun_table_context *context = handle->backend_context;
+	struct bun_writer writer;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		return 0;
+
+	bun_header_backend_set(&writer, BUN_BACKEND_TABLE);
+	bun_header_tid_set(&writer, bun_gettid());
+
+	do {
+		if (bun_cursor_write_frame(cursor, &writer, handle) == false)
+			return 0;
+	} while (table_step(context, cursor) == true);
+
+	return hdr->size;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+	struct bun_table_context *context = handle->backend_context;
+
+	for (size_t i = 0; i < context->modules.count; i++) {
+		if (context->tables[i].header != NULL)
+			munmap((void *)context->tables[i].header,
+			    context->tables[i].size);
+	}
+
+	free(context->tables);
+	bun_module_table_deinit(&context->modules);
+	free(context);
+	return;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bun/bun.h>
+
+/*
+ * Initialize the precomputed unwind table backend. This function is only
+ * meant for internal use.
+ *
+ * Tables are looked up in the directory set with bun_cache_dir_set(), or in
+ * /tmp if none is set, for every object loaded at the time the handle is
+ * initialized. Objects without a table are unwound with the DWARF backend.
+ */
+bool bun_internal_initialize_table(struct bun_handle *handle);
+
+/*
+ * Formats the path of the table of the object with the given build-id. This
+ * function is only meant for internal use.
+ *
+ * Returns false if the path does not fit into `dest`.
+ */
+bool bun_internal_table_path(char *dest, size_t size, const char *directory,
+    const uint8_t *build_id, size_t build_id_size);
@@ -0,0 +1,443 @@
+#define _GNU_SOURCE
+#include "bun_table_builder.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <bun/bun.h>
+
+#include "../../bun_cursor.h"
+#include "../../bun_modules.h"
+#include "../dwarf/bun_dwarf_cfi.h"
+#include "bun_table.h"
+#include "bun_table_format.h"
+
+#if defined(__aarch64__) || defined(__arm__)
+/* The return address column is a real register, the link register. */
+#define RA_IN_REGISTER true
+#else
+#define RA_IN_REGISTER false
+#endif
+
+/*
+ * A row of the table being built. Terminators mark the end of an FDE and are
+ * overridden by rows of an adjacent FDE starting at the same address.
+ */
+struct row {
+	uint64_t pc;
+	struct bun_table_entry entry;
+	bool terminator;
+};
+
+struct rows {
+	struct row *rows;
+	size_t count;
+	size_t capacity;
+	bool error;
+};
+
+struct elf_file {
+	const uint8_t *data;
+	size_t size;
+	const uint8_t *eh_frame;
+	size_t eh_frame_size;
+	uint64_t eh_frame_addr;
+	const uint8_t *build_id;
+	size_t build_id_size;
+};
+
+static bool
+rows_append(struct rows *rows, uint64_t pc, const struct bun_table_entry *entry,
+    bool terminator)
+{
+
+	if (rows->count == rows->capacity) {
+		size_t capacity = rows->capacity == 0 ? 1024 :
+		    rows->capacity * 2;
+		struct row *grown;
+
+		grown = realloc(rows->rows, capacity * sizeof(*grown));
+		if (grown == NULL) {
+			rows->error = true;
+			return false;
+		}
+
+		rows->rows = grown;
+		rows->capacity = capacity;
+	}
+
+	rows->rows[rows->count].pc = pc;
+	rows->rows[rows->count].entry = *entry;
+	rows->rows[rows->count].terminator = terminator;
+	rows->count++;
+	return true;
+}
+
+static bool
+fits_int16(intptr_t value)
+{
+
+	return value >= INT16_MIN && value <= INT16_MAX;
+}
+
+/*
+ * Converts a row of the call frame table into an entry. Rows using anything
+ * but the stack or frame pointer to compute the CFA, or recovering the return
+ * address and frame pointer in any other way than loading them from the
+ * stack, are left to the DWARF interpreter.
+ */
+static void
+entry_from_rules(const struct bun_dwarf_rules *rules,
+    struct bun_table_entry *entry)
+{
+	const struct bun_dwarf_rule *ra = &rules->regs[BUN_CURSOR_REGISTER_RA];
+	const struct bun_dwarf_rule *fp = &rules->regs[BUN_CURSOR_REGISTER_FP];
+	const struct bun_dwarf_rule *sp = &rules->regs[BUN_CURSOR_REGISTER_SP];
+	uint8_t type;
+
+	memset(entry, 0, sizeof(*entry));
+	entry->type = BUN_TABLE_TYPE_FALLBACK;
+
+	if (rules->ra_register != BUN_CURSOR_REGISTER_RA)
+		return;
+
+	if (ra->type == BUN_DWARF_RULE_UNDEFINED) {
+		entry->type = BUN_TABLE_TYPE_UNDEFINED;
+		return;
+	}
+
+	if (rules->cfa_expression != NULL || fits_int16(rules->cfa_offset) ==
+	    false)
+		return;
+
+	if (rules->cfa_register == BUN_CURSOR_REGISTER_SP) {
+		type = BUN_TABLE_TYPE_CFA_SP;
+	} else if (rules->cfa_register == BUN_CURSOR_REGISTER_FP) {
+		type = BUN_TABLE_TYPE_CFA_FP;
+	} else {
+		return;
+	}
+
+	if (sp->type != BUN_DWARF_RULE_UNSPECIFIED)
+		return;
+
+	switch (ra->type) {
+	case BUN_DWARF_RULE_OFFSET:
+		if (fits_int16(ra->offset) == false)
+			return;
+		entry->flags |= BUN_TABLE_RA_SAVED;
+		entry->ra_offset = ra->offset;
+		break;
+	case BUN_DWARF_RULE_UNSPECIFIED:
+	case BUN_DWARF_RULE_SAME_VALUE:
+		if (RA_IN_REGISTER == false)
+			return;
+		break;
+	default:
+		return;
+	}
+
+	switch (fp->type) {
+	case BUN_DWARF_RULE_OFFSET:
+		if (fits_int16(fp->offset) == false)
+			return;
+		entry->flags |= BUN_TABLE_FP_SAVED;
+		entry->fp_offset = fp->offset;
+		break;
+	case BUN_DWARF_RULE_UNSPECIFIED:
+	case BUN_DWARF_RULE_SAME_VALUE:
+		break;
+	default:
+		return;
+	}
+
+	if (rules->signal_frame == true)
+		entry->flags |= BUN_TABLE_SIGNAL_FRAME;
+
+	entry->cfa_offset = rules->cfa_offset;
+	entry->type = type;
+	return;
+}
+
+static bool
+row_callback(void *arg, const struct bun_dwarf_rules *rules)
+{
+	struct bun_table_entry entry;
+
+	entry_from_rules(rules, &entry);
+	return rows_append(arg, rules->start, &entry, false);
+}
+
+static bool
+collect_rows(const struct elf_file *elf, struct rows *rows)
+{
+	const uint8_t *end = elf->eh_frame + elf->eh_frame_size;
+	const uint8_t *entry = elf->eh_frame;
+	const intptr_t delta = (intptr_t)(elf->eh_frame_addr -
+	    (uintptr_t)elf->eh_frame);
+
+	while (entry != NULL && entry < end) {
+		struct bun_table_entry undefined = { 0 };
+		struct bun_dwarf_fde fde;
+
+		if (bun_dwarf_fde_parse(entry, end, delta, &fde) == true &&
+		    fde.pc_begin < fde.pc_end) {
+			const size_t count = rows->count;
+
+			if (bun_dwarf_rows(&fde, row_callback, rows) == false) {
+				struct bun_table_entry fallback = { 0 };
+
+				if (rows->error == true)
+					return false;
+
+				/* Let the interpreter deal with the FDE. */
+				rows->count = count;
+				fallback.type = BUN_TABLE_TYPE_FALLBACK;
+				if (rows_append(rows, fde.pc_begin, &fallback,
+				    false) == false)
+					return false;
+			}
+
+			undefined.type = BUN_TABLE_TYPE_UNDEFINED;
+			if (rows_append(rows, fde.pc_end, &undefined,
+			    true) == false)
+				return false;
+		}
+
+		entry = bun_dwarf_entry_next(entry, end);
+	}
+
+	return true;
+}
+
+static int
+compare_rows(const void *a, const void *b)
+{
+	const struct row *lhs = a;
+	const struct row *rhs = b;
+
+	if (lhs->pc != rhs->pc)
+		return lhs->pc < rhs->pc ? -1 : 1;
+
+	/* Terminators go first, so that real rows override them. */
+	return (int)rhs->terminator - (int)lhs->terminator;
+}
+
+/*
+ * Sorts the rows and drops those that are overridden or do not change the
+ * rules. Returns the number of remaining rows.
+ */
+static size_t
+compact_rows(struct rows *rows)
+{
+	size_t count = 0;
+
+	qsort(rows->rows, rows->count, sizeof(*rows->rows), compare_rows);
+
+	for (size_t i = 0; i < rows->count; i++) {
+		const struct row *row = &rows->rows[i];
+
+		if (i + 1 < rows->count && rows->rows[i + 1].pc == row->pc)
+			continue;
+
+		if (count > 0 && memcmp(&rows->rows[count - 1].entry,
+		    &row->entry, sizeof(row->entry)) == 0)
+			continue;
+
+		rows->rows[count++] = *row;
+	}
+
+	rows->count = count;
+	return count;
+}
+
+static bool
+parse_elf(struct elf_file *elf)
+{
+	const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)elf->data;
+	const ElfW(Shdr) *shdrs, *shstrtab;
+
+	if (elf->size < sizeof(*ehdr) ||
+	    memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+	    ehdr->e_ident[EI_CLASS] != (sizeof(void *) == 8 ?
+	    ELFCLASS64 : ELFCLASS32) ||
+	    ehdr->e_shentsize != sizeof(ElfW(Shdr)) ||
+	    ehdr->e_shoff > elf->size ||
+	    (elf->size - ehdr->e_shoff) / sizeof(ElfW(Shdr)) < ehdr->e_shnum ||
+	    ehdr->e_shstrndx >= ehdr->e_shnum)
+		return false;
+
+	shdrs = (const ElfW(Shdr) *)(elf->data + ehdr->e_shoff);
+	shstrtab = &shdrs[ehdr->e_shstrndx];
+	if (shstrtab->sh_offset > elf->size ||
+	    shstrtab->sh_size > elf->size - shstrtab->sh_offset)
+		return false;
+
+	for (size_t i = 0; i < ehdr->e_shnum; i++) {
+		const ElfW(Shdr) *shdr = &shdrs[i];
+		const char *name;
+
+		if (shdr->sh_type == SHT_NOBITS ||
+		    shdr->sh_offset > elf->size ||
+		    shdr->sh_size > elf->size - shdr->sh_offset ||
+		    shdr->sh_name >= shstrtab->sh_size)
+			continue;
+
+		name = (const char *)elf->data + shstrtab->sh_offset +
+		    shdr->sh_name;
+		if (strnlen(name, shstrtab->sh_size - shdr->sh_name) ==
+		    shstrtab->sh_size - shdr->sh_name)
+			continue;
+
+		if (shdr->sh_type == SHT_NOTE && elf->build_id == NULL) {
+			bun_build_id_find(elf->data + shdr->sh_offset,
+			    shdr->sh_size, &elf->build_id,
+			    &elf->build_id_size);
+		} else if (strcmp(name, ".eh_frame") == 0) {
+			elf->eh_frame = elf->data + shdr->sh_offset;
+			elf->eh_frame_size = shdr->sh_size;
+			elf->eh_frame_addr = shdr->sh_addr;
+		}
+	}
+
+	return elf->eh_frame != NULL && elf->build_id != NULL &&
+	    elf->build_id_size <= BUN_TABLE_BUILD_ID_MAX;
+}
+
+static bool
+write_table(const char *path, const struct elf_file *elf,
+    const struct rows *rows)
+{
+	struct bun_table_header header;
+	char *temp_path = NULL;
+	FILE *file = NULL;
+	int fd = -1;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = BUN_TABLE_MAGIC;
+	header.version = BUN_TABLE_VERSION;
+	header.architecture = BUN_ARCH_DETECTED;
+	header.count = rows->count;
+	header.base = rows->rows[0].pc;
+	header.build_id_size = elf->build_id_size;
+	memcpy(header.build_id, elf->build_id, elf->build_id_size);
+
+	/* Write to a temporary file first, so readers never see a partial one. */
+	if (asprintf(&temp_path, "%s.XXXXXX", path) == -1) {
+		temp_path = NULL;
+		goto error;
+	}
+
+	fd = mkstemp(temp_path);
+	if (fd == -1)
+		goto error;
+
+	file = fdopen(fd, "wb");
+	if (file == NULL)
+		goto error;
+	fd = -1;
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1)
+		goto error;
+
+	for (size_t i = 0; i < rows->count; i++) {
+		uint32_t pc = rows->rows[i].pc - header.base;
+
+		if (fwrite(&pc, sizeof(pc), 1, file) != 1)
+			goto error;
+	}
+
+	for (size_t i = 0; i < rows->count; i++) {
+		if (fwrite(&rows->rows[i].entry,
+		    sizeof(rows->rows[i].entry), 1, file) != 1)
+			goto error;
+	}
+
+	if (fclose(file) != 0) {
+		file = NULL;
+		goto error;
+	}
+	file = NULL;
+
+	if (chmod(temp_path, 0644) != 0 || rename(temp_path, path) != 0)
+		goto error;
+
+	free(temp_path);
+	return true;
+error:
+	if (file != NULL)
+		fclose(file);
+	if (fd != -1)
+		close(fd);
+	if (temp_path != NULL) {
+		unlink(temp_path);
+		free(temp_path);
+	}
+	return false;
+}
+
+bool
+bun_table_build(const char *path, const char *directory, char *output,
+    size_t output_size)
+{
+	char table_path[PATH_MAX];
+	struct elf_file elf;
+	struct rows rows;
+	struct stat st;
+	void *data = MAP_FAILED;
+	bool result = false;
+	int fd;
+
+	memset(&elf, 0, sizeof(elf));
+	memset(&rows, 0, sizeof(rows));
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	elf.data = data;
+	elf.size = st.st_size;
+	if (parse_elf(&elf) == false)
+		goto out;
+
+	if (collect_rows(&elf, &rows) == false || compact_rows(&rows) == 0)
+		goto out;
+
+	/* Offsets from the base are stored in 32 bits. */
+	if (rows.rows[rows.count - 1].pc - rows.rows[0].pc > UINT32_MAX)
+		goto out;
+
+	if (bun_internal_table_path(table_path, sizeof(table_path), directory,
+	    elf.build_id, elf.build_id_size) == false)
+		goto out;
+
+	if (write_table(table_path, &elf, &rows) == false)
+		goto out;
+
+	if (output != NULL) {
+		if (strlen(table_path) >= output_size)
+			goto out;
+		strcpy(output, table_path);
+	}
+
+	result = true;
+out:
+	free(rows.rows);
+	munmap(data, st.st_size);
+	return result;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*
+ * Generates the unwind table of the ELF object at `path` from its .eh_frame
+ * section and writes it to `directory`, under the name given by
+ * bun_internal_table_path(). If `output` is not NULL, the path of the
+ * generated file is copied into it.
+ *
+ * The object must have been built for the current architecture and carry a
+ * GNU build-id. This function allocates memory and is meant to be used at
+ * build or install time only.
+ *
+ * Returns true on success.
+ */
+bool bun_table_build(const char *path, const char *directory, char *output,
+    size_t output_size);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Layout of precomputed unwind table files.
+ *
+ * A table describes one ELF object and is named after its build-id, see
+ * bun_table_path(). It is generated offline from the object's .eh_frame by
+ * the bun_unwind_table tool and mapped read-only at runtime.
+ *
+ * The header is followed by `count` 32-bit pc offsets, sorted in ascending
+ * order, and by `count` entries. Entry i applies to the link-time addresses
+ * [base + pcs[i], base + pcs[i + 1]). Keeping the pcs in a separate array
+ * makes the binary search touch as few cache lines as possible.
+ *
+ * Tables are meant to be consumed on the machine they describe and use the
+ * native byte order.
+ */
+
+#define BUN_TABLE_MAGIC 0x454c4241544e5542ULL /* "BUNTABLE" */
+#define BUN_TABLE_VERSION 1
+#define BUN_TABLE_BUILD_ID_MAX 64
+#define BUN_TABLE_SUFFIX ".bun_table"
+
+struct bun_table_header {
+	uint64_t magic;
+	uint16_t version;
+	uint16_t architecture;
+	uint32_t count;
+	uint64_t base;
+	uint32_t build_id_size;
+	uint8_t build_id[BUN_TABLE_BUILD_ID_MAX];
+	uint32_t reserved;
+};
+static_assert(sizeof(struct bun_table_header) == 96,
+    "Expected the table header to be 96 bytes long");
+
+enum bun_table_type {
+	/* No unwind information, or the outermost frame. */
+	BUN_TABLE_TYPE_UNDEFINED = 0,
+	/* CFA is the stack pointer plus cfa_offset. */
+	BUN_TABLE_TYPE_CFA_SP,
+	/* CFA is the frame pointer plus cfa_offset. */
+	BUN_TABLE_TYPE_CFA_FP,
+	/* The rules do not fit into an entry, use the DWARF interpreter. */
+	BUN_TABLE_TYPE_FALLBACK
+};
+
+enum bun_table_flags {
+	/* The return address is saved at CFA + ra_offset. */
+	BUN_TABLE_RA_SAVED = 1 << 0,
+	/* The frame pointer is saved at CFA + fp_offset. */
+	BUN_TABLE_FP_SAVED = 1 << 1,
+	/* The frame is a signal trampoline. */
+	BUN_TABLE_SIGNAL_FRAME = 1 << 2
+};
+
+/*
+ * Unwinding rules for a range of instructions. The stack pointer of the
+ * caller is always the CFA. Without BUN_TABLE_RA_SAVED, the return address is
+ * still in the link register; without BUN_TABLE_FP_SAVED, the frame pointer
+ * is unchanged.
+ */
+struct bun_table_entry {
+	int16_t cfa_offset;
+	int16_t ra_offset;
+	int16_t fp_offset;
+	uint8_t type;
+	uint8_t flags;
+};
+static_assert(sizeof(struct bun_table_entry) == 8,
+    "Expected table entries to be 8 bytes long");
+
+/*
+ * Returns the size of a table file with `count` entries.
+ */
+static inline size_t
+bun_table_size(uint32_t count)
+{
+
+	return sizeof(struct bun_table_header) +
+	    (size_t)count * (sizeof(uint32_t) + sizeof(struct bun_table_entry));
+}
@@ -14,6 +14,38 @@
 #if defined(BUN_LIBUNWINDSTACK_ENABLED)
 #include "backend/libunwindstack/bun_libunwindstack.h"
 #endif /* BUN_LIBUNWINDSTACK_ENABLED */
+#if defined(BUN_FRAMEPOINTER_ENABLED)
+#include "backend/framepointer/bun_framepointer.h"
+#endif /* BUN_FRAMEPOINTER_ENABLED */
+#if defined(BUN_DWARF_ENABLED)
+#include "backend/dwarf/bun_dwarf.h"
+#endif /* BUN_DWARF_ENABLED */
+#if defined(BUN_TABLE_ENABLED)
+#include "backend/table/bun_table.h"
+#endif /* BUN_TABLE_ENABLED */
+#if defined(BUN_SFRAME_ENABLED)
+#include "backend/sframe/bun_sframe.h"
+#endif /* BUN_SFRAME_ENABLED */
+#if defined(BUN_SHADOW_ENABLED)
+#include "backend/shadow/bun_shadow.h"
+#endif /* BUN_SHADOW_ENABLED */
+#if defined(BUN_PERF_ENABLED)
+#include "backend/perf/bun_perf.h"
+#endif /* BUN_PERF_ENABLED */
+#if defined(BUN_HYBRID_ENABLED)
+#include "backend/hybrid/bun_hybrid.h"
+#endif /* BUN_HYBRID_ENABLED */
+#if defined(BUN_HANDSHAKE_ENABLED)
+#include "backend/handshake/bun_handshake.h"
+#endif /* BUN_HANDSHAKE_ENABLED */
+#if defined(BUN_CENSUS_ENABLED)
+#include "backend/census/bun_census.h"
+#endif /* BUN_CENSUS_ENABLED */
+#if defined(BUN_CORE_ENABLED)
+#include <bun/core.h>
+
+#include "backend/core/bun_core.h"
+#endif /* BUN_CORE_ENABLED */
 
 bool
 bun_handle_init(struct bun_handle *handle, enum bun_unwind_backend backend)
@@ -34,6 +66,42 @@ bun_handle_init(struct bun_handle *handle, enum bun_unwind_backend backend)
 		case BUN_BACKEND_LIBUNWINDSTACK:
 			return bun_internal_initialize_libunwindstack(handle);
 #endif /* BUN_LIBUNWINDSTACK_ENABLED */
+#if defined(BUN_FRAMEPOINTER_ENABLED)
+		case BUN_BACKEND_FRAMEPOINTER:
+			return bun_internal_initialize_framepointer(handle);
+#endif /* BUN_FRAMEPOINTER_ENABLED */
+#if defined(BUN_DWARF_ENABLED)
+		case BUN_BACKEND_DWARF:
+			return bun_internal_initialize_dwarf(handle);
+#endif /* BUN_DWARF_ENABLED */
+#if defined(BUN_TABLE_ENABLED)
+		case BUN_BACKEND_TABLE:
+			return bun_internal_initialize_table(handle);
+#endif /* BUN_TABLE_ENABLED */
+#if defined(BUN_SFRAME_ENABLED)
+		case BUN_BACKEND_SFRAME:
+			return bun_internal_initialize_sframe(handle);
+#endif /* BUN_SFRAME_ENABLED */
+#if defined(BUN_SHADOW_ENABLED)
+		case BUN_BACKEND_SHADOW:
+			return bun_internal_initialize_shadow(handle);
+#endif /* BUN_SHADOW_ENABLED */
+#if defined(BUN_PERF_ENABLED)
+		case BUN_BACKEND_PERF:
+			return bun_internal_initialize_perf(handle);
+#endif /* BUN_PERF_ENABLED */
+#if defined(BUN_HYBRID_ENABLED)
+		case BUN_BACKEND_HYBRID:
+			return bun_internal_initialize_hybrid(handle);
+#endif /* BUN_HYBRID_ENABLED */
+#if defined(BUN_HANDSHAKE_ENABLED)
+		case BUN_BACKEND_HANDSHAKE:
+			return bun_internal_initialize_handshake(handle);
+#endif /* BUN_HANDSHAKE_ENABLED */
+#if defined(BUN_CENSUS_ENABLED)
+		case BUN_BACKEND_CENSUS:
+			return bun_internal_initialize_census(handle);
+#endif /* BUN_CENSUS_ENABLED */
 		default:
 			return false;
 	}
@@ -41,6 +109,26 @@ bun_handle_init(struct bun_handle *handle, enum bun_unwind_backend backend)
 	return false;
 }
 
+#if defined(BUN_CORE_ENABLED)
+bool
+bun_handle_init_core(struct bun_handle *handle, const char *path,
+    const char *sysroot)
+{
+
+	memset(handle, 0, sizeof(*handle));
+	return bun_internal_initialize_core(handle, path, sysroot, NULL);
+}
+
+bool
+bun_handle_init_core_cached(struct bun_handle *handle, const char *path,
+    const char *sysroot, struct bun_object_cache *cache)
+{
+
+	memset(handle, 0, sizeof(*handle));
+	return bun_internal_initialize_core(handle, path, sysroot, cache);
+}
+#endif /* BUN_CORE_ENABLED */
+
 void
 bun_handle_deinit(struct bun_handle *handle)
 {
@@ -53,6 +141,9 @@ size_t
 bun_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
 {
 
+	if (handle->unwind == NULL)
+		return 0;
+
 	return handle->unwind(handle, buffer);
 }
 
@@ -61,6 +152,10 @@ bun_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
 	void *context)
 {
 
+	/* Not every backend can unwind from a context. */
+	if (handle->unwind_context == NULL)
+		return 0;
+
 	return handle->unwind_context(handle, buffer, context);
 }
 
@@ -69,5 +164,8 @@ bun_unwind_remote(struct bun_handle *handle, struct bun_buffer *buffer,
 	pid_t pid)
 {
 
+	if (handle->unwind_remote == NULL)
+		return 0;
+
 	return handle->unwind_remote(handle, buffer, pid);
 }
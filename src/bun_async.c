@@ -0,0 +1,254 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/types.h>
+
+#include <bun/async.h>
+#include <bun/bun.h>
+
+/* Upper bound of the number of workers of a bun_async. */
+#define ASYNC_JOBS_MAX 64
+
+struct async_request {
+	struct bun_buffer *buffer;
+	pid_t tid;
+	bun_async_fn *callback;
+	void *arg;
+	size_t size;
+	struct async_request *next;
+};
+
+struct async_queue {
+	struct async_request *head;
+	struct async_request *tail;
+};
+
+/*
+ * Requests move from the pending queue to the completed one under the lock;
+ * workers sleep on the condition while nothing is pending.
+ */
+struct bun_async {
+	struct bun_handle *handle;
+	int fd;
+
+	pthread_mutex_t lock;
+	pthread_cond_t pending_cond;
+	struct async_queue pending;
+	struct async_queue completed;
+	bool stopping;
+
+	unsigned int jobs;
+	pthread_t threads[ASYNC_JOBS_MAX];
+};
+
+static void
+queue_push(struct async_queue *queue, struct async_request *request)
+{
+
+	request->next = NULL;
+	if (queue->tail != NULL)
+		queue->tail->next = request;
+	else
+		queue->head = request;
+
+	queue->tail = request;
+	return;
+}
+
+static struct async_request *
+queue_pop(struct async_queue *queue)
+{
+	struct async_request *request = queue->head;
+
+	if (request != NULL) {
+		queue->head = request->next;
+		if (queue->head == NULL)
+			queue->tail = NULL;
+	}
+
+	return request;
+}
+
+/*
+ * Calls the callbacks of every request in the list and frees them.
+ */
+static size_t
+requests_complete(struct async_request *request)
+{
+	size_t count = 0;
+
+	while (request != NULL) {
+		struct async_request *next = request->next;
+
+		request->callback(request->arg, request->tid, request->buffer,
+		    request->size);
+		free(request);
+		request = next;
+		count++;
+	}
+
+	return count;
+}
+
+static void *
+async_worker(void *arg)
+{
+	struct bun_async *async = arg;
+	const uint64_t one = 1;
+
+	pthread_mutex_lock(&async->lock);
+	for (;;) {
+		struct async_request *request;
+		ssize_t r;
+
+		while (async->pending.head == NULL && async->stopping == false)
+			pthread_cond_wait(&async->pending_cond, &async->lock);
+
+		if (async->stopping == true)
+			break;
+
+		request = queue_pop(&async->pending);
+		pthread_mutex_unlock(&async->lock);
+
+		request->size = bun_unwind_remote(async->handle,
+		    request->buffer, request->tid);
+
+		pthread_mutex_lock(&async->lock);
+		queue_push(&async->completed, request);
+
+		/* Only fails once the counter would overflow. */
+		r = write(async->fd, &one, sizeof(one));
+		(void) r;
+	}
+
+	pthread_mutex_unlock(&async->lock);
+	return NULL;
+}
+
+struct bun_async *
+bun_async_create(struct bun_handle *handle, unsigned int jobs)
+{
+	struct bun_async *async;
+
+	async = calloc(1, sizeof(*async));
+	if (async == NULL)
+		return NULL;
+
+	async->handle = handle;
+	async->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (async->fd == -1)
+		goto error;
+
+	if (pthread_mutex_init(&async->lock, NULL) != 0)
+		goto close;
+
+	if (pthread_cond_init(&async->pending_cond, NULL) != 0)
+		goto mutex;
+
+	if (jobs == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		jobs = cpus > 0 ? cpus : 1;
+	}
+
+	if (jobs > ASYNC_JOBS_MAX)
+		jobs = ASYNC_JOBS_MAX;
+
+	for (; async->jobs < jobs; async->jobs++) {
+		if (pthread_create(&async->threads[async->jobs], NULL,
+		    async_worker, async) != 0)
+			break;
+	}
+
+	if (async->jobs > 0)
+		return async;
+
+	pthread_cond_destroy(&async->pending_cond);
+mutex:
+	pthread_mutex_destroy(&async->lock);
+close:
+	close(async->fd);
+error:
+	free(async);
+	return NULL;
+}
+
+int
+bun_async_fd(const struct bun_async *async)
+{
+
+	return async->fd;
+}
+
+bool
+bun_unwind_remote_async(struct bun_async *async, struct bun_buffer *buffer,
+    pid_t tid, bun_async_fn *callback, void *arg)
+{
+	struct async_request *request;
+
+	if (callback == NULL)
+		return false;
+
+	request = malloc(sizeof(*request));
+	if (request == NULL)
+		return false;
+
+	request->buffer = buffer;
+	request->tid = tid;
+	request->callback = callback;
+	request->arg = arg;
+	request->size = 0;
+
+	pthread_mutex_lock(&async->lock);
+	queue_push(&async->pending, request);
+	pthread_cond_signal(&async->pending_cond);
+	pthread_mutex_unlock(&async->lock);
+	return true;
+}
+
+size_t
+bun_async_dispatch(struct bun_async *async)
+{
+	struct async_request *completed;
+	uint64_t count;
+
+	pthread_mutex_lock(&async->lock);
+	completed = async->completed.head;
+	memset(&async->completed, 0, sizeof(async->completed));
+
+	/* Cleared under the lock so that no completion is missed. */
+	while (read(async->fd, &count, sizeof(count)) == -1 && errno == EINTR)
+		;
+	pthread_mutex_unlock(&async->lock);
+
+	return requests_complete(completed);
+}
+
+void
+bun_async_destroy(struct bun_async *async)
+{
+
+	pthread_mutex_lock(&async->lock);
+	async->stopping = true;
+	pthread_cond_broadcast(&async->pending_cond);
+	pthread_mutex_unlock(&async->lock);
+
+	for (unsigned int i = 0; i < async->jobs; i++)
+		pthread_join(async->threads[i], NULL);
+
+	requests_complete(async->completed.head);
+	requests_complete(async->pending.head);
+
+	pthread_cond_destroy(&async->pending_cond);
+	pthread_mutex_destroy(&async->lock);
+	close(async->fd);
+	free(async);
+	return;
+}
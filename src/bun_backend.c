@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <bun/backend.h>
+#include <bun/bun.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include "bun_internal.h"
+
+struct bun_custom_context {
+	struct bun_backend_ops ops;
+	void *context;
+};
+
+static size_t custom_unwind(struct bun_handle *handle,
+    struct bun_buffer *buffer);
+static size_t custom_unwind_context(struct bun_handle *handle,
+    struct bun_buffer *buffer, void *context);
+static size_t custom_unwind_remote(struct bun_handle *handle,
+    struct bun_buffer *buffer, pid_t tid);
+static void destroy_handle(struct bun_handle *handle);
+
+bool
+bun_handle_init_custom(struct bun_handle *handle,
+    const struct bun_backend_ops *ops, void *context)
+{
+	const size_t required = offsetof(struct bun_backend_ops, unwind) +
+	    sizeof(ops->unwind);
+	struct bun_custom_context *custom;
+
+	memset(handle, 0, sizeof(*handle));
+
+	if (ops == NULL || ops->size < required || ops->unwind == NULL)
+		return false;
+
+	custom = calloc(1, sizeof(*custom));
+	if (custom == NULL)
+		return false;
+
+	/*
+	 * Callers built against an older header pass a smaller structure, the
+	 * callbacks it does not have are left NULL.
+	 */
+	memcpy(&custom->ops, ops, ops->size < sizeof(custom->ops) ?
+	    ops->size : sizeof(custom->ops));
+	custom->ops.size = sizeof(custom->ops);
+	custom->context = context;
+
+	handle->backend_context = custom;
+	handle->unwind = custom_unwind;
+	handle->unwind_context = custom_unwind_context;
+	handle->unwind_remote = custom_unwind_remote;
+	handle->destroy = destroy_handle;
+	return true;
+}
+
+/*
+ * Prepares the writer for the callbacks.
+ */
+static bool
+custom_writer_init(struct bun_writer *writer, struct bun_handle *handle,
+    struct bun_buffer *buffer, pid_t tid)
+{
+
+	if (bun_writer_init(writer, buffer, BUN_ARCH_DETECTED, handle) == false)
+		return false;
+
+	bun_header_backend_set(writer, BUN_BACKEND_CUSTOM);
+	bun_header_tid_set(writer, tid);
+	return true;
+}
+
+static size_t
+custom_unwind(struct bun_handle *handle, struct bun_buffer *buffer)
+{
+	struct bun_custom_context *custom = handle->backend_context;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+	struct bun_writer writer;
+
+	if (custom_writer_init(&writer, handle, buffer, bun_gettid()) == false)
+		return 0;
+
+	if (custom->ops.unwind(custom->context, &writer) == false)
+		return 0;
+
+	return hdr->size;
+}
+
+static size_t
+custom_unwind_context(struct bun_handle *handle, struct bun_buffer *buffer,
+    void *context)
+{
+	struct bun_custom_context *custom = handle->backend_context;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+	struct bun_writer writer;
+
+	if (custom->ops.unwind_context == NULL)
+		return 0;
+
+	if (custom_writer_init(&writer, handle, buffer, bun_gettid()) == false)
+		return 0;
+
+	if (custom->ops.unwind_context(custom->context, &writer,
+	    context) == false)
+		return 0;
+
+	return hdr->size;
+}
+
+static size_t
+custom_unwind_remote(struct bun_handle *handle, struct bun_buffer *buffer,
+    pid_t tid)
+{
+	struct bun_custom_context *custom = handle->backend_context;
+	struct bun_payload_header *hdr = bun_buffer_payload(buffer);
+	struct bun_writer writer;
+
+	if (custom->ops.unwind_remote == NULL)
+		return 0;
+
+	if (custom_writer_init(&writer, handle, buffer, tid) == false)
+		return 0;
+
+	if (custom->ops.unwind_remote(custom->context, &writer, tid) == false)
+		return 0;
+
+	return hdr->size;
+}
+
+static void
+destroy_handle(struct bun_handle *handle)
+{
+	struct bun_custom_context *custom = handle->backend_context;
+
+	if (custom->ops.destroy != NULL)
+		custom->ops.destroy(custom->context);
+
+	free(custom);
+	return;
+}
@@ -0,0 +1,342 @@
+#define _GNU_SOURCE
+#include "bun_cursor.h"
+
+#include <dlfcn.h>
+#include <signal.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include <sys/resource.h>
+
+#include "bun_memory.h"
+
+/*
+ * Granularity of memory probes. This is the smallest page size of the
+ * supported architectures, so a successful probe never covers an unmapped
+ * page on systems with larger pages.
+ */
+#define PROBE_GRANULE 4096
+
+/*
+ * Stack size limit used when RLIMIT_STACK is unlimited or unavailable.
+ */
+#define DEFAULT_STACK_LIMIT (256UL << 20)
+
+/*
+ * Mapping of the cursor registers to the serialized register identifiers.
+ * BUN_REGISTER_COUNT marks columns that are not real registers.
+ */
+#if defined(__x86_64__)
+#define REGISTER_PC BUN_REGISTER_X86_64_RIP
+static const enum bun_register register_map[BUN_CURSOR_REGISTER_COUNT] = {
+	BUN_REGISTER_X86_64_RAX, BUN_REGISTER_X86_64_RDX,
+	BUN_REGISTER_X86_64_RCX, BUN_REGISTER_X86_64_RBX,
+	BUN_REGISTER_X86_64_RSI, BUN_REGISTER_X86_64_RDI,
+	BUN_REGISTER_X86_64_RBP, BUN_REGISTER_X86_64_RSP,
+	BUN_REGISTER_X86_64_R8, BUN_REGISTER_X86_64_R9,
+	BUN_REGISTER_X86_64_R10, BUN_REGISTER_X86_64_R11,
+	BUN_REGISTER_X86_64_R12, BUN_REGISTER_X86_64_R13,
+	BUN_REGISTER_X86_64_R14, BUN_REGISTER_X86_64_R15,
+	BUN_REGISTER_COUNT
+};
+#elif defined(__i386__)
+#define REGISTER_PC BUN_REGISTER_X86_EIP
+static const enum bun_register register_map[BUN_CURSOR_REGISTER_COUNT] = {
+	BUN_REGISTER_X86_EAX, BUN_REGISTER_X86_ECX, BUN_REGISTER_X86_EDX,
+	BUN_REGISTER_X86_EBX, BUN_REGISTER_X86_ESP, BUN_REGISTER_X86_EBP,
+	BUN_REGISTER_X86_ESI, BUN_REGISTER_X86_EDI, BUN_REGISTER_COUNT
+};
+#elif defined(__aarch64__)
+#define REGISTER_PC BUN_REGISTER_AARCH64_PC
+static const enum bun_register register_map[BUN_CURSOR_REGISTER_COUNT] = {
+	BUN_REGISTER_AARCH64_X0, BUN_REGISTER_AARCH64_X1,
+	BUN_REGISTER_AARCH64_X2, BUN_REGISTER_AARCH64_X3,
+	BUN_REGISTER_AARCH64_X4, BUN_REGISTER_AARCH64_X5,
+	BUN_REGISTER_AARCH64_X6, BUN_REGISTER_AARCH64_X7,
+	BUN_REGISTER_AARCH64_X8, BUN_REGISTER_AARCH64_X9,
+	BUN_REGISTER_AARCH64_X10, BUN_REGISTER_AARCH64_X11,
+	BUN_REGISTER_AARCH64_X12, BUN_REGISTER_AARCH64_X13,
+	BUN_REGISTER_AARCH64_X14, BUN_REGISTER_AARCH64_X15,
+	BUN_REGISTER_AARCH64_X16, BUN_REGISTER_AARCH64_X17,
+	BUN_REGISTER_AARCH64_X18, BUN_REGISTER_AARCH64_X19,
+	BUN_REGISTER_AARCH64_X20, BUN_REGISTER_AARCH64_X21,
+	BUN_REGISTER_AARCH64_X22, BUN_REGISTER_AARCH64_X23,
+	BUN_REGISTER_AARCH64_X24, BUN_REGISTER_AARCH64_X25,
+	BUN_REGISTER_AARCH64_X26, BUN_REGISTER_AARCH64_X27,
+	BUN_REGISTER_AARCH64_X28, BUN_REGISTER_AARCH64_X29,
+	BUN_REGISTER_AARCH64_X30, BUN_REGISTER_AARCH64_X31
+};
+#elif defined(__arm__)
+#define REGISTER_PC BUN_REGISTER_ARM_R15
+static const enum bun_register register_map[BUN_CURSOR_REGISTER_COUNT] = {
+	BUN_REGISTER_ARM_R0, BUN_REGISTER_ARM_R1, BUN_REGISTER_ARM_R2,
+	BUN_REGISTER_ARM_R3, BUN_REGISTER_ARM_R4, BUN_REGISTER_ARM_R5,
+	BUN_REGISTER_ARM_R6, BUN_REGISTER_ARM_R7, BUN_REGISTER_ARM_R8,
+	BUN_REGISTER_ARM_R9, BUN_REGISTER_ARM_R10, BUN_REGISTER_ARM_R11,
+	BUN_REGISTER_ARM_R12, BUN_REGISTER_ARM_R13, BUN_REGISTER_ARM_R14,
+	BUN_REGISTER_COUNT
+};
+#endif
+
+size_t
+bun_cursor_stack_limit(void)
+{
+	struct rlimit limit;
+
+	if (getrlimit(RLIMIT_STACK, &limit) != 0)
+		return DEFAULT_STACK_LIMIT;
+
+	if (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur == 0 ||
+	    limit.rlim_cur > DEFAULT_STACK_LIMIT)
+		return DEFAULT_STACK_LIMIT;
+
+	return limit.rlim_cur;
+}
+
+static void
+set_stack_bounds(struct bun_cursor *cursor, uintptr_t low)
+{
+
+	cursor->stack_low = low;
+	if (UINTPTR_MAX - low < cursor->stack_limit)
+		cursor->stack_high = UINTPTR_MAX;
+	else
+		cursor->stack_high = low + cursor->stack_limit;
+
+	cursor->probed_low = 0;
+	cursor->probed_high = 0;
+}
+
+void
+bun_cursor_init(struct bun_cursor *cursor, uintptr_t pc, uintptr_t sp,
+    uintptr_t fp, size_t stack_limit)
+{
+	stack_t altstack;
+
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->pc = pc;
+	cursor->regs[BUN_CURSOR_REGISTER_SP] = sp;
+	cursor->regs[BUN_CURSOR_REGISTER_FP] = fp;
+	cursor->regs_valid = BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_SP) |
+	    BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_FP);
+	cursor->stack_limit = stack_limit;
+
+	set_stack_bounds(cursor, sp);
+
+	/*
+	 * When running on the alternate signal stack, the frames of the
+	 * interrupted code live on a different stack, possibly below this one.
+	 * Limit the bounds to the signal stack and let bun_cursor_advance()
+	 * switch over once.
+	 */
+	if (sigaltstack(NULL, &altstack) == 0 &&
+	    (altstack.ss_flags & SS_ONSTACK) != 0) {
+		uintptr_t low = (uintptr_t)altstack.ss_sp;
+		uintptr_t high = low + altstack.ss_size;
+
+		if (sp >= low && sp < high) {
+			cursor->stack_high = high;
+			cursor->on_altstack = true;
+		}
+	}
+
+	return;
+}
+
+void
+bun_cursor_init_reader(struct bun_cursor *cursor, uintptr_t pc, uintptr_t sp,
+    uintptr_t fp, size_t stack_limit, bun_cursor_read_fn *read, void *arg)
+{
+
+	memset(cursor, 0, sizeof(*cursor));
+	cursor->pc = pc;
+	cursor->regs[BUN_CURSOR_REGISTER_SP] = sp;
+	cursor->regs[BUN_CURSOR_REGISTER_FP] = fp;
+	cursor->regs_valid = BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_SP) |
+	    BUN_CURSOR_REGISTER_BIT(BUN_CURSOR_REGISTER_FP);
+	cursor->stack_limit = stack_limit;
+	cursor->read = read;
+	cursor->read_arg = arg;
+
+	/* The signal stack of this thread says nothing about the other one. */
+	set_stack_bounds(cursor, sp);
+	return;
+}
+
+bool
+bun_cursor_init_context(struct bun_cursor *cursor, const void *context,
+    size_t stack_limit)
+{
+	const ucontext_t *uc = context;
+
+	if (uc == NULL)
+		return false;
+
+#if defined(__x86_64__)
+	static const int gregs[] = {
+		REG_RAX, REG_RDX, REG_RCX, REG_RBX, REG_RSI, REG_RDI, REG_RBP,
+		REG_RSP, REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13,
+		REG_R14, REG_R15
+	};
+
+	bun_cursor_init(cursor, uc->uc_mcontext.gregs[REG_RIP],
+	    uc->uc_mcontext.gregs[REG_RSP], uc->uc_mcontext.gregs[REG_RBP],
+	    stack_limit);
+	for (size_t i = 0; i < sizeof(gregs) / sizeof(*gregs); i++) {
+		cursor->regs[i] = uc->uc_mcontext.gregs[gregs[i]];
+		cursor->regs_valid |= BUN_CURSOR_REGISTER_BIT(i);
+	}
+	return true;
+#elif defined(__i386__)
+	static const int gregs[] = {
+		REG_EAX, REG_ECX, REG_EDX, REG_EBX, REG_ESP, REG_EBP, REG_ESI,
+		REG_EDI
+	};
+
+	bun_cursor_init(cursor, uc->uc_mcontext.gregs[REG_EIP],
+	    uc->uc_mcontext.gregs[REG_ESP], uc->uc_mcontext.gregs[REG_EBP],
+	    stack_limit);
+	for (size_t i = 0; i < sizeof(gregs) / sizeof(*gregs); i++) {
+		cursor->regs[i] = uc->uc_mcontext.gregs[gregs[i]];
+		cursor->regs_valid |= BUN_CURSOR_REGISTER_BIT(i);
+	}
+	return true;
+#elif defined(__aarch64__)
+	bun_cursor_init(cursor, uc->uc_mcontext.pc, uc->uc_mcontext.sp,
+	    uc->uc_mcontext.regs[29], stack_limit);
+	for (size_t i = 0; i < 31; i++) {
+		cursor->regs[i] = uc->uc_mcontext.regs[i];
+		cursor->regs_valid |= BUN_CURSOR_REGISTER_BIT(i);
+	}
+	return true;
+#elif defined(__arm__)
+	bun_cursor_init(cursor, uc->uc_mcontext.arm_pc, uc->uc_mcontext.arm_sp,
+	    uc->uc_mcontext.arm_fp, stack_limit);
+	/* arm_r0 through arm_lr are laid out in register order. */
+	for (size_t i = 0; i < 15; i++) {
+		cursor->regs[i] = (&uc->uc_mcontext.arm_r0)[i];
+		cursor->regs_valid |= BUN_CURSOR_REGISTER_BIT(i);
+	}
+	return true;
+#else
+	(void) stack_limit;
+	return false;
+#endif
+}
+
+static bool
+probe(struct bun_cursor *cursor, uintptr_t addr)
+{
+	uintptr_t page = addr & ~((uintptr_t)PROBE_GRANULE - 1);
+
+	if (page >= cursor->probed_low && page < cursor->probed_high)
+		return true;
+
+	if (bun_memory_probe(page) == false)
+		return false;
+
+	if (page == cursor->probed_high) {
+		cursor->probed_high += PROBE_GRANULE;
+	} else if (page + PROBE_GRANULE == cursor->probed_low) {
+		cursor->probed_low = page;
+	} else {
+		cursor->probed_low = page;
+		cursor->probed_high = page + PROBE_GRANULE;
+	}
+
+	return true;
+}
+
+bool
+bun_cursor_read(struct bun_cursor *cursor, uintptr_t addr, uintptr_t *value)
+{
+
+	if (addr % sizeof(uintptr_t) != 0)
+		return false;
+
+	if (addr < cursor->stack_low || addr >= cursor->stack_high ||
+	    cursor->stack_high - addr < sizeof(uintptr_t))
+		return false;
+
+	if (cursor->read != NULL)
+		return cursor->read(cursor->read_arg, addr, value);
+
+	/* Words are aligned, so they never straddle two pages. */
+	if (probe(cursor, addr) == false)
+		return false;
+
+	*value = *(const volatile uintptr_t *)addr;
+	return true;
+}
+
+bool
+bun_cursor_advance(struct bun_cursor *cursor, uintptr_t sp)
+{
+
+	if (sp >= cursor->stack_low && sp < cursor->stack_high) {
+		cursor->stack_low = sp;
+		return true;
+	}
+
+	if (cursor->on_altstack == true) {
+		cursor->on_altstack = false;
+		set_stack_bounds(cursor, sp);
+		return true;
+	}
+
+	return false;
+}
+
+bool
+bun_cursor_write_frame(const struct bun_cursor *cursor,
+    struct bun_writer *writer, const struct bun_handle *handle)
+{
+	Dl_info info;
+
+	if ((handle->flags & BUN_HANDLE_SKIP_SYMBOLS) == 0 &&
+	    dladdr((void *)cursor->pc, &info) != 0) {
+		size_t offset = 0;
+
+		if (info.dli_saddr != NULL)
+			offset = cursor->pc - (uintptr_t)info.dli_saddr;
+
+		return bun_cursor_write_frame_symbol(cursor, writer,
+		    info.dli_sname, info.dli_fname, offset);
+	}
+
+	return bun_cursor_write_frame_symbol(cursor, writer, NULL, NULL, 0);
+}
+
+bool
+bun_cursor_write_frame_symbol(const struct bun_cursor *cursor,
+    struct bun_writer *writer, const char *symbol, const char *filename,
+    size_t offset)
+{
+	struct bun_frame frame;
+	char registers[(BUN_CURSOR_REGISTER_COUNT + 1) *
+	    (sizeof(uint16_t) + sizeof(uint64_t))];
+
+	memset(&frame, 0, sizeof(frame));
+	frame.addr = cursor->pc;
+	frame.symbol = symbol;
+	frame.filename = filename;
+	frame.offset = offset;
+	frame.register_buffer_size = sizeof(registers);
+	frame.register_data = registers;
+
+#if defined(REGISTER_PC)
+	for (size_t i = 0; i < BUN_CURSOR_REGISTER_COUNT; i++) {
+		if ((cursor->regs_valid & BUN_CURSOR_REGISTER_BIT(i)) == 0 ||
+		    register_map[i] == BUN_REGISTER_COUNT ||
+		    bun_writer_register_wanted(writer, register_map[i]) == false)
+			continue;
+
+		bun_frame_register_append(&frame, register_map[i],
+		    cursor->regs[i]);
+	}
+	if (bun_writer_register_wanted(writer, REGISTER_PC) == true)
+		bun_frame_register_append(&frame, REGISTER_PC, cursor->pc);
+#endif
+
+	return bun_frame_write(writer, &frame) != 0;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+/*
+ * Registers tracked by the cursor, in DWARF numbering. BUN_CURSOR_REGISTER_RA
+ * is the column holding the return address.
+ */
+#if defined(__x86_64__)
+#define BUN_CURSOR_REGISTER_COUNT 17
+#define BUN_CURSOR_REGISTER_FP 6
+#define BUN_CURSOR_REGISTER_SP 7
+#define BUN_CURSOR_REGISTER_RA 16
+#elif defined(__i386__)
+#define BUN_CURSOR_REGISTER_COUNT 9
+#define BUN_CURSOR_REGISTER_SP 4
+#define BUN_CURSOR_REGISTER_FP 5
+#define BUN_CURSOR_REGISTER_RA 8
+#elif defined(__aarch64__)
+#define BUN_CURSOR_REGISTER_COUNT 32
+#define BUN_CURSOR_REGISTER_FP 29
+#define BUN_CURSOR_REGISTER_RA 30
+#define BUN_CURSOR_REGISTER_SP 31
+#elif defined(__arm__)
+#define BUN_CURSOR_REGISTER_COUNT 16
+#define BUN_CURSOR_REGISTER_FP 11
+#define BUN_CURSOR_REGISTER_SP 13
+#define BUN_CURSOR_REGISTER_RA 14
+#else
+#define BUN_CURSOR_REGISTER_COUNT 1
+#define BUN_CURSOR_REGISTER_FP 0
+#define BUN_CURSOR_REGISTER_SP 0
+#define BUN_CURSOR_REGISTER_RA 0
+#endif
+
+#define BUN_CURSOR_REGISTER_BIT(reg) (1ULL << (reg))
+
+struct bun_module;
+
+/*
+ * Reads the machine word at `addr` of the unwound thread's memory, for
+ * cursors walking a stack that is not mapped into the current process.
+ */
+typedef bool (bun_cursor_read_fn)(void *arg, uintptr_t addr,
+    uintptr_t *value);
+
+/*
+ * Register state and stack bounds of the frame being unwound. It is shared by
+ * the backends that walk the stack themselves instead of delegating it to an
+ * unwinding library.
+ *
+ * All the reads of stack memory go through bun_cursor_read(), which rejects
+ * addresses outside of the thread's stack and probes every new page before
+ * dereferencing it, so a corrupt stack cannot fault inside a signal handler.
+ */
+struct bun_cursor {
+	uintptr_t pc;
+
+	/* Register values and the mask of the ones that are known. */
+	uintptr_t regs[BUN_CURSOR_REGISTER_COUNT];
+	uint64_t regs_valid;
+
+	/*
+	 * Set if pc is a return address rather than the address of the
+	 * instruction being executed, which is the case for all frames but
+	 * the first one and those interrupted by a signal.
+	 */
+	bool return_address;
+
+	/* Bounds of the stack currently being walked. */
+	uintptr_t stack_low;
+	uintptr_t stack_high;
+
+	/* Maximum size of the thread stack, used to derive stack_high. */
+	size_t stack_limit;
+
+	/* Set if unwinding started on the alternate signal stack. */
+	bool on_altstack;
+
+	/* Page-aligned range that has already been probed successfully. */
+	uintptr_t probed_low;
+	uintptr_t probed_high;
+
+	/* Module whose unwind sections were probed last, see bun_module_probe. */
+	const struct bun_module *probed_module;
+
+	/* Source of the stack memory, or NULL for the current process. */
+	bun_cursor_read_fn *read;
+	void *read_arg;
+};
+
+/*
+ * Returns the stack size limit to be used with bun_cursor_init(). This is not
+ * async-signal-safe and is meant to be called when initializing the handle.
+ */
+size_t bun_cursor_stack_limit(void);
+
+/*
+ * Initializes the cursor with the given registers of the current thread.
+ */
+void bun_cursor_init(struct bun_cursor *cursor, uintptr_t pc, uintptr_t sp,
+    uintptr_t fp, size_t stack_limit);
+
+/*
+ * Initializes the cursor for a thread whose stack is only accessible through
+ * `read`, such as one saved in a core file. The caller is expected to load
+ * the other known registers.
+ */
+void bun_cursor_init_reader(struct bun_cursor *cursor, uintptr_t pc,
+    uintptr_t sp, uintptr_t fp, size_t stack_limit, bun_cursor_read_fn *read,
+    void *arg);
+
+/*
+ * Initializes the cursor from the ucontext_t pointed to by `context`. All the
+ * general purpose registers stored in the context are loaded.
+ *
+ * Returns false if the architecture is not supported.
+ */
+bool bun_cursor_init_context(struct bun_cursor *cursor, const void *context,
+    size_t stack_limit);
+
+/*
+ * Returns the stack pointer of the current frame.
+ */
+static inline uintptr_t
+bun_cursor_sp(const struct bun_cursor *cursor)
+{
+
+	return cursor->regs[BUN_CURSOR_REGISTER_SP];
+}
+
+/*
+ * Returns the frame pointer of the current frame.
+ */
+static inline uintptr_t
+bun_cursor_fp(const struct bun_cursor *cursor)
+{
+
+	return cursor->regs[BUN_CURSOR_REGISTER_FP];
+}
+
+/*
+ * Reads a machine word from the stack at `addr`.
+ *
+ * Returns false if the address is outside of the stack or not readable.
+ */
+bool bun_cursor_read(struct bun_cursor *cursor, uintptr_t addr,
+    uintptr_t *value);
+
+/*
+ * Moves the lower bound of the stack to `sp`, which must be above the current
+ * lower bound. If unwinding started on the alternate signal stack and `sp` is
+ * outside of it, the bounds are moved to the interrupted thread stack.
+ *
+ * Returns false if `sp` is not a valid new stack pointer.
+ */
+bool bun_cursor_advance(struct bun_cursor *cursor, uintptr_t sp);
+
+/*
+ * Serializes the frame described by the cursor, along with all the known
+ * registers. Unless the handle has the BUN_HANDLE_SKIP_SYMBOLS flag set, the
+ * symbol is resolved with dladdr(3).
+ *
+ * Returns false if the frame did not fit into the buffer.
+ */
+bool bun_cursor_write_frame(const struct bun_cursor *cursor,
+    struct bun_writer *writer, const struct bun_handle *handle);
+
+/*
+ * Same as bun_cursor_write_frame(), with the symbol information provided by
+ * the caller. Any of `symbol` and `filename` may be NULL.
+ *
+ * Returns false if the frame did not fit into the buffer.
+ */
+bool bun_cursor_write_frame_symbol(const struct bun_cursor *cursor,
+    struct bun_writer *writer, const char *symbol, const char *filename,
+    size_t offset);
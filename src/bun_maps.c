@@ -0,0 +1,363 @@
+#define _GNU_SOURCE
+#include "bun_maps.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+ * Reads the beginning of a small /proc file into `buffer` as a string.
+ */
+static bool
+proc_read(const char *path, char *buffer, size_t size)
+{
+	ssize_t r;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	r = read(fd, buffer, size - 1);
+	close(fd);
+	if (r <= 0)
+		return false;
+
+	buffer[r] = '\0';
+	return true;
+}
+
+bool
+bun_maps_stamp_get(pid_t tid, struct bun_maps_stamp *stamp)
+{
+	char buffer[1024];
+	char path[64];
+	struct stat st;
+	const char *p;
+	int pid;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", (int)tid);
+	if (proc_read(path, buffer, sizeof(buffer)) == false)
+		return false;
+
+	p = strstr(buffer, "\nTgid:");
+	if (p == NULL || sscanf(p, "\nTgid: %d", &pid) != 1)
+		return false;
+
+	memset(stamp, 0, sizeof(*stamp));
+	stamp->pid = pid;
+
+	/* The command name may contain anything, including parentheses. */
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	if (proc_read(path, buffer, sizeof(buffer)) == false)
+		return false;
+
+	p = strrchr(buffer, ')');
+	if (p == NULL || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u "
+	    "%*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+	    &stamp->start_time) != 1)
+		return false;
+
+	snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+	if (proc_read(path, buffer, sizeof(buffer)) == false ||
+	    sscanf(buffer, "%lu", &stamp->size) != 1)
+		return false;
+
+	/* The executable may not be accessible, e.g. for kernel threads. */
+	snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+	if (stat(path, &st) == 0) {
+		stamp->exe_dev = st.st_dev;
+		stamp->exe_ino = st.st_ino;
+	}
+
+	return true;
+}
+
+bool
+bun_maps_stamp_equal(const struct bun_maps_stamp *a,
+    const struct bun_maps_stamp *b)
+{
+
+	return a->pid == b->pid && a->start_time == b->start_time &&
+	    a->exe_dev == b->exe_dev && a->exe_ino == b->exe_ino &&
+	    a->size == b->size;
+}
+
+static void
+maps_free(struct bun_maps *maps)
+{
+
+	free(maps->entries);
+	free(maps->paths);
+	free(maps);
+	return;
+}
+
+/*
+ * Reads the whole file at `path` into a NUL-terminated buffer.
+ */
+static char *
+file_read(const char *path)
+{
+	size_t size = 0, capacity = 16384;
+	char *buffer;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+
+	buffer = malloc(capacity);
+	if (buffer == NULL)
+		goto error;
+
+	for (;;) {
+		ssize_t r;
+
+		if (capacity - size < 4096) {
+			char *p = realloc(buffer, capacity * 2);
+
+			if (p == NULL)
+				goto error;
+
+			buffer = p;
+			capacity *= 2;
+		}
+
+		r = read(fd, buffer + size, capacity - size - 1);
+		if (r == -1)
+			goto error;
+
+		if (r == 0)
+			break;
+
+		size += r;
+	}
+
+	close(fd);
+	buffer[size] = '\0';
+	return buffer;
+error:
+	close(fd);
+	free(buffer);
+	return NULL;
+}
+
+/*
+ * Reads the mappings of the process of `tid`. The entries are
+ * in the order of the file, which is sorted by address, and their paths
+ * point into the contents of the file.
+ */
+static struct bun_maps *
+maps_load(pid_t tid, const struct bun_maps_stamp *stamp)
+{
+	char path[64];
+	size_t capacity = 0;
+	struct bun_maps *maps;
+	char *line;
+
+	maps = calloc(1, sizeof(*maps));
+	if (maps == NULL)
+		return NULL;
+
+	maps->stamp = *stamp;
+	maps->references = 1;
+
+	snprintf(path, sizeof(path), "/proc/%d/maps", (int)tid);
+	maps->paths = file_read(path);
+	if (maps->paths == NULL)
+		goto error;
+
+	for (line = maps->paths; *line != '\0'; ) {
+		char *next = strchr(line, '\n');
+		struct bun_maps_entry *entry;
+		uintmax_t start, end, offset;
+		int name = 0;
+
+		if (next != NULL)
+			*next++ = '\0';
+		else
+			next = line + strlen(line);
+
+		if (sscanf(line, "%jx-%jx %*s %jx %*s %*s %n", &start, &end,
+		    &offset, &name) < 3) {
+			line = next;
+			continue;
+		}
+
+		if (maps->count == capacity) {
+			size_t n = capacity == 0 ? 64 : capacity * 2;
+			void *p = realloc(maps->entries, n * sizeof(*entry));
+
+			if (p == NULL)
+				goto error;
+
+			maps->entries = p;
+			capacity = n;
+		}
+
+		entry = &maps->entries[maps->count++];
+		entry->start = start;
+		entry->end = end;
+		entry->offset = offset;
+		entry->path = name != 0 && line[name] == '/' ? line + name : NULL;
+		line = next;
+	}
+
+	return maps;
+error:
+	maps_free(maps);
+	return NULL;
+}
+
+const struct bun_maps_entry *
+bun_maps_find(const struct bun_maps *maps, uintptr_t addr)
+{
+	size_t low = 0;
+	size_t high = maps->count;
+
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		const struct bun_maps_entry *entry = &maps->entries[mid];
+
+		if (addr < entry->start) {
+			high = mid;
+		} else if (addr >= entry->end) {
+			low = mid + 1;
+		} else {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+void
+bun_maps_table_init(struct bun_maps_table *table)
+{
+
+	memset(table, 0, sizeof(*table));
+	return;
+}
+
+int
+bun_maps_table_find(struct bun_maps_table *table, pid_t pid)
+{
+
+	for (int i = 0; i < BUN_MAPS_CACHE_SIZE; i++) {
+		if (table->pids[i] == pid) {
+			table->used[i] = ++table->clock;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+size_t
+bun_maps_table_slot(struct bun_maps_table *table, pid_t pid)
+{
+	size_t slot = 0;
+
+	for (size_t i = 0; i < BUN_MAPS_CACHE_SIZE; i++) {
+		if (table->pids[i] == pid) {
+			slot = i;
+			break;
+		}
+
+		/* Free slots were never used. */
+		if (table->used[i] < table->used[slot])
+			slot = i;
+	}
+
+	table->pids[slot] = pid;
+	table->used[slot] = ++table->clock;
+	return slot;
+}
+
+void
+bun_maps_cache_init(struct bun_maps_cache *cache)
+{
+
+	pthread_mutex_init(&cache->lock, NULL);
+	bun_maps_table_init(&cache->table);
+	memset(cache->maps, 0, sizeof(cache->maps));
+	return;
+}
+
+void
+bun_maps_cache_deinit(struct bun_maps_cache *cache)
+{
+
+	for (size_t i = 0; i < BUN_MAPS_CACHE_SIZE; i++) {
+		if (cache->maps[i] != NULL)
+			bun_maps_release(cache->maps[i]);
+	}
+
+	pthread_mutex_destroy(&cache->lock);
+	return;
+}
+
+/*
+ * The stamp is computed before reading the maps, so that a change while they
+ * are being read is caught by the next lookup.
+ */
+struct bun_maps *
+bun_maps_cache_get(struct bun_maps_cache *cache, pid_t tid, bool reload)
+{
+	struct bun_maps_stamp stamp;
+	struct bun_maps *maps = NULL, *previous;
+	size_t slot;
+	int found;
+
+	if (bun_maps_stamp_get(tid, &stamp) == false)
+		return NULL;
+
+	pthread_mutex_lock(&cache->lock);
+	found = bun_maps_table_find(&cache->table, stamp.pid);
+	if (found != -1)
+		maps = cache->maps[found];
+	if (maps != NULL && reload == false &&
+	    bun_maps_stamp_equal(&maps->stamp, &stamp) == true) {
+		__atomic_add_fetch(&maps->references, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&cache->lock);
+		return maps;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+
+	/* Concurrent misses may both read the maps, the last one is kept. */
+	maps = maps_load(tid, &stamp);
+	if (maps == NULL)
+		return NULL;
+
+	maps->references++;
+	pthread_mutex_lock(&cache->lock);
+	slot = bun_maps_table_slot(&cache->table, stamp.pid);
+	previous = cache->maps[slot];
+	cache->maps[slot] = maps;
+	pthread_mutex_unlock(&cache->lock);
+
+	if (previous != NULL)
+		bun_maps_release(previous);
+
+	return maps;
+}
+
+void
+bun_maps_release(struct bun_maps *maps)
+{
+
+	if (__atomic_sub_fetch(&maps->references, 1, __ATOMIC_ACQ_REL) == 0)
+		maps_free(maps);
+
+	return;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*
+ * Cheap fingerprint of the address space of a process, telling whether what
+ * was read from its /proc/<pid>/maps can still be used. It changes when the
+ * pid is reused, when the process calls execve(2), and whenever the total
+ * size of its mappings changes, which is the case for almost every mmap(2) or
+ * munmap(2). Mappings replaced by ones of the same size go unnoticed, users
+ * are expected to reload the maps when an address is not found.
+ */
+struct bun_maps_stamp {
+	pid_t pid;
+	unsigned long long start_time;
+	dev_t exe_dev;
+	ino_t exe_ino;
+	unsigned long size;
+};
+
+/*
+ * Computes the stamp of the process the thread `tid` belongs to.
+ *
+ * Returns false if the process does not exist anymore.
+ */
+bool bun_maps_stamp_get(pid_t tid, struct bun_maps_stamp *stamp);
+
+bool bun_maps_stamp_equal(const struct bun_maps_stamp *a,
+    const struct bun_maps_stamp *b);
+
+/*
+ * A mapping of a process. `path` is NULL unless the mapping is backed by a
+ * file.
+ */
+struct bun_maps_entry {
+	uintptr_t start;
+	uintptr_t end;
+	uint64_t offset;
+	const char *path;
+};
+
+/*
+ * The mappings of a process, sorted by address. Instances are
+ * shared by the users of a cache and are never modified once loaded.
+ */
+struct bun_maps {
+	struct bun_maps_stamp stamp;
+	struct bun_maps_entry *entries;
+	size_t count;
+
+	/* Contents of the maps file, which the paths of the entries point to. */
+	char *paths;
+	unsigned int references;
+};
+
+/*
+ * Returns the mapping containing `addr`, or NULL.
+ */
+const struct bun_maps_entry *bun_maps_find(const struct bun_maps *maps,
+    uintptr_t addr);
+
+/* Number of processes whose maps, and what derives from them, are kept. */
+#define BUN_MAPS_CACHE_SIZE 8
+
+/*
+ * The slots of a table of entries about processes, which evicts the least
+ * recently used process once BUN_MAPS_CACHE_SIZE are known. Users keep the
+ * entries in an array of the same size and serialize the accesses.
+ */
+struct bun_maps_table {
+	pid_t pids[BUN_MAPS_CACHE_SIZE];
+	uint64_t used[BUN_MAPS_CACHE_SIZE];
+	uint64_t clock;
+};
+
+void bun_maps_table_init(struct bun_maps_table *table);
+
+/*
+ * Returns the slot of the process `pid` and marks it as used, or -1 if the
+ * process is not in the table.
+ */
+int bun_maps_table_find(struct bun_maps_table *table, pid_t pid);
+
+/*
+ * Returns the slot an entry about the process `pid` is to be stored in and
+ * marks it as used by the process: the slot of the process if it has one,
+ * else a free slot, else the least recently used one. The entry it held, if
+ * any, is to be released by the caller.
+ */
+size_t bun_maps_table_slot(struct bun_maps_table *table, pid_t pid);
+
+/*
+ * The maps of the processes last unwound through a handle. The maps of a
+ * process are only read again when its stamp changes or on request, so that
+ * alternating between processes does not read them every time.
+ */
+struct bun_maps_cache {
+	pthread_mutex_t lock;
+	struct bun_maps_table table;
+	struct bun_maps *maps[BUN_MAPS_CACHE_SIZE];
+};
+
+void bun_maps_cache_init(struct bun_maps_cache *cache);
+void bun_maps_cache_deinit(struct bun_maps_cache *cache);
+
+/*
+ * Returns the maps of the process of the thread `tid`, which must be released
+ * with bun_maps_release(). If `reload` is true, the maps are read again even if
+ * the cached ones look current, for instance because an address could not be
+ * found in them.
+ *
+ * Returns NULL if the maps cannot be read.
+ */
+struct bun_maps *bun_maps_cache_get(struct bun_maps_cache *cache, pid_t tid,
+    bool reload);
+
+void bun_maps_release(struct bun_maps *maps);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+#include "bun_memory.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+bool
+bun_memory_probe(uintptr_t addr)
+{
+	int saved_errno = errno;
+	bool readable;
+	long r;
+
+	/*
+	 * The kernel copies the new signal mask from user memory before it
+	 * validates `how`, so an invalid `how` lets us test readability of
+	 * eight bytes without changing the mask: EFAULT means the memory is
+	 * not readable, EINVAL means it is.
+	 */
+	r = syscall(SYS_rt_sigprocmask, ~0, (void *)addr, NULL, _NSIG / 8);
+	readable = r == -1 && errno == EINVAL;
+
+	errno = saved_errno;
+	return readable;
+}
+
+bool
+bun_memory_read(pid_t pid, void *dest, uintptr_t addr, size_t size)
+{
+	struct iovec local = { .iov_base = dest, .iov_len = size };
+	struct iovec remote = { .iov_base = (void *)addr, .iov_len = size };
+	ssize_t r;
+
+	r = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+	return r >= 0 && (size_t)r == size;
+}
+
+void
+bun_memory_cache_init(struct bun_memory_cache *cache, pid_t pid)
+{
+
+	cache->pid = pid;
+	cache->clock = 0;
+	for (size_t i = 0; i < BUN_MEMORY_CACHE_PAGES; i++)
+		cache->pages[i].used = 0;
+
+	return;
+}
+
+/*
+ * Returns the cached page starting at `base`, reading it in place of the
+ * least recently used page on a miss. Returns NULL if it cannot be read.
+ */
+static struct bun_memory_page *
+cache_page(struct bun_memory_cache *cache, uintptr_t base)
+{
+	struct bun_memory_page *victim = &cache->pages[0];
+
+	for (size_t i = 0; i < BUN_MEMORY_CACHE_PAGES; i++) {
+		struct bun_memory_page *page = &cache->pages[i];
+
+		if (page->used != 0 && page->base == base) {
+			page->used = ++cache->clock;
+			return page;
+		}
+
+		if (page->used < victim->used)
+			victim = page;
+	}
+
+	if (bun_memory_read(cache->pid, victim->data, base,
+	    sizeof(victim->data)) == false)
+		return NULL;
+
+	victim->base = base;
+	victim->used = ++cache->clock;
+	return victim;
+}
+
+bool
+bun_memory_cache_read(struct bun_memory_cache *cache, void *dest,
+    uintptr_t addr, size_t size)
+{
+	unsigned char *out = dest;
+
+	while (size > 0) {
+		uintptr_t base = addr & ~(uintptr_t)(BUN_MEMORY_CACHE_PAGE_SIZE - 1);
+		size_t offset = addr - base;
+		size_t length = BUN_MEMORY_CACHE_PAGE_SIZE - offset;
+		struct bun_memory_page *page;
+
+		if (length > size)
+			length = size;
+
+		page = cache_page(cache, base);
+		if (page != NULL) {
+			memcpy(out, page->data + offset, length);
+		} else if (bun_memory_read(cache->pid, out, addr,
+		    length) == false) {
+			return false;
+		}
+
+		out += length;
+		addr += length;
+		size -= length;
+	}
+
+	return true;
+}
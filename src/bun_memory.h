@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*
+ * Returns true if the machine word at `addr` in the current process can be
+ * read without faulting.
+ *
+ * This function is async-signal-safe.
+ */
+bool bun_memory_probe(uintptr_t addr);
+
+/*
+ * Copies `size` bytes at address `addr` of the process `pid` into `dest`. An
+ * unmapped or unreadable range results in failure rather than a fault, so this
+ * can be used on the current process as well.
+ *
+ * Returns true if all the bytes have been read.
+ *
+ * This function is async-signal-safe.
+ */
+bool bun_memory_read(pid_t pid, void *dest, uintptr_t addr, size_t size);
+
+#define BUN_MEMORY_CACHE_PAGE_SIZE 4096
+#define BUN_MEMORY_CACHE_PAGES 16
+
+/*
+ * A small cache of the memory of a stopped process, filled a page at a time
+ * so that unwinders reading many nearby words do not pay for one system call
+ * per word. The cache must be reinitialized whenever the process may have run.
+ */
+struct bun_memory_cache {
+	pid_t pid;
+	unsigned long clock;
+	struct bun_memory_page {
+		uintptr_t base;
+
+		/* Value of the clock when last used, 0 if the page is empty. */
+		unsigned long used;
+		unsigned char data[BUN_MEMORY_CACHE_PAGE_SIZE];
+	} pages[BUN_MEMORY_CACHE_PAGES];
+};
+
+/*
+ * Initializes an empty cache of the memory of the process `pid`.
+ */
+void bun_memory_cache_init(struct bun_memory_cache *cache, pid_t pid);
+
+/*
+ * Copies `size` bytes at address `addr` of the cached process into `dest`,
+ * reading the pages they are on if they are not cached yet. Ranges which
+ * cannot be read as whole pages are read directly, uncached.
+ *
+ * Returns true if all the bytes have been read.
+ */
+bool bun_memory_cache_read(struct bun_memory_cache *cache, void *dest,
+    uintptr_t addr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
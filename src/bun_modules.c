@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include "bun_modules.h"
+#include "bun_memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <link.h>
+
+#if !defined(PT_GNU_SFRAME)
+#define PT_GNU_SFRAME 0x6474e554
+#endif
+
+struct collect_state {
+	struct bun_module_table *table;
+	size_t capacity;
+
+	/* Bytes of the path buffer in use and available. */
+	size_t paths_used;
+	size_t paths_size;
+};
+
+static int
+count_callback(struct dl_phdr_info *info, size_t size, void *data)
+{
+	struct collect_state *state = data;
+
+	(void) size;
+	state->capacity++;
+	state->paths_size += strlen(info->dlpi_name) + 1;
+	return 0;
+}
+
+static int
+collect_callback(struct dl_phdr_info *info, size_t size, void *data)
+{
+	struct collect_state *state = data;
+	struct bun_module module;
+	size_t path_size = strlen(info->dlpi_name) + 1;
+
+	(void) size;
+
+	/* Objects loaded after counting are ignored. */
+	if (state->table->count == state->capacity ||
+	    state->paths_size - state->paths_used < path_size)
+		return 1;
+
+	memset(&module, 0, sizeof(module));
+	module.start = UINTPTR_MAX;
+	module.bias = info->dlpi_addr;
+
+	for (size_t i = 0; i < info->dlpi_phnum; i++) {
+		const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+		uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+
+		switch (phdr->p_type) {
+		case PT_LOAD:
+			if ((phdr->p_flags & PF_X) == 0)
+				break;
+			if (start < module.start)
+				module.start = start;
+			if (start + phdr->p_memsz > module.end)
+				module.end = start + phdr->p_memsz;
+			break;
+		case PT_GNU_EH_FRAME:
+			module.eh_frame_hdr = (const uint8_t *)start;
+			module.eh_frame_hdr_size = phdr->p_memsz;
+			break;
+		case PT_GNU_SFRAME:
+			module.sframe = (const uint8_t *)start;
+			module.sframe_size = phdr->p_memsz;
+			break;
+		case PT_NOTE:
+			if (module.build_id == NULL)
+				bun_build_id_find((const uint8_t *)start,
+				    phdr->p_memsz, &module.build_id,
+				    &module.build_id_size);
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* Nothing to unwind through, e.g. the data-only vDSO stub. */
+	if (module.end == 0)
+		return 0;
+
+	/* The loader frees dlpi_name when the object is unloaded. */
+	module.path = state->table->paths + state->paths_used;
+	memcpy(state->table->paths + state->paths_used, info->dlpi_name,
+	    path_size);
+	state->paths_used += path_size;
+
+	state->table->modules[state->table->count++] = module;
+	return 0;
+}
+
+static int
+compare_modules(const void *a, const void *b)
+{
+	const struct bun_module *lhs = a;
+	const struct bun_module *rhs = b;
+
+	if (lhs->start < rhs->start)
+		return -1;
+
+	return lhs->start > rhs->start;
+}
+
+bool
+bun_module_table_init(struct bun_module_table *table)
+{
+	struct collect_state state;
+
+	memset(table, 0, sizeof(*table));
+	memset(&state, 0, sizeof(state));
+
+	dl_iterate_phdr(count_callback, &state);
+	if (state.capacity == 0)
+		return false;
+
+	table->modules = calloc(state.capacity, sizeof(*table->modules));
+	table->paths = malloc(state.paths_size);
+	if (table->modules == NULL || table->paths == NULL) {
+		bun_module_table_deinit(table);
+		return false;
+	}
+
+	state.table = table;
+	dl_iterate_phdr(collect_callback, &state);
+
+	qsort(table->modules, table->count, sizeof(*table->modules),
+	    compare_modules);
+	return true;
+}
+
+void
+bun_module_table_deinit(struct bun_module_table *table)
+{
+
+	free(table->modules);
+	free(table->paths);
+	table->modules = NULL;
+	table->paths = NULL;
+	table->count = 0;
+	return;
+}
+
+bool
+bun_build_id_find(const uint8_t *notes, size_t size, const uint8_t **build_id,
+    size_t *build_id_size)
+{
+	const size_t align = 4;
+	size_t offset = 0;
+
+	while (size - offset >= sizeof(ElfW(Nhdr))) {
+		const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *)(notes + offset);
+		size_t name_size = (nhdr->n_namesz + align - 1) & ~(align - 1);
+		size_t desc_size = (nhdr->n_descsz + align - 1) & ~(align - 1);
+		const uint8_t *name = notes + offset + sizeof(*nhdr);
+
+		offset += sizeof(*nhdr);
+		if (size - offset < name_size ||
+		    size - offset - name_size < desc_size)
+			return false;
+
+		if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+		    memcmp(name, "GNU", 4) == 0) {
+			*build_id = name + name_size;
+			*build_id_size = nhdr->n_descsz;
+			return true;
+		}
+
+		offset += name_size + desc_size;
+	}
+
+	return false;
+}
+
+const struct bun_module *
+bun_module_table_find(const struct bun_module_table *table, uintptr_t pc)
+{
+	size_t low = 0;
+	size_t high = table->count;
+
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		const struct bun_module *module = &table->modules[mid];
+
+		if (pc < module->start) {
+			high = mid;
+		} else if (pc >= module->end) {
+			low = mid + 1;
+		} else {
+			return module;
+		}
+	}
+
+	return NULL;
+}
+
+bool
+bun_module_probe(const struct bun_module *module,
+    const struct bun_module **probed)
+{
+
+	if (*probed == module)
+		return true;
+
+	if (module->eh_frame_hdr != NULL &&
+	    bun_memory_probe((uintptr_t)module->eh_frame_hdr) == false)
+		return false;
+
+	if (module->sframe != NULL &&
+	    bun_memory_probe((uintptr_t)module->sframe) == false)
+		return false;
+
+	*probed = module;
+	return true;
+}
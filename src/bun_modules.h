@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*
+ * A loaded ELF object and the location of its unwind information.
+ */
+struct bun_module {
+	/* Runtime address range covered by the executable segments. */
+	uintptr_t start;
+	uintptr_t end;
+
+	/* Difference between runtime and link-time addresses. */
+	uintptr_t bias;
+
+	/*
+	 * Value to add to the section pointers below to obtain their runtime
+	 * address. It is zero for objects loaded into the current process and
+	 * only honored by the DWARF lookups.
+	 */
+	intptr_t delta;
+
+	/* The .eh_frame_hdr section, or NULL if the object has none. */
+	const uint8_t *eh_frame_hdr;
+	size_t eh_frame_hdr_size;
+
+	/* The .sframe section, or NULL if the object has none. */
+	const uint8_t *sframe;
+	size_t sframe_size;
+
+	/* Contents of the NT_GNU_BUILD_ID note, or NULL. */
+	const uint8_t *build_id;
+	size_t build_id_size;
+
+	/* Owned by the table for objects of the current process. */
+	const char *path;
+};
+
+/*
+ * Snapshot of the objects loaded into the current process, sorted by address.
+ * Once initialized, the table is never modified, so lookups are lock-free and
+ * async-signal-safe, and can be performed by many threads at once.
+ *
+ * Objects loaded after the table has been initialized are not included, and
+ * the sections of objects unloaded since then are no longer mapped: refreshing
+ * the table would take the dynamic loader lock, which a signal handler cannot
+ * do. Readers call bun_module_probe() before using a module's sections.
+ */
+struct bun_module_table {
+	struct bun_module *modules;
+	size_t count;
+
+	/* Copies of the module paths, NULL if the table does not own them. */
+	char *paths;
+};
+
+/*
+ * Initializes the table with the objects loaded into the current process.
+ * This function allocates memory and is not async-signal-safe.
+ *
+ * Returns true on success.
+ */
+bool bun_module_table_init(struct bun_module_table *table);
+
+/*
+ * Releases the memory held by the table.
+ */
+void bun_module_table_deinit(struct bun_module_table *table);
+
+/*
+ * Looks for the NT_GNU_BUILD_ID note in the given notes, as found in a
+ * PT_NOTE segment or SHT_NOTE section.
+ *
+ * Returns false if there is no build-id.
+ */
+bool bun_build_id_find(const uint8_t *notes, size_t size,
+    const uint8_t **build_id, size_t *build_id_size);
+
+/*
+ * Returns the module whose executable segments contain `pc`, or NULL.
+ */
+const struct bun_module *bun_module_table_find(
+    const struct bun_module_table *table, uintptr_t pc);
+
+/*
+ * Returns false if the unwind sections of the module are no longer mapped,
+ * e.g. because the object has been unloaded with dlclose(3). `probed` holds
+ * the module checked last, so that a walk staying within one object pays for
+ * a single probe.
+ *
+ * This function is async-signal-safe.
+ */
+bool bun_module_probe(const struct bun_module *module,
+    const struct bun_module **probed);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
@@ -0,0 +1,456 @@
+#define _GNU_SOURCE
+#include "bun_object_cache.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <bun/core.h>
+
+#include "bun_modules.h"
+
+static int
+compare_symbols(const void *a, const void *b)
+{
+	const struct bun_object_symbol *lhs = a;
+	const struct bun_object_symbol *rhs = b;
+
+	if (lhs->start < rhs->start)
+		return -1;
+
+	return lhs->start > rhs->start;
+}
+
+/*
+ * Collects the function symbols of the object, preferring .symtab over
+ * .dynsym.
+ */
+static bool
+object_symbols_load(struct bun_object *object, const ElfW(Ehdr) *ehdr)
+{
+	const ElfW(Shdr) *shdrs, *strtab;
+	const ElfW(Shdr) *symtab = NULL;
+	const ElfW(Sym) *symbols;
+	const char *strings;
+	size_t count;
+
+	if (ehdr->e_shoff == 0 || ehdr->e_shentsize != sizeof(ElfW(Shdr)) ||
+	    ehdr->e_shoff > object->size ||
+	    (object->size - ehdr->e_shoff) / sizeof(ElfW(Shdr)) <
+	    ehdr->e_shnum)
+		return true;
+
+	shdrs = (const ElfW(Shdr) *)(object->data + ehdr->e_shoff);
+	for (size_t i = 0; i < ehdr->e_shnum; i++) {
+		if (shdrs[i].sh_type == SHT_SYMTAB) {
+			symtab = &shdrs[i];
+			break;
+		}
+
+		if (shdrs[i].sh_type == SHT_DYNSYM)
+			symtab = &shdrs[i];
+	}
+
+	if (symtab == NULL || symtab->sh_link >= ehdr->e_shnum)
+		return true;
+
+	strtab = &shdrs[symtab->sh_link];
+	if (symtab->sh_offset > object->size ||
+	    object->size - symtab->sh_offset < symtab->sh_size ||
+	    strtab->sh_offset > object->size ||
+	    object->size - strtab->sh_offset < strtab->sh_size)
+		return true;
+
+	symbols = (const ElfW(Sym) *)(object->data + symtab->sh_offset);
+	strings = (const char *)(object->data + strtab->sh_offset);
+	count = symtab->sh_size / sizeof(ElfW(Sym));
+
+	object->symbols = calloc(count + 1, sizeof(*object->symbols));
+	if (object->symbols == NULL)
+		return false;
+
+	for (size_t i = 0; i < count; i++) {
+		const ElfW(Sym) *symbol = &symbols[i];
+		struct bun_object_symbol *entry;
+
+		/* The type is encoded the same way for both classes. */
+		if (ELF64_ST_TYPE(symbol->st_info) != STT_FUNC ||
+		    symbol->st_shndx == SHN_UNDEF || symbol->st_size == 0 ||
+		    symbol->st_name >= strtab->sh_size ||
+		    memchr(strings + symbol->st_name, '\0',
+		    strtab->sh_size - symbol->st_name) == NULL)
+			continue;
+
+		entry = &object->symbols[object->symbol_count++];
+		entry->start = symbol->st_value;
+		entry->size = symbol->st_size;
+		entry->name = strings + symbol->st_name;
+	}
+
+	qsort(object->symbols, object->symbol_count, sizeof(*object->symbols),
+	    compare_symbols);
+	return true;
+}
+
+static void
+object_free(struct bun_object *object)
+{
+
+	munmap((void *)object->data, object->size);
+	free(object->symbols);
+	free(object);
+	return;
+}
+
+/*
+ * Maps the ELF file at `path` and indexes its build-id and symbols.
+ */
+static struct bun_object *
+object_load(const char *path)
+{
+	const ElfW(Ehdr) *ehdr;
+	const ElfW(Phdr) *phdrs;
+	struct bun_object *object;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*ehdr)) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	object = calloc(1, sizeof(*object));
+	if (object == NULL) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	object->data = map;
+	object->size = st.st_size;
+	object->references = 1;
+
+	ehdr = map;
+	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+	    ehdr->e_ident[EI_CLASS] != (sizeof(uintptr_t) == 8 ?
+	    ELFCLASS64 : ELFCLASS32) ||
+	    ehdr->e_phentsize != sizeof(ElfW(Phdr)) ||
+	    ehdr->e_phoff > object->size ||
+	    (object->size - ehdr->e_phoff) / sizeof(ElfW(Phdr)) <
+	    ehdr->e_phnum)
+		goto error;
+
+	phdrs = (const ElfW(Phdr) *)(object->data + ehdr->e_phoff);
+	for (size_t i = 0; i < ehdr->e_phnum; i++) {
+		if (phdrs[i].p_type != PT_NOTE ||
+		    phdrs[i].p_offset > object->size ||
+		    object->size - phdrs[i].p_offset < phdrs[i].p_filesz)
+			continue;
+
+		if (bun_build_id_find(object->data + phdrs[i].p_offset,
+		    phdrs[i].p_filesz, &object->build_id,
+		    &object->build_id_size) == true)
+			break;
+	}
+
+	if (object_symbols_load(object, ehdr) == false)
+		goto error;
+
+	object->cost = object->size +
+	    object->symbol_count * sizeof(*object->symbols);
+	return object;
+error:
+	object_free(object);
+	return NULL;
+}
+
+static bool
+object_has_build_id(const struct bun_object *object, const uint8_t *build_id,
+    size_t build_id_size)
+{
+
+	return object->build_id_size == build_id_size &&
+	    memcmp(object->build_id, build_id, build_id_size) == 0;
+}
+
+static void
+cache_unlink(struct bun_object_cache *cache, struct bun_object *object)
+{
+
+	if (object->prev != NULL)
+		object->prev->next = object->next;
+	else
+		cache->head = object->next;
+
+	if (object->next != NULL)
+		object->next->prev = object->prev;
+	else
+		cache->tail = object->prev;
+
+	object->prev = object->next = NULL;
+	return;
+}
+
+static void
+cache_push(struct bun_object_cache *cache, struct bun_object *object)
+{
+
+	object->prev = NULL;
+	object->next = cache->head;
+	if (cache->head != NULL)
+		cache->head->prev = object;
+	else
+		cache->tail = object;
+
+	cache->head = object;
+	return;
+}
+
+/*
+ * Unloads the least recently used objects that are not in use until the
+ * cache fits its limit. Called with the lock held.
+ */
+static void
+cache_evict(struct bun_object_cache *cache)
+{
+	struct bun_object *object = cache->tail;
+
+	while (object != NULL && cache->used > cache->limit) {
+		struct bun_object *prev = object->prev;
+
+		if (object->references == 0) {
+			cache_unlink(cache, object);
+			cache->used -= object->cost;
+			object_free(object);
+		}
+
+		object = prev;
+	}
+
+	return;
+}
+
+static struct bun_object *
+cache_find(struct bun_object_cache *cache, const uint8_t *build_id,
+    size_t build_id_size)
+{
+
+	for (struct bun_object *object = cache->head; object != NULL;
+	    object = object->next) {
+		if (object_has_build_id(object, build_id, build_id_size) == true)
+			return object;
+	}
+
+	return NULL;
+}
+
+struct bun_object *
+bun_object_get(struct bun_object_cache *cache, const char *path,
+    const uint8_t *build_id, size_t build_id_size)
+{
+	struct bun_object *object, *existing;
+
+	if (cache != NULL && build_id != NULL) {
+		pthread_mutex_lock(&cache->lock);
+		object = cache_find(cache, build_id, build_id_size);
+		if (object != NULL) {
+			object->references++;
+			cache_unlink(cache, object);
+			cache_push(cache, object);
+		}
+
+		pthread_mutex_unlock(&cache->lock);
+		if (object != NULL)
+			return object;
+	}
+
+	/* The file is mapped and indexed without holding the lock. */
+	object = object_load(path);
+	if (object == NULL)
+		return NULL;
+
+	if (build_id != NULL && object_has_build_id(object, build_id,
+	    build_id_size) == false) {
+		object_free(object);
+		return NULL;
+	}
+
+	if (cache == NULL || build_id == NULL)
+		return object;
+
+	pthread_mutex_lock(&cache->lock);
+
+	/* Another thread may have loaded the same object in the meantime. */
+	existing = cache_find(cache, build_id, build_id_size);
+	if (existing != NULL) {
+		existing->references++;
+		pthread_mutex_unlock(&cache->lock);
+		object_free(object);
+		return existing;
+	}
+
+	object->cache = cache;
+	cache_push(cache, object);
+	cache->used += object->cost;
+	cache_evict(cache);
+	pthread_mutex_unlock(&cache->lock);
+	return object;
+}
+
+void
+bun_object_release(struct bun_object *object)
+{
+	struct bun_object_cache *cache = object->cache;
+
+	if (cache == NULL) {
+		if (--object->references == 0)
+			object_free(object);
+
+		return;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	if (--object->references == 0)
+		cache_evict(cache);
+	pthread_mutex_unlock(&cache->lock);
+	return;
+}
+
+const struct bun_object_symbol *
+bun_object_symbol_find(const struct bun_object *object, uintptr_t addr)
+{
+	const struct bun_object_symbol *symbol;
+	size_t low = 0;
+	size_t high = object->symbol_count;
+
+	/* Find the last symbol starting at or before `addr`. */
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+
+		if (object->symbols[mid].start <= addr)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low == 0)
+		return NULL;
+
+	symbol = &object->symbols[low - 1];
+	if (addr - symbol->start >= symbol->size)
+		return NULL;
+
+	return symbol;
+}
+
+bool
+bun_object_module(const struct bun_object *object, const char *path,
+    uintptr_t base, struct bun_module *module)
+{
+	const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)object->data;
+	const ElfW(Phdr) *phdrs;
+	bool biased = false;
+
+	memset(module, 0, sizeof(*module));
+	phdrs = (const ElfW(Phdr) *)(object->data + ehdr->e_phoff);
+	module->start = UINTPTR_MAX;
+	module->path = path;
+
+	for (size_t i = 0; i < ehdr->e_phnum; i++) {
+		const ElfW(Phdr) *phdr = &phdrs[i];
+
+		if (phdr->p_type == PT_LOAD && biased == false) {
+			/* The first segment is the one mapped at `base`. */
+			module->bias = base - (phdr->p_vaddr - phdr->p_offset);
+			biased = true;
+		}
+	}
+
+	for (size_t i = 0; i < ehdr->e_phnum && biased == true; i++) {
+		const ElfW(Phdr) *phdr = &phdrs[i];
+		uintptr_t start = module->bias + phdr->p_vaddr;
+
+		if (phdr->p_offset > object->size ||
+		    object->size - phdr->p_offset < phdr->p_filesz)
+			continue;
+
+		switch (phdr->p_type) {
+		case PT_LOAD:
+			if ((phdr->p_flags & PF_X) == 0)
+				break;
+			if (start < module->start)
+				module->start = start;
+			if (start + phdr->p_memsz > module->end)
+				module->end = start + phdr->p_memsz;
+			break;
+		case PT_GNU_EH_FRAME:
+			module->eh_frame_hdr = object->data + phdr->p_offset;
+			module->eh_frame_hdr_size = phdr->p_filesz;
+			module->delta = start -
+			    (uintptr_t)module->eh_frame_hdr;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (module->end == 0)
+		return false;
+
+	module->build_id = object->build_id;
+	module->build_id_size = object->build_id_size;
+	return true;
+}
+
+struct bun_object_cache *
+bun_object_cache_create(size_t limit)
+{
+	struct bun_object_cache *cache;
+
+	cache = calloc(1, sizeof(*cache));
+	if (cache == NULL)
+		return NULL;
+
+	if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+		free(cache);
+		return NULL;
+	}
+
+	cache->limit = limit;
+	return cache;
+}
+
+void
+bun_object_cache_destroy(struct bun_object_cache *cache)
+{
+	struct bun_object *object = cache->head;
+
+	while (object != NULL) {
+		struct bun_object *next = object->next;
+
+		object_free(object);
+		object = next;
+	}
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+	return;
+}
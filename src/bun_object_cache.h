@@ -0,0 +1,97 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+struct bun_module;
+
+/*
+ * A function symbol of an object, at its link-time address.
+ */
+struct bun_object_symbol {
+	uintptr_t start;
+	uintptr_t size;
+	const char *name;
+};
+
+/*
+ * An ELF file mapped into memory, with its function symbols sorted by
+ * address. Objects are read-only once loaded, so they can be shared by
+ * the handles of every process running the same build.
+ */
+struct bun_object {
+	const uint8_t *data;
+	size_t size;
+
+	/* Contents of the NT_GNU_BUILD_ID note, pointing into data, or NULL. */
+	const uint8_t *build_id;
+	size_t build_id_size;
+
+	struct bun_object_symbol *symbols;
+	size_t symbol_count;
+
+	/* The owning cache, or NULL if the object is not cached. */
+	struct bun_object_cache *cache;
+
+	/* Position in the cache, most recently used first. */
+	struct bun_object *prev;
+	struct bun_object *next;
+	unsigned int references;
+
+	/* Bytes accounted against the limit of the cache. */
+	size_t cost;
+};
+
+/*
+ * Objects keyed by build-id. Objects that are not in use any more stay cached
+ * until the memory they take exceeds `limit`, at which point the least
+ * recently used ones are unloaded. Objects in use are never unloaded, even if
+ * they alone exceed the limit.
+ */
+struct bun_object_cache {
+	pthread_mutex_t lock;
+	struct bun_object *head;
+	struct bun_object *tail;
+	size_t used;
+	size_t limit;
+};
+
+/*
+ * Returns the object at `path`, which must be released with
+ * bun_object_release(). If `build_id` is not NULL, the object is only
+ * returned if it has that build-id, and it is looked up in `cache` first. A
+ * NULL `cache`, or a NULL `build_id`, loads an object of its own.
+ *
+ * Returns NULL if the object cannot be loaded or its build-id differs.
+ */
+struct bun_object *bun_object_get(struct bun_object_cache *cache,
+    const char *path, const uint8_t *build_id, size_t build_id_size);
+
+void bun_object_release(struct bun_object *object);
+
+/*
+ * Returns the function symbol containing the link-time address `addr`, or
+ * NULL.
+ */
+const struct bun_object_symbol *bun_object_symbol_find(
+    const struct bun_object *object, uintptr_t addr);
+
+/*
+ * Describes the object in `module` as loaded at `base`, the address its first
+ * PT_LOAD segment is mapped at, under the name `path`. The unwind sections
+ * point into the object, which must outlive the module.
+ *
+ * Returns false if the object has no executable segment.
+ */
+bool bun_object_module(const struct bun_object *object, const char *path,
+    uintptr_t base, struct bun_module *module);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
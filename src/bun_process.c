@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+#include "bun_internal.h"
+#include "bun_ptrace.h"
+
+/* Upper bound of the number of workers of a process unwind. */
+#define PROCESS_JOBS_MAX 64
+
+/*
+ * State shared by the workers of a process unwind. Threads are handed out
+ * one at a time, first to be stopped, then to be unwound.
+ *
+ * ptrace(2) requests are only accepted from the thread that attached to the
+ * tracee, so each worker unwinds the threads it stopped itself. Workers wait
+ * for every thread to be stopped before unwinding any of them, and for every
+ * thread to be unwound before resuming their own.
+ */
+struct process_unwind {
+	struct bun_handle *handle;
+	size_t buffer_size;
+	bun_process_thread_fn *callback;
+	void *arg;
+	bool stop;
+
+	pid_t *tids;
+	size_t count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t next;
+	size_t stopped;
+	size_t finished;
+	size_t unwound;
+};
+
+/*
+ * A worker, with room for the ids of all the threads in case it stops them
+ * all, and its output buffer.
+ */
+struct process_worker {
+	struct process_unwind *unwind;
+	pthread_t thread;
+	pid_t *tids;
+	void *data;
+};
+
+/*
+ * Returns the ids of the threads of `pid`, or NULL.
+ */
+static pid_t *
+process_tids(pid_t pid, size_t *count)
+{
+	char path[64];
+	size_t capacity = 64;
+	struct dirent *entry;
+	pid_t *tids;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+	dir = opendir(path);
+	if (dir == NULL)
+		return NULL;
+
+	tids = malloc(capacity * sizeof(*tids));
+	if (tids == NULL)
+		goto error;
+
+	*count = 0;
+	while ((entry = readdir(dir)) != NULL) {
+		char *end;
+		long tid = strtol(entry->d_name, &end, 10);
+
+		if (*end != '\0' || tid <= 0)
+			continue;
+
+		if (*count == capacity) {
+			pid_t *p = realloc(tids, 2 * capacity * sizeof(*tids));
+
+			if (p == NULL)
+				goto error;
+
+			tids = p;
+			capacity *= 2;
+		}
+
+		tids[(*count)++] = tid;
+	}
+
+	closedir(dir);
+	return tids;
+error:
+	free(tids);
+	closedir(dir);
+	return NULL;
+}
+
+static void *
+process_worker(void *arg)
+{
+	struct process_worker *worker = arg;
+	struct process_unwind *unwind = worker->unwind;
+	struct bun_buffer buffer;
+	size_t claimed = 0, held = 0, unwound = 0;
+
+	/* Claim threads and stop them until none is left. */
+	pthread_mutex_lock(&unwind->lock);
+	while (unwind->next < unwind->count) {
+		pid_t tid = unwind->tids[unwind->next++];
+
+		pthread_mutex_unlock(&unwind->lock);
+		if (unwind->stop == false || bun_ptrace_attach(tid,
+		    unwind->handle->flags, 5000) == true) {
+			worker->tids[held++] = tid;
+		} else {
+			unwind->callback(unwind->arg, tid, NULL, 0);
+		}
+		pthread_mutex_lock(&unwind->lock);
+
+		unwind->stopped++;
+		claimed++;
+	}
+
+	if (unwind->stopped == unwind->count)
+		pthread_cond_broadcast(&unwind->cond);
+
+	while (unwind->stopped < unwind->count)
+		pthread_cond_wait(&unwind->cond, &unwind->lock);
+	pthread_mutex_unlock(&unwind->lock);
+
+	if (unwind->stop == true)
+		bun_ptrace_hold(worker->tids, held);
+
+	for (size_t i = 0; i < held; i++) {
+		size_t size = 0;
+
+		if (bun_buffer_init(&buffer, worker->data,
+		    unwind->buffer_size) == true)
+			size = bun_unwind_remote(unwind->handle, &buffer,
+			    worker->tids[i]);
+
+		if (size != 0)
+			unwound++;
+
+		unwind->callback(unwind->arg, worker->tids[i],
+		    size != 0 ? &buffer : NULL, size);
+	}
+
+	pthread_mutex_lock(&unwind->lock);
+	unwind->unwound += unwound;
+	unwind->finished += claimed;
+	if (unwind->finished == unwind->count)
+		pthread_cond_broadcast(&unwind->cond);
+
+	while (unwind->stop == true && unwind->finished < unwind->count)
+		pthread_cond_wait(&unwind->cond, &unwind->lock);
+	pthread_mutex_unlock(&unwind->lock);
+
+	if (unwind->stop == true) {
+		bun_ptrace_hold(NULL, 0);
+		for (size_t i = 0; i < held; i++)
+			bun_ptrace_detach(worker->tids[i]);
+	}
+
+	return NULL;
+}
+
+static bool
+process_worker_init(struct process_worker *worker,
+    struct process_unwind *unwind)
+{
+
+	worker->unwind = unwind;
+	worker->tids = malloc(unwind->count * sizeof(*worker->tids));
+	worker->data = malloc(unwind->buffer_size);
+	if (worker->tids == NULL || worker->data == NULL) {
+		free(worker->tids);
+		free(worker->data);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+process_worker_deinit(struct process_worker *worker)
+{
+
+	free(worker->tids);
+	free(worker->data);
+	return;
+}
+
+size_t
+bun_unwind_remote_process(struct bun_handle *handle, pid_t pid,
+    size_t buffer_size, unsigned int jobs, bun_process_thread_fn *callback,
+    void *arg)
+{
+	struct process_worker workers[PROCESS_JOBS_MAX];
+	struct process_unwind unwind;
+	size_t started = 1;
+
+	if (handle->unwind_remote == NULL || callback == NULL)
+		return 0;
+
+	memset(&unwind, 0, sizeof(unwind));
+	unwind.tids = process_tids(pid, &unwind.count);
+	if (unwind.tids == NULL)
+		return 0;
+
+	unwind.handle = handle;
+	unwind.buffer_size = buffer_size;
+	unwind.callback = callback;
+	unwind.arg = arg;
+	unwind.stop = handle->remote_ptrace;
+
+	if (jobs == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		jobs = cpus > 0 ? cpus : 1;
+	}
+
+	if (jobs > unwind.count)
+		jobs = unwind.count;
+	if (jobs > PROCESS_JOBS_MAX)
+		jobs = PROCESS_JOBS_MAX;
+
+	/* The calling thread is the first worker. */
+	if (unwind.count == 0 ||
+	    process_worker_init(&workers[0], &unwind) == false) {
+		free(unwind.tids);
+		return 0;
+	}
+
+	pthread_mutex_init(&unwind.lock, NULL);
+	pthread_cond_init(&unwind.cond, NULL);
+
+	for (; started < jobs; started++) {
+		struct process_worker *worker = &workers[started];
+
+		if (process_worker_init(worker, &unwind) == false)
+			break;
+
+		if (pthread_create(&worker->thread, NULL, process_worker,
+		    worker) != 0) {
+			process_worker_deinit(worker);
+			break;
+		}
+	}
+
+	process_worker(&workers[0]);
+	process_worker_deinit(&workers[0]);
+	for (size_t i = 1; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		process_worker_deinit(&workers[i]);
+	}
+
+	pthread_cond_destroy(&unwind.cond);
+	pthread_mutex_destroy(&unwind.lock);
+	free(unwind.tids);
+	return unwind.unwound;
+}
@@ -0,0 +1,216 @@
+#define _GNU_SOURCE
+#include "bun_ptrace.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <bun/bun.h>
+#include <bun/utils.h>
+
+#if !defined(PTRACE_SEIZE)
+#define PTRACE_SEIZE 0x4206
+#endif
+#if !defined(PTRACE_INTERRUPT)
+#define PTRACE_INTERRUPT 0x4207
+#endif
+
+/* Bytes below the stack pointer that leaf functions may use. */
+#if defined(__x86_64__)
+#define STACK_RED_ZONE 128
+#else
+#define STACK_RED_ZONE 0
+#endif
+
+/* Threads held by bun_ptrace_hold() on the calling thread. */
+static __thread const pid_t *held_tids;
+static __thread size_t held_count;
+
+#define SNAPSHOT_PAGE_SIZE 4096
+#define SNAPSHOT_PAGES (BUN_PTRACE_SNAPSHOT_STACK_SIZE / SNAPSHOT_PAGE_SIZE)
+
+/*
+ * PTRACE_INTERRUPT puts the thread in a PTRACE_EVENT_STOP trap, which is
+ * reported as a SIGTRAP stop and needs no signal to be suppressed or
+ * re-injected afterwards. If the thread is already in group-stop, the trap
+ * reports it as such and PTRACE_DETACH leaves the thread stopped.
+ */
+static int
+seize(pid_t tid)
+{
+
+	if (ptrace(PTRACE_SEIZE, tid, 0, 0) != 0)
+		return -1;
+
+	if (ptrace(PTRACE_INTERRUPT, tid, 0, 0) != 0) {
+		ptrace(PTRACE_DETACH, tid, 0, 0);
+		return 1;
+	}
+
+	return 0;
+}
+
+static bool
+held(pid_t tid)
+{
+
+	for (size_t i = 0; i < held_count; i++) {
+		if (held_tids[i] == tid)
+			return true;
+	}
+
+	return false;
+}
+
+bool
+bun_ptrace_attach(pid_t tid, uint64_t flags, int msec_timeout)
+{
+	bool seized = false;
+
+	if (held(tid) == true)
+		return true;
+
+	if ((flags & BUN_HANDLE_PTRACE_SEIZE) != 0) {
+		int r = seize(tid);
+
+		/* Kernels before 3.4 do not know about PTRACE_SEIZE. */
+		if (r == -1 && errno != EIO && errno != EINVAL)
+			return false;
+		if (r == 1)
+			return false;
+
+		seized = (r == 0);
+	}
+
+	if (seized == false && ptrace(PTRACE_ATTACH, tid, 0, 0) != 0)
+		return false;
+
+	if (bun_waitpid(tid, msec_timeout) < 0) {
+		ptrace(PTRACE_DETACH, tid, 0, 0);
+		return false;
+	}
+
+	return true;
+}
+
+void
+bun_ptrace_detach(pid_t tid)
+{
+
+	if (held(tid) == false)
+		ptrace(PTRACE_DETACH, tid, 0, 0);
+
+	return;
+}
+
+void
+bun_ptrace_hold(const pid_t *tids, size_t count)
+{
+
+	held_tids = tids;
+	held_count = count;
+	return;
+}
+
+#if defined(BUN_PTRACE_SNAPSHOT_SUPPORTED)
+static uintptr_t
+snapshot_sp(const struct bun_ptrace_snapshot *snapshot)
+{
+
+#if defined(__x86_64__)
+	return snapshot->regs.rsp;
+#elif defined(__i386__)
+	return snapshot->regs.esp;
+#elif defined(__aarch64__)
+	return snapshot->regs.sp;
+#endif
+}
+
+/*
+ * The stack is read a page per iovec, so that the copy stops at the first
+ * page that cannot be read instead of failing as a whole.
+ */
+static size_t
+snapshot_stack(struct bun_ptrace_snapshot *snapshot)
+{
+	struct iovec local = {
+		.iov_base = snapshot->stack,
+		.iov_len = sizeof(snapshot->stack)
+	};
+	struct iovec remote[SNAPSHOT_PAGES + 1];
+	uintptr_t addr = snapshot->stack_low;
+	size_t left = sizeof(snapshot->stack);
+	int count = 0;
+	ssize_t r;
+
+	while (left > 0 && count < (int)(sizeof(remote) / sizeof(*remote))) {
+		size_t length = SNAPSHOT_PAGE_SIZE - addr % SNAPSHOT_PAGE_SIZE;
+
+		if (length > left)
+			length = left;
+
+		/* Do not wrap around the end of the address space. */
+		if (addr + length < addr)
+			break;
+
+		remote[count].iov_base = (void *)addr;
+		remote[count].iov_len = length;
+		count++;
+		addr += length;
+		left -= length;
+	}
+
+	r = process_vm_readv(snapshot->tid, &local, 1, remote, count, 0);
+	return r > 0 ? (size_t)r : 0;
+}
+#endif
+
+bool
+bun_ptrace_snapshot_save(pid_t tid, struct bun_ptrace_snapshot *snapshot)
+{
+#if defined(BUN_PTRACE_SNAPSHOT_SUPPORTED)
+	struct iovec regs = {
+		.iov_base = &snapshot->regs,
+		.iov_len = sizeof(snapshot->regs)
+	};
+	uintptr_t sp;
+
+	snapshot->tid = tid;
+	if (ptrace(PTRACE_GETREGSET, tid, (void *)NT_PRSTATUS, &regs) != 0)
+		return false;
+
+	if (regs.iov_len != sizeof(snapshot->regs))
+		return false;
+
+	sp = snapshot_sp(snapshot);
+	snapshot->stack_low = sp >= STACK_RED_ZONE ? sp - STACK_RED_ZONE : 0;
+	snapshot->stack_size = snapshot_stack(snapshot);
+	return true;
+#else
+	(void)tid;
+	(void)snapshot;
+	return false;
+#endif
+}
+
+bool
+bun_ptrace_snapshot_read(const struct bun_ptrace_snapshot *snapshot,
+    void *dest, uintptr_t addr, size_t size)
+{
+
+	if (addr < snapshot->stack_low ||
+	    addr - snapshot->stack_low > snapshot->stack_size ||
+	    size > snapshot->stack_size - (addr - snapshot->stack_low))
+		return false;
+
+	memcpy(dest, snapshot->stack + (addr - snapshot->stack_low), size);
+	return true;
+}
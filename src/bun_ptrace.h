@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <sys/user.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/*
+ * Stops the thread `tid` of another process for inspection, waiting up to
+ * `msec_timeout` milliseconds for the stop.
+ *
+ * If `flags`, the flags of the handle, has BUN_HANDLE_PTRACE_SEIZE set, the
+ * thread is seized and interrupted, which stops it without sending it a
+ * signal. Otherwise, or if the kernel does not support it, PTRACE_ATTACH is
+ * used, which sends SIGSTOP.
+ *
+ * Returns false if the thread could not be stopped, in which case it is not
+ * traced anymore.
+ */
+bool bun_ptrace_attach(pid_t tid, uint64_t flags, int msec_timeout);
+
+/*
+ * Resumes a thread stopped with bun_ptrace_attach(). A thread which was
+ * already in group-stop when it was seized stays stopped.
+ */
+void bun_ptrace_detach(pid_t tid);
+
+/*
+ * Declares the `count` threads in `tids`, which the calling thread has
+ * stopped, as held: until the hold is lifted by passing no threads,
+ * bun_ptrace_attach() succeeds immediately and bun_ptrace_detach() does
+ * nothing for them when called on this thread. This lets a set of threads be
+ * unwound while they are all stopped. `tids` must stay valid until then.
+ */
+void bun_ptrace_hold(const pid_t *tids, size_t count);
+
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+#define BUN_PTRACE_SNAPSHOT_SUPPORTED
+#endif
+
+/* Bytes of stack copied by bun_ptrace_snapshot_save(). */
+#define BUN_PTRACE_SNAPSHOT_STACK_SIZE (128 * 1024)
+
+/*
+ * The state of a stopped thread needed to unwind it once it is running again:
+ * its registers and a copy of the top of its stack.
+ */
+struct bun_ptrace_snapshot {
+	pid_t tid;
+#if defined(BUN_PTRACE_SNAPSHOT_SUPPORTED)
+	struct user_regs_struct regs;
+#endif
+
+	/* The stack copy covers [stack_low, stack_low + stack_size). */
+	uintptr_t stack_low;
+	size_t stack_size;
+	unsigned char stack[BUN_PTRACE_SNAPSHOT_STACK_SIZE];
+};
+
+/*
+ * Saves the registers and the top of the stack of the thread `tid`, which
+ * must have been stopped with bun_ptrace_attach(). The stack is copied from
+ * just below the stack pointer, to include the red zone, up to
+ * BUN_PTRACE_SNAPSHOT_STACK_SIZE bytes or the first unreadable page.
+ *
+ * Returns false if the registers cannot be read or the architecture is not
+ * supported.
+ */
+bool bun_ptrace_snapshot_save(pid_t tid, struct bun_ptrace_snapshot *snapshot);
+
+/*
+ * Copies `size` bytes at address `addr` of the saved stack into `dest`.
+ *
+ * Returns false if the range is not entirely saved.
+ */
+bool bun_ptrace_snapshot_read(const struct bun_ptrace_snapshot *snapshot,
+    void *dest, uintptr_t addr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
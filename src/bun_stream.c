@@ -20,11 +20,33 @@
 #define BUN_HEADER_MAGIC 0xaee9eb7a786a6145ull
 #define REGISTER_SIZE (sizeof(uint16_t) + sizeof(uint64_t))
 
+#define STREAM_VERSION_1 1
+#define STREAM_VERSION_2 2
+
+/* Fields present in a version 2 frame, see frame_write_v2(). */
+#define FRAME_LINE_NO (1U << 0)
+#define FRAME_OFFSET (1U << 1)
+#define FRAME_SYMBOL (1U << 2)
+#define FRAME_FILENAME (1U << 3)
+#define FRAME_REGISTERS (1U << 4)
+#define FRAME_FIELDS (FRAME_LINE_NO | FRAME_OFFSET | FRAME_SYMBOL | \
+    FRAME_FILENAME | FRAME_REGISTERS)
+
+/* A 64-bit value takes up to 10 bytes as a LEB128 varint. */
+#define VARINT_SIZE_MAX 10
+
+/* The registers of a version 2 frame are a bitmask over its architecture's. */
+#define REGISTER_MASK_BITS 64
+
 static bool is_safe_access(const struct bun_writer_reader_base *, size_t bytes);
+static uint8_t read_8(struct bun_reader *src);
+static void write_8(struct bun_writer *dest, uint8_t value);
 static uint16_t read_le_16(struct bun_reader *src);
 static void write_le_16(struct bun_writer *dest, uint16_t value);
 static uint64_t read_le_64(struct bun_reader *src);
 static void write_le_64(struct bun_writer *dest, uint64_t value);
+static uint64_t read_varint(struct bun_reader *src);
+static void write_varint(struct bun_writer *dest, uint64_t value);
 static ssize_t safe_strlen(struct bun_reader *src);
 
 #define CONCAT(a, b) CONCAT_INNER(a, b)
@@ -110,11 +132,16 @@ bun_writer_init(struct bun_writer *writer, struct bun_buffer *buffer,
 	writer->data.cursor = bun_buffer_payload(buffer) +
 	    sizeof(struct bun_payload_header);
 	writer->data.size = bun_buffer_payload_size(buffer);
-	writer->data.handle = handle;
+	writer->data.handle = buffer_payload->handle;
 	writer->data.overflow = false;
 
+	writer->previous_addr = 0;
+
 	hdr->magic = BUN_HEADER_MAGIC;
-	hdr->version = 1;
+	hdr->version = STREAM_VERSION_1;
+	if (buffer_payload->handle != NULL &&
+	    (buffer_payload->handle->flags & BUN_HANDLE_STREAM_V2) != 0)
+		hdr->version = STREAM_VERSION_2;
 	hdr->architecture = arch;
 	hdr->size = sizeof(*hdr);
 	hdr->tid = bun_gettid();
@@ -135,42 +162,73 @@ bun_reader_init(struct bun_reader *reader, struct bun_buffer *buffer,
 	if (header->magic != BUN_HEADER_MAGIC)
 		return false;
 
+	if (header->version != STREAM_VERSION_1 &&
+	    header->version != STREAM_VERSION_2)
+		return false;
+
 	reader->data.buffer = bun_buffer_payload(buffer);
 	reader->data.cursor = bun_buffer_payload(buffer) +
 	    sizeof(struct bun_payload_header);
 	reader->data.size = bun_buffer_payload_size(buffer);
 	reader->data.handle = handle;
 	reader->data.overflow = false;
+	reader->previous_addr = 0;
 
 	return true;
 }
 
-size_t
-bun_frame_write(struct bun_writer *writer, const struct bun_frame *frame)
+static size_t
+string_length(const char *string, size_t length)
+{
+
+	if (length == 0 && string != NULL)
+		return strlen(string);
+
+	return length;
+}
+
+static bool
+register_get_v1(const uint8_t *data, size_t index, enum bun_register *reg,
+    uintmax_t *value)
 {
-	size_t symbol_length;
-	size_t filename_length;
+	uint16_t le_reg;
+	uint64_t le_value;
+
+	data += REGISTER_SIZE * index;
+	memcpy(&le_reg, data, sizeof(le_reg));
+	memcpy(&le_value, data + sizeof(le_reg), sizeof(le_value));
+	*reg = le16toh(le_reg);
+	*value = le64toh(le_value);
+	return true;
+}
+
+static size_t
+frame_write_v1(struct bun_writer *writer, const struct bun_frame *frame)
+{
+	size_t symbol_length = string_length(frame->symbol,
+	    frame->symbol_length);
+	size_t filename_length = string_length(frame->filename,
+	    frame->filename_length);
 	size_t buffer_available = writer->data.size - (writer->data.cursor -
 	    writer->data.buffer);
-	size_t would_write;
+	size_t would_write, register_count = 0;
 	struct bun_payload_header *header = (void *)writer->data.buffer;
+	const char *registers = frame->register_data;
+	enum bun_register reg;
+	uintmax_t value;
 
-	if (frame->symbol_length == 0 && frame->symbol != NULL) {
-		symbol_length = strlen(frame->symbol);
-	} else {
-		symbol_length = frame->symbol_length;
-	}
-
-	if (frame->filename_length == 0 && frame->filename != NULL) {
-		filename_length = strlen(frame->filename);
-	} else {
-		filename_length = frame->filename_length;
+	for (size_t i = 0; i < frame->register_count; i++) {
+		register_get_v1(frame->register_data, i, &reg, &value);
+		register_count += bun_writer_register_wanted(writer, reg);
 	}
 
-	/* 2 for null bytes */
-	would_write = symbol_length + filename_length + 2 + sizeof(frame->addr) +
-	    sizeof(frame->line_no) + sizeof(frame->register_count) +
-	    frame->register_count * REGISTER_SIZE;
+	/*
+	 * 2 for null bytes. Address, line number and offset are serialized as
+	 * 64-bit values, the register count as a 16-bit one.
+	 */
+	would_write = symbol_length + filename_length + 2 +
+	    3 * sizeof(uint64_t) + sizeof(uint16_t) +
+	    register_count * REGISTER_SIZE;
 
 	if (would_write > buffer_available)
 		return 0;
@@ -185,34 +243,326 @@ bun_frame_write(struct bun_writer *writer, const struct bun_frame *frame)
 	strcpy(writer->data.cursor, frame->filename ? frame->filename : "");
 	writer->data.cursor += filename_length + 1;
 
-	write_le_16(writer, frame->register_count);
+	write_le_16(writer, register_count);
 
-	if (frame->register_count > 0) {
-		memcpy(writer->data.cursor, frame->register_data,
-		    frame->register_count * REGISTER_SIZE);
-		writer->data.cursor += frame->register_count * REGISTER_SIZE;
+	for (size_t i = 0; i < frame->register_count && register_count > 0;
+	    i++) {
+		register_get_v1(frame->register_data, i, &reg, &value);
+		if (bun_writer_register_wanted(writer, reg) == false)
+			continue;
+
+		memcpy(writer->data.cursor, registers + i * REGISTER_SIZE,
+		    REGISTER_SIZE);
+		writer->data.cursor += REGISTER_SIZE;
 	}
 
 	header->size += would_write;
 	return would_write;
 }
 
-bool
-bun_frame_read(struct bun_reader *reader, struct bun_frame *frame)
+static uint64_t
+zigzag_encode(uint64_t value)
 {
-	struct bun_payload_header *header = (void *)reader->data.buffer;
-	char *const initial_cursor_value = reader->data.cursor;
-	const size_t offset = reader->data.cursor - reader->data.buffer;
-	ptrdiff_t buffer_available = header->size - offset;
-	ssize_t length = -1;
-	(void) header;
 
-	if (reader->data.size - offset <= 0)
+	return (value << 1) ^ (uint64_t)((int64_t)value >> 63);
+}
+
+static uint64_t
+zigzag_decode(uint64_t value)
+{
+
+	return (value >> 1) ^ -(value & 1);
+}
+
+static size_t
+varint_size(uint64_t value)
+{
+	size_t size = 1;
+
+	while (value >= 0x80) {
+		value >>= 7;
+		size++;
+	}
+
+	return size;
+}
+
+/*
+ * Decodes the varint at `*cursor`, which must end before `end`, and moves the
+ * cursor past it.
+ */
+static bool
+varint_decode(const uint8_t **cursor, const uint8_t *end, uint64_t *value)
+{
+	const uint8_t *p = *cursor;
+	uint64_t result = 0;
+
+	for (unsigned int shift = 0; shift < 7 * VARINT_SIZE_MAX; shift += 7) {
+		if (p >= end)
+			return false;
+
+		result |= (uint64_t)(*p & 0x7f) << shift;
+		if ((*p++ & 0x80) == 0) {
+			*value = result;
+			*cursor = p;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Gets the registers of the architecture, from `begin` to `end` inclusive.
+ */
+static bool
+register_range(enum bun_architecture arch, enum bun_register *begin,
+    enum bun_register *end)
+{
+
+	switch (arch) {
+	case BUN_ARCH_X86:
+		*begin = BUN_REGISTER_X86_BEGIN;
+		*end = BUN_REGISTER_X86_END;
+		return true;
+	case BUN_ARCH_X86_64:
+		*begin = BUN_REGISTER_X86_64_BEGIN;
+		*end = BUN_REGISTER_X86_64_END;
+		return true;
+	case BUN_ARCH_ARM:
+		*begin = BUN_REGISTER_ARM_BEGIN;
+		*end = BUN_REGISTER_ARM_END;
+		return true;
+	case BUN_ARCH_ARM64:
+		*begin = BUN_REGISTER_AARCH64_BEGIN;
+		*end = BUN_REGISTER_AARCH64_END;
+		return true;
+	default:
+		return false;
+	}
+}
+static_assert(BUN_REGISTER_AARCH64_END - BUN_REGISTER_AARCH64_BEGIN <
+    REGISTER_MASK_BITS, "Registers of an architecture cannot be serialized "
+    "into a 64-bit mask.");
+
+/*
+ * Returns the number of bytes needed to store the value, at least 1.
+ */
+static size_t
+value_size(uint64_t value)
+{
+	size_t size = 1;
+
+	while (size < sizeof(value) && (value >> (size * 8)) != 0)
+		size++;
+
+	return size;
+}
+
+/*
+ * Gets the index-th of the values that follow the width byte of a version 2
+ * frame's registers.
+ */
+static uintmax_t
+register_value_v2(const uint8_t *data, size_t index)
+{
+	const uint8_t *value = data + 1 + index * data[0];
+	uintmax_t result = 0;
+
+	for (size_t i = 0; i < data[0]; i++)
+		result |= (uintmax_t)value[i] << (i * 8);
+
+	return result;
+}
+
+/*
+ * The registers of a version 2 frame were validated by frame_read_v2(), only
+ * the mask needs decoding to locate their values.
+ */
+static bool
+register_get_v2(const struct bun_frame *frame, size_t index,
+    enum bun_register *reg, uintmax_t *value)
+{
+	const uint8_t *data = frame->register_data;
+	const uint8_t *end = data + frame->register_buffer_size;
+	enum bun_register begin, last;
+	uint64_t mask;
+
+	if (register_range(frame->architecture, &begin, &last) == false ||
+	    varint_decode(&data, end, &mask) == false)
 		return false;
 
-	if (buffer_available <= 0)
+	/* Clear the bits of the registers stored before it. */
+	for (size_t i = 0; i < index && mask != 0; i++)
+		mask &= mask - 1;
+
+	if (mask == 0)
+		return false;
+
+	*reg = begin + __builtin_ctzll(mask);
+	*value = register_value_v2(data, index);
+	return true;
+}
+
+static bool
+register_find_v2(const struct bun_frame *frame, enum bun_register reg,
+    uintmax_t *value)
+{
+	const uint8_t *data = frame->register_data;
+	const uint8_t *end = data + frame->register_buffer_size;
+	enum bun_register begin, last;
+	uint64_t mask, bit;
+
+	if (register_range(frame->architecture, &begin, &last) == false ||
+	    reg < begin || reg > last ||
+	    varint_decode(&data, end, &mask) == false)
+		return false;
+
+	bit = 1ULL << (reg - begin);
+	if ((mask & bit) == 0)
 		return false;
 
+	/* Values are stored in the order of the bits. */
+	*value = register_value_v2(data, __builtin_popcountll(mask & (bit - 1)));
+	return true;
+}
+
+/*
+ * A version 2 frame is made of the following, with all integers encoded as
+ * unsigned LEB128 varints:
+ *  - a byte of FRAME_* flags telling which of the optional fields follow,
+ *  - the zigzag-encoded difference between the address and the address of
+ *    the previous frame, or 0 for the first frame,
+ *  - the line number, if FRAME_LINE_NO,
+ *  - the offset, if FRAME_OFFSET,
+ *  - the null-terminated symbol, if FRAME_SYMBOL,
+ *  - the null-terminated file name, if FRAME_FILENAME,
+ *  - if FRAME_REGISTERS, a mask with bit i set if the i-th register of the
+ *    stream's architecture is present, a byte holding the size of the
+ *    largest of their values, and the value of each present register in the
+ *    order of the bits, as little endian integers of that size. Registers
+ *    are thus found in constant time.
+ *
+ * Registers that do not belong to the stream's architecture are left out, as
+ * are later duplicates of a register. In both versions, so are the registers
+ * not wanted by the BUN_HANDLE_REGISTERS_* flags of the writer's handle.
+ */
+static size_t
+frame_write_v2(struct bun_writer *writer, const struct bun_frame *frame)
+{
+	size_t symbol_length = string_length(frame->symbol,
+	    frame->symbol_length);
+	size_t filename_length = string_length(frame->filename,
+	    frame->filename_length);
+	size_t buffer_available = writer->data.size - (writer->data.cursor -
+	    writer->data.buffer);
+	uint64_t delta = zigzag_encode(frame->addr - writer->previous_addr);
+	struct bun_payload_header *header = (void *)writer->data.buffer;
+	size_t would_write = 1 + varint_size(delta);
+	uint64_t values[REGISTER_MASK_BITS];
+	enum bun_register reg, begin, last;
+	uint64_t mask = 0;
+	size_t width = 0;
+	uintmax_t value;
+	uint8_t flags = 0;
+
+	if (frame->line_no != 0) {
+		flags |= FRAME_LINE_NO;
+		would_write += varint_size(frame->line_no);
+	}
+
+	if (frame->offset != 0) {
+		flags |= FRAME_OFFSET;
+		would_write += varint_size(frame->offset);
+	}
+
+	if (symbol_length > 0) {
+		flags |= FRAME_SYMBOL;
+		would_write += symbol_length + 1;
+	}
+
+	if (filename_length > 0) {
+		flags |= FRAME_FILENAME;
+		would_write += filename_length + 1;
+	}
+
+	if (frame->register_count > 0 && register_range(header->architecture,
+	    &begin, &last) == true) {
+		for (size_t i = 0; i < frame->register_count; i++) {
+			register_get_v1(frame->register_data, i, &reg, &value);
+			if (reg < begin || reg > last ||
+			    (mask & (1ULL << (reg - begin))) != 0 ||
+			    bun_writer_register_wanted(writer, reg) == false)
+				continue;
+
+			mask |= 1ULL << (reg - begin);
+			values[reg - begin] = value;
+			if (value_size(value) > width)
+				width = value_size(value);
+		}
+	}
+
+	if (mask != 0) {
+		flags |= FRAME_REGISTERS;
+		would_write += varint_size(mask) + 1 +
+		    __builtin_popcountll(mask) * width;
+	}
+
+	if (would_write > buffer_available)
+		return 0;
+
+	write_8(writer, flags);
+	write_varint(writer, delta);
+	if ((flags & FRAME_LINE_NO) != 0)
+		write_varint(writer, frame->line_no);
+	if ((flags & FRAME_OFFSET) != 0)
+		write_varint(writer, frame->offset);
+
+	if ((flags & FRAME_SYMBOL) != 0) {
+		memcpy(writer->data.cursor, frame->symbol, symbol_length);
+		writer->data.cursor[symbol_length] = '\0';
+		writer->data.cursor += symbol_length + 1;
+	}
+
+	if ((flags & FRAME_FILENAME) != 0) {
+		memcpy(writer->data.cursor, frame->filename, filename_length);
+		writer->data.cursor[filename_length] = '\0';
+		writer->data.cursor += filename_length + 1;
+	}
+
+	if ((flags & FRAME_REGISTERS) != 0) {
+		write_varint(writer, mask);
+		write_8(writer, width);
+		for (uint64_t m = mask; m != 0; m &= m - 1) {
+			value = values[__builtin_ctzll(m)];
+			for (size_t i = 0; i < width; i++)
+				write_8(writer, value >> (i * 8));
+		}
+	}
+
+	writer->previous_addr = frame->addr;
+	header->size += would_write;
+	return would_write;
+}
+
+size_t
+bun_frame_write(struct bun_writer *writer, const struct bun_frame *frame)
+{
+	struct bun_payload_header *header = (void *)writer->data.buffer;
+
+	if (header->version == STREAM_VERSION_2)
+		return frame_write_v2(writer, frame);
+
+	return frame_write_v1(writer, frame);
+}
+
+static bool
+frame_read_v1(struct bun_reader *reader, struct bun_frame *frame)
+{
+	struct bun_payload_header *header = (void *)reader->data.buffer;
+	char *const initial_cursor_value = reader->data.cursor;
+	ssize_t length = -1;
+
 	frame->addr = read_le_64(reader);
 	frame->line_no = read_le_64(reader);
 	frame->offset = read_le_64(reader);
@@ -247,6 +597,92 @@ bun_frame_read(struct bun_reader *reader, struct bun_frame *frame)
 		reader->data.cursor += frame->register_buffer_size;
 	}
 
+	frame->version = STREAM_VERSION_1;
+	frame->architecture = header->architecture;
+	return true;
+
+error:
+	reader->data.cursor = initial_cursor_value;
+	return false;
+}
+
+static bool
+frame_read_v2(struct bun_reader *reader, struct bun_frame *frame)
+{
+	struct bun_payload_header *header = (void *)reader->data.buffer;
+	char *const initial_cursor_value = reader->data.cursor;
+	enum bun_register begin, last;
+	ssize_t length = -1;
+	uint64_t mask;
+	size_t count, width;
+	uint8_t flags;
+	char *registers;
+
+	flags = read_8(reader);
+	if ((flags & ~FRAME_FIELDS) != 0)
+		goto error;
+
+	frame->addr = reader->previous_addr +
+	    zigzag_decode(read_varint(reader));
+	frame->line_no = 0;
+	if ((flags & FRAME_LINE_NO) != 0)
+		frame->line_no = read_varint(reader);
+
+	frame->offset = 0;
+	if ((flags & FRAME_OFFSET) != 0)
+		frame->offset = read_varint(reader);
+
+	frame->symbol = "";
+	if ((flags & FRAME_SYMBOL) != 0) {
+		length = safe_strlen(reader);
+		if (reader->data.overflow == true)
+			goto error;
+		frame->symbol = reader->data.cursor;
+		reader->data.cursor += length + 1;
+	}
+
+	frame->filename = "";
+	if ((flags & FRAME_FILENAME) != 0) {
+		length = safe_strlen(reader);
+		if (reader->data.overflow == true)
+			goto error;
+		frame->filename = reader->data.cursor;
+		reader->data.cursor += length + 1;
+	}
+
+	frame->register_count = 0;
+	frame->register_buffer_size = 0;
+	frame->register_data = NULL;
+	if ((flags & FRAME_REGISTERS) != 0) {
+		registers = reader->data.cursor;
+		mask = read_varint(reader);
+		width = read_8(reader);
+		if (reader->data.overflow == true ||
+		    register_range(header->architecture, &begin,
+		    &last) == false ||
+		    (mask >> (last - begin) >> 1) != 0 ||
+		    width == 0 || width > sizeof(uint64_t))
+			goto error;
+
+		/* They are decoded on access by bun_frame_register_get(). */
+		count = __builtin_popcountll(mask);
+		if (is_safe_access(&reader->data, count * width) == false) {
+			reader->data.overflow = true;
+			goto error;
+		}
+
+		reader->data.cursor += count * width;
+		frame->register_count = count;
+		frame->register_data = registers;
+		frame->register_buffer_size = reader->data.cursor - registers;
+	}
+
+	if (reader->data.overflow == true)
+		goto error;
+
+	frame->version = STREAM_VERSION_2;
+	frame->architecture = header->architecture;
+	reader->previous_addr = frame->addr;
 	return true;
 
 error:
@@ -254,6 +690,25 @@ error:
 	return false;
 }
 
+bool
+bun_frame_read(struct bun_reader *reader, struct bun_frame *frame)
+{
+	struct bun_payload_header *header = (void *)reader->data.buffer;
+	const size_t offset = reader->data.cursor - reader->data.buffer;
+	ptrdiff_t buffer_available = header->size - offset;
+
+	if (reader->data.size - offset <= 0)
+		return false;
+
+	if (buffer_available <= 0)
+		return false;
+
+	if (header->version == STREAM_VERSION_2)
+		return frame_read_v2(reader, frame);
+
+	return frame_read_v1(reader, frame);
+}
+
 void
 bun_header_tid_set(struct bun_writer *writer, uint32_t tid)
 {
@@ -318,18 +773,83 @@ bool
 bun_frame_register_get(struct bun_frame *frame, size_t index,
     enum bun_register *reg, uintmax_t *value)
 {
-	uint8_t *buffer;
 
 	if (index >= frame->register_count)
 		return false;
 
-	buffer = frame->register_data + REGISTER_SIZE * index;
-	*reg = 0;
-	memcpy(reg, buffer, sizeof(uint16_t));
+	if (frame->version == STREAM_VERSION_2)
+		return register_get_v2(frame, index, reg, value);
 
-	buffer += sizeof(uint16_t);
-	*value = 0;
-	memcpy(value, buffer, sizeof(uint64_t));
+	return register_get_v1(frame->register_data, index, reg, value);
+}
+
+bool
+bun_frame_register_find(struct bun_frame *frame, enum bun_register reg,
+    uintmax_t *value)
+{
+	enum bun_register r;
+	uintmax_t v;
+
+	if (frame->version == STREAM_VERSION_2)
+		return register_find_v2(frame, reg, value);
+
+	for (size_t i = 0; i < frame->register_count; i++) {
+		register_get_v1(frame->register_data, i, &r, &v);
+		if (r == reg) {
+			*value = v;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * The registers preserved across calls by the ABI of each architecture, and
+ * the stack pointer and program counter needed to resume unwinding.
+ */
+static const bool register_callee_saved[BUN_REGISTER_COUNT] = {
+	[BUN_REGISTER_X86_64_RBX] = true,
+	[BUN_REGISTER_X86_64_RBP] = true,
+	[BUN_REGISTER_X86_64_RSP] = true,
+	[BUN_REGISTER_X86_64_R12] = true,
+	[BUN_REGISTER_X86_64_R13] = true,
+	[BUN_REGISTER_X86_64_R14] = true,
+	[BUN_REGISTER_X86_64_R15] = true,
+	[BUN_REGISTER_X86_64_RIP] = true,
+	[BUN_REGISTER_X86_EBX] = true,
+	[BUN_REGISTER_X86_ESI] = true,
+	[BUN_REGISTER_X86_EDI] = true,
+	[BUN_REGISTER_X86_EBP] = true,
+	[BUN_REGISTER_X86_ESP] = true,
+	[BUN_REGISTER_X86_EIP] = true,
+	[BUN_REGISTER_AARCH64_X19 ... BUN_REGISTER_AARCH64_X31] = true,
+	[BUN_REGISTER_AARCH64_PC] = true,
+	[BUN_REGISTER_ARM_R4 ... BUN_REGISTER_ARM_R11] = true,
+	[BUN_REGISTER_ARM_R13 ... BUN_REGISTER_ARM_R15] = true
+};
+
+bool
+bun_writer_register_wanted(const struct bun_writer *writer,
+    enum bun_register reg)
+{
+	const struct bun_payload_header *header = (void *)writer->data.buffer;
+	uint64_t flags = 0;
+
+	if (writer->data.handle != NULL)
+		flags = writer->data.handle->flags;
+
+	if ((flags & BUN_HANDLE_REGISTERS_NONE) != 0)
+		return false;
+
+	/* The innermost frame is the first one written. */
+	if ((flags & BUN_HANDLE_REGISTERS_TOP_FRAME) != 0 &&
+	    header->size != sizeof(*header))
+		return false;
+
+	if ((flags & BUN_HANDLE_REGISTERS_CALLEE_SAVED) != 0)
+		return reg < BUN_REGISTER_COUNT &&
+		    register_callee_saved[reg] == true;
 
 	return true;
 }
@@ -346,6 +866,35 @@ is_safe_access(const struct bun_writer_reader_base *base, size_t bytes)
 	return bytes <= bytes_left;
 }
 
+static uint8_t
+read_8(struct bun_reader *src)
+{
+	uint8_t value;
+
+	if (is_safe_access(&src->data, sizeof(value)) == false) {
+		src->data.overflow = true;
+		return 0;
+	}
+
+	memcpy(&value, src->data.cursor, sizeof(value));
+	src->data.cursor += sizeof(value);
+	return value;
+}
+
+static void
+write_8(struct bun_writer *dest, uint8_t value)
+{
+
+	if (is_safe_access(&dest->data, sizeof(value)) == false) {
+		dest->data.overflow = true;
+		return;
+	}
+
+	memcpy(dest->data.cursor, &value, sizeof(value));
+	dest->data.cursor += sizeof(value);
+	return;
+}
+
 static uint16_t
 read_le_16(struct bun_reader *src)
 {
@@ -407,6 +956,42 @@ write_le_64(struct bun_writer *dest, uint64_t value)
 	return;
 }
 
+static uint64_t
+read_varint(struct bun_reader *src)
+{
+	const uint8_t *cursor = (const uint8_t *)src->data.cursor;
+	const uint8_t *end = (const uint8_t *)src->data.buffer + src->data.size;
+	uint64_t value;
+
+	if (src->data.overflow == true)
+		return 0;
+
+	if (varint_decode(&cursor, end, &value) == false) {
+		src->data.overflow = true;
+		return 0;
+	}
+
+	src->data.cursor = (char *)cursor;
+	return value;
+}
+
+static void
+write_varint(struct bun_writer *dest, uint64_t value)
+{
+
+	if (is_safe_access(&dest->data, varint_size(value)) == false) {
+		dest->data.overflow = true;
+		return;
+	}
+
+	while (value >= 0x80) {
+		*dest->data.cursor++ = (char)(value | 0x80);
+		value >>= 7;
+	}
+
+	*dest->data.cursor++ = (char)value;
+	return;
+}
 
 /*
  * Safe string length computation.
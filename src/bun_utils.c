@@ -19,8 +19,17 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #endif
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
 #include <sys/user.h>
 #include <sys/ptrace.h>
+#include <sys/wait.h>
 #include <linux/elf.h>
 
 #ifndef BUN_NO_BACKTRACE_LOG
@@ -212,152 +221,273 @@ getregs_success(pid_t pid)
 }
 #endif
 
-int
-bun_waitpid(pid_t pid, int msec_timeout)
+/*
+ * Bounds of the interval between two checks for the stop of the tracee. The
+ * upper one is the fixed interval that was polled at before.
+ */
+#define WAIT_INTERVAL_MIN_NS 20000L
+#define WAIT_INTERVAL_MAX_NS 500000L
+
+static void
+timespec_add_ns(struct timespec *ts, long ns)
 {
-	struct timespec current, remaining;
-	int loop = 0;
 
-	for (;;) {
-		int r, sig;
-		int status, e;
-		const int flags = WNOHANG | WUNTRACED;
-		siginfo_t sinfo;
-
-		pid_t p = waitpid(pid, &status, flags);
-		if (p == -1) {
-			bt_log(BT_LOG_DEBUG, "Observed -1 in waitpid: %d\n", errno);
-			if (errno == EINTR)
-				continue;
+	ts->tv_sec += ns / 1000000000L;
+	ts->tv_nsec += ns % 1000000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+	return;
+}
 
-			if (errno == ECHILD) {
-				bt_log(BT_LOG_DEBUG, "Received child stop "
-									 "notification; retrying\n");
-				continue;
-			}
+static bool
+timespec_before(const struct timespec *a, const struct timespec *b)
+{
 
-			return -1;
-		} else if (p != pid) {
-			bt_log(BT_LOG_DEBUG, "No matched event: %d != %ju\n", p,
-				   (uintmax_t) pid);
+	if (a->tv_sec != b->tv_sec)
+		return a->tv_sec < b->tv_sec;
 
-			/* No status to report, try again. */
-			current.tv_sec = 0;
-			current.tv_nsec = 500000;
+	return a->tv_nsec < b->tv_nsec;
+}
 
-			for (;;) {
-				r = nanosleep(&current, &remaining);
-				if (r != -1 || errno != EINTR)
-					break;
+/*
+ * Returns a pidfd for `pid`, or -1 if the kernel does not support them (before
+ * Linux 5.3) or `pid` is not a thread group leader.
+ */
+static int
+open_pidfd(pid_t pid)
+{
+
+#if defined(SYS_pidfd_open)
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	(void) pid;
+	return -1;
+#endif
+}
+
+/*
+ * Sleeps until `until`, or until the process behind `pidfd` exits if there is
+ * one.
+ */
+static void
+wait_until(int pidfd, const struct timespec *until)
+{
+	struct timespec now, timeout;
+	struct pollfd pfd;
 
-				current = remaining;
-			}
+	if (pidfd == -1) {
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, until,
+		    NULL) == EINTR);
+		return;
+	}
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0 ||
+	    timespec_before(&now, until) == false)
+		return;
 
-			msec_timeout -= loop++ & 1;
-			if (msec_timeout > 0) {
-				bt_log(BT_LOG_DEBUG, "Trying again, timeout is: %d\n", msec_timeout);
+	timeout.tv_sec = until->tv_sec - now.tv_sec;
+	timeout.tv_nsec = until->tv_nsec - now.tv_nsec;
+	if (timeout.tv_nsec < 0) {
+		timeout.tv_sec--;
+		timeout.tv_nsec += 1000000000L;
+	}
+
+	pfd.fd = pidfd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	ppoll(&pfd, 1, &timeout, NULL);
+	return;
+}
+
+/*
+ * Waits for a state change of the tracee `pid` until the monotonic `deadline`,
+ * or forever if it is NULL. Stops cannot be polled for, so waitid() is
+ * retried at growing intervals; a pidfd cuts the sleep short if the target
+ * exits in the meantime.
+ *
+ * Returns 1 if `info` has been filled, 0 on timeout and -1 on error.
+ */
+static int
+wait_event(pid_t pid, const struct timespec *deadline, siginfo_t *info)
+{
+	const int flags = WEXITED | WSTOPPED | __WALL;
+	long interval = WAIT_INTERVAL_MIN_NS;
+	int pidfd = -1;
+	int result;
+
+	if (deadline == NULL) {
+		do {
+			result = waitid(P_PID, pid, info, flags);
+		} while (result == -1 && errno == EINTR);
+
+		return result == 0 ? 1 : -1;
+	}
+
+	for (;;) {
+		struct timespec now, until;
+
+		memset(info, 0, sizeof(*info));
+		if (waitid(P_PID, pid, info, flags | WNOHANG) == -1) {
+			if (errno == EINTR)
 				continue;
-			}
-
-			/*
-			* There are two reasons why we may have reached this
-			* timeout:
-			*
-			* 1) The process was already stopped when we attached
-			*    and we did not observe a state transition.
-			* 2) The process was running when we attached but it
-			*    has not yet transitioned to a stop state.  This
-			*    case is extremely unlikely unless the timeout
-			*    period was very short.
-			*
-			* In either case, we may as well try to get register
-			* values before giving up.  If the process truly is not
-			* stopped yet then this call will fail and we can
-			* indicate failure.  However, if it succeeds then we
-			* probably encountered the first case above and it is
-			* safe for us to proceed.
-			*/
-
-			if (getregs_success(pid) != -1)
-				goto stopped;
 
-			return -1;
+			bt_log(BT_LOG_DEBUG, "waitid failed: %d\n", errno);
+			result = -1;
+			break;
 		}
 
-		/* The child has terminated. */
-		if (WIFEXITED(status) || WIFSIGNALED(status)) {
-			bt_log(BT_LOG_ERROR, "process already exited with code %d",
-			    WEXITSTATUS(status));
-			return -1;
+		/* si_pid is left to 0 if there is nothing to report yet. */
+		if (info->si_pid != 0) {
+			result = 1;
+			break;
 		}
 
-		if (WIFSTOPPED(status) == false) {
-			bt_log(BT_LOG_ERROR, "process stopped with unexpected status %d",
-			    status);
-			return -1;
+		if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
+			result = -1;
+			break;
 		}
 
-		sig = WSTOPSIG(status);
-		bt_log(BT_LOG_DEBUG, "Process %ju stopped with signal %d\n",
-		    (uintmax_t) pid, sig);
-
-		/*
-		 * From the Linux ptrace(2) man page:
-		* If WSTOPSIG(status) is not one of SIGSTOP, SIGTSTP,
-		* SIGTTIN, or SIGTTOU, then this can't be a group-stop.
-		* If it is one of these signals, then we must use
-		* PTRACE_GETSIGINFO.  If that fails with EINVAL then we
-		* are definitely in a group-stop.  Otherwise we are in
-		* a signal-delivery-stop.  We already know that this
-		* signal is a SIGSTOP because otherwise we would have
-		* returned above.
-		*
-		* Being in group-stop means that we are currently
-		* handling a signal sent from another source (i.e. not
-		* from our PTRACE_ATTACH), so we should store the
-		* signal for injection when detaching.
-		*/
-		switch (sig) {
-			case SIGSTOP:
-			case SIGTSTP:
-			case SIGTTIN:
-			case SIGTTOU:
-				break;
-			default:
-				goto signal_stop;
+		if (timespec_before(&now, deadline) == false) {
+			result = 0;
+			break;
 		}
 
-		r = ptrace(PTRACE_GETSIGINFO, pid, NULL, &sinfo);
-		if (r != -1)
-			goto signal_stop;
+		/* Only open the pidfd if the stop is not immediate. */
+		if (pidfd == -1 && interval == WAIT_INTERVAL_MIN_NS)
+			pidfd = open_pidfd(pid);
 
-		e = errno;
-		bt_log(BT_LOG_DEBUG, "Failed to retrieve siginfo for "
-		    "process %ju: %s\n", (uintmax_t) pid, strerror(e));
+		until = now;
+		timespec_add_ns(&until, interval);
+		if (timespec_before(deadline, &until) == true)
+			until = *deadline;
 
-		switch (e) {
-		case EINVAL:
-			break;
-		case ESRCH:
-			bt_log(BT_LOG_DEBUG, "Process %ju was killed "
-			    "from under us\n", (uintmax_t) pid);
+		wait_until(pidfd, &until);
+		interval *= 2;
+		if (interval > WAIT_INTERVAL_MAX_NS)
+			interval = WAIT_INTERVAL_MAX_NS;
+	}
+
+	if (pidfd != -1)
+		close(pidfd);
+
+	return result;
+}
+
+int
+bun_waitpid(pid_t pid, int msec_timeout)
+{
+	struct timespec deadline;
+	siginfo_t info, sinfo;
+	int r, sig, e;
+
+	if (msec_timeout >= 0) {
+		if (clock_gettime(CLOCK_MONOTONIC, &deadline) != 0)
 			return -1;
-		default:
-			bt_log(BT_LOG_DEBUG, "Failed to read signal "
-			    "information from process %ju: %s\n",
-			    (uintmax_t) pid, strerror(e));
-			goto stopped;
+
+		/* long is 32 bits on some targets, too short for the ns. */
+		deadline.tv_sec += msec_timeout / 1000;
+		timespec_add_ns(&deadline, (msec_timeout % 1000) * 1000000L);
 	}
 
-		bt_log(BT_LOG_DEBUG, "Process %ju is in group-stop "
-		    "state; re-injecting SIGSTOP\n", (uintmax_t) pid);
+	r = wait_event(pid, msec_timeout >= 0 ? &deadline : NULL, &info);
+	if (r == -1)
+		return -1;
+
+	if (r == 0) {
+		/*
+		 * There are two reasons why we may have reached this
+		 * timeout:
+		 *
+		 * 1) The process was already stopped when we attached
+		 *    and we did not observe a state transition.
+		 * 2) The process was running when we attached but it
+		 *    has not yet transitioned to a stop state.  This
+		 *    case is extremely unlikely unless the timeout
+		 *    period was very short.
+		 *
+		 * In either case, we may as well try to get register
+		 * values before giving up.  If the process truly is not
+		 * stopped yet then this call will fail and we can
+		 * indicate failure.  However, if it succeeds then we
+		 * probably encountered the first case above and it is
+		 * safe for us to proceed.
+		 */
+		if (getregs_success(pid) != -1)
+			return 0;
+
+		return -1;
+	}
+
+	/* The child has terminated. */
+	if (info.si_code == CLD_EXITED || info.si_code == CLD_KILLED ||
+	    info.si_code == CLD_DUMPED) {
+		bt_log(BT_LOG_ERROR, "process already exited with code %d",
+		    info.si_status);
+		return -1;
+	}
+
+	if (info.si_code != CLD_STOPPED && info.si_code != CLD_TRAPPED) {
+		bt_log(BT_LOG_ERROR, "process stopped with unexpected code %d",
+		    info.si_code);
+		return -1;
+	}
+
+	sig = info.si_status;
+	bt_log(BT_LOG_DEBUG, "Process %ju stopped with signal %d\n",
+	    (uintmax_t) pid, sig);
+
+	/*
+	 * From the Linux ptrace(2) man page:
+	 * If WSTOPSIG(status) is not one of SIGSTOP, SIGTSTP,
+	 * SIGTTIN, or SIGTTOU, then this can't be a group-stop.
+	 * If it is one of these signals, then we must use
+	 * PTRACE_GETSIGINFO.  If that fails with EINVAL then we
+	 * are definitely in a group-stop.  Otherwise we are in
+	 * a signal-delivery-stop.  We already know that this
+	 * signal is a SIGSTOP because otherwise we would have
+	 * returned above.
+	 *
+	 * Being in group-stop means that we are currently
+	 * handling a signal sent from another source (i.e. not
+	 * from our PTRACE_ATTACH), so we should store the
+	 * signal for injection when detaching.
+	 */
+	switch (sig) {
+	case SIGSTOP:
+	case SIGTSTP:
+	case SIGTTIN:
+	case SIGTTOU:
+		break;
+	default:
+		return 0;
+	}
 
-		goto stopped;
-signal_stop:
-		goto stopped;
+	r = ptrace(PTRACE_GETSIGINFO, pid, NULL, &sinfo);
+	if (r != -1)
+		return 0;
+
+	e = errno;
+	bt_log(BT_LOG_DEBUG, "Failed to retrieve siginfo for "
+	    "process %ju: %s\n", (uintmax_t) pid, strerror(e));
+
+	switch (e) {
+	case EINVAL:
+		break;
+	case ESRCH:
+		bt_log(BT_LOG_DEBUG, "Process %ju was killed "
+		    "from under us\n", (uintmax_t) pid);
+		return -1;
+	default:
+		bt_log(BT_LOG_DEBUG, "Failed to read signal "
+		    "information from process %ju: %s\n",
+		    (uintmax_t) pid, strerror(e));
+		return 0;
 	}
 
-stopped:
+	bt_log(BT_LOG_DEBUG, "Process %ju is in group-stop "
+	    "state; re-injecting SIGSTOP\n", (uintmax_t) pid);
 	return 0;
 }
 
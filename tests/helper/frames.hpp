@@ -0,0 +1,57 @@
+#pragma once
+/*
+ * Copyright (c) 2021 Backtrace I/O, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+#include <cstring>
+#include <vector>
+
+/*
+ * Deserializes every frame of the buffer.
+ */
+static inline std::vector<bun_frame>
+read_frames(struct bun_buffer *buffer, struct bun_handle *handle)
+{
+	struct bun_reader reader;
+	std::vector<bun_frame> frames;
+	bun_frame next_frame;
+
+	if (bun_reader_init(&reader, buffer, handle) == false)
+		return frames;
+
+	while (bun_frame_read(&reader, &next_frame))
+		frames.push_back(next_frame);
+
+	return frames;
+}
+
+/*
+ * Matches the symbolized frame of the dummy_func() defined by each test.
+ */
+static inline bool
+is_dummy_func(bun_frame const& f)
+{
+
+	return strcmp(f.symbol, "_Z10dummy_funcRKSt8functionIFvvEE") == 0;
+}
@@ -1,5 +1,6 @@
 #include <utility>
 #include <type_traits>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -64,6 +65,23 @@ TEST(base, call_destructor) {
 	ASSERT_TRUE(flag);
 }
 
+TEST(base, missing_unwinders) {
+	struct bun_handle handle;
+	char buf[256];
+	struct bun_buffer buffer;
+	auto unwind = [](auto &&...) -> size_t { return 1; };
+
+	bool init_result = initialize_test_backend(&handle, unwind, [](auto){});
+	ASSERT_TRUE(init_result);
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf, sizeof(buf));
+	ASSERT_TRUE(buffer_init_result);
+
+	ASSERT_EQ(bun_unwind_context(&handle, &buffer, nullptr), 0);
+	ASSERT_EQ(bun_unwind_remote(&handle, &buffer, getpid()), 0);
+	bun_handle_deinit(&handle);
+}
+
 TEST(base, write_frame) {
 	struct bun_handle handle;
 	std::vector<char> buf(1024);
@@ -95,6 +113,39 @@ TEST(base, write_frame) {
 	bun_handle_deinit(&handle);
 }
 
+TEST(base, write_frame_size) {
+	std::vector<char> buf(1024);
+	struct bun_buffer buffer;
+	struct bun_writer writer;
+	struct bun_frame frame = {};
+	char *start;
+	size_t written, slack;
+
+	frame.addr = 0x1234;
+	frame.line_no = 42;
+	frame.offset = 8;
+	frame.symbol = "symbol";
+	frame.filename = "file.c";
+
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_TRUE(bun_writer_init(&writer, &buffer, BUN_ARCH_DETECTED, NULL));
+	start = writer.data.cursor;
+
+	written = bun_frame_write(&writer, &frame);
+	ASSERT_GT(written, 0);
+	ASSERT_EQ(written, (size_t)(writer.data.cursor - start));
+
+	/* A buffer one byte short of the frame must reject it. */
+	slack = writer.data.size - (start - writer.data.buffer) - written;
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size() - slack - 1));
+	ASSERT_TRUE(bun_writer_init(&writer, &buffer, BUN_ARCH_DETECTED, NULL));
+	ASSERT_EQ(bun_frame_write(&writer, &frame), 0);
+
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size() - slack));
+	ASSERT_TRUE(bun_writer_init(&writer, &buffer, BUN_ARCH_DETECTED, NULL));
+	ASSERT_EQ(bun_frame_write(&writer, &frame), written);
+}
+
 TEST(base, two_writers_initialize)
 {
 	struct bun_handle handle;
@@ -148,3 +199,246 @@ TEST(base, write_once_writer_wont_initialize)
 		BUN_ARCH_DETECTED, &handle);
 	ASSERT_FALSE(writer_2_initialized);
 }
+
+struct stream_frame {
+	uint64_t addr;
+	size_t line_no;
+	size_t offset;
+	const char *symbol;
+	const char *filename;
+	std::vector<std::pair<int, uintmax_t>> registers;
+};
+
+/*
+ * A stack as written with BUN_HANDLE_SKIP_SYMBOLS, with nearby addresses in a
+ * couple of objects and a mix of small values and pointers in the registers
+ * of the innermost frames. A few frames have strings to cover them.
+ */
+static std::vector<stream_frame>
+stream_frames()
+{
+	std::vector<stream_frame> frames;
+
+	for (int i = 0; i < 24; i++) {
+		stream_frame frame = {};
+
+		frame.addr = (i % 8 == 7 ? 0x55d0c0de0000ULL :
+		    0x7f3a12340000ULL) + i * 0x1f3;
+		frame.offset = i % 3 == 0 ? 0 : 0x40 + i;
+		frame.line_no = i % 4 == 0 ? 100 + i : 0;
+		frame.symbol = i % 6 == 1 ? "a_symbol" : nullptr;
+		frame.filename = i % 6 == 2 ? "/usr/lib/libc.so.6" : nullptr;
+		for (int r = 0; i < 2 && r < 17; r++) {
+			frame.registers.emplace_back(r, r % 2 == 0 ?
+			    (uintmax_t)r * 3 : 0x7ffd4c2a1000ULL - r * 8);
+		}
+
+		frames.push_back(frame);
+	}
+
+	return frames;
+}
+
+/*
+ * Writes the frames until one does not fit. Returns the size of the frames
+ * written and their count in `count`.
+ */
+static size_t
+write_stream(struct bun_handle *handle, struct bun_buffer *buffer,
+    const std::vector<stream_frame> &frames, size_t *count)
+{
+	struct bun_writer writer;
+	size_t size = 0;
+
+	*count = 0;
+
+	/* The registers of stream_frames() are x86-64 ones. */
+	if (bun_writer_init(&writer, buffer, BUN_ARCH_X86_64, handle) == false)
+		return 0;
+
+	for (const auto &f : frames) {
+		char registers[32 * (sizeof(uint16_t) + sizeof(uint64_t))];
+		struct bun_frame frame = {};
+		size_t written;
+
+		frame.addr = f.addr;
+		frame.line_no = f.line_no;
+		frame.offset = f.offset;
+		frame.symbol = f.symbol;
+		frame.filename = f.filename;
+		frame.register_data = registers;
+		frame.register_buffer_size = sizeof(registers);
+		for (const auto &reg : f.registers) {
+			bun_frame_register_append(&frame,
+			    (enum bun_register)reg.first, reg.second);
+		}
+
+		written = bun_frame_write(&writer, &frame);
+		if (written == 0)
+			break;
+		size += written;
+		(*count)++;
+	}
+
+	return size;
+}
+
+static void
+check_stream(struct bun_handle *handle, struct bun_buffer *buffer,
+    const std::vector<stream_frame> &frames, size_t count)
+{
+	struct bun_reader reader;
+	struct bun_frame frame;
+	size_t read = 0;
+
+	ASSERT_TRUE(bun_reader_init(&reader, buffer, handle));
+	while (bun_frame_read(&reader, &frame) == true) {
+		ASSERT_LT(read, frames.size());
+		const stream_frame &expected = frames[read++];
+
+		ASSERT_EQ(frame.addr, expected.addr);
+		ASSERT_EQ(frame.line_no, expected.line_no);
+		ASSERT_EQ(frame.offset, expected.offset);
+		ASSERT_STREQ(frame.symbol, expected.symbol ?
+		    expected.symbol : "");
+		ASSERT_STREQ(frame.filename, expected.filename ?
+		    expected.filename : "");
+		ASSERT_EQ(frame.register_count, expected.registers.size());
+
+		/* Backwards, so that no register is found by chance. */
+		for (size_t i = frame.register_count; i-- > 0;) {
+			enum bun_register reg;
+			uintmax_t value;
+
+			ASSERT_TRUE(bun_frame_register_get(&frame, i, &reg,
+			    &value));
+			ASSERT_EQ(reg, expected.registers[i].first);
+			ASSERT_EQ(value, expected.registers[i].second);
+		}
+	}
+
+	ASSERT_EQ(read, count);
+}
+
+TEST(base, stream_versions)
+{
+	struct bun_handle handle;
+	std::vector<char> buf(0x4000);
+	struct bun_buffer buffer;
+	auto frames = stream_frames();
+	auto unwind = [](auto &&...) -> size_t { return 1; };
+	size_t v1, v2, count;
+
+	ASSERT_TRUE(initialize_test_backend(&handle, unwind, [](auto){}));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	v1 = write_stream(&handle, &buffer, frames, &count);
+	ASSERT_EQ(count, frames.size());
+	check_stream(&handle, &buffer, frames, count);
+
+	/* Frames without registers shrink the most. */
+	handle.flags |= BUN_HANDLE_STREAM_V2;
+	v2 = write_stream(&handle, &buffer, frames, &count);
+	ASSERT_EQ(count, frames.size());
+	ASSERT_LT(v2 * 2, v1);
+	check_stream(&handle, &buffer, frames, count);
+
+	/* The frames that do not fit are left out whole. */
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), 256));
+	write_stream(&handle, &buffer, frames, &count);
+	ASSERT_GT(count, 0);
+	ASSERT_LT(count, frames.size());
+	check_stream(&handle, &buffer, frames, count);
+
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * Returns the register count of each frame of the stream, checking that the
+ * registers are found by their index and by their name alike.
+ */
+static std::vector<size_t>
+stream_registers(struct bun_handle *handle, struct bun_buffer *buffer)
+{
+	std::vector<size_t> counts;
+	struct bun_reader reader;
+	struct bun_frame frame;
+
+	EXPECT_TRUE(bun_reader_init(&reader, buffer, handle));
+	while (bun_frame_read(&reader, &frame) == true) {
+		for (size_t i = 0; i < frame.register_count; i++) {
+			enum bun_register reg;
+			uintmax_t value, found;
+
+			EXPECT_TRUE(bun_frame_register_get(&frame, i, &reg,
+			    &value));
+			EXPECT_TRUE(bun_frame_register_find(&frame, reg,
+			    &found));
+			EXPECT_EQ(found, value);
+		}
+
+		counts.push_back(frame.register_count);
+	}
+
+	return counts;
+}
+
+TEST(base, stream_register_policy)
+{
+	struct bun_handle handle;
+	std::vector<char> buf(0x4000);
+	struct bun_buffer buffer;
+	auto frames = stream_frames();
+	auto unwind = [](auto &&...) -> size_t { return 1; };
+	const struct {
+		uint64_t flags;
+		size_t top;
+		size_t next;
+	} policies[] = {
+		{ 0, 17, 17 },
+		{ BUN_HANDLE_REGISTERS_TOP_FRAME, 17, 0 },
+		/* RBX, RBP, RSP, R12 to R15 and RIP. */
+		{ BUN_HANDLE_REGISTERS_CALLEE_SAVED, 8, 8 },
+		{ BUN_HANDLE_REGISTERS_TOP_FRAME |
+		    BUN_HANDLE_REGISTERS_CALLEE_SAVED, 8, 0 },
+		{ BUN_HANDLE_REGISTERS_NONE, 0, 0 },
+	};
+	const uint64_t versions[] = { 0, BUN_HANDLE_STREAM_V2 };
+	size_t count;
+
+	ASSERT_TRUE(initialize_test_backend(&handle, unwind, [](auto){}));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	for (uint64_t version : versions) {
+		for (const auto &policy : policies) {
+			handle.flags = version | policy.flags;
+			write_stream(&handle, &buffer, frames, &count);
+			ASSERT_EQ(count, frames.size());
+
+			auto counts = stream_registers(&handle, &buffer);
+			ASSERT_EQ(counts.size(), frames.size());
+			ASSERT_EQ(counts[0], policy.top);
+			ASSERT_EQ(counts[1], policy.next);
+			ASSERT_EQ(counts[2], 0);
+		}
+	}
+
+	/* Only the registers that were written are found by name. */
+	struct bun_reader reader;
+	struct bun_frame frame;
+	uintmax_t value;
+
+	handle.flags = BUN_HANDLE_STREAM_V2 | BUN_HANDLE_REGISTERS_CALLEE_SAVED;
+	write_stream(&handle, &buffer, frames, &count);
+	ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+	ASSERT_TRUE(bun_frame_read(&reader, &frame));
+	ASSERT_TRUE(bun_frame_register_find(&frame, BUN_REGISTER_X86_64_RSP,
+	    &value));
+	ASSERT_EQ(value, 0x7ffd4c2a1000ULL - BUN_REGISTER_X86_64_RSP * 8);
+	ASSERT_FALSE(bun_frame_register_find(&frame, BUN_REGISTER_X86_64_RAX,
+	    &value));
+	ASSERT_FALSE(bun_frame_register_find(&frame, BUN_REGISTER_AARCH64_X0,
+	    &value));
+
+	bun_handle_deinit(&handle);
+}
@@ -0,0 +1,180 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+#include "frames.hpp"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+static volatile bool spinning = true;
+
+/*
+ * Forks a child inside dummy_func(), blocked in pause() or spinning. Returns
+ * its pid once it is ready to be unwound.
+ */
+static pid_t
+spawn_child(bool blocked)
+{
+	int fds[2];
+	char c = 0;
+	pid_t pid;
+
+	if (pipe(fds) != 0)
+		return -1;
+
+	pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		dummy_func([&]{
+			if (write(fds[1], &c, 1) != 1)
+				_exit(1);
+
+			while (blocked == true)
+				pause();
+			while (spinning == true)
+				;
+		});
+		_exit(0);
+	}
+
+	close(fds[1]);
+	if (pid != -1 && read(fds[0], &c, 1) != 1) {
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+		pid = -1;
+	}
+
+	close(fds[0]);
+	return pid;
+}
+
+static void
+reap(pid_t pid)
+{
+
+	kill(pid, SIGKILL);
+	waitpid(pid, nullptr, 0);
+}
+
+TEST(census, blocked) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	char exe[PATH_MAX] = {0};
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_CENSUS));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_GT(readlink("/proc/self/exe", exe, sizeof(exe) - 1), 0);
+
+	pid_t child = spawn_child(true);
+	ASSERT_NE(child, -1);
+
+	/*
+	 * A traced thread cannot be attached to again, so the unwind only
+	 * succeeds if the child is not stopped.
+	 */
+	ASSERT_EQ(ptrace(PTRACE_SEIZE, child, 0, 0), 0);
+
+	size_t size = 0;
+	for (int i = 0; i < 100 && size == 0; i++) {
+		size = bun_unwind_remote(&handle, &buffer, child);
+		if (size == 0)
+			usleep(10000);
+	}
+
+	ASSERT_NE(size, 0);
+
+	struct bun_reader reader;
+	ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+	ASSERT_EQ(bun_header_tid_get(&reader), (unsigned)child);
+	ASSERT_EQ(bun_header_backend_get(&reader), BUN_BACKEND_CENSUS);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	ASSERT_STREQ(it->filename, exe);
+
+	reap(child);
+	bun_handle_deinit(&handle);
+}
+
+TEST(census, alternating) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_CENSUS));
+	handle.flags |= BUN_HANDLE_PTRACE_SEIZE;
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	pid_t children[2] = { spawn_child(true), spawn_child(true) };
+	ASSERT_NE(children[0], -1);
+	ASSERT_NE(children[1], -1);
+
+	/* Each process keeps its own target. */
+	for (int i = 0; i < 4; i++) {
+		pid_t child = children[i % 2];
+
+		ASSERT_NE(bun_unwind_remote(&handle, &buffer, child), 0);
+
+		struct bun_reader reader;
+		ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+		ASSERT_EQ(bun_header_tid_get(&reader), (unsigned)child);
+
+		auto frames = read_frames(&buffer, &handle);
+		ASSERT_NE(std::find_if(frames.cbegin(), frames.cend(),
+		    is_dummy_func), frames.cend());
+	}
+
+	reap(children[0]);
+	reap(children[1]);
+	bun_handle_deinit(&handle);
+}
+
+TEST(census, running) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_CENSUS));
+	handle.flags |= BUN_HANDLE_PTRACE_SEIZE;
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	pid_t child = spawn_child(false);
+	ASSERT_NE(child, -1);
+
+	/* The spinning thread is stopped to be unwound. */
+	size_t size = bun_unwind_remote(&handle, &buffer, child);
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 1);
+	ASSERT_GT(frames[0].register_count, 0);
+	ASSERT_NE(std::find_if(frames.cbegin(), frames.cend(), is_dummy_func),
+	    frames.cend());
+
+	/* It runs on afterwards. */
+	ASSERT_EQ(waitpid(child, nullptr, WNOHANG), 0);
+	reap(child);
+	bun_handle_deinit(&handle);
+}
@@ -0,0 +1,511 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/core.h>
+#include <bun/stream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <elf.h>
+#include <link.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/procfs.h>
+#include <sys/user.h>
+
+#include "bun_object_cache.h"
+
+#include "frames.hpp"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+#if defined(__x86_64__) || defined(__aarch64__)
+/*
+ * Registers and stack of a thread, as they would be saved in a core file.
+ */
+struct captured_thread {
+	pid_t tid;
+	struct elf_prstatus status;
+	uintptr_t stack_start;
+	std::vector<uint8_t> stack;
+};
+
+static void __attribute__((noinline))
+capture(captured_thread *thread)
+{
+	struct user_regs_struct regs = {};
+	pthread_attr_t attr;
+	void *stack_address;
+	size_t stack_size;
+	ucontext_t uc;
+	uintptr_t sp;
+
+	pthread_getattr_np(pthread_self(), &attr);
+	pthread_attr_getstack(&attr, &stack_address, &stack_size);
+	pthread_attr_destroy(&attr);
+
+	getcontext(&uc);
+
+#if defined(__x86_64__)
+	const greg_t *gregs = uc.uc_mcontext.gregs;
+
+	regs.rax = gregs[REG_RAX];
+	regs.rbx = gregs[REG_RBX];
+	regs.rcx = gregs[REG_RCX];
+	regs.rdx = gregs[REG_RDX];
+	regs.rsi = gregs[REG_RSI];
+	regs.rdi = gregs[REG_RDI];
+	regs.rbp = gregs[REG_RBP];
+	regs.rsp = gregs[REG_RSP];
+	regs.r8 = gregs[REG_R8];
+	regs.r9 = gregs[REG_R9];
+	regs.r10 = gregs[REG_R10];
+	regs.r11 = gregs[REG_R11];
+	regs.r12 = gregs[REG_R12];
+	regs.r13 = gregs[REG_R13];
+	regs.r14 = gregs[REG_R14];
+	regs.r15 = gregs[REG_R15];
+	regs.rip = gregs[REG_RIP];
+	sp = regs.rsp;
+#else
+	for (size_t i = 0; i < 31; i++)
+		regs.regs[i] = uc.uc_mcontext.regs[i];
+	regs.sp = uc.uc_mcontext.sp;
+	regs.pc = uc.uc_mcontext.pc;
+	sp = regs.sp;
+#endif
+
+	memset(&thread->status, 0, sizeof(thread->status));
+	thread->tid = gettid();
+	thread->status.pr_pid = thread->tid;
+	memcpy(&thread->status.pr_reg, &regs, sizeof(regs));
+
+	/* Everything above the stack pointer is left untouched from here on. */
+	thread->stack_start = sp;
+	thread->stack.assign(reinterpret_cast<const uint8_t *>(sp),
+	    static_cast<const uint8_t *>(stack_address) + stack_size);
+}
+
+/*
+ * Builds a minimal ELF core file: one PT_NOTE segment holding the NT_PRSTATUS
+ * notes and the NT_FILE note, followed by PT_LOAD segments.
+ */
+class core_writer {
+public:
+	void
+	add_note(uint32_t type, const void *desc, size_t size)
+	{
+		ElfW(Nhdr) nhdr = {};
+		static const char name[8] = "CORE";
+
+		nhdr.n_namesz = 5;
+		nhdr.n_descsz = size;
+		nhdr.n_type = type;
+		append(notes, &nhdr, sizeof(nhdr));
+		append(notes, name, sizeof(name));
+		append(notes, desc, size);
+		notes.resize((notes.size() + 3) & ~size_t(3));
+	}
+
+	void
+	add_segment(uintptr_t address, const void *data, size_t size)
+	{
+
+		segments.push_back({address,
+		    std::vector<uint8_t>(static_cast<const uint8_t *>(data),
+		    static_cast<const uint8_t *>(data) + size)});
+	}
+
+	/*
+	 * Lists the file mappings of the current process in an NT_FILE note
+	 * and saves the first page of each object, as the kernel does.
+	 */
+	void
+	add_mappings()
+	{
+		std::ifstream maps("/proc/self/maps");
+		std::vector<unsigned long> words;
+		std::string paths, line;
+		const unsigned long page = sysconf(_SC_PAGESIZE);
+
+		words.push_back(0);
+		words.push_back(page);
+		while (std::getline(maps, line)) {
+			std::istringstream fields(line);
+			std::string range, perms, offset, device, inode, path;
+			unsigned long start, end;
+
+			fields >> range >> perms >> offset >> device >> inode >>
+			    path;
+			if (path.empty() || path[0] != '/')
+				continue;
+
+			start = std::stoul(range.substr(0, range.find('-')),
+			    nullptr, 16);
+			end = std::stoul(range.substr(range.find('-') + 1),
+			    nullptr, 16);
+			words.push_back(start);
+			words.push_back(end);
+			words.push_back(std::stoul(offset, nullptr, 16) / page);
+			words[0]++;
+			paths += path;
+			paths.push_back('\0');
+
+			if (std::stoul(offset, nullptr, 16) == 0 &&
+			    perms[0] == 'r')
+				add_segment(start, reinterpret_cast<void *>(start),
+				    page);
+		}
+
+		std::vector<uint8_t> desc;
+		append(desc, words.data(), words.size() * sizeof(words[0]));
+		append(desc, paths.data(), paths.size());
+		add_note(NT_FILE, desc.data(), desc.size());
+	}
+
+	void
+	add_thread(const captured_thread &thread)
+	{
+
+		add_note(NT_PRSTATUS, &thread.status, sizeof(thread.status));
+		add_segment(thread.stack_start, thread.stack.data(),
+		    thread.stack.size());
+	}
+
+	bool
+	write(const std::string &path) const
+	{
+		std::vector<uint8_t> image;
+		ElfW(Ehdr) ehdr = {};
+		std::vector<ElfW(Phdr)> phdrs(segments.size() + 1);
+		size_t offset;
+
+		memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+		ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+		ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+		ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+		ehdr.e_type = ET_CORE;
+#if defined(__x86_64__)
+		ehdr.e_machine = EM_X86_64;
+#else
+		ehdr.e_machine = EM_AARCH64;
+#endif
+		ehdr.e_version = EV_CURRENT;
+		ehdr.e_phoff = sizeof(ehdr);
+		ehdr.e_ehsize = sizeof(ehdr);
+		ehdr.e_phentsize = sizeof(ElfW(Phdr));
+		ehdr.e_phnum = phdrs.size();
+
+		offset = sizeof(ehdr) + phdrs.size() * sizeof(ElfW(Phdr));
+		phdrs[0].p_type = PT_NOTE;
+		phdrs[0].p_offset = offset;
+		phdrs[0].p_filesz = notes.size();
+		offset += notes.size();
+
+		for (size_t i = 0; i < segments.size(); i++) {
+			ElfW(Phdr) &phdr = phdrs[i + 1];
+
+			phdr.p_type = PT_LOAD;
+			phdr.p_offset = offset;
+			phdr.p_vaddr = segments[i].address;
+			phdr.p_filesz = segments[i].data.size();
+			phdr.p_memsz = segments[i].data.size();
+			phdr.p_flags = PF_R | PF_W;
+			offset += segments[i].data.size();
+		}
+
+		append(image, &ehdr, sizeof(ehdr));
+		append(image, phdrs.data(), phdrs.size() * sizeof(phdrs[0]));
+		append(image, notes.data(), notes.size());
+		for (const auto &segment : segments)
+			append(image, segment.data.data(), segment.data.size());
+
+		std::ofstream out(path, std::ios::binary);
+		out.write(reinterpret_cast<const char *>(image.data()),
+		    image.size());
+		return out.good();
+	}
+
+private:
+	struct segment {
+		uintptr_t address;
+		std::vector<uint8_t> data;
+	};
+
+	static void
+	append(std::vector<uint8_t> &dest, const void *data, size_t size)
+	{
+		const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+		dest.insert(dest.end(), bytes, bytes + size);
+	}
+
+	std::vector<uint8_t> notes;
+	std::vector<segment> segments;
+};
+
+class core : public ::testing::Test {
+protected:
+	static void
+	SetUpTestSuite()
+	{
+		char path[] = "/tmp/bun_core_XXXXXX";
+		captured_thread worker;
+		core_writer writer;
+		int fd;
+
+		dummy_func([&]{ capture(&main_thread); });
+		std::thread([&]{
+			dummy_func([&]{ capture(&worker); });
+		}).join();
+		worker_tid = worker.tid;
+
+		fd = mkstemp(path);
+		ASSERT_NE(fd, -1);
+		close(fd);
+		core_path = path;
+
+		writer.add_mappings();
+		writer.add_thread(main_thread);
+		writer.add_thread(worker);
+		ASSERT_TRUE(writer.write(core_path));
+	}
+
+	static void
+	TearDownTestSuite()
+	{
+
+		unlink(core_path.c_str());
+	}
+
+	static captured_thread main_thread;
+	static pid_t worker_tid;
+	static std::string core_path;
+};
+
+captured_thread core::main_thread;
+pid_t core::worker_tid;
+std::string core::core_path;
+
+TEST_F(core, initialize) {
+	struct bun_handle handle;
+
+	ASSERT_TRUE(bun_handle_init_core(&handle, core_path.c_str(), nullptr));
+	bun_handle_deinit(&handle);
+
+	ASSERT_FALSE(bun_handle_init_core(&handle, "/proc/self/exe", nullptr));
+	ASSERT_FALSE(bun_handle_init_core(&handle, "/nonexistent", nullptr));
+	ASSERT_FALSE(bun_handle_init(&handle, BUN_BACKEND_CORE));
+}
+
+TEST_F(core, threads) {
+	struct bun_handle handle;
+	pid_t tids[4];
+
+	ASSERT_TRUE(bun_handle_init_core(&handle, core_path.c_str(), nullptr));
+	ASSERT_EQ(bun_core_threads(&handle, tids, 4), 2);
+	ASSERT_EQ(tids[0], main_thread.tid);
+	ASSERT_EQ(tids[1], worker_tid);
+	ASSERT_EQ(bun_core_threads(&handle, tids, 1), 2);
+	bun_handle_deinit(&handle);
+}
+
+TEST_F(core, unwinding) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	char exe[PATH_MAX] = {0};
+
+	ASSERT_GT(readlink("/proc/self/exe", exe, sizeof(exe) - 1), 0);
+	ASSERT_TRUE(bun_handle_init_core(&handle, core_path.c_str(), nullptr));
+
+	for (pid_t tid : {main_thread.tid, worker_tid}) {
+		ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+		ASSERT_NE(bun_unwind_remote(&handle, &buffer, tid), 0);
+
+		struct bun_reader reader;
+		ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+		ASSERT_EQ(bun_header_tid_get(&reader), (unsigned)tid);
+		ASSERT_EQ(bun_header_backend_get(&reader), BUN_BACKEND_CORE);
+
+		auto frames = read_frames(&buffer, &handle);
+		ASSERT_GT(frames.size(), 2);
+		ASSERT_GT(frames[0].register_count, 0);
+
+		auto it = std::find_if(frames.cbegin(), frames.cend(),
+		    is_dummy_func);
+		ASSERT_NE(it, frames.cend());
+		ASSERT_STREQ(it->filename, exe);
+	}
+
+	ASSERT_NE(dummy_line, 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST_F(core, skip_symbols) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init_core(&handle, core_path.c_str(), nullptr));
+	handle.flags |= BUN_HANDLE_SKIP_SYMBOLS;
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_NE(bun_unwind_remote(&handle, &buffer, main_thread.tid), 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 2);
+	for (const auto &frame : frames) {
+		ASSERT_STREQ(frame.symbol, "");
+		ASSERT_STREQ(frame.filename, "");
+	}
+
+	bun_handle_deinit(&handle);
+}
+
+TEST_F(core, unknown_thread) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init_core(&handle, core_path.c_str(), nullptr));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_EQ(bun_unwind_remote(&handle, &buffer, 0), 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST_F(core, missing_objects) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	/* Nothing can be unwound without the objects, but the core loads. */
+	ASSERT_TRUE(bun_handle_init_core(&handle, core_path.c_str(),
+	    "/nonexistent"));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_NE(bun_unwind_remote(&handle, &buffer, main_thread.tid), 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 0);
+	ASSERT_EQ(std::find_if(frames.cbegin(), frames.cend(), is_dummy_func),
+	    frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+static size_t
+cached_objects(const struct bun_object_cache *cache)
+{
+	size_t count = 0;
+
+	for (auto *object = cache->head; object != nullptr; object = object->next)
+		count++;
+
+	return count;
+}
+
+TEST_F(core, object_cache) {
+	std::vector<char> buf(0x10000);
+	struct bun_object_cache *cache = bun_object_cache_create(256 << 20);
+	struct bun_handle first, second;
+	struct bun_buffer buffer;
+
+	ASSERT_NE(cache, nullptr);
+	ASSERT_TRUE(bun_handle_init_core_cached(&first, core_path.c_str(),
+	    nullptr, cache));
+	size_t count = cached_objects(cache);
+	size_t used = cache->used;
+	ASSERT_GT(count, 0);
+
+	/* The second core of the same build loads nothing new. */
+	ASSERT_TRUE(bun_handle_init_core_cached(&second, core_path.c_str(),
+	    nullptr, cache));
+	ASSERT_EQ(cached_objects(cache), count);
+	ASSERT_EQ(cache->used, used);
+
+	for (auto *handle : {&first, &second}) {
+		ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+		ASSERT_NE(bun_unwind_remote(handle, &buffer, main_thread.tid), 0);
+
+		auto frames = read_frames(&buffer, handle);
+		ASSERT_NE(std::find_if(frames.cbegin(), frames.cend(),
+		    is_dummy_func), frames.cend());
+	}
+
+	bun_handle_deinit(&first);
+	bun_handle_deinit(&second);
+
+	/* Objects that are not in use stay cached within the limit. */
+	ASSERT_EQ(cached_objects(cache), count);
+	bun_object_cache_destroy(cache);
+}
+
+TEST_F(core, object_cache_limit) {
+	std::vector<char> buf(0x10000);
+	struct bun_object_cache *cache = bun_object_cache_create(0);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_NE(cache, nullptr);
+	ASSERT_TRUE(bun_handle_init_core_cached(&handle, core_path.c_str(),
+	    nullptr, cache));
+
+	/* Objects in use are kept whatever the limit. */
+	ASSERT_GT(cached_objects(cache), 0);
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_NE(bun_unwind_remote(&handle, &buffer, main_thread.tid), 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_NE(std::find_if(frames.cbegin(), frames.cend(), is_dummy_func),
+	    frames.cend());
+
+	bun_handle_deinit(&handle);
+	ASSERT_EQ(cached_objects(cache), 0);
+	ASSERT_EQ(cache->used, 0);
+	bun_object_cache_destroy(cache);
+}
+
+TEST_F(core, concurrent) {
+	struct bun_handle handle;
+	std::atomic<int> failures{0};
+	std::vector<std::thread> threads;
+
+	ASSERT_TRUE(bun_handle_init_core(&handle, core_path.c_str(), nullptr));
+
+	for (int i = 0; i < 4; i++) {
+		threads.emplace_back([&, i]{
+			std::vector<char> buf(0x10000);
+			pid_t tid = i % 2 ? worker_tid : main_thread.tid;
+			struct bun_buffer buffer;
+
+			for (int j = 0; j < 100; j++) {
+				bun_buffer_init(&buffer, buf.data(), buf.size());
+				if (bun_unwind_remote(&handle, &buffer, tid) == 0)
+					failures++;
+			}
+		});
+	}
+
+	for (auto &thread : threads)
+		thread.join();
+
+	ASSERT_EQ(failures.load(), 0);
+	bun_handle_deinit(&handle);
+}
+#endif
@@ -0,0 +1,317 @@
+#include "gtest/gtest.h"
+
+#include <bun/async.h>
+#include <bun/backend.h>
+#include <bun/bun.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#include <poll.h>
+
+#include "frames.hpp"
+
+static const char *needle = "a_really_unique_vm_frame";
+
+struct vm_state {
+	int frames;
+	int destroyed;
+	pid_t remote_tid;
+};
+
+static bool
+write_vm_frames(void *context, struct bun_writer *writer)
+{
+	struct vm_state *state = static_cast<struct vm_state *>(context);
+
+	for (int i = 0; i < state->frames; i++) {
+		struct bun_frame frame = {};
+
+		frame.addr = 0x1000 + i;
+		frame.symbol = needle;
+		frame.symbol_length = strlen(needle);
+		frame.line_no = i;
+		if (bun_frame_write(writer, &frame) == 0)
+			return false;
+	}
+
+	return true;
+}
+
+static struct bun_backend_ops
+vm_ops()
+{
+	struct bun_backend_ops ops = {};
+
+	ops.size = sizeof(ops);
+	ops.unwind = write_vm_frames;
+	ops.destroy = [](void *context) {
+		static_cast<struct vm_state *>(context)->destroyed++;
+	};
+	return ops;
+}
+
+TEST(custom, invalid_ops) {
+	struct bun_handle handle;
+	struct bun_backend_ops ops = vm_ops();
+	struct vm_state state = {};
+
+	ASSERT_FALSE(bun_handle_init_custom(&handle, nullptr, &state));
+
+	ops.size = offsetof(struct bun_backend_ops, unwind);
+	ASSERT_FALSE(bun_handle_init_custom(&handle, &ops, &state));
+
+	ops = vm_ops();
+	ops.unwind = nullptr;
+	ASSERT_FALSE(bun_handle_init_custom(&handle, &ops, &state));
+	ASSERT_EQ(state.destroyed, 0);
+}
+
+TEST(custom, unwinding) {
+	std::vector<char> buf(0x1000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct bun_backend_ops ops = vm_ops();
+	struct vm_state state = {};
+
+	state.frames = 3;
+	ASSERT_TRUE(bun_handle_init_custom(&handle, &ops, &state));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_NE(bun_unwind(&handle, &buffer), 0);
+
+	struct bun_reader reader;
+	ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+	ASSERT_EQ(bun_header_backend_get(&reader), BUN_BACKEND_CUSTOM);
+	ASSERT_EQ(bun_header_tid_get(&reader), (unsigned)bun_gettid());
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_EQ(frames.size(), 3);
+	for (size_t i = 0; i < frames.size(); i++) {
+		ASSERT_EQ(frames[i].addr, 0x1000 + i);
+		ASSERT_EQ(frames[i].line_no, i);
+		ASSERT_STREQ(frames[i].symbol, needle);
+	}
+
+	bun_handle_deinit(&handle);
+	ASSERT_EQ(state.destroyed, 1);
+}
+
+TEST(custom, tiny_buffer) {
+	std::vector<char> buf(128);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct bun_backend_ops ops = vm_ops();
+	struct vm_state state = {};
+
+	state.frames = 100;
+	ASSERT_TRUE(bun_handle_init_custom(&handle, &ops, &state));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_EQ(bun_unwind(&handle, &buffer), 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST(custom, optional_callbacks) {
+	std::vector<char> buf(0x1000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct bun_backend_ops ops = vm_ops();
+	struct vm_state state = {};
+
+	ASSERT_TRUE(bun_handle_init_custom(&handle, &ops, &state));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_EQ(bun_unwind_context(&handle, &buffer, nullptr), 0);
+	ASSERT_EQ(bun_unwind_remote(&handle, &buffer, getpid()), 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST(custom, unwind_remote) {
+	std::vector<char> buf(0x1000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct bun_backend_ops ops = vm_ops();
+	struct vm_state state = {};
+
+	ops.unwind_remote = [](void *context, struct bun_writer *writer,
+	    pid_t tid) {
+		struct vm_state *state = static_cast<struct vm_state *>(context);
+
+		state->remote_tid = tid;
+		return write_vm_frames(context, writer);
+	};
+
+	state.frames = 1;
+	ASSERT_TRUE(bun_handle_init_custom(&handle, &ops, &state));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_NE(bun_unwind_remote(&handle, &buffer, 1234), 0);
+	ASSERT_EQ(state.remote_tid, 1234);
+
+	struct bun_reader reader;
+	ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+	ASSERT_EQ(bun_header_tid_get(&reader), 1234);
+	ASSERT_EQ(read_frames(&buffer, &handle).size(), 1);
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * Callers built against an older, smaller structure must not have the
+ * fields they do not know about read.
+ */
+TEST(custom, older_ops) {
+	std::vector<char> buf(0x1000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct bun_backend_ops ops = vm_ops();
+	struct vm_state state = {};
+
+	ops.size = offsetof(struct bun_backend_ops, unwind_context);
+	ops.unwind_context = [](void *, struct bun_writer *, void *) {
+		ADD_FAILURE();
+		return false;
+	};
+
+	ASSERT_TRUE(bun_handle_init_custom(&handle, &ops, &state));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_NE(bun_unwind(&handle, &buffer), 0);
+	ASSERT_EQ(bun_unwind_context(&handle, &buffer, nullptr), 0);
+
+	/* Neither is the destructor. */
+	bun_handle_deinit(&handle);
+	ASSERT_EQ(state.destroyed, 0);
+}
+
+struct async_state {
+	std::promise<void> started;
+	std::atomic<int> calls{0};
+	std::shared_future<void> release;
+	std::vector<std::pair<pid_t, size_t>> completed;
+};
+
+/*
+ * Blocks until the test releases it, then unwinds a single frame unless `tid`
+ * is 0.
+ */
+static bool
+async_unwind_remote(void *context, struct bun_writer *writer, pid_t tid)
+{
+	auto state = static_cast<struct async_state *>(context);
+	struct bun_frame frame = {};
+
+	if (state->calls++ == 0)
+		state->started.set_value();
+
+	state->release.wait();
+	frame.addr = 0x1000;
+	return tid != 0 && bun_frame_write(writer, &frame) != 0;
+}
+
+static struct bun_backend_ops
+async_ops()
+{
+	struct bun_backend_ops ops = {};
+
+	ops.size = sizeof(ops);
+	ops.unwind = [](void *, struct bun_writer *) { return false; };
+	ops.unwind_remote = async_unwind_remote;
+	return ops;
+}
+
+static void
+async_completed(void *arg, pid_t tid, struct bun_buffer *, size_t size)
+{
+	auto state = static_cast<struct async_state *>(arg);
+
+	state->completed.emplace_back(tid, size);
+}
+
+static bool
+poll_readable(int fd, int msec_timeout)
+{
+	struct pollfd pfd = {};
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	return poll(&pfd, 1, msec_timeout) == 1;
+}
+
+TEST(custom, unwind_remote_async) {
+	std::vector<char> buf(0x1000);
+	std::promise<void> release;
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct bun_backend_ops ops = async_ops();
+	struct async_state state;
+
+	state.release = release.get_future().share();
+	ASSERT_TRUE(bun_handle_init_custom(&handle, &ops, &state));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	struct bun_async *async = bun_async_create(&handle, 1);
+	ASSERT_NE(async, nullptr);
+	int fd = bun_async_fd(async);
+
+	ASSERT_TRUE(bun_unwind_remote_async(async, &buffer, 1234,
+	    async_completed, &state));
+	ASSERT_FALSE(poll_readable(fd, 50));
+	ASSERT_EQ(bun_async_dispatch(async), 0);
+
+	release.set_value();
+	ASSERT_TRUE(poll_readable(fd, 5000));
+	ASSERT_EQ(bun_async_dispatch(async), 1);
+	ASSERT_FALSE(poll_readable(fd, 0));
+	ASSERT_EQ(state.completed.size(), 1);
+	ASSERT_EQ(state.completed[0].first, 1234);
+	ASSERT_NE(state.completed[0].second, 0);
+
+	struct bun_reader reader;
+	ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+	ASSERT_EQ(bun_header_tid_get(&reader), 1234);
+
+	/* Failures are reported with a size of 0. */
+	state.completed.clear();
+	ASSERT_TRUE(bun_unwind_remote_async(async, &buffer, 0,
+	    async_completed, &state));
+	ASSERT_TRUE(poll_readable(fd, 5000));
+	ASSERT_EQ(bun_async_dispatch(async), 1);
+	ASSERT_EQ(state.completed.size(), 1);
+	ASSERT_EQ(state.completed[0].second, 0);
+
+	bun_async_destroy(async);
+	bun_handle_deinit(&handle);
+}
+
+TEST(custom, unwind_remote_async_destroy) {
+	std::vector<char> buf(0x1000);
+	std::promise<void> release;
+	struct bun_handle handle;
+	struct bun_buffer buffers[4];
+	struct bun_backend_ops ops = async_ops();
+	struct async_state state;
+
+	state.release = release.get_future().share();
+	ASSERT_TRUE(bun_handle_init_custom(&handle, &ops, &state));
+
+	struct bun_async *async = bun_async_create(&handle, 1);
+	ASSERT_NE(async, nullptr);
+	for (size_t i = 0; i < 4; i++) {
+		ASSERT_TRUE(bun_buffer_init(&buffers[i],
+		    buf.data() + i * 0x400, 0x400));
+		ASSERT_TRUE(bun_unwind_remote_async(async, &buffers[i], i + 1,
+		    async_completed, &state));
+	}
+
+	/* The first request is being carried out when stopping. */
+	state.started.get_future().wait();
+	release.set_value();
+	bun_async_destroy(async);
+
+	/* Every callback is called, at least the first one succeeded. */
+	ASSERT_EQ(state.completed.size(), 4);
+	ASSERT_EQ(state.completed[0].first, 1);
+	ASSERT_NE(state.completed[0].second, 0);
+	bun_handle_deinit(&handle);
+}
@@ -0,0 +1,240 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/core.h>
+#include <bun/stream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <string>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "backend/dwarf/bun_dwarf_remote.h"
+#include "bun_maps.h"
+#include "bun_object_cache.h"
+#include "frames.hpp"
+#include "payload_header.h"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+TEST(dwarf, initialize) {
+	struct bun_handle handle;
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_DWARF));
+	bun_handle_deinit(&handle);
+}
+
+TEST(dwarf, unwinding) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_DWARF));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 0);
+
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	ASSERT_GT(it->register_count, 0);
+	ASSERT_NE(dummy_line, 0);
+
+	/* The walk must get past main() into the C runtime. */
+	ASSERT_GT(frames.cend() - it, 2);
+	bun_handle_deinit(&handle);
+}
+
+TEST(dwarf, tiny_buffer)
+{
+	std::vector<char> buf(payload_header_size());
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_DWARF));
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_EQ(size, 0);
+
+	bun_handle_deinit(&handle);
+}
+
+static struct {
+	struct bun_handle *handle;
+	struct bun_buffer *buffer;
+	size_t size;
+} signal_unwind;
+
+TEST(dwarf, unwind_context) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct sigaction action = {}, old;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_DWARF));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	signal_unwind.handle = &handle;
+	signal_unwind.buffer = &buffer;
+	signal_unwind.size = 0;
+
+	action.sa_flags = SA_SIGINFO;
+	action.sa_sigaction = +[](int, siginfo_t *, void *context) {
+		signal_unwind.size = bun_unwind_context(signal_unwind.handle,
+		    signal_unwind.buffer, context);
+	};
+	ASSERT_EQ(sigaction(SIGUSR1, &action, &old), 0);
+
+	dummy_func([&]{ raise(SIGUSR1); });
+	sigaction(SIGUSR1, &old, nullptr);
+
+	ASSERT_NE(signal_unwind.size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * Unwinding from within a signal handler has to step through the signal
+ * trampoline, which is described by hand-written CFI expressions.
+ */
+TEST(dwarf, signal_trampoline) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct sigaction action = {}, old;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_DWARF));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	signal_unwind.handle = &handle;
+	signal_unwind.buffer = &buffer;
+	signal_unwind.size = 0;
+
+	action.sa_handler = +[](int) {
+		signal_unwind.size = bun_unwind(signal_unwind.handle,
+		    signal_unwind.buffer);
+	};
+	ASSERT_EQ(sigaction(SIGUSR1, &action, &old), 0);
+
+	dummy_func([&]{ raise(SIGUSR1); });
+	sigaction(SIGUSR1, &old, nullptr);
+
+	ASSERT_NE(signal_unwind.size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * The handle keeps no mutable state, so it can be shared between threads
+ * without synchronization.
+ */
+TEST(dwarf, concurrent) {
+	struct bun_handle handle;
+	std::atomic<int> failures{0};
+	std::vector<std::thread> threads;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_DWARF));
+
+	for (int i = 0; i < 8; i++) {
+		threads.emplace_back([&] {
+			std::vector<char> buf(0x10000);
+			struct bun_buffer buffer;
+
+			for (int j = 0; j < 100; j++) {
+				bool found = false;
+
+				if (bun_buffer_init(&buffer, buf.data(),
+				    buf.size()) == false) {
+					failures++;
+					return;
+				}
+
+				dummy_func([&]{ bun_unwind(&handle, &buffer); });
+				auto frames = read_frames(&buffer, &handle);
+				found = std::any_of(frames.cbegin(),
+				    frames.cend(), is_dummy_func);
+				if (found == false)
+					failures++;
+			}
+		});
+	}
+
+	for (auto &thread : threads)
+		thread.join();
+
+	ASSERT_EQ(failures, 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST(dwarf, remote_shared_objects) {
+	struct bun_object_cache *objects;
+	struct bun_dwarf_remote first, second;
+	struct bun_maps_cache maps;
+	size_t shared = 0;
+
+	objects = bun_object_cache_create(BUN_DWARF_REMOTE_CACHE_LIMIT);
+	ASSERT_NE(objects, nullptr);
+	bun_maps_cache_init(&maps);
+
+	ASSERT_TRUE(bun_dwarf_remote_init(&first,
+	    bun_maps_cache_get(&maps, getpid(), false), objects));
+	ASSERT_TRUE(bun_dwarf_remote_init(&second,
+	    bun_maps_cache_get(&maps, getpid(), true), objects));
+	ASSERT_GT(first.modules.count, 0);
+
+	/*
+	 * Objects with a build-id are loaded once and shared. The second maps
+	 * also hold the files mapped by the first load, so the modules do not
+	 * match one to one.
+	 */
+	for (size_t i = 0; i < first.modules.count; i++) {
+		struct bun_object **end = second.objects +
+		    second.modules.count;
+
+		if (first.objects[i]->build_id == nullptr)
+			continue;
+
+		ASSERT_NE(std::find(second.objects, end, first.objects[i]),
+		    end);
+		shared++;
+	}
+
+	ASSERT_GT(shared, 0);
+
+	bun_dwarf_remote_deinit(&first);
+	bun_dwarf_remote_deinit(&second);
+	bun_maps_cache_deinit(&maps);
+	bun_object_cache_destroy(objects);
+}
@@ -0,0 +1,198 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <string>
+
+#include <signal.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#include "frames.hpp"
+#include "payload_header.h"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+TEST(framepointer, initialize) {
+	struct bun_handle handle;
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_FRAMEPOINTER));
+	bun_handle_deinit(&handle);
+}
+
+TEST(framepointer, unwinding) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_FRAMEPOINTER));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 0);
+
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	ASSERT_GT(it->register_count, 0);
+	ASSERT_NE(dummy_line, 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST(framepointer, skip_symbols) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_FRAMEPOINTER));
+	handle.flags |= BUN_HANDLE_SKIP_SYMBOLS;
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 1);
+	for (const auto &frame : frames) {
+		ASSERT_NE(frame.addr, 0);
+		ASSERT_STREQ(frame.symbol, "");
+	}
+
+	bun_handle_deinit(&handle);
+}
+
+TEST(framepointer, tiny_buffer)
+{
+	std::vector<char> buf(payload_header_size());
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_FRAMEPOINTER));
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_EQ(size, 0);
+
+	bun_handle_deinit(&handle);
+}
+
+static struct {
+	struct bun_handle *handle;
+	struct bun_buffer *buffer;
+	size_t size;
+} signal_unwind;
+
+TEST(framepointer, unwind_context) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct sigaction action = {}, old;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_FRAMEPOINTER));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	signal_unwind.handle = &handle;
+	signal_unwind.buffer = &buffer;
+	signal_unwind.size = 0;
+
+	action.sa_flags = SA_SIGINFO;
+	action.sa_sigaction = +[](int, siginfo_t *, void *context) {
+		signal_unwind.size = bun_unwind_context(signal_unwind.handle,
+		    signal_unwind.buffer, context);
+	};
+	ASSERT_EQ(sigaction(SIGUSR1, &action, &old), 0);
+
+	dummy_func([&]{ raise(SIGUSR1); });
+	sigaction(SIGUSR1, &old, nullptr);
+
+	ASSERT_NE(signal_unwind.size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * Corrupt chains must terminate without faulting: a cycle, a pointer into an
+ * unreadable page within the stack bounds and a misaligned pointer.
+ */
+TEST(framepointer, corrupt_chain) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	ucontext_t context;
+	const size_t page_size = 4096;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_FRAMEPOINTER));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_EQ(getcontext(&context), 0);
+
+	char *pages = static_cast<char *>(mmap(nullptr, 2 * page_size,
+	    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	ASSERT_NE(pages, MAP_FAILED);
+	ASSERT_EQ(mprotect(pages + page_size, page_size, PROT_NONE), 0);
+	auto *stack = reinterpret_cast<uintptr_t *>(pages + page_size) - 16;
+
+	/* stack[4] -> stack[8] -> stack[4] */
+	stack[4] = (uintptr_t)&stack[8];
+	stack[5] = 0x1000;
+	stack[8] = (uintptr_t)&stack[4];
+	stack[9] = 0x2000;
+	/* stack[12] -> protected page, stack[0] -> misaligned */
+	stack[12] = (uintptr_t)(pages + page_size + 64);
+	stack[13] = 0x3000;
+	stack[0] = (uintptr_t)&stack[2] + 1;
+	stack[1] = 0x4000;
+
+	const uintptr_t starts[] = {
+	    (uintptr_t)&stack[4], (uintptr_t)&stack[12], (uintptr_t)&stack[0]
+	};
+	for (uintptr_t fp : starts) {
+#if defined(__x86_64__)
+		context.uc_mcontext.gregs[REG_RSP] = (uintptr_t)stack;
+		context.uc_mcontext.gregs[REG_RBP] = fp;
+#elif defined(__i386__)
+		context.uc_mcontext.gregs[REG_ESP] = (uintptr_t)stack;
+		context.uc_mcontext.gregs[REG_EBP] = fp;
+#elif defined(__aarch64__)
+		context.uc_mcontext.sp = (uintptr_t)stack;
+		context.uc_mcontext.regs[29] = fp;
+#endif
+		ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+		ASSERT_NE(bun_unwind_context(&handle, &buffer, &context), 0);
+
+		auto frames = read_frames(&buffer, &handle);
+		ASSERT_GT(frames.size(), 0);
+		ASSERT_LE(frames.size(), 3);
+	}
+
+	munmap(pages, 2 * page_size);
+	bun_handle_deinit(&handle);
+}
@@ -0,0 +1,238 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/handshake.h>
+#include <bun/stream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "frames.hpp"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+enum child_mode {
+	CHILD_INSTALLED,
+	CHILD_NOT_INSTALLED,
+	CHILD_BLOCKED
+};
+
+/*
+ * Forks a child waiting inside dummy_func(). Returns its pid once it is
+ * ready to be unwound.
+ */
+static pid_t
+spawn_child(enum child_mode mode)
+{
+	int fds[2];
+	char c = 0;
+	pid_t pid;
+
+	if (pipe(fds) != 0)
+		return -1;
+
+	pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		if (mode != CHILD_NOT_INSTALLED &&
+		    bun_handshake_install(SIGRTMIN + 1, 0) == false)
+			_exit(1);
+
+		if (mode == CHILD_BLOCKED) {
+			sigset_t set;
+
+			sigemptyset(&set);
+			sigaddset(&set, SIGRTMIN + 1);
+			sigprocmask(SIG_BLOCK, &set, nullptr);
+		}
+
+		dummy_func([&]{
+			if (write(fds[1], &c, 1) != 1)
+				_exit(1);
+
+			for (;;)
+				pause();
+		});
+		_exit(0);
+	}
+
+	close(fds[1]);
+	if (pid != -1 && read(fds[0], &c, 1) != 1) {
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+		pid = -1;
+	}
+
+	close(fds[0]);
+	return pid;
+}
+
+static void
+reap(pid_t pid)
+{
+
+	kill(pid, SIGKILL);
+	waitpid(pid, nullptr, 0);
+}
+
+TEST(handshake, unwinding) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	char exe[PATH_MAX] = {0};
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HANDSHAKE));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_GT(readlink("/proc/self/exe", exe, sizeof(exe) - 1), 0);
+
+	pid_t child = spawn_child(CHILD_INSTALLED);
+	ASSERT_NE(child, -1);
+
+	/* The objects are loaded once, the second unwind reuses them. */
+	for (int i = 0; i < 2; i++) {
+		size_t size = bun_unwind_remote(&handle, &buffer, child);
+		ASSERT_NE(size, 0);
+
+		struct bun_reader reader;
+		ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+		ASSERT_EQ(bun_header_tid_get(&reader), (unsigned)child);
+		ASSERT_EQ(bun_header_backend_get(&reader),
+		    BUN_BACKEND_HANDSHAKE);
+
+		auto frames = read_frames(&buffer, &handle);
+		ASSERT_GT(frames.size(), 1);
+		ASSERT_GT(frames[0].register_count, 0);
+
+		auto it = std::find_if(frames.cbegin(), frames.cend(),
+		    is_dummy_func);
+		ASSERT_NE(it, frames.cend());
+		ASSERT_STREQ(it->filename, exe);
+	}
+
+	/* The child is still running. */
+	ASSERT_EQ(waitpid(child, nullptr, WNOHANG), 0);
+	reap(child);
+	bun_handle_deinit(&handle);
+}
+
+TEST(handshake, alternating) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HANDSHAKE));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	pid_t children[2] = {
+		spawn_child(CHILD_INSTALLED),
+		spawn_child(CHILD_INSTALLED)
+	};
+	ASSERT_NE(children[0], -1);
+	ASSERT_NE(children[1], -1);
+
+	/* Each process keeps its own target. */
+	for (int i = 0; i < 4; i++) {
+		pid_t child = children[i % 2];
+
+		ASSERT_NE(bun_unwind_remote(&handle, &buffer, child), 0);
+
+		struct bun_reader reader;
+		ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+		ASSERT_EQ(bun_header_tid_get(&reader), (unsigned)child);
+
+		auto frames = read_frames(&buffer, &handle);
+		ASSERT_NE(std::find_if(frames.cbegin(), frames.cend(),
+		    is_dummy_func), frames.cend());
+	}
+
+	reap(children[0]);
+	reap(children[1]);
+	bun_handle_deinit(&handle);
+}
+
+TEST(handshake, fork_snapshot) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HANDSHAKE));
+	handle.flags |= BUN_HANDLE_FORK_SNAPSHOT;
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	pid_t child = spawn_child(CHILD_INSTALLED);
+	ASSERT_NE(child, -1);
+
+	size_t size = bun_unwind_remote(&handle, &buffer, child);
+	ASSERT_NE(size, 0);
+
+	/* The stream is that of the thread, not of its copy. */
+	struct bun_reader reader;
+	ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+	ASSERT_EQ(bun_header_tid_get(&reader), (unsigned)child);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_NE(std::find_if(frames.cbegin(), frames.cend(), is_dummy_func),
+	    frames.cend());
+
+	/* The intermediate process was reaped by the handler. */
+	ASSERT_EQ(waitpid(child, nullptr, WNOHANG), 0);
+	ASSERT_EQ(waitpid(-1, nullptr, WNOHANG | __WALL), 0);
+	reap(child);
+	bun_handle_deinit(&handle);
+}
+
+TEST(handshake, not_installed) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HANDSHAKE));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	pid_t child = spawn_child(CHILD_NOT_INSTALLED);
+	ASSERT_NE(child, -1);
+	ASSERT_EQ(bun_unwind_remote(&handle, &buffer, child), 0);
+	ASSERT_EQ(waitpid(child, nullptr, WNOHANG), 0);
+	reap(child);
+
+	ASSERT_EQ(bun_unwind_remote(&handle, &buffer, child), 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST(handshake, timeout) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HANDSHAKE));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	pid_t child = spawn_child(CHILD_BLOCKED);
+	ASSERT_NE(child, -1);
+
+	auto start = std::chrono::steady_clock::now();
+	ASSERT_EQ(bun_unwind_remote(&handle, &buffer, child), 0);
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	ASSERT_LT(elapsed, std::chrono::seconds(5));
+
+	/* The slot was given back, the pending signal is ignored later. */
+	ASSERT_EQ(waitpid(child, nullptr, WNOHANG), 0);
+	reap(child);
+	bun_handle_deinit(&handle);
+}
@@ -0,0 +1,206 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <string>
+
+#include <signal.h>
+
+#include "backend/hybrid/bun_hybrid.h"
+#include "frames.hpp"
+#include "payload_header.h"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+TEST(hybrid, initialize) {
+	struct bun_handle handle;
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HYBRID));
+	bun_handle_deinit(&handle);
+}
+
+TEST(hybrid, unwinding) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HYBRID));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	ASSERT_GT(it->register_count, 0);
+
+	/* The walk must get past main() into the C runtime. */
+	ASSERT_GT(frames.cend() - it, 2);
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * This file is built without frame pointers, so the chain cannot be trusted
+ * in this executable once it has been checked against the CFI.
+ */
+TEST(hybrid, learns_cfi) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	const uintptr_t pc = reinterpret_cast<uintptr_t>(&dummy_func);
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HYBRID));
+	ASSERT_EQ(bun_internal_hybrid_strategy(&handle, pc), BUN_HYBRID_UNKNOWN);
+
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	dummy_func([&]{ bun_unwind(&handle, &buffer); });
+	ASSERT_EQ(bun_internal_hybrid_strategy(&handle, pc), BUN_HYBRID_CFI);
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * Whatever has been learned, the frames must be the ones found by the DWARF
+ * backend alone.
+ */
+TEST(hybrid, matches_dwarf) {
+	std::vector<char> dwarf_buf(0x10000), hybrid_buf(0x10000);
+	struct bun_handle dwarf, hybrid;
+	struct bun_buffer dwarf_buffer, hybrid_buffer;
+
+	ASSERT_TRUE(bun_handle_init(&dwarf, BUN_BACKEND_DWARF));
+	ASSERT_TRUE(bun_handle_init(&hybrid, BUN_BACKEND_HYBRID));
+
+	for (int i = 0; i < 64; i++) {
+		ASSERT_TRUE(bun_buffer_init(&dwarf_buffer, dwarf_buf.data(),
+		    dwarf_buf.size()));
+		ASSERT_TRUE(bun_buffer_init(&hybrid_buffer, hybrid_buf.data(),
+		    hybrid_buf.size()));
+
+		dummy_func([&]{
+			bun_unwind(&dwarf, &dwarf_buffer);
+			bun_unwind(&hybrid, &hybrid_buffer);
+		});
+
+		auto expected = read_frames(&dwarf_buffer, &dwarf);
+		auto frames = read_frames(&hybrid_buffer, &hybrid);
+		auto expected_it = std::find_if(expected.cbegin(),
+		    expected.cend(), is_dummy_func);
+		auto it = std::find_if(frames.cbegin(), frames.cend(),
+		    is_dummy_func);
+		ASSERT_NE(expected_it, expected.cend());
+		ASSERT_NE(it, frames.cend());
+		ASSERT_EQ(frames.cend() - it, expected.cend() - expected_it);
+
+		for (; it != frames.cend(); it++, expected_it++)
+			ASSERT_EQ(it->addr, expected_it->addr);
+	}
+
+	bun_handle_deinit(&hybrid);
+	bun_handle_deinit(&dwarf);
+}
+
+TEST(hybrid, tiny_buffer)
+{
+	std::vector<char> buf(payload_header_size());
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HYBRID));
+
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+	ASSERT_EQ(size, 0);
+	bun_handle_deinit(&handle);
+}
+
+static struct {
+	struct bun_handle *handle;
+	struct bun_buffer *buffer;
+	size_t size;
+} signal_unwind;
+
+TEST(hybrid, unwind_context) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct sigaction action = {}, old;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HYBRID));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	signal_unwind.handle = &handle;
+	signal_unwind.buffer = &buffer;
+	signal_unwind.size = 0;
+
+	action.sa_flags = SA_SIGINFO;
+	action.sa_sigaction = +[](int, siginfo_t *, void *context) {
+		signal_unwind.size = bun_unwind_context(signal_unwind.handle,
+		    signal_unwind.buffer, context);
+	};
+	ASSERT_EQ(sigaction(SIGUSR1, &action, &old), 0);
+
+	dummy_func([&]{ raise(SIGUSR1); });
+	sigaction(SIGUSR1, &old, nullptr);
+
+	ASSERT_NE(signal_unwind.size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * The learned strategies are shared by all the threads using the handle.
+ */
+TEST(hybrid, concurrent) {
+	struct bun_handle handle;
+	std::atomic<int> failures{0};
+	std::vector<std::thread> threads;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_HYBRID));
+
+	for (int i = 0; i < 8; i++) {
+		threads.emplace_back([&] {
+			std::vector<char> buf(0x10000);
+			struct bun_buffer buffer;
+
+			for (int j = 0; j < 100; j++) {
+				if (bun_buffer_init(&buffer, buf.data(),
+				    buf.size()) == false) {
+					failures++;
+					return;
+				}
+
+				dummy_func([&]{ bun_unwind(&handle, &buffer); });
+				auto frames = read_frames(&buffer, &handle);
+				if (std::none_of(frames.cbegin(), frames.cend(),
+				    is_dummy_func))
+					failures++;
+			}
+		});
+	}
+
+	for (auto &thread : threads)
+		thread.join();
+
+	ASSERT_EQ(failures, 0);
+	bun_handle_deinit(&handle);
+}
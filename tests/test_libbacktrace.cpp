@@ -8,6 +8,8 @@
 #include <bun/bun.h>
 #include <bun/stream.h>
 
+#include <signal.h>
+
 #include "payload_header.h"
 
 static int dummy_line;
@@ -81,3 +83,56 @@ TEST(libbacktrace, tiny_buffer)
 
 	bun_handle_deinit(&handle);
 }
+
+static struct {
+	struct bun_handle *handle;
+	struct bun_buffer *buffer;
+	size_t size;
+} signal_unwind;
+
+/*
+ * The walk starts at the frame interrupted by the signal, without going
+ * through the handler and the signal trampoline.
+ */
+TEST(libbacktrace, unwind_context) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct sigaction action = {}, old;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_LIBBACKTRACE));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	signal_unwind.handle = &handle;
+	signal_unwind.buffer = &buffer;
+	signal_unwind.size = 0;
+
+	action.sa_flags = SA_SIGINFO;
+	action.sa_sigaction = +[](int, siginfo_t *, void *context) {
+		signal_unwind.size = bun_unwind_context(signal_unwind.handle,
+		    signal_unwind.buffer, context);
+	};
+	ASSERT_EQ(sigaction(SIGUSR1, &action, &old), 0);
+
+	dummy_func([&]{ raise(SIGUSR1); });
+	sigaction(SIGUSR1, &old, nullptr);
+
+	ASSERT_NE(signal_unwind.size, 0);
+
+	struct bun_reader reader;
+	bun_reader_init(&reader, &buffer, &handle);
+
+	std::vector<bun_frame> frames;
+	bun_frame next_frame;
+
+	while (bun_frame_read(&reader, &next_frame)) {
+		frames.push_back(next_frame);
+	}
+
+	auto pred = [](bun_frame const& f) {
+		return strcmp(f.symbol, "_Z10dummy_funcRKSt8functionIFvvEE") == 0;
+	};
+	ASSERT_NE(std::find_if(frames.cbegin(), frames.cend(), pred),
+	    frames.cend());
+	bun_handle_deinit(&handle);
+}
@@ -0,0 +1,230 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <string>
+
+#include <dlfcn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "frames.hpp"
+#include "payload_header.h"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+/*
+ * The child is forked from this process, so its addresses can be resolved
+ * locally.
+ */
+static bool
+resolves_to_dummy_func(bun_frame const& f)
+{
+	Dl_info info;
+
+	if (dladdr(reinterpret_cast<void *>(f.addr - 1), &info) == 0 ||
+	    info.dli_sname == nullptr)
+		return false;
+
+	return strcmp(info.dli_sname, "_Z10dummy_funcRKSt8functionIFvvEE") == 0;
+}
+
+/*
+ * Returns false if perf events cannot be used here, e.g. because of
+ * kernel.perf_event_paranoid or a seccomp filter.
+ */
+static bool
+perf_available()
+{
+	struct perf_event_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = PERF_COUNT_SW_TASK_CLOCK;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fd == -1)
+		return false;
+
+	close(fd);
+	return true;
+}
+
+/*
+ * Forks a child spinning inside dummy_func(). Returns its pid once it runs.
+ */
+static pid_t
+spawn_spinning_child()
+{
+	int fds[2];
+	char c = 0;
+	pid_t pid;
+
+	if (pipe(fds) != 0)
+		return -1;
+
+	pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		dummy_func([&]{
+			volatile unsigned long counter = 0;
+
+			if (write(fds[1], &c, 1) != 1)
+				_exit(1);
+
+			for (;;)
+				counter++;
+		});
+		_exit(0);
+	}
+
+	close(fds[1]);
+	if (pid != -1 && read(fds[0], &c, 1) != 1) {
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+		pid = -1;
+	}
+
+	close(fds[0]);
+	return pid;
+}
+
+static void
+reap(pid_t pid)
+{
+
+	kill(pid, SIGKILL);
+	waitpid(pid, nullptr, 0);
+}
+
+TEST(perf, initialize) {
+	struct bun_handle handle;
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_PERF));
+	bun_handle_deinit(&handle);
+}
+
+TEST(perf, unwinding) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	char exe[PATH_MAX] = {0};
+
+	if (perf_available() == false)
+		GTEST_SKIP();
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_PERF));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+	ASSERT_GT(readlink("/proc/self/exe", exe, sizeof(exe) - 1), 0);
+
+	pid_t child = spawn_spinning_child();
+	ASSERT_NE(child, -1);
+
+	size_t size = bun_unwind_remote(&handle, &buffer, child);
+	reap(child);
+	ASSERT_NE(size, 0);
+
+	struct bun_reader reader;
+	ASSERT_TRUE(bun_reader_init(&reader, &buffer, &handle));
+	ASSERT_EQ(bun_header_tid_get(&reader), (unsigned)child);
+	ASSERT_EQ(bun_header_backend_get(&reader), BUN_BACKEND_PERF);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 1);
+
+	/* Only the sampled frame carries registers. */
+	ASSERT_GT(frames[0].register_count, 0);
+	ASSERT_EQ(frames[1].register_count, 0);
+
+	auto it = std::find_if(frames.cbegin(), frames.cend(), resolves_to_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	ASSERT_STREQ(it->filename, exe);
+	bun_handle_deinit(&handle);
+}
+
+TEST(perf, skip_symbols) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	if (perf_available() == false)
+		GTEST_SKIP();
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_PERF));
+	handle.flags |= BUN_HANDLE_SKIP_SYMBOLS;
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	pid_t child = spawn_spinning_child();
+	ASSERT_NE(child, -1);
+
+	size_t size = bun_unwind_remote(&handle, &buffer, child);
+	reap(child);
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 0);
+	for (const auto &frame : frames)
+		ASSERT_STREQ(frame.filename, "");
+
+	ASSERT_NE(std::find_if(frames.cbegin(), frames.cend(), resolves_to_dummy_func),
+	    frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+TEST(perf, tiny_buffer) {
+	std::vector<char> buf(payload_header_size() + 64);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	if (perf_available() == false)
+		GTEST_SKIP();
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_PERF));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	pid_t child = spawn_spinning_child();
+	ASSERT_NE(child, -1);
+
+	size_t size = bun_unwind_remote(&handle, &buffer, child);
+	reap(child);
+	ASSERT_EQ(size, 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST(perf, exited_thread) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_PERF));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	pid_t child = fork();
+	ASSERT_NE(child, -1);
+	if (child == 0)
+		_exit(0);
+
+	waitpid(child, nullptr, 0);
+	ASSERT_EQ(bun_unwind_remote(&handle, &buffer, child), 0);
+	bun_handle_deinit(&handle);
+}
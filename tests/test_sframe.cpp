@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <string>
+
+#include <signal.h>
+
+#include "bun_modules.h"
+#include "frames.hpp"
+#include "payload_header.h"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+TEST(sframe, initialize) {
+	struct bun_handle handle;
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SFRAME));
+	bun_handle_deinit(&handle);
+}
+
+TEST(sframe, unwinding) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SFRAME));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 0);
+
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	ASSERT_GT(it->register_count, 0);
+	ASSERT_NE(dummy_line, 0);
+
+	ASSERT_GT(frames.cend() - it, 2);
+	bun_handle_deinit(&handle);
+}
+
+TEST(sframe, tiny_buffer)
+{
+	std::vector<char> buf(payload_header_size());
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SFRAME));
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_EQ(size, 0);
+
+	bun_handle_deinit(&handle);
+}
+
+static struct {
+	struct bun_handle *handle;
+	struct bun_buffer *buffer;
+	size_t size;
+} signal_unwind;
+
+TEST(sframe, unwind_context) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct sigaction action = {}, old;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SFRAME));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	signal_unwind.handle = &handle;
+	signal_unwind.buffer = &buffer;
+	signal_unwind.size = 0;
+
+	action.sa_flags = SA_SIGINFO;
+	action.sa_sigaction = +[](int, siginfo_t *, void *context) {
+		signal_unwind.size = bun_unwind_context(signal_unwind.handle,
+		    signal_unwind.buffer, context);
+	};
+	ASSERT_EQ(sigaction(SIGUSR1, &action, &old), 0);
+
+	dummy_func([&]{ raise(SIGUSR1); });
+	sigaction(SIGUSR1, &old, nullptr);
+
+	ASSERT_NE(signal_unwind.size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * The test itself is assembled with --gsframe, so its module must have SFrame
+ * data.
+ */
+TEST(sframe, section) {
+	struct bun_module_table modules;
+
+	ASSERT_TRUE(bun_module_table_init(&modules));
+	const struct bun_module *module = bun_module_table_find(&modules,
+	    (uintptr_t)&dummy_func);
+	ASSERT_NE(module, nullptr);
+	ASSERT_NE(module->sframe, nullptr);
+	ASSERT_GT(module->sframe_size, 0);
+	bun_module_table_deinit(&modules);
+}
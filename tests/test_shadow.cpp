@@ -0,0 +1,216 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/shadow.h>
+#include <bun/stream.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <string>
+
+#include <signal.h>
+
+#include "frames.hpp"
+#include "payload_header.h"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+TEST(shadow, initialize) {
+	struct bun_handle handle;
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SHADOW));
+	bun_handle_deinit(&handle);
+}
+
+TEST(shadow, unwinding) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SHADOW));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 0);
+
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	ASSERT_NE(dummy_line, 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST(shadow, tiny_buffer)
+{
+	std::vector<char> buf(payload_header_size());
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SHADOW));
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_EQ(size, 0);
+
+	bun_handle_deinit(&handle);
+}
+
+static struct {
+	struct bun_handle *handle;
+	struct bun_buffer *buffer;
+	size_t size;
+} signal_unwind;
+
+TEST(shadow, unwind_context) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct sigaction action = {}, old;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SHADOW));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	signal_unwind.handle = &handle;
+	signal_unwind.buffer = &buffer;
+	signal_unwind.size = 0;
+
+	action.sa_flags = SA_SIGINFO;
+	action.sa_sigaction = +[](int, siginfo_t *, void *context) {
+		signal_unwind.size = bun_unwind_context(signal_unwind.handle,
+		    signal_unwind.buffer, context);
+	};
+	ASSERT_EQ(sigaction(SIGUSR1, &action, &old), 0);
+
+	dummy_func([&]{ raise(SIGUSR1); });
+	sigaction(SIGUSR1, &old, nullptr);
+
+	ASSERT_NE(signal_unwind.size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+/*
+ * Once dummy_func has returned, its entry must be gone.
+ */
+TEST(shadow, balanced) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SHADOW));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	dummy_func([]{});
+	ASSERT_NE(bun_unwind(&handle, &buffer), 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 0);
+	ASSERT_EQ(std::find_if(frames.cbegin(), frames.cend(), is_dummy_func),
+	    frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+static size_t
+recurse(struct bun_handle *handle, struct bun_buffer *buffer, int depth)
+{
+
+	if (depth == 0)
+		return bun_unwind(handle, buffer);
+
+	size_t size = recurse(handle, buffer, depth - 1);
+	/* Prevent tail call optimization. */
+	asm volatile("" ::: "memory");
+	return size;
+}
+
+/*
+ * Only the innermost BUN_SHADOW_STACK_DEPTH entries are kept.
+ */
+TEST(shadow, overflow) {
+	std::vector<char> buf(0x100000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SHADOW));
+	handle.flags |= BUN_HANDLE_SKIP_SYMBOLS;
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	ASSERT_NE(recurse(&handle, &buffer, 2 * BUN_SHADOW_STACK_DEPTH), 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_EQ(frames.size(), BUN_SHADOW_STACK_DEPTH + 1);
+
+	/* The frames are all in recurse(), called from itself. */
+	for (size_t i = 2; i < frames.size(); i++)
+		ASSERT_EQ(frames[i].addr, frames[1].addr);
+
+	bun_handle_deinit(&handle);
+}
+
+extern "C" __attribute__((no_instrument_function)) void
+annotated_func(std::function<void()> const& f)
+{
+	BUN_SHADOW_SCOPE(annotated_func);
+
+	f();
+}
+
+extern "C" __attribute__((no_instrument_function)) void
+annotated_enter_exit(std::function<void()> const& f)
+{
+
+	BUN_SHADOW_ENTER(annotated_enter_exit);
+	f();
+	BUN_SHADOW_EXIT();
+}
+
+TEST(shadow, macros) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_SHADOW));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	size_t size = 0;
+	annotated_func([&]{
+		annotated_enter_exit([&]{
+			size = bun_unwind(&handle, &buffer);
+		});
+	});
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto has = [&](const char *name) {
+		return std::any_of(frames.cbegin(), frames.cend(),
+		    [&](bun_frame const& f) {
+			return strcmp(f.symbol, name) == 0;
+		});
+	};
+	ASSERT_TRUE(has("annotated_func"));
+	ASSERT_TRUE(has("annotated_enter_exit"));
+	bun_handle_deinit(&handle);
+}
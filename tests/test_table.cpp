@@ -0,0 +1,196 @@
+#include "gtest/gtest.h"
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+#include <string>
+
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "backend/table/bun_table_builder.h"
+#include "backend/table/bun_table_format.h"
+#include "frames.hpp"
+#include "payload_header.h"
+
+int dummy_line;
+/*
+ * This function is not marked static on purpose - we do want the name to appear
+ * in the callstack
+ */
+void dummy_func(std::function<void()> const& f)
+{
+	f(); dummy_line = __LINE__;
+}
+
+/*
+ * Generates the table of the test executable into a temporary directory,
+ * which is used as the cache directory.
+ */
+class table : public ::testing::Test {
+protected:
+	void SetUp() override {
+		char self[PATH_MAX];
+		ssize_t length;
+
+		ASSERT_NE(mkdtemp(directory), nullptr);
+		length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+		ASSERT_GT(length, 0);
+		self[length] = '\0';
+
+		ASSERT_TRUE(bun_table_build(self, directory, path,
+		    sizeof(path)));
+		bun_cache_dir_set(directory);
+	}
+
+	void TearDown() override {
+		bun_cache_dir_set(nullptr);
+		unlink(path);
+		rmdir(directory);
+	}
+
+	char directory[32] = "/tmp/bun_table.XXXXXX";
+	char path[PATH_MAX] = "";
+};
+
+TEST_F(table, format) {
+	FILE *file = fopen(path, "rb");
+	struct bun_table_header header;
+	size_t stack_rules = 0;
+
+	ASSERT_NE(file, nullptr);
+	ASSERT_EQ(fread(&header, sizeof(header), 1, file), 1);
+	ASSERT_EQ(header.magic, BUN_TABLE_MAGIC);
+	ASSERT_EQ(header.version, BUN_TABLE_VERSION);
+	ASSERT_GT(header.count, 0);
+	ASSERT_GT(header.build_id_size, 0);
+
+	std::vector<uint32_t> pcs(header.count);
+	std::vector<bun_table_entry> entries(header.count);
+	ASSERT_EQ(fread(pcs.data(), sizeof(uint32_t), pcs.size(), file),
+	    pcs.size());
+	ASSERT_EQ(fread(entries.data(), sizeof(bun_table_entry),
+	    entries.size(), file), entries.size());
+	fclose(file);
+
+	ASSERT_TRUE(std::is_sorted(pcs.cbegin(), pcs.cend()));
+	ASSERT_EQ(std::adjacent_find(pcs.cbegin(), pcs.cend()), pcs.cend());
+
+	/* The last entry ends the last FDE. */
+	ASSERT_EQ(entries.back().type, BUN_TABLE_TYPE_UNDEFINED);
+
+	/* Code built with -fomit-frame-pointer mostly uses the stack pointer. */
+	for (const auto &entry : entries) {
+		if (entry.type == BUN_TABLE_TYPE_CFA_SP)
+			stack_rules++;
+	}
+	ASSERT_GT(stack_rules, 0);
+}
+
+TEST_F(table, unwinding) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_TABLE));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	ASSERT_GT(frames.size(), 0);
+
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	ASSERT_GT(frames.cend() - it, 2);
+	bun_handle_deinit(&handle);
+}
+
+TEST_F(table, missing_table) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	/* Without a table, the DWARF interpreter is used. */
+	unlink(path);
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_TABLE));
+	ASSERT_TRUE(bun_buffer_init(&buffer, buf.data(), buf.size()));
+
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+	ASSERT_NE(size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	bun_handle_deinit(&handle);
+}
+
+TEST_F(table, tiny_buffer)
+{
+	std::vector<char> buf(payload_header_size());
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_TABLE));
+	size_t size = 0;
+	dummy_func([&]{ size = bun_unwind(&handle, &buffer); });
+
+	ASSERT_EQ(size, 0);
+
+	bun_handle_deinit(&handle);
+}
+
+static struct {
+	struct bun_handle *handle;
+	struct bun_buffer *buffer;
+	size_t size;
+} signal_unwind;
+
+TEST_F(table, unwind_context) {
+	std::vector<char> buf(0x10000);
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	struct sigaction action = {}, old;
+
+	ASSERT_TRUE(bun_handle_init(&handle, BUN_BACKEND_TABLE));
+
+	bool buffer_init_result = bun_buffer_init(&buffer, buf.data(), buf.size());
+	ASSERT_TRUE(buffer_init_result);
+
+	signal_unwind.handle = &handle;
+	signal_unwind.buffer = &buffer;
+	signal_unwind.size = 0;
+
+	action.sa_flags = SA_SIGINFO;
+	action.sa_sigaction = +[](int, siginfo_t *, void *context) {
+		signal_unwind.size = bun_unwind_context(signal_unwind.handle,
+		    signal_unwind.buffer, context);
+	};
+	ASSERT_EQ(sigaction(SIGUSR1, &action, &old), 0);
+
+	dummy_func([&]{ raise(SIGUSR1); });
+	sigaction(SIGUSR1, &old, nullptr);
+
+	ASSERT_NE(signal_unwind.size, 0);
+
+	auto frames = read_frames(&buffer, &handle);
+	auto it = std::find_if(frames.cbegin(), frames.cend(), is_dummy_func);
+	ASSERT_NE(it, frames.cend());
+	bun_handle_deinit(&handle);
+}
@@ -0,0 +1,652 @@
+#include "gtest/gtest.h"
+
+#include <bun/backend.h>
+#include <bun/bun.h>
+#include <bun/stream.h>
+#include <bun/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "bun_internal.h"
+#include "bun_maps.h"
+#include "bun_memory.h"
+#include "bun_modules.h"
+#include "bun_ptrace.h"
+
+/*
+ * Forks a child spinning on a second thread. Returns the pid of the child and
+ * stores the id of that thread into `tid`.
+ */
+static pid_t
+spawn_child(pid_t *tid)
+{
+	int fds[2];
+	pid_t pid;
+
+	if (pipe(fds) != 0)
+		return -1;
+
+	pid = fork();
+	if (pid == 0) {
+		pthread_t thread;
+
+		close(fds[0]);
+		pthread_create(&thread, nullptr, [](void *arg) -> void * {
+			pid_t self = syscall(SYS_gettid);
+			int fd = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+
+			if (write(fd, &self, sizeof(self)) != sizeof(self))
+				_exit(1);
+
+			for (;;)
+				pause();
+		}, reinterpret_cast<void *>(static_cast<intptr_t>(fds[1])));
+
+		for (;;)
+			pause();
+	}
+
+	close(fds[1]);
+	if (pid != -1 && read(fds[0], tid, sizeof(*tid)) != sizeof(*tid)) {
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+		pid = -1;
+	}
+
+	close(fds[0]);
+	return pid;
+}
+
+static void
+reap(pid_t pid)
+{
+
+	kill(pid, SIGKILL);
+	waitpid(pid, nullptr, 0);
+}
+
+/*
+ * Returns the state letter of the thread `tid` of this process' child `pid`.
+ */
+static char
+thread_state(pid_t pid, pid_t tid)
+{
+	char path[64];
+	char state = '?';
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", pid, tid);
+	fp = fopen(path, "r");
+	if (fp == nullptr)
+		return state;
+
+	if (fscanf(fp, "%*d (%*[^)]) %c", &state) != 1)
+		state = '?';
+
+	fclose(fp);
+	return state;
+}
+
+static long
+elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+	    std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(utils, waitpid_attach) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	if (ptrace(PTRACE_ATTACH, child, 0, 0) != 0) {
+		reap(child);
+		GTEST_SKIP();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	ASSERT_EQ(bun_waitpid(child, 5000), 0);
+	ASSERT_LT(elapsed_ms(start), 1000);
+
+	ptrace(PTRACE_DETACH, child, 0, 0);
+	reap(child);
+}
+
+/*
+ * Threads other than the thread group leader are only reported with __WALL.
+ */
+TEST(utils, waitpid_thread) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	if (ptrace(PTRACE_ATTACH, tid, 0, 0) != 0) {
+		reap(child);
+		GTEST_SKIP();
+	}
+
+	ASSERT_EQ(bun_waitpid(tid, 5000), 0);
+	ptrace(PTRACE_DETACH, tid, 0, 0);
+	reap(child);
+}
+
+TEST(utils, waitpid_no_timeout) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	if (ptrace(PTRACE_ATTACH, child, 0, 0) != 0) {
+		reap(child);
+		GTEST_SKIP();
+	}
+
+	ASSERT_EQ(bun_waitpid(child, -1), 0);
+	ptrace(PTRACE_DETACH, child, 0, 0);
+	reap(child);
+}
+
+TEST(utils, waitpid_exited) {
+	pid_t child = fork();
+	ASSERT_NE(child, -1);
+	if (child == 0)
+		_exit(0);
+
+	ASSERT_LT(bun_waitpid(child, 5000), 0);
+}
+
+/*
+ * A running child that is not traced never stops, the wait must give up at
+ * the deadline.
+ */
+TEST(utils, waitpid_timeout) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	auto start = std::chrono::steady_clock::now();
+	ASSERT_LT(bun_waitpid(child, 100), 0);
+	long elapsed = elapsed_ms(start);
+	ASSERT_GE(elapsed, 100);
+	ASSERT_LT(elapsed, 1000);
+	reap(child);
+}
+
+TEST(utils, ptrace_seize) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	if (bun_ptrace_attach(child, BUN_HANDLE_PTRACE_SEIZE, 5000) == false) {
+		reap(child);
+		GTEST_SKIP();
+	}
+
+	ASSERT_EQ(thread_state(child, child), 't');
+	bun_ptrace_detach(child);
+
+	/* No SIGSTOP was queued, the child must not end up stopped. */
+	usleep(10000);
+	ASSERT_NE(thread_state(child, child), 'T');
+	ASSERT_NE(thread_state(child, child), 't');
+	reap(child);
+}
+
+TEST(utils, ptrace_seize_thread) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	if (bun_ptrace_attach(tid, BUN_HANDLE_PTRACE_SEIZE, 5000) == false) {
+		reap(child);
+		GTEST_SKIP();
+	}
+
+	ASSERT_EQ(thread_state(child, tid), 't');
+	ASSERT_NE(thread_state(child, child), 't');
+	bun_ptrace_detach(tid);
+	reap(child);
+}
+
+/*
+ * A process stopped by job control must still be stopped once we are done.
+ */
+TEST(utils, ptrace_seize_stopped) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	kill(child, SIGSTOP);
+	ASSERT_EQ(waitpid(child, nullptr, WUNTRACED), child);
+
+	if (bun_ptrace_attach(child, BUN_HANDLE_PTRACE_SEIZE, 5000) == false) {
+		reap(child);
+		GTEST_SKIP();
+	}
+
+	bun_ptrace_detach(child);
+	usleep(10000);
+	ASSERT_EQ(thread_state(child, child), 'T');
+	reap(child);
+}
+
+TEST(utils, ptrace_attach) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	if (bun_ptrace_attach(child, 0, 5000) == false) {
+		reap(child);
+		GTEST_SKIP();
+	}
+
+	ASSERT_EQ(thread_state(child, child), 't');
+	bun_ptrace_detach(child);
+	reap(child);
+}
+
+TEST(utils, ptrace_exited) {
+	pid_t child = fork();
+	ASSERT_NE(child, -1);
+	if (child == 0)
+		_exit(0);
+
+	waitpid(child, nullptr, 0);
+	ASSERT_FALSE(bun_ptrace_attach(child, BUN_HANDLE_PTRACE_SEIZE, 5000));
+	ASSERT_FALSE(bun_ptrace_attach(child, 0, 5000));
+}
+
+/*
+ * The child is forked after `pattern` is filled and the parent overwrites its
+ * copy, so only reads of the child's memory see the pattern.
+ */
+TEST(utils, memory_cache_read) {
+	const size_t size = BUN_MEMORY_CACHE_PAGE_SIZE * (BUN_MEMORY_CACHE_PAGES + 4);
+	std::vector<unsigned char> pattern(size);
+	std::vector<unsigned char> out(size);
+	pid_t tid;
+
+	for (size_t i = 0; i < size; i++)
+		pattern[i] = static_cast<unsigned char>(i * 7 + 3);
+
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+	std::fill(pattern.begin(), pattern.end(), 0);
+
+	auto cache = std::make_unique<bun_memory_cache>();
+	bun_memory_cache_init(cache.get(), child);
+
+	uintptr_t base = reinterpret_cast<uintptr_t>(pattern.data());
+	if (bun_memory_cache_read(cache.get(), out.data(), base, 8) == false) {
+		reap(child);
+		GTEST_SKIP();
+	}
+
+	/* More pages than the cache holds, so pages get evicted. */
+	ASSERT_TRUE(bun_memory_cache_read(cache.get(), out.data(), base, size));
+	for (size_t i = 0; i < size; i++)
+		ASSERT_EQ(out[i], static_cast<unsigned char>(i * 7 + 3));
+
+	/* Words straddling a page boundary. */
+	for (size_t i = 1; i < size / BUN_MEMORY_CACHE_PAGE_SIZE; i++) {
+		size_t offset = i * BUN_MEMORY_CACHE_PAGE_SIZE -
+		    (base % BUN_MEMORY_CACHE_PAGE_SIZE) - 3;
+		uint64_t word, expected;
+
+		ASSERT_TRUE(bun_memory_cache_read(cache.get(), &word,
+		    base + offset, sizeof(word)));
+		for (size_t j = 0; j < sizeof(expected); j++) {
+			reinterpret_cast<unsigned char *>(&expected)[j] =
+			    static_cast<unsigned char>((offset + j) * 7 + 3);
+		}
+		ASSERT_EQ(word, expected);
+	}
+
+	reap(child);
+}
+
+TEST(utils, memory_cache_unmapped) {
+	long page_size = sysconf(_SC_PAGESIZE);
+	unsigned char *map = static_cast<unsigned char *>(mmap(nullptr,
+	    page_size * 2, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	ASSERT_NE(map, MAP_FAILED);
+	ASSERT_EQ(munmap(map + page_size, page_size), 0);
+	map[page_size - 1] = 42;
+
+	auto cache = std::make_unique<bun_memory_cache>();
+	bun_memory_cache_init(cache.get(), getpid());
+
+	unsigned char byte = 0;
+	uint64_t word;
+	uintptr_t last = reinterpret_cast<uintptr_t>(map + page_size - 1);
+	if (bun_memory_cache_read(cache.get(), &byte, last, 1) == false) {
+		munmap(map, page_size);
+		GTEST_SKIP();
+	}
+
+	ASSERT_EQ(byte, 42);
+	ASSERT_FALSE(bun_memory_cache_read(cache.get(), &word, last,
+	    sizeof(word)));
+	ASSERT_FALSE(bun_memory_cache_read(cache.get(), &word, 0,
+	    sizeof(word)));
+	munmap(map, page_size);
+}
+
+TEST(utils, module_probe) {
+	long page_size = sysconf(_SC_PAGESIZE);
+	void *map = mmap(nullptr, page_size, PROT_READ,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ASSERT_NE(map, MAP_FAILED);
+
+	struct bun_module module = {};
+	const struct bun_module *probed = nullptr;
+	module.eh_frame_hdr = static_cast<const uint8_t *>(map);
+
+	ASSERT_TRUE(bun_module_probe(&module, &probed));
+	ASSERT_EQ(probed, &module);
+
+	/* A module that is probed already is not checked again. */
+	ASSERT_EQ(munmap(map, page_size), 0);
+	ASSERT_TRUE(bun_module_probe(&module, &probed));
+
+	probed = nullptr;
+	ASSERT_FALSE(bun_module_probe(&module, &probed));
+	ASSERT_EQ(probed, nullptr);
+}
+
+TEST(utils, module_table_paths) {
+	struct bun_module_table table;
+
+	ASSERT_TRUE(bun_module_table_init(&table));
+	ASSERT_GT(table.count, 0);
+
+	/* The paths must outlive the objects, which may be dlclose()d. */
+	for (size_t i = 0; i < table.count; i++)
+		ASSERT_GE(table.modules[i].path, table.paths);
+
+	bun_module_table_deinit(&table);
+}
+
+#if defined(BUN_PTRACE_SNAPSHOT_SUPPORTED)
+TEST(utils, ptrace_snapshot) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	if (bun_ptrace_attach(tid, BUN_HANDLE_PTRACE_SEIZE, 5000) == false) {
+		reap(child);
+		GTEST_SKIP();
+	}
+
+	auto snapshot = std::make_unique<bun_ptrace_snapshot>();
+	ASSERT_TRUE(bun_ptrace_snapshot_save(tid, snapshot.get()));
+	bun_ptrace_detach(tid);
+
+#if defined(__x86_64__)
+	uintptr_t sp = snapshot->regs.rsp;
+#elif defined(__i386__)
+	uintptr_t sp = snapshot->regs.esp;
+#elif defined(__aarch64__)
+	uintptr_t sp = snapshot->regs.sp;
+#endif
+
+	ASSERT_LE(snapshot->stack_low, sp);
+	ASSERT_GT(snapshot->stack_size, sp - snapshot->stack_low);
+	ASSERT_LE(snapshot->stack_size, sizeof(snapshot->stack));
+
+	/* The thread is blocked in pause(), its stack does not change. */
+	uintptr_t saved, live;
+	ASSERT_TRUE(bun_ptrace_snapshot_read(snapshot.get(), &saved, sp,
+	    sizeof(saved)));
+	ASSERT_TRUE(bun_memory_read(child, &live, sp, sizeof(live)));
+	ASSERT_EQ(saved, live);
+
+	uintptr_t end = snapshot->stack_low + snapshot->stack_size;
+	ASSERT_FALSE(bun_ptrace_snapshot_read(snapshot.get(), &saved,
+	    snapshot->stack_low - 1, sizeof(saved)));
+	ASSERT_FALSE(bun_ptrace_snapshot_read(snapshot.get(), &saved,
+	    end - 1, sizeof(saved)));
+	ASSERT_TRUE(bun_ptrace_snapshot_read(snapshot.get(), &saved,
+	    end - sizeof(saved), sizeof(saved)));
+	reap(child);
+}
+#endif
+
+TEST(utils, ptrace_snapshot_detached) {
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	/* The registers of a thread that is not stopped cannot be read. */
+	auto snapshot = std::make_unique<bun_ptrace_snapshot>();
+	ASSERT_FALSE(bun_ptrace_snapshot_save(tid, snapshot.get()));
+	reap(child);
+}
+
+TEST(utils, maps_stamp) {
+	struct bun_maps_stamp before, after;
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	ASSERT_TRUE(bun_maps_stamp_get(bun_gettid(), &before));
+	ASSERT_EQ(before.pid, getpid());
+	ASSERT_TRUE(bun_maps_stamp_get(bun_gettid(), &after));
+	ASSERT_TRUE(bun_maps_stamp_equal(&before, &after));
+
+	void *map = mmap(nullptr, page_size * 4, PROT_READ,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ASSERT_NE(map, MAP_FAILED);
+	ASSERT_TRUE(bun_maps_stamp_get(getpid(), &after));
+	munmap(map, page_size * 4);
+	ASSERT_FALSE(bun_maps_stamp_equal(&before, &after));
+}
+
+TEST(utils, maps_cache) {
+	struct bun_maps_cache cache;
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	bun_maps_cache_init(&cache);
+	struct bun_maps *maps = bun_maps_cache_get(&cache, tid, false);
+	ASSERT_NE(maps, nullptr);
+	ASSERT_EQ(maps->stamp.pid, child);
+
+	/* The child is forked from this process, so its code is here too. */
+	auto pc = reinterpret_cast<uintptr_t>(&spawn_child);
+	const struct bun_maps_entry *entry = bun_maps_find(maps, pc);
+	ASSERT_NE(entry, nullptr);
+	ASSERT_NE(entry->path, nullptr);
+
+	char exe[PATH_MAX] = {0};
+	ASSERT_GT(readlink("/proc/self/exe", exe, sizeof(exe) - 1), 0);
+	ASSERT_STREQ(entry->path, exe);
+	ASSERT_EQ(bun_maps_find(maps, 0), nullptr);
+
+	/* Nothing changed, the maps are not read again. */
+	struct bun_maps *again = bun_maps_cache_get(&cache, child, false);
+	ASSERT_EQ(again, maps);
+	bun_maps_release(again);
+
+	again = bun_maps_cache_get(&cache, child, true);
+	ASSERT_NE(again, nullptr);
+	ASSERT_NE(again, maps);
+	ASSERT_NE(bun_maps_find(again, pc), nullptr);
+
+	/* The replaced maps stay usable until released. */
+	ASSERT_EQ(bun_maps_find(maps, pc), entry);
+	bun_maps_release(maps);
+	bun_maps_release(again);
+
+	reap(child);
+	ASSERT_EQ(bun_maps_cache_get(&cache, child, false), nullptr);
+	bun_maps_cache_deinit(&cache);
+}
+
+TEST(utils, maps_cache_processes) {
+	struct bun_maps_cache cache;
+	pid_t tids[2];
+	pid_t children[2] = {
+		spawn_child(&tids[0]),
+		spawn_child(&tids[1])
+	};
+	struct bun_maps *maps[2];
+
+	ASSERT_NE(children[0], -1);
+	ASSERT_NE(children[1], -1);
+
+	bun_maps_cache_init(&cache);
+	for (size_t i = 0; i < 2; i++) {
+		maps[i] = bun_maps_cache_get(&cache, children[i], false);
+		ASSERT_NE(maps[i], nullptr);
+	}
+
+	/* Alternating between the processes does not read the maps again. */
+	for (size_t i = 0; i < 4; i++) {
+		struct bun_maps *again = bun_maps_cache_get(&cache,
+		    tids[i % 2], false);
+
+		ASSERT_EQ(again, maps[i % 2]);
+		bun_maps_release(again);
+	}
+
+	/* Other processes only evict the least recently used ones. */
+	struct bun_maps_table table;
+	bun_maps_table_init(&table);
+	for (pid_t pid = 1; pid <= BUN_MAPS_CACHE_SIZE; pid++)
+		ASSERT_EQ(bun_maps_table_slot(&table, pid), (size_t)pid - 1);
+	ASSERT_EQ(bun_maps_table_find(&table, 1), 0);
+	ASSERT_EQ(bun_maps_table_slot(&table, 1000), 1);
+	ASSERT_EQ(bun_maps_table_find(&table, 2), -1);
+	ASSERT_EQ(bun_maps_table_slot(&table, 1), 0);
+
+	bun_maps_release(maps[0]);
+	bun_maps_release(maps[1]);
+	bun_maps_cache_deinit(&cache);
+	reap(children[0]);
+	reap(children[1]);
+}
+
+struct process_state {
+	pid_t pid;
+	std::mutex lock;
+	std::vector<pid_t> unwound;
+	std::vector<pid_t> seen;
+	bool stopped = true;
+};
+
+/*
+ * Unwinds a single frame, checking that every thread of the process is
+ * stopped if the handle stops them.
+ */
+static bool
+process_unwind_remote(void *context, struct bun_writer *writer, pid_t tid)
+{
+	auto state = static_cast<struct process_state *>(context);
+	struct bun_frame frame = {};
+
+	frame.addr = 0x1000;
+	if (bun_ptrace_attach(tid, 0, 5000) == false ||
+	    thread_state(state->pid, state->pid) != 't' ||
+	    thread_state(state->pid, tid) != 't') {
+		std::lock_guard<std::mutex> guard(state->lock);
+
+		state->stopped = false;
+	}
+
+	bun_ptrace_detach(tid);
+	return bun_frame_write(writer, &frame) != 0;
+}
+
+static void
+process_thread(void *arg, pid_t tid, struct bun_buffer *buffer, size_t size)
+{
+	auto state = static_cast<struct process_state *>(arg);
+	std::lock_guard<std::mutex> guard(state->lock);
+
+	state->seen.push_back(tid);
+	if (buffer != nullptr && size != 0)
+		state->unwound.push_back(tid);
+}
+
+TEST(utils, process_unwind) {
+	struct bun_backend_ops ops = {};
+	struct bun_handle handle;
+	struct process_state state;
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	ops.size = sizeof(ops);
+	ops.unwind = [](void *, struct bun_writer *) { return false; };
+	ops.unwind_remote = process_unwind_remote;
+	state.pid = child;
+	ASSERT_TRUE(bun_handle_init_custom(&handle, &ops, &state));
+
+	/* The threads are left running, the backend does not stop them. */
+	ASSERT_EQ(bun_unwind_remote_process(&handle, child, 0x1000, 4,
+	    process_thread, &state), 2);
+	ASSERT_FALSE(state.stopped);
+
+	std::sort(state.seen.begin(), state.seen.end());
+	ASSERT_EQ(state.seen, std::vector<pid_t>({ child, tid }));
+	ASSERT_EQ(state.unwound.size(), 2);
+
+	/* Too small a buffer, no thread is unwound but all are reported. */
+	state.seen.clear();
+	state.unwound.clear();
+	ASSERT_EQ(bun_unwind_remote_process(&handle, child, 8, 1,
+	    process_thread, &state), 0);
+	ASSERT_EQ(state.seen.size(), 2);
+	ASSERT_TRUE(state.unwound.empty());
+
+	reap(child);
+	ASSERT_EQ(bun_unwind_remote_process(&handle, child, 0x1000, 0,
+	    process_thread, &state), 0);
+	bun_handle_deinit(&handle);
+}
+
+TEST(utils, process_unwind_stopped) {
+	struct bun_backend_ops ops = {};
+	struct bun_handle handle;
+	struct process_state state;
+	pid_t tid;
+	pid_t child = spawn_child(&tid);
+	ASSERT_NE(child, -1);
+
+	ops.size = sizeof(ops);
+	ops.unwind = [](void *, struct bun_writer *) { return false; };
+	ops.unwind_remote = process_unwind_remote;
+	state.pid = child;
+	ASSERT_TRUE(bun_handle_init_custom(&handle, &ops, &state));
+
+	/*
+	 * Pretend the backend stops threads with ptrace: each worker stops
+	 * its threads and they all stay stopped until every one is unwound.
+	 */
+	handle.remote_ptrace = true;
+	handle.flags |= BUN_HANDLE_PTRACE_SEIZE;
+	ASSERT_EQ(bun_unwind_remote_process(&handle, child, 0x1000, 2,
+	    process_thread, &state), 2);
+	ASSERT_TRUE(state.stopped);
+	ASSERT_EQ(state.seen.size(), 2);
+
+	ASSERT_NE(thread_state(child, child), 't');
+	ASSERT_NE(thread_state(child, tid), 't');
+	reap(child);
+	bun_handle_deinit(&handle);
+}
@@ -0,0 +1,205 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <bun/bun.h>
+#include <bun/core.h>
+#include <bun/stream.h>
+
+/* Size of the buffer each thread of a core is unwound into. */
+#define BUFFER_SIZE (1UL << 20)
+
+#define JOBS_MAX 256
+
+/* Default memory limit of the objects shared by the cores, in MiB. */
+#define CACHE_LIMIT_DEFAULT 512
+
+struct job_queue {
+	const char *directory;
+	const char *sysroot;
+	struct bun_object_cache *cache;
+	char **cores;
+	int count;
+	atomic_int next;
+	atomic_bool failed;
+};
+
+int usage();
+
+/*
+ * Writes the stream of every thread of the core to
+ * <directory>/<core name>.<tid>.bun.
+ */
+static bool
+convert(const struct job_queue *queue, const char *core, char *data)
+{
+	struct bun_handle handle;
+	struct bun_buffer buffer;
+	const char *name = basename(core);
+	size_t count, written = 0;
+	pid_t *tids;
+
+	if (bun_handle_init_core_cached(&handle, core, queue->sysroot,
+	    queue->cache) == false)
+		return false;
+
+	count = bun_core_threads(&handle, NULL, 0);
+	tids = calloc(count + 1, sizeof(*tids));
+	if (tids == NULL) {
+		bun_handle_deinit(&handle);
+		return false;
+	}
+
+	bun_core_threads(&handle, tids, count);
+	for (size_t i = 0; i < count; i++) {
+		char path[PATH_MAX];
+		size_t size;
+		FILE *fp;
+
+		if (bun_buffer_init(&buffer, data, BUFFER_SIZE) == false)
+			break;
+
+		size = bun_unwind_remote(&handle, &buffer, tids[i]);
+		if (size == 0) {
+			printf("%s: cannot unwind thread %d\n", core, tids[i]);
+			continue;
+		}
+
+		if (snprintf(path, sizeof(path), "%s/%s.%d.bun",
+		    queue->directory, name, tids[i]) >= (int)sizeof(path))
+			continue;
+
+		fp = fopen(path, "wb");
+		if (fp == NULL)
+			continue;
+
+		if (fwrite(bun_buffer_payload(&buffer), size, 1, fp) == 1)
+			written++;
+		fclose(fp);
+	}
+
+	printf("%s: %zu of %zu threads\n", core, written, count);
+	free(tids);
+	bun_handle_deinit(&handle);
+	return written == count;
+}
+
+static void *
+worker(void *arg)
+{
+	struct job_queue *queue = arg;
+	char *data;
+
+	data = malloc(BUFFER_SIZE);
+	if (data == NULL) {
+		atomic_store(&queue->failed, true);
+		return NULL;
+	}
+
+	for (;;) {
+		int i = atomic_fetch_add(&queue->next, 1);
+
+		if (i >= queue->count)
+			break;
+
+		if (convert(queue, queue->cores[i], data) == false) {
+			printf("Error: cannot convert %s\n", queue->cores[i]);
+			atomic_store(&queue->failed, true);
+		}
+	}
+
+	free(data);
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	pthread_t threads[JOBS_MAX];
+	struct job_queue queue;
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	long limit = CACHE_LIMIT_DEFAULT;
+	int started = 0;
+	int opt;
+
+	memset(&queue, 0, sizeof(queue));
+	while ((opt = getopt(argc, argv, "j:m:s:")) != -1) {
+		switch (opt) {
+		case 'j':
+			jobs = strtol(optarg, NULL, 10);
+			break;
+		case 'm':
+			limit = strtol(optarg, NULL, 10);
+			if (limit < 0)
+				return usage();
+			break;
+		case 's':
+			queue.sysroot = optarg;
+			break;
+		default:
+			return usage();
+		}
+	}
+
+	if (argc - optind < 2)
+		return usage();
+
+	queue.directory = argv[optind];
+	queue.cores = &argv[optind + 1];
+	queue.count = argc - optind - 1;
+	atomic_init(&queue.next, 0);
+	atomic_init(&queue.failed, false);
+
+	/* Cores of processes running the same build share their objects. */
+	queue.cache = bun_object_cache_create((size_t)limit << 20);
+	if (queue.cache == NULL) {
+		printf("Error: cannot create the object cache\n");
+		return 2;
+	}
+
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > queue.count)
+		jobs = queue.count;
+	if (jobs > JOBS_MAX)
+		jobs = JOBS_MAX;
+
+	for (long i = 0; i < jobs; i++) {
+		if (pthread_create(&threads[started], NULL, worker, &queue) != 0)
+			break;
+		started++;
+	}
+
+	/* Convert on this thread if no worker could be started. */
+	if (started == 0)
+		worker(&queue);
+
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	bun_object_cache_destroy(queue.cache);
+	return atomic_load(&queue.failed) ? 2 : 0;
+}
+
+int
+usage()
+{
+
+	printf("Usage: bun_core_unwind [-j jobs] [-m cache MiB] [-s sysroot] "
+	    "<output directory> <core>...\n");
+	printf("\n");
+	printf("Unwinds every thread of the given ELF core files and writes\n");
+	printf("their streams to <output directory>/<core>.<tid>.bun. Cores are\n");
+	printf("processed in parallel by `jobs` threads, one per CPU by default.\n");
+	printf("The objects mapped by the processes are read below `sysroot`.\n");
+	printf("Objects with the same build-id are loaded once for all the\n");
+	printf("cores, keeping up to `cache` MiB of unused ones (%d by default).\n",
+	    CACHE_LIMIT_DEFAULT);
+	return 1;
+}
@@ -0,0 +1,412 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <bun/bun.h>
+#include <bun/stream.h>
+
+/* Size of the buffer each thread is unwound into. */
+#define BUFFER_SIZE (1UL << 16)
+
+/* Frames beyond this depth are not compared nor printed. */
+#define FRAMES_MAX 256
+
+/* Number of hash table buckets, a power of two. */
+#define BUCKETS 1024
+
+struct stack_frame {
+	uint64_t addr;
+	char *symbol;
+	char *filename;
+	size_t offset;
+};
+
+/*
+ * A distinct stack and the threads it was seen on.
+ */
+struct stack {
+	uint64_t hash;
+	struct stack_frame *frames;
+	size_t frame_count;
+	pid_t *tids;
+	size_t tid_count;
+	size_t tid_capacity;
+	struct stack *next;
+};
+
+struct capture {
+	struct bun_handle *handle;
+	pthread_mutex_t lock;
+	struct stack *buckets[BUCKETS];
+	size_t stack_count;
+
+	/* Threads that could not be unwound, kept as a stack without frames. */
+	struct stack failed;
+	bool oom;
+};
+
+static const struct {
+	const char *name;
+	enum bun_unwind_backend backend;
+} backends[] = {
+#if defined(BUN_LIBUNWIND_ENABLED)
+	{ "libunwind", BUN_BACKEND_LIBUNWIND },
+#endif /* BUN_LIBUNWIND_ENABLED */
+#if defined(BUN_LIBUNWINDSTACK_ENABLED)
+	{ "libunwindstack", BUN_BACKEND_LIBUNWINDSTACK },
+#endif /* BUN_LIBUNWINDSTACK_ENABLED */
+#if defined(BUN_HANDSHAKE_ENABLED)
+	{ "handshake", BUN_BACKEND_HANDSHAKE },
+#endif /* BUN_HANDSHAKE_ENABLED */
+#if defined(BUN_CENSUS_ENABLED)
+	{ "census", BUN_BACKEND_CENSUS },
+#endif /* BUN_CENSUS_ENABLED */
+#if defined(BUN_PERF_ENABLED)
+	{ "perf", BUN_BACKEND_PERF },
+#endif /* BUN_PERF_ENABLED */
+	{ NULL, BUN_BACKEND_NONE }
+};
+
+int usage();
+
+static bool
+stack_add_tid(struct stack *stack, pid_t tid)
+{
+
+	if (stack->tid_count == stack->tid_capacity) {
+		size_t capacity = stack->tid_capacity * 2 + 8;
+		pid_t *tids;
+
+		tids = realloc(stack->tids, capacity * sizeof(*tids));
+		if (tids == NULL)
+			return false;
+
+		stack->tids = tids;
+		stack->tid_capacity = capacity;
+	}
+
+	stack->tids[stack->tid_count++] = tid;
+	return true;
+}
+
+static char *
+copy_string(const char *s)
+{
+
+	if (s == NULL || *s == '\0')
+		return NULL;
+
+	return strdup(s);
+}
+
+/*
+ * Creates the stack for `frames`, copying the strings that point into the
+ * buffer of the thread.
+ */
+static struct stack *
+stack_create(uint64_t hash, const struct bun_frame *frames, size_t count)
+{
+	struct stack *stack;
+
+	stack = calloc(1, sizeof(*stack));
+	if (stack == NULL)
+		return NULL;
+
+	stack->frames = calloc(count + 1, sizeof(*stack->frames));
+	if (stack->frames == NULL) {
+		free(stack);
+		return NULL;
+	}
+
+	stack->hash = hash;
+	stack->frame_count = count;
+	for (size_t i = 0; i < count; i++) {
+		stack->frames[i].addr = frames[i].addr;
+		stack->frames[i].symbol = copy_string(frames[i].symbol);
+		stack->frames[i].filename = copy_string(frames[i].filename);
+		stack->frames[i].offset = frames[i].offset;
+	}
+
+	return stack;
+}
+
+static void
+stack_free(struct stack *stack)
+{
+
+	for (size_t i = 0; i < stack->frame_count; i++) {
+		free(stack->frames[i].symbol);
+		free(stack->frames[i].filename);
+	}
+
+	free(stack->frames);
+	free(stack->tids);
+	free(stack);
+	return;
+}
+
+static bool
+stack_matches(const struct stack *stack, uint64_t hash,
+    const struct bun_frame *frames, size_t count)
+{
+
+	if (stack->hash != hash || stack->frame_count != count)
+		return false;
+
+	for (size_t i = 0; i < count; i++) {
+		if (stack->frames[i].addr != frames[i].addr)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Files the stream of the thread under its stack, which is identified by the
+ * addresses of its frames. Called by the workers of
+ * bun_unwind_remote_process().
+ */
+static void
+capture_thread(void *arg, pid_t tid, struct bun_buffer *buffer, size_t size)
+{
+	static __thread struct bun_frame frames[FRAMES_MAX];
+	struct capture *capture = arg;
+	struct bun_reader reader;
+	struct stack *stack;
+	uint64_t hash = 14695981039346656037ULL;
+	size_t count = 0;
+
+	if (buffer == NULL || size == 0 ||
+	    bun_reader_init(&reader, buffer, capture->handle) == false) {
+		pthread_mutex_lock(&capture->lock);
+		capture->oom |= stack_add_tid(&capture->failed, tid) == false;
+		pthread_mutex_unlock(&capture->lock);
+		return;
+	}
+
+	/* FNV-1a over the frame addresses. */
+	while (count < FRAMES_MAX &&
+	    bun_frame_read(&reader, &frames[count]) == true) {
+		uint64_t addr = frames[count].addr;
+
+		for (size_t i = 0; i < sizeof(addr); i++) {
+			hash ^= (addr >> (i * 8)) & 0xff;
+			hash *= 1099511628211ULL;
+		}
+
+		count++;
+	}
+
+	pthread_mutex_lock(&capture->lock);
+	for (stack = capture->buckets[hash & (BUCKETS - 1)]; stack != NULL;
+	    stack = stack->next) {
+		if (stack_matches(stack, hash, frames, count) == true)
+			break;
+	}
+
+	if (stack == NULL) {
+		stack = stack_create(hash, frames, count);
+		if (stack == NULL) {
+			capture->oom = true;
+			pthread_mutex_unlock(&capture->lock);
+			return;
+		}
+
+		stack->next = capture->buckets[hash & (BUCKETS - 1)];
+		capture->buckets[hash & (BUCKETS - 1)] = stack;
+		capture->stack_count++;
+	}
+
+	capture->oom |= stack_add_tid(stack, tid) == false;
+	pthread_mutex_unlock(&capture->lock);
+	return;
+}
+
+static int
+compare_tids(const void *a, const void *b)
+{
+	pid_t lhs = *(const pid_t *)a;
+	pid_t rhs = *(const pid_t *)b;
+
+	return (lhs > rhs) - (lhs < rhs);
+}
+
+/*
+ * Most common stacks first, then by lowest thread id.
+ */
+static int
+compare_stacks(const void *a, const void *b)
+{
+	const struct stack *lhs = *(const struct stack * const *)a;
+	const struct stack *rhs = *(const struct stack * const *)b;
+
+	if (lhs->tid_count != rhs->tid_count)
+		return lhs->tid_count > rhs->tid_count ? -1 : 1;
+
+	return compare_tids(&lhs->tids[0], &rhs->tids[0]);
+}
+
+static void
+print_tids(const struct stack *stack)
+{
+
+	for (size_t i = 0; i < stack->tid_count; i++)
+		printf("%s%d", i == 0 ? "" : ", ", stack->tids[i]);
+
+	printf("\n");
+	return;
+}
+
+static void
+print_stack(struct stack *stack)
+{
+
+	qsort(stack->tids, stack->tid_count, sizeof(*stack->tids),
+	    compare_tids);
+	printf("%zu thread%s: ", stack->tid_count,
+	    stack->tid_count == 1 ? "" : "s");
+	print_tids(stack);
+
+	for (size_t i = 0; i < stack->frame_count; i++) {
+		const struct stack_frame *frame = &stack->frames[i];
+
+		printf("#%-3zu 0x%016" PRIx64 " in %s", i, frame->addr,
+		    frame->symbol != NULL ? frame->symbol : "??");
+		if (frame->symbol != NULL && frame->offset != 0)
+			printf("+0x%zx", frame->offset);
+		if (frame->filename != NULL)
+			printf(" (%s)", frame->filename);
+		printf("\n");
+	}
+
+	printf("\n");
+	return;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct stack **stacks;
+	struct capture capture;
+	struct bun_handle handle;
+	enum bun_unwind_backend backend = backends[0].backend;
+	uint64_t flags = BUN_HANDLE_PTRACE_SEIZE;
+	long jobs = 0;
+	size_t count, unwound, n = 0;
+	pid_t pid;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:fj:")) != -1) {
+		switch (opt) {
+		case 'b':
+			backend = BUN_BACKEND_NONE;
+			for (size_t i = 0; backends[i].name != NULL; i++) {
+				if (strcmp(optarg, backends[i].name) == 0)
+					backend = backends[i].backend;
+			}
+
+			if (backend == BUN_BACKEND_NONE)
+				return usage();
+			break;
+		case 'f':
+			flags |= BUN_HANDLE_FORK_SNAPSHOT;
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 10);
+			if (jobs < 0)
+				return usage();
+			break;
+		default:
+			return usage();
+		}
+	}
+
+	if (argc - optind != 1 || backend == BUN_BACKEND_NONE)
+		return usage();
+
+	pid = strtol(argv[optind], NULL, 10);
+	if (pid <= 0)
+		return usage();
+
+	if (bun_handle_init(&handle, backend) == false) {
+		printf("Error: cannot initialize the backend\n");
+		return 2;
+	}
+
+	handle.flags |= flags;
+
+	memset(&capture, 0, sizeof(capture));
+	capture.handle = &handle;
+	pthread_mutex_init(&capture.lock, NULL);
+
+	/* The handle caches the maps and objects for all the threads. */
+	unwound = bun_unwind_remote_process(&handle, pid, BUFFER_SIZE, jobs,
+	    capture_thread, &capture);
+	count = unwound + capture.failed.tid_count;
+	if (count == 0) {
+		printf("Error: cannot unwind process %d\n", pid);
+		bun_handle_deinit(&handle);
+		return 2;
+	}
+
+	stacks = calloc(capture.stack_count + 1, sizeof(*stacks));
+	if (stacks == NULL || capture.oom == true) {
+		printf("Error: out of memory\n");
+		bun_handle_deinit(&handle);
+		return 2;
+	}
+
+	for (size_t i = 0; i < BUCKETS; i++) {
+		for (struct stack *stack = capture.buckets[i]; stack != NULL;
+		    stack = stack->next)
+			stacks[n++] = stack;
+	}
+
+	qsort(stacks, n, sizeof(*stacks), compare_stacks);
+	for (size_t i = 0; i < n; i++) {
+		print_stack(stacks[i]);
+		stack_free(stacks[i]);
+	}
+
+	if (capture.failed.tid_count > 0) {
+		qsort(capture.failed.tids, capture.failed.tid_count,
+		    sizeof(*capture.failed.tids), compare_tids);
+		printf("%zu thread%s could not be unwound: ",
+		    capture.failed.tid_count,
+		    capture.failed.tid_count == 1 ? "" : "s");
+		print_tids(&capture.failed);
+	}
+
+	printf("%zu threads, %zu distinct stacks\n", count, n);
+
+	free(capture.failed.tids);
+	free(stacks);
+	pthread_mutex_destroy(&capture.lock);
+	bun_handle_deinit(&handle);
+	return unwound == count ? 0 : 2;
+}
+
+int
+usage()
+{
+
+	printf("Usage: bun_pstack [-b backend] [-f] [-j jobs] <pid>\n");
+	printf("\n");
+	printf("Unwinds every thread of the process `pid` and prints each\n");
+	printf("distinct stack once, along with the threads sharing it, most\n");
+	printf("common first. Threads are unwound by `jobs` threads, one per\n");
+	printf("CPU by default. With -f, handshake targets are unwound from a\n");
+	printf("forked snapshot.\n");
+	printf("\n");
+	printf("Backends:");
+	for (size_t i = 0; backends[i].name != NULL; i++)
+		printf(" %s%s", backends[i].name, i == 0 ? " (default)" : "");
+	printf("\n");
+	return 1;
+}
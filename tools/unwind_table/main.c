@@ -0,0 +1,42 @@
+#include <limits.h>
+#include <stdio.h>
+
+#include "backend/table/bun_table_builder.h"
+
+int usage();
+
+int
+main(int argc, char **argv)
+{
+	char path[PATH_MAX];
+	int result = 0;
+
+	if (argc < 3)
+		return usage();
+
+	for (int i = 2; i < argc; i++) {
+		if (bun_table_build(argv[i], argv[1], path,
+		    sizeof(path)) == false) {
+			printf("Error: cannot generate the table of %s\n",
+			    argv[i]);
+			result = 2;
+			continue;
+		}
+
+		printf("%s: %s\n", argv[i], path);
+	}
+
+	return result;
+}
+
+int
+usage()
+{
+
+	printf("Usage: bun_unwind_table <output directory> <file>...\n");
+	printf("\n");
+	printf("Generates the unwind tables used by BUN_BACKEND_TABLE from the\n");
+	printf(".eh_frame section of each file. The files must carry a GNU\n");
+	printf("build-id, which the tables are named after.\n");
+	return 1;
+}